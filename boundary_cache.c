@@ -0,0 +1,315 @@
+/*
+
+    SLIDEM Processor: boundary_cache.c
+
+    Copyright (C) 2024  Johnathan K Burchill
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "boundary_cache.h"
+#include "column_file.h"
+#include "slidem_settings.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <cdf.h>
+
+extern char infoHeader[50];
+
+static char *derivedVariables[BOUNDARY_CACHE_NUM_DERIVED_VARIABLES] = {
+    "FP_Current",
+    "V_North",
+    "V_East",
+    "V_Centre",
+    "Dip_Latitude"
+};
+
+void boundaryCacheFilename(const char *cacheDirectory, const char *slidemFilename, char *cacheFilename, size_t length)
+{
+    snprintf(cacheFilename, length, "%s/%s.%s", cacheDirectory, slidemFilename + strlen(slidemFilename) - SLIDEM_BASE_FILENAME_LENGTH, BOUNDARY_CACHE_EXTENSION);
+
+    return;
+}
+
+int writeBoundaryCache(const char *cacheFilename, char **hmVariables, int nHmVariables, uint8_t **hmDataBuffers, const long *hmDataTypes, const size_t *hmRecordSizes, long nHmRecs, double *fpCurrent, double *vn, double *ve, double *vc, double *dipLatitude, double windowSeconds)
+{
+    if (cacheFilename == NULL || hmVariables == NULL || hmDataBuffers == NULL || hmDataTypes == NULL || hmRecordSizes == NULL || nHmRecs <= 0)
+        return BOUNDARY_CACHE_ARGUMENTS;
+
+    // Head and tail windows by time. The two overlap for short days, which is harmless.
+    double *times = (double*)hmDataBuffers[0];
+    long nHead = 0;
+    while (nHead < nHmRecs && times[nHead] < times[0] + windowSeconds * 1000.0)
+        nHead++;
+    long nTail = 0;
+    while (nTail < nHmRecs && times[nHmRecs - 1 - nTail] > times[nHmRecs - 1] - windowSeconds * 1000.0)
+        nTail++;
+    long nRecs = nHead + nTail;
+    long tailStart = nHmRecs - nTail;
+
+    int nColumns = nHmVariables + BOUNDARY_CACHE_NUM_DERIVED_VARIABLES + 1;
+    const char **names = calloc((size_t)nColumns, sizeof(char*));
+    long *dataTypes = calloc((size_t)nColumns, sizeof(long));
+    size_t *recordSizes = calloc((size_t)nColumns, sizeof(size_t));
+    const void **columns = calloc((size_t)nColumns, sizeof(void*));
+    uint8_t **windowBuffers = calloc((size_t)nColumns, sizeof(uint8_t*));
+    uint8_t *sources[BOUNDARY_CACHE_NUM_DERIVED_VARIABLES] = {(uint8_t*)fpCurrent, (uint8_t*)vn, (uint8_t*)ve, (uint8_t*)vc, (uint8_t*)dipLatitude};
+    int status = BOUNDARY_CACHE_OK;
+    if (names == NULL || dataTypes == NULL || recordSizes == NULL || columns == NULL || windowBuffers == NULL)
+    {
+        status = BOUNDARY_CACHE_MEMORY;
+        goto cleanup;
+    }
+
+    for (int c = 0; c < nColumns - 1; c++)
+    {
+        uint8_t *source = NULL;
+        if (c < nHmVariables)
+        {
+            names[c] = hmVariables[c];
+            dataTypes[c] = hmDataTypes[c];
+            recordSizes[c] = hmRecordSizes[c];
+            source = hmDataBuffers[c];
+        }
+        else
+        {
+            names[c] = derivedVariables[c - nHmVariables];
+            dataTypes[c] = CDF_REAL8;
+            recordSizes[c] = sizeof(double);
+            source = sources[c - nHmVariables];
+        }
+        windowBuffers[c] = malloc(recordSizes[c] * (size_t)nRecs);
+        if (windowBuffers[c] == NULL)
+        {
+            status = BOUNDARY_CACHE_MEMORY;
+            goto cleanup;
+        }
+        memcpy(windowBuffers[c], source, recordSizes[c] * (size_t)nHead);
+        memcpy(windowBuffers[c] + recordSizes[c] * (size_t)nHead, source + recordSizes[c] * (size_t)tailStart, recordSizes[c] * (size_t)nTail);
+        columns[c] = windowBuffers[c];
+    }
+    int w = nColumns - 1;
+    names[w] = BOUNDARY_CACHE_WINDOW_COLUMN;
+    dataTypes[w] = CDF_UINT1;
+    recordSizes[w] = sizeof(uint8_t);
+    windowBuffers[w] = malloc((size_t)nRecs);
+    if (windowBuffers[w] == NULL)
+    {
+        status = BOUNDARY_CACHE_MEMORY;
+        goto cleanup;
+    }
+    memset(windowBuffers[w], BOUNDARY_CACHE_HEAD, (size_t)nHead);
+    memset(windowBuffers[w] + nHead, BOUNDARY_CACHE_TAIL, (size_t)nTail);
+    columns[w] = windowBuffers[w];
+
+    char label[COLUMN_FILE_LABEL_LENGTH];
+    snprintf(label, COLUMN_FILE_LABEL_LENGTH, "SLIDEM boundary windows: %.0f s head, %.0f s tail", windowSeconds, windowSeconds);
+    if (writeColumnFile(cacheFilename, label, nColumns, names, dataTypes, recordSizes, columns, 0, nRecs) != COLUMN_FILE_OK)
+        status = BOUNDARY_CACHE_WRITE;
+
+cleanup:
+    if (windowBuffers != NULL)
+    {
+        for (int c = 0; c < nColumns; c++)
+            free(windowBuffers[c]);
+    }
+    free(windowBuffers);
+    free(columns);
+    free(recordSizes);
+    free(dataTypes);
+    free(names);
+
+    return status;
+}
+
+// Finds the contiguous run of records in a cached window that lies outside this day:
+// before beforeTime (previous day's tail) or after afterTime (next day's head).
+static int selectWindow(const char *cacheFilename, ColumnFile *file, int window, double beforeTime, double afterTime, char **hmVariables, int nHmVariables, const size_t *hmRecordSizes, long *first, long *nRecs)
+{
+    *first = 0;
+    *nRecs = 0;
+    if (cacheFilename == NULL || openColumnFile(cacheFilename, file) != COLUMN_FILE_OK)
+        return BOUNDARY_CACHE_UNAVAILABLE;
+
+    // Every column must be present with the same record size as this day's inputs
+    size_t recordSize = 0;
+    for (int c = 0; c < nHmVariables; c++)
+    {
+        if (columnFileData(file, hmVariables[c], &recordSize, NULL) == NULL || recordSize != hmRecordSizes[c])
+            return BOUNDARY_CACHE_MISMATCH;
+    }
+    for (int c = 0; c < BOUNDARY_CACHE_NUM_DERIVED_VARIABLES; c++)
+    {
+        if (columnFileData(file, derivedVariables[c], &recordSize, NULL) == NULL || recordSize != sizeof(double))
+            return BOUNDARY_CACHE_MISMATCH;
+    }
+    const uint8_t *windows = columnFileData(file, BOUNDARY_CACHE_WINDOW_COLUMN, &recordSize, NULL);
+    if (windows == NULL || recordSize != sizeof(uint8_t))
+        return BOUNDARY_CACHE_MISMATCH;
+
+    const double *times = columnFileData(file, hmVariables[0], NULL, NULL);
+    long n = (long)file->header->nRecords;
+    for (long i = 0; i < n; i++)
+    {
+        if (windows[i] == window && times[i] < beforeTime && times[i] > afterTime)
+        {
+            if (*nRecs == 0)
+                *first = i;
+            (*nRecs)++;
+        }
+    }
+
+    return BOUNDARY_CACHE_OK;
+}
+
+// New buffer holding previous, then the column's nRecs records, then next. NULL if memory is exhausted.
+static uint8_t *extendedColumn(const uint8_t *buffer, size_t recordSize, long nRecs, const uint8_t *previous, long nPrevious, const uint8_t *next, long nNext)
+{
+    uint8_t *extended = malloc(recordSize * (size_t)(nPrevious + nRecs + nNext));
+    if (extended == NULL)
+        return NULL;
+
+    if (nPrevious > 0)
+        memcpy(extended, previous, recordSize * (size_t)nPrevious);
+    memcpy(extended + recordSize * (size_t)nPrevious, buffer, recordSize * (size_t)nRecs);
+    if (nNext > 0)
+        memcpy(extended + recordSize * (size_t)(nPrevious + nRecs), next, recordSize * (size_t)nNext);
+
+    return extended;
+}
+
+int addBoundaryData(const char *previousCacheFilename, const char *nextCacheFilename, char **hmVariables, int nHmVariables, uint8_t **hmDataBuffers, const size_t *hmRecordSizes, long *nHmRecs, double **fpCurrent, double **vn, double **ve, double **vc, double **dipLatitude, long *nPreviousRecs, long *nNextRecs)
+{
+    if (hmVariables == NULL || hmDataBuffers == NULL || hmRecordSizes == NULL || nHmRecs == NULL || *nHmRecs <= 0 || fpCurrent == NULL || vn == NULL || ve == NULL || vc == NULL || dipLatitude == NULL || nPreviousRecs == NULL || nNextRecs == NULL)
+        return BOUNDARY_CACHE_ARGUMENTS;
+
+    *nPreviousRecs = 0;
+    *nNextRecs = 0;
+
+    double *times = (double*)hmDataBuffers[0];
+    double dayFirstTime = times[0];
+    double dayLastTime = times[*nHmRecs - 1];
+
+    ColumnFile previousFile = {.fd = -1};
+    ColumnFile nextFile = {.fd = -1};
+    long previousFirst = 0, nPrevious = 0;
+    long nextFirst = 0, nNext = 0;
+    uint8_t **extended = NULL;
+    int status = selectWindow(previousCacheFilename, &previousFile, BOUNDARY_CACHE_TAIL, dayFirstTime, -1.0e300, hmVariables, nHmVariables, hmRecordSizes, &previousFirst, &nPrevious);
+    if (status == BOUNDARY_CACHE_MISMATCH)
+        fprintf(stdout, "%sIgnoring incompatible boundary cache %s\n", infoHeader, previousCacheFilename);
+    if (status != BOUNDARY_CACHE_OK)
+        nPrevious = 0;
+    status = selectWindow(nextCacheFilename, &nextFile, BOUNDARY_CACHE_HEAD, 1.0e300, dayLastTime, hmVariables, nHmVariables, hmRecordSizes, &nextFirst, &nNext);
+    if (status == BOUNDARY_CACHE_MISMATCH)
+        fprintf(stdout, "%sIgnoring incompatible boundary cache %s\n", infoHeader, nextCacheFilename);
+    if (status != BOUNDARY_CACHE_OK)
+        nNext = 0;
+
+    status = BOUNDARY_CACHE_OK;
+    if (nPrevious == 0 && nNext == 0)
+        goto cleanup;
+
+    // Every column is extended into a new buffer first, so the inputs are unchanged unless all succeed
+    int nColumns = nHmVariables + BOUNDARY_CACHE_NUM_DERIVED_VARIABLES;
+    extended = calloc((size_t)nColumns, sizeof *extended);
+    if (extended == NULL)
+    {
+        status = BOUNDARY_CACHE_MEMORY;
+        goto cleanup;
+    }
+    uint8_t **buffers[BOUNDARY_CACHE_NUM_DERIVED_VARIABLES] = {(uint8_t**)fpCurrent, (uint8_t**)vn, (uint8_t**)ve, (uint8_t**)vc, (uint8_t**)dipLatitude};
+    const uint8_t *previousData = NULL;
+    const uint8_t *nextData = NULL;
+    for (int c = 0; c < nColumns; c++)
+    {
+        const char *name = c < nHmVariables ? hmVariables[c] : derivedVariables[c - nHmVariables];
+        size_t recordSize = c < nHmVariables ? hmRecordSizes[c] : sizeof(double);
+        const uint8_t *buffer = c < nHmVariables ? hmDataBuffers[c] : *buffers[c - nHmVariables];
+        if (nPrevious > 0)
+            previousData = (const uint8_t*)columnFileData(&previousFile, name, NULL, NULL) + recordSize * (size_t)previousFirst;
+        if (nNext > 0)
+            nextData = (const uint8_t*)columnFileData(&nextFile, name, NULL, NULL) + recordSize * (size_t)nextFirst;
+        extended[c] = extendedColumn(buffer, recordSize, *nHmRecs, previousData, nPrevious, nextData, nNext);
+        if (extended[c] == NULL)
+        {
+            status = BOUNDARY_CACHE_MEMORY;
+            goto cleanup;
+        }
+    }
+    for (int c = 0; c < nColumns; c++)
+    {
+        uint8_t **buffer = c < nHmVariables ? &hmDataBuffers[c] : buffers[c - nHmVariables];
+        free(*buffer);
+        *buffer = extended[c];
+        extended[c] = NULL;
+    }
+
+    *nHmRecs += nPrevious + nNext;
+    *nPreviousRecs = nPrevious;
+    *nNextRecs = nNext;
+
+cleanup:
+    if (extended != NULL)
+    {
+        for (int c = 0; c < nHmVariables + BOUNDARY_CACHE_NUM_DERIVED_VARIABLES; c++)
+            free(extended[c]);
+        free(extended);
+    }
+    closeColumnFile(&previousFile);
+    closeColumnFile(&nextFile);
+
+    return status;
+}
+
+int readBoundaryWindow(const char *cacheFilename, int window, double dayFirstTime, double dayLastTime, char **hmVariables, int nHmVariables, const size_t *hmRecordSizes, uint8_t **hmDataBuffers, double **fpCurrent, double **vn, double **ve, double **vc, double **dipLatitude, long *nRecs)
+{
+    if (hmVariables == NULL || hmDataBuffers == NULL || hmRecordSizes == NULL || fpCurrent == NULL || vn == NULL || ve == NULL || vc == NULL || dipLatitude == NULL || nRecs == NULL)
+        return BOUNDARY_CACHE_ARGUMENTS;
+
+    *nRecs = 0;
+
+    ColumnFile file = {.fd = -1};
+    long first = 0, n = 0;
+    double beforeTime = window == BOUNDARY_CACHE_TAIL ? dayFirstTime : 1.0e300;
+    double afterTime = window == BOUNDARY_CACHE_TAIL ? -1.0e300 : dayLastTime;
+    int status = selectWindow(cacheFilename, &file, window, beforeTime, afterTime, hmVariables, nHmVariables, hmRecordSizes, &first, &n);
+    if (status != BOUNDARY_CACHE_OK || n == 0)
+        goto cleanup;
+
+    uint8_t **buffers[BOUNDARY_CACHE_NUM_DERIVED_VARIABLES] = {(uint8_t**)fpCurrent, (uint8_t**)vn, (uint8_t**)ve, (uint8_t**)vc, (uint8_t**)dipLatitude};
+    int nColumns = nHmVariables + BOUNDARY_CACHE_NUM_DERIVED_VARIABLES;
+    for (int c = 0; c < nColumns; c++)
+    {
+        const char *name = c < nHmVariables ? hmVariables[c] : derivedVariables[c - nHmVariables];
+        size_t recordSize = c < nHmVariables ? hmRecordSizes[c] : sizeof(double);
+        uint8_t **buffer = c < nHmVariables ? &hmDataBuffers[c] : buffers[c - nHmVariables];
+        *buffer = malloc(recordSize * (size_t)n);
+        if (*buffer == NULL)
+        {
+            status = BOUNDARY_CACHE_MEMORY;
+            goto cleanup;
+        }
+        memcpy(*buffer, (const uint8_t*)columnFileData(&file, name, NULL, NULL) + recordSize * (size_t)first, recordSize * (size_t)n);
+    }
+    *nRecs = n;
+
+cleanup:
+    closeColumnFile(&file);
+
+    return status;
+}
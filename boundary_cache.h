@@ -0,0 +1,68 @@
+/*
+
+    SLIDEM Processor: boundary_cache.h
+
+    Copyright (C) 2024  Johnathan K Burchill
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _BOUNDARY_CACHE_H
+#define _BOUNDARY_CACHE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Each day's run caches the first and last SECONDS_OF_BOUNDARY_DATA_REQUIRED_FOR_PROCESSING
+// of its HM-aligned inputs so that adjacent days can complete fit regions that straddle midnight
+// without reloading and interpolating the neighbouring input files.
+
+#define BOUNDARY_CACHE_EXTENSION "bnd"
+#define BOUNDARY_CACHE_WINDOW_COLUMN "Window"
+
+enum BOUNDARY_CACHE_WINDOW {
+    BOUNDARY_CACHE_HEAD = 0,
+    BOUNDARY_CACHE_TAIL = 1
+};
+
+// Number of non-HM columns in the cache: fpCurrent, vn, ve, vc, dipLatitude
+#define BOUNDARY_CACHE_NUM_DERIVED_VARIABLES 5
+
+// <cacheDirectory>/<SLIDEM base filename>.bnd, kept out of the export directory
+void boundaryCacheFilename(const char *cacheDirectory, const char *slidemFilename, char *cacheFilename, size_t length);
+
+// Writes the cache holding the head and tail windows of the HM-aligned inputs.
+// Call before the arrays are extended with adjacent-day data.
+int writeBoundaryCache(const char *cacheFilename, char **hmVariables, int nHmVariables, uint8_t **hmDataBuffers, const long *hmDataTypes, const size_t *hmRecordSizes, long nHmRecs, double *fpCurrent, double *vn, double *ve, double *vc, double *dipLatitude, double windowSeconds);
+
+// Prepends the previous day's tail window and appends the next day's head window when those caches exist.
+// Only records before the first and after the last record of this day are added.
+// Arrays are reallocated; nPreviousRecs and nNextRecs return the number of records added at each end.
+int addBoundaryData(const char *previousCacheFilename, const char *nextCacheFilename, char **hmVariables, int nHmVariables, uint8_t **hmDataBuffers, const size_t *hmRecordSizes, long *nHmRecs, double **fpCurrent, double **vn, double **ve, double **vc, double **dipLatitude, long *nPreviousRecs, long *nNextRecs);
+
+// Reads the records of one cached window that lie outside this day into newly allocated arrays: the previous
+// day's BOUNDARY_CACHE_TAIL records before dayFirstTime, or the next day's BOUNDARY_CACHE_HEAD records after dayLastTime.
+// Arrays are allocated only if nRecs is positive; on failure the caller frees those that were.
+int readBoundaryWindow(const char *cacheFilename, int window, double dayFirstTime, double dayLastTime, char **hmVariables, int nHmVariables, const size_t *hmRecordSizes, uint8_t **hmDataBuffers, double **fpCurrent, double **vn, double **ve, double **vc, double **dipLatitude, long *nRecs);
+
+enum BOUNDARY_CACHE_STATUS {
+    BOUNDARY_CACHE_OK = 0,
+    BOUNDARY_CACHE_ARGUMENTS = -1,
+    BOUNDARY_CACHE_MEMORY = -2,
+    BOUNDARY_CACHE_WRITE = -3,
+    BOUNDARY_CACHE_UNAVAILABLE = -4,
+    BOUNDARY_CACHE_MISMATCH = -5
+};
+
+#endif // _BOUNDARY_CACHE_H
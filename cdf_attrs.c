@@ -207,7 +207,7 @@ CDFstatus addVariableAttributes(CDFid id, varAttr attr)
     return status;
 }
 
-void addAttributes(CDFid id, const char *softwareVersion, const char satellite, const char *version, double minTime, double maxTime, const char *slidemFilename, const char *fpFilename, const char *hmFilename, const char *modFilename, const char *modFilenamePrevious, const char *magFilename, long nVnecRecsPrev)
+void addStaticAttributes(CDFid id, const char *softwareVersion, const char satellite, const char *version)
 {
     long attrNum;
     char buf[1000];
@@ -219,7 +219,6 @@ void addAttributes(CDFid id, const char *softwareVersion, const char satellite,
     addgEntry(id, attrNum, 0, buf);
 
     CDFcreateAttr(id, "File_Name", GLOBAL_SCOPE, &attrNum);
-    addgEntry(id, attrNum, 0, slidemFilename + strlen(slidemFilename) - SLIDEM_BASE_FILENAME_LENGTH - 4);
 
     CDFcreateAttr(id, "Creator", GLOBAL_SCOPE, &attrNum);
     addgEntry(id, attrNum, 0, "University of Calgary, Alberta, Canada");
@@ -231,20 +230,8 @@ void addAttributes(CDFid id, const char *softwareVersion, const char satellite,
     addgEntry(id, attrNum, 0, SOFTWARE_VERSION);
 
     CDFcreateAttr(id, "Generation_date", GLOBAL_SCOPE, &attrNum);
-    char genDate[UTC_DATE_LENGTH];
-    utcNowDateString(genDate);
-    addgEntry(id, attrNum, 0, genDate);
 
     CDFcreateAttr(id, "Input_files", GLOBAL_SCOPE, &attrNum);
-    int fileNo = 0;
-    addgEntry(id, attrNum, fileNo++, fpFilename + strlen(fpFilename) - FP_FILENAME_LENGTH);
-    addgEntry(id, attrNum, fileNo++, hmFilename + strlen(hmFilename) - HM_FILENAME_LENGTH);
-    if (nVnecRecsPrev > 0)
-        addgEntry(id, attrNum, fileNo++, modFilenamePrevious + strlen(modFilenamePrevious) - MOD_FILENAME_LENGTH);
-    addgEntry(id, attrNum, fileNo++, modFilename + strlen(modFilename) - MOD_FILENAME_LENGTH);
-    addgEntry(id, attrNum, fileNo++, magFilename + strlen(magFilename) - MAG_FILENAME_LENGTH);
-    addgEntry(id, attrNum, fileNo++, "apf107.dat");
-    addgEntry(id, attrNum, fileNo++, ".slidem_modified_oml_configrc_" EXPORT_VERSION_STRING);
 
     CDFcreateAttr(id, "PI_name", GLOBAL_SCOPE, &attrNum);
     addgEntry(id, attrNum, 0, "Johnathan Burchill");   
@@ -285,14 +272,6 @@ void addAttributes(CDFid id, const char *softwareVersion, const char satellite,
     addgEntry(id, attrNum, 0, "Swarm");
     CDFcreateAttr(id, "MODS", GLOBAL_SCOPE, &attrNum);
     addgEntry(id, attrNum, 0, "Initial release.");
-
-    // Get rid of trailing newline from creation date
-    time_t created;
-    time(&created);
-    struct tm * dp = gmtime(&created);
-    char dateCreated[255] = { 0 };
-    sprintf(dateCreated, "UTC=%04d-%02d-%02dT%02d:%02d:%02d", dp->tm_year+1900, dp->tm_mon+1, dp->tm_mday, dp->tm_hour, dp->tm_min, dp->tm_sec);
-    addgEntry(id, attrNum, 0, dateCreated);
     CDFcreateAttr(id, "LINK_TEXT", GLOBAL_SCOPE, &attrNum);
     addgEntry(id, attrNum, 0, "2 Hz EFI IDM ion drift and effective mass data available at");
     CDFcreateAttr(id, "LINK_TITLE", GLOBAL_SCOPE, &attrNum);
@@ -353,6 +332,13 @@ void addAttributes(CDFid id, const char *softwareVersion, const char satellite,
 
     addgEntry(id, attrNum, 6, "Pakhotin et al. (2022). The Swarm Langmuir Probe Ion Drift, Density and Effective Mass (SLIDEM) Product. Earth, Planets and Space 74.1, 1-18, doi.org/10.1186/s40623-022-01668-5.");
     addgEntry(id, attrNum, 7, "Knudsen, D.J., Burchill, J.K., Buchert, S.C., Eriksson, A.I., Gill, R., Wahlund, J.E., Ahlen, L., Smith, M. and Moffat, B., 2017. Thermal ion imagers and Langmuir probes in the Swarm electric field instruments. Journal of Geophysical Research: Space Physics, 122(2), pp.2655-2673.");
+    addgEntry(id, attrNum, 8, "Pass_Index bits:\n\
+0      Northern hemisphere (QDLatitude >= 0)\n\
+1      Moving northward\n\
+2      Poleward of QDLatitude cutoff (|QDLatitude| >= 50)\n\
+3      Within ion drift offset fit band (50 <= |QDLatitude| < 51)\n\
+4-15   Pass number, incremented at each QDLatitude equator crossing from the start of the processed data,\n\
+       which includes up to 5700 s of the previous day when that day has been processed.");
     CDFcreateAttr(id, "Time_resolution", GLOBAL_SCOPE, &attrNum);
     addgEntry(id, attrNum, 0, "0.5 seconds");
     CDFcreateAttr(id, "TITLE", GLOBAL_SCOPE, &attrNum);
@@ -380,7 +366,7 @@ void addAttributes(CDFid id, const char *softwareVersion, const char satellite,
     CDFcreateAttr(id, "TIME_BASE", VARIABLE_SCOPE, &attrNum);
 
     const varAttr variableAttrs[NUM_EXPORT_VARIABLES] = {
-        {"Timestamp", "CDF_EPOCH", "*", "UT", minTime, maxTime, "%f"},
+        {"Timestamp", "CDF_EPOCH", "*", "UT", 0.0, 0.0, "%f"},
         {"Latitude", "CDF_REAL8", "degrees", "Geodetic latitude.", -90., 90., "%5.1f"},
         {"Longitude", "CDF_REAL8", "degrees", "Geodetic longitude.", -180., 180., "%6.1f"},
         {"Radius", "CDF_REAL8", "m", "Geocentric radius.", 6400000., 7400000., "%9.1f"},
@@ -402,7 +388,8 @@ void addAttributes(CDFid id, const char *softwareVersion, const char satellite,
         {"A_fp", "CDF_REAL8", "m^2", "Modified-OML EFI faceplate area.", 0., 1., "%6.4f"},
         {"R_p", "CDF_REAL8", "m", "Modified-OML Langmuir spherical probe radius.", 0., 0.01, "%6.4f"},
         {"T_e", "CDF_REAL8", "K", "Electron temperature.", FLAGS_MINIMUM_LP_TE, FLAGS_MAXIMUM_LP_TE,"%7.1f"},
-        {"Phi_sc", "CDF_REAL8", "V", "Spacecraft floating potential with respect to plasma potential far from satellite.", FLAGS_MINIMUM_LP_SPACECRAFT_POTENTIAL, FLAGS_MAXIMUM_LP_SPACECRAFT_POTENTIAL, "%5.1f"}
+        {"Phi_sc", "CDF_REAL8", "V", "Spacecraft floating potential with respect to plasma potential far from satellite.", FLAGS_MINIMUM_LP_SPACECRAFT_POTENTIAL, FLAGS_MAXIMUM_LP_SPACECRAFT_POTENTIAL, "%5.1f"},
+        {"Pass_Index", "CDF_UINT2", " ", "Pass number (bits 4-15) and pass flags (bits 0-3) from QDLatitude crossings.", 0, 65535, "%d"}
     };
 
     for (uint8_t i = 0; i < NUM_EXPORT_VARIABLES; i++)
@@ -412,4 +399,49 @@ void addAttributes(CDFid id, const char *softwareVersion, const char satellite,
 
 }
 
+CDFstatus addFileAttributes(CDFid id, double minTime, double maxTime, const char *slidemFilename, const char *fpFilename, const char *hmFilename, const char *modFilename, const char *modFilenamePrevious, const char *magFilename, long nVnecRecsPrev)
+{
+    CDFstatus status = addgEntry(id, CDFgetAttrNum(id, "File_Name"), 0, slidemFilename + strlen(slidemFilename) - SLIDEM_BASE_FILENAME_LENGTH - 4);
+    if (status != CDF_OK)
+    {
+        printErrorMessage(status);
+        return status;
+    }
+
+    char genDate[UTC_DATE_LENGTH];
+    utcNowDateString(genDate);
+    addgEntry(id, CDFgetAttrNum(id, "Generation_date"), 0, genDate);
+
+    long attrNum = CDFgetAttrNum(id, "Input_files");
+    int fileNo = 0;
+    addgEntry(id, attrNum, fileNo++, fpFilename + strlen(fpFilename) - FP_FILENAME_LENGTH);
+    addgEntry(id, attrNum, fileNo++, hmFilename + strlen(hmFilename) - HM_FILENAME_LENGTH);
+    if (nVnecRecsPrev > 0)
+        addgEntry(id, attrNum, fileNo++, modFilenamePrevious + strlen(modFilenamePrevious) - MOD_FILENAME_LENGTH);
+    addgEntry(id, attrNum, fileNo++, modFilename + strlen(modFilename) - MOD_FILENAME_LENGTH);
+    addgEntry(id, attrNum, fileNo++, magFilename + strlen(magFilename) - MAG_FILENAME_LENGTH);
+    addgEntry(id, attrNum, fileNo++, "apf107.dat");
+    addgEntry(id, attrNum, fileNo++, ".slidem_modified_oml_configrc_" EXPORT_VERSION_STRING);
+
+    // The creation date has always replaced the first MODS entry
+    time_t created;
+    time(&created);
+    struct tm * dp = gmtime(&created);
+    char dateCreated[255] = { 0 };
+    sprintf(dateCreated, "UTC=%04d-%02d-%02dT%02d:%02d:%02d", dp->tm_year+1900, dp->tm_mon+1, dp->tm_mday, dp->tm_hour, dp->tm_min, dp->tm_sec);
+    addgEntry(id, CDFgetAttrNum(id, "MODS"), 0, dateCreated);
+
+    return addTimeRangeAttributes(id, minTime, maxTime);
+}
+
+CDFstatus addTimeRangeAttributes(CDFid id, double minTime, double maxTime)
+{
+    long varNum = CDFgetVarNum(id, "Timestamp");
+    CDFstatus status = CDFputAttrzEntry(id, CDFgetAttrNum(id, "VALIDMIN"), varNum, CDF_EPOCH, 1, &minTime);
+    if (status == CDF_OK)
+        status = CDFputAttrzEntry(id, CDFgetAttrNum(id, "VALIDMAX"), varNum, CDF_EPOCH, 1, &maxTime);
+    if (status != CDF_OK)
+        printErrorMessage(status);
 
+    return status;
+}
@@ -39,7 +39,12 @@ typedef struct varAttr {
 
 CDFstatus addVariableAttributes(CDFid id, varAttr attr);
 
-void addAttributes(CDFid id, const char *softwareVersion, const char satellite, const char *version, double minTime, double maxTime, const char *slidemFilename, const char *fpFilename, const char *hmFilename, const char *modFilename, const char *modFilenamePrevious, const char *magFilename, long nVnecRecsPrev);
+// Attributes that are the same for every file of a satellite, software version and export version.
+// File_Name, Generation_date and Input_files are created without entries and the Timestamp valid range is zero.
+void addStaticAttributes(CDFid id, const char *softwareVersion, const char satellite, const char *version);
+// Entries that differ from file to file, added to a file that has the static attributes
+CDFstatus addFileAttributes(CDFid id, double minTime, double maxTime, const char *slidemFilename, const char *fpFilename, const char *hmFilename, const char *modFilename, const char *modFilenamePrevious, const char *magFilename, long nVnecRecsPrev);
+CDFstatus addTimeRangeAttributes(CDFid id, double minTime, double maxTime);
 
 
 #endif // CDF_ATTRS_H
@@ -0,0 +1,513 @@
+/*
+
+    SLIDEM Processor: cdf_blocks.c
+
+    Copyright (C) 2024  Johnathan K Burchill
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "cdf_blocks.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+
+#include <zlib.h>
+#include <cdf.h>
+
+// Offsets and codes from the CDF Internal Format Description, version 3.
+// Fields of internal records are big-endian. Offsets are from the start of each record.
+#define CDF_V3_MAGIC 0xCDF30001U
+#define CDF_UNCOMPRESSED_FILE_MAGIC 0x0000FFFFU
+#define CDR_OFFSET 8
+#define CDR_GDR_OFFSET 12
+#define CDR_ENCODING 28
+#define CDR_FLAGS 32
+#define CDR_FLAG_SINGLE_FILE 0x2
+#define CDR_FLAG_CHECKSUM 0x4
+#define GDR_ZVDR_HEAD 20
+#define GDR_EOF 36
+#define GDR_NZVARS 60
+#define RECORD_TYPE 8
+#define RECORD_TYPE_ZVDR 8
+#define RECORD_TYPE_VXR 6
+#define RECORD_TYPE_CPR 11
+#define RECORD_TYPE_CVVR 13
+#define VDR_NEXT 12
+#define VDR_DATA_TYPE 20
+#define VDR_MAX_REC 24
+#define VDR_VXR_HEAD 28
+#define VDR_VXR_TAIL 36
+#define VDR_FLAGS 44
+#define VDR_SRECORDS 48
+#define VDR_NUM_ELEMS 64
+#define VDR_CPR_OFFSET 72
+#define VDR_BLOCKING_FACTOR 80
+#define VDR_NAME 84
+#define VDR_NAME_LENGTH 256
+#define VDR_NUM_DIMS 340
+#define VDR_HEADER_SIZE (VDR_NUM_DIMS + 4)
+#define VDR_FLAG_RECORD_VARIANCE 0x1
+#define VDR_FLAG_COMPRESSION 0x4
+#define CPR_TYPE 12
+#define CPR_PARAMETER_COUNT 20
+#define CPR_PARAMETERS 24
+#define CPR_HEADER_SIZE 28
+#define VXR_NEXT 12
+#define VXR_NENTRIES 20
+#define VXR_NUSED_ENTRIES 24
+#define VXR_HEADER_SIZE 28
+#define CVVR_SIZE 16
+#define CVVR_HEADER_SIZE 24
+#define CDF_FILE_NETWORK_ENCODING 1
+#define CDF_FILE_IBMPC_ENCODING 6
+#define CDF_FILE_GZIP_COMPRESSION 5
+
+#define GZIP_WINDOW_BITS (15 + 16) // zlib writes a gzip header and trailer, as the CDF library's GZIP does
+
+typedef struct cdfBlockVariable {
+    uint64_t vdrOffset;
+    uint64_t vxrHead;
+    uint64_t vxrTail;
+    size_t elementSize;
+    size_t recordSize;
+    long blockingFactor;
+    int level;
+    long firstBlock;
+    long nBlocks;
+    const uint8_t *values;
+} CdfBlockVariable;
+
+typedef struct cdfBlock {
+    const CdfBlockVariable *variable;
+    long firstRecord; // from the first appended record
+    long nRecords;
+    uint8_t *data;
+    size_t size;
+} CdfBlock;
+
+typedef struct cdfBlockWorker {
+    int workerNumber;
+    int nWorkers;
+    CdfBlock *blocks;
+    long nBlocks;
+    bool swapBytes;
+    int status;
+} CdfBlockWorker;
+
+static uint32_t get32(const uint8_t *p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+static uint64_t get64(const uint8_t *p)
+{
+    return ((uint64_t)get32(p) << 32) | (uint64_t)get32(p + 4);
+}
+
+static uint8_t *put32(uint8_t *p, uint32_t value)
+{
+    p[0] = (uint8_t)(value >> 24);
+    p[1] = (uint8_t)((value >> 16) & 0xFF);
+    p[2] = (uint8_t)((value >> 8) & 0xFF);
+    p[3] = (uint8_t)(value & 0xFF);
+
+    return p + 4;
+}
+
+static uint8_t *put64(uint8_t *p, uint64_t value)
+{
+    put32(p, (uint32_t)(value >> 32));
+
+    return put32(p + 4, (uint32_t)(value & 0xFFFFFFFFU));
+}
+
+static int readAt(int fd, uint64_t offset, void *buffer, size_t n)
+{
+    return pread(fd, buffer, n, (off_t)offset) == (ssize_t)n ? CDF_BLOCKS_OK : CDF_BLOCKS_READ;
+}
+
+static int writeAt(int fd, uint64_t offset, const void *buffer, size_t n)
+{
+    return pwrite(fd, buffer, n, (off_t)offset) == (ssize_t)n ? CDF_BLOCKS_OK : CDF_BLOCKS_WRITE;
+}
+
+static int writeField64(int fd, uint64_t offset, uint64_t value)
+{
+    uint8_t field[8];
+    put64(field, value);
+
+    return writeAt(fd, offset, field, sizeof field);
+}
+
+static int writeField32(int fd, uint64_t offset, uint32_t value)
+{
+    uint8_t field[4];
+    put32(field, value);
+
+    return writeAt(fd, offset, field, sizeof field);
+}
+
+// Element sizes of the data types the writer can convert between encodings
+static size_t elementSize(long dataType)
+{
+    switch (dataType)
+    {
+        case CDF_INT1:
+        case CDF_UINT1:
+        case CDF_BYTE:
+        case CDF_CHAR:
+        case CDF_UCHAR:
+            return 1;
+        case CDF_INT2:
+        case CDF_UINT2:
+            return 2;
+        case CDF_INT4:
+        case CDF_UINT4:
+        case CDF_REAL4:
+        case CDF_FLOAT:
+            return 4;
+        case CDF_INT8:
+        case CDF_REAL8:
+        case CDF_DOUBLE:
+        case CDF_EPOCH:
+        case CDF_TIME_TT2000:
+            return 8;
+        default:
+            return 0;
+    }
+}
+
+static bool hostIsBigEndian(void)
+{
+    const uint16_t one = 1;
+
+    return *(const uint8_t *)&one == 0;
+}
+
+// Finds the zVariable and checks that the writer supports it
+static int findVariable(int fd, uint64_t zvdrHead, long nzVars, const char *name, long firstRecord, size_t recordSize, CdfBlockVariable *variable)
+{
+    uint8_t vdr[VDR_HEADER_SIZE];
+    uint64_t offset = zvdrHead;
+    for (long v = 0; v < nzVars && offset != 0; v++)
+    {
+        if (readAt(fd, offset, vdr, sizeof vdr) != CDF_BLOCKS_OK || get32(vdr + RECORD_TYPE) != RECORD_TYPE_ZVDR)
+            return CDF_BLOCKS_READ;
+        if (strncmp((const char *)vdr + VDR_NAME, name, VDR_NAME_LENGTH) != 0)
+        {
+            offset = get64(vdr + VDR_NEXT);
+            continue;
+        }
+
+        uint32_t flags = get32(vdr + VDR_FLAGS);
+        int32_t maxRec = (int32_t)get32(vdr + VDR_MAX_REC);
+        long blockingFactor = (long)(int32_t)get32(vdr + VDR_BLOCKING_FACTOR);
+        size_t size = elementSize((long)(int32_t)get32(vdr + VDR_DATA_TYPE));
+        if ((flags & VDR_FLAG_RECORD_VARIANCE) == 0 || (flags & VDR_FLAG_COMPRESSION) == 0 || get32(vdr + VDR_SRECORDS) != 0 || blockingFactor <= 0 || size == 0 || (long)maxRec != firstRecord - 1)
+            return CDF_BLOCKS_UNSUPPORTED;
+
+        // Values per record: the number of elements times the varying dimension sizes
+        uint32_t nDims = get32(vdr + VDR_NUM_DIMS);
+        if (nDims > CDF_MAX_DIMS)
+            return CDF_BLOCKS_UNSUPPORTED;
+        uint8_t dims[8 * CDF_MAX_DIMS];
+        if (nDims > 0 && readAt(fd, offset + VDR_HEADER_SIZE, dims, 8 * nDims) != CDF_BLOCKS_OK)
+            return CDF_BLOCKS_READ;
+        size_t nValues = get32(vdr + VDR_NUM_ELEMS);
+        for (uint32_t d = 0; d < nDims; d++)
+        {
+            if (get32(dims + 4 * (nDims + d)) != 0)
+                nValues *= get32(dims + 4 * d);
+        }
+        if (size * nValues != recordSize)
+            return CDF_BLOCKS_UNSUPPORTED;
+
+        uint8_t cpr[CPR_HEADER_SIZE];
+        uint64_t cprOffset = get64(vdr + VDR_CPR_OFFSET);
+        if (cprOffset == 0 || readAt(fd, cprOffset, cpr, sizeof cpr) != CDF_BLOCKS_OK || get32(cpr + RECORD_TYPE) != RECORD_TYPE_CPR)
+            return CDF_BLOCKS_READ;
+        int level = (int)get32(cpr + CPR_PARAMETERS);
+        if (get32(cpr + CPR_TYPE) != CDF_FILE_GZIP_COMPRESSION || get32(cpr + CPR_PARAMETER_COUNT) < 1 || level < 1 || level > 9)
+            return CDF_BLOCKS_UNSUPPORTED;
+
+        variable->vdrOffset = offset;
+        variable->vxrHead = get64(vdr + VDR_VXR_HEAD);
+        variable->vxrTail = get64(vdr + VDR_VXR_TAIL);
+        variable->elementSize = size;
+        variable->recordSize = recordSize;
+        variable->blockingFactor = blockingFactor;
+        variable->level = level;
+
+        return CDF_BLOCKS_OK;
+    }
+
+    return CDF_BLOCKS_UNSUPPORTED;
+}
+
+static int compressBlock(CdfBlock *block, bool swapBytes)
+{
+    const CdfBlockVariable *variable = block->variable;
+    size_t n = (size_t)block->nRecords * variable->recordSize;
+    const uint8_t *source = variable->values + (size_t)block->firstRecord * variable->recordSize;
+    uint8_t *swapped = NULL;
+    if (swapBytes && variable->elementSize > 1)
+    {
+        swapped = malloc(n);
+        if (swapped == NULL)
+            return CDF_BLOCKS_MEMORY;
+        size_t s = variable->elementSize;
+        for (size_t i = 0; i < n; i += s)
+        {
+            for (size_t b = 0; b < s; b++)
+                swapped[i + b] = source[i + s - 1 - b];
+        }
+        source = swapped;
+    }
+
+    int status = CDF_BLOCKS_OK;
+    z_stream stream = {0};
+    if (deflateInit2(&stream, variable->level, Z_DEFLATED, GZIP_WINDOW_BITS, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+    {
+        free(swapped);
+        return CDF_BLOCKS_COMPRESSION;
+    }
+    size_t bound = deflateBound(&stream, (uLong)n);
+    block->data = malloc(bound);
+    if (block->data == NULL)
+    {
+        status = CDF_BLOCKS_MEMORY;
+        goto cleanup;
+    }
+    stream.next_in = (Bytef *)source;
+    stream.avail_in = (uInt)n;
+    stream.next_out = block->data;
+    stream.avail_out = (uInt)bound;
+    if (deflate(&stream, Z_FINISH) != Z_STREAM_END)
+    {
+        status = CDF_BLOCKS_COMPRESSION;
+        goto cleanup;
+    }
+    block->size = (size_t)stream.total_out;
+
+cleanup:
+    deflateEnd(&stream);
+    free(swapped);
+
+    return status;
+}
+
+static void *compressBlocksThread(void *arg)
+{
+    CdfBlockWorker *worker = (CdfBlockWorker *)arg;
+    for (long b = worker->workerNumber; b < worker->nBlocks && worker->status == CDF_BLOCKS_OK; b += worker->nWorkers)
+        worker->status = compressBlock(&worker->blocks[b], worker->swapBytes);
+
+    return NULL;
+}
+
+// Each worker takes every nWorkers-th block. Workers that cannot be started are run on the calling thread.
+static int compressBlocks(CdfBlock *blocks, long nBlocks, bool swapBytes, int maxThreads)
+{
+    int nWorkers = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (nWorkers > maxThreads)
+        nWorkers = maxThreads;
+    if (nWorkers > nBlocks)
+        nWorkers = (int)nBlocks;
+    if (nWorkers < 1)
+        nWorkers = 1;
+
+    CdfBlockWorker *workers = calloc((size_t)nWorkers, sizeof(CdfBlockWorker));
+    pthread_t *threadIds = calloc((size_t)nWorkers, sizeof(pthread_t));
+    bool *threadStarted = calloc((size_t)nWorkers, sizeof(bool));
+    int status = CDF_BLOCKS_OK;
+    if (workers == NULL || threadIds == NULL || threadStarted == NULL)
+    {
+        status = CDF_BLOCKS_MEMORY;
+        goto cleanup;
+    }
+    for (int w = 0; w < nWorkers; w++)
+    {
+        workers[w].workerNumber = w;
+        workers[w].nWorkers = nWorkers;
+        workers[w].blocks = blocks;
+        workers[w].nBlocks = nBlocks;
+        workers[w].swapBytes = swapBytes;
+        workers[w].status = CDF_BLOCKS_OK;
+    }
+    for (int w = 1; w < nWorkers; w++)
+        threadStarted[w] = pthread_create(&threadIds[w], NULL, &compressBlocksThread, (void *)&workers[w]) == 0;
+    compressBlocksThread((void *)&workers[0]);
+    for (int w = 1; w < nWorkers; w++)
+    {
+        if (threadStarted[w])
+            pthread_join(threadIds[w], NULL);
+        else
+            compressBlocksThread((void *)&workers[w]);
+    }
+    for (int w = 0; w < nWorkers && status == CDF_BLOCKS_OK; w++)
+        status = workers[w].status;
+
+cleanup:
+    free(threadStarted);
+    free(threadIds);
+    free(workers);
+
+    return status;
+}
+
+int appendCdfBlocks(const char *cdfFilename, long firstRecord, long nRecords, int nVariables, char **names, const size_t *recordSizes, void **buffers, int maxThreads)
+{
+    if (cdfFilename == NULL || names == NULL || recordSizes == NULL || buffers == NULL || firstRecord < 0 || nRecords < 0 || nVariables <= 0 || nVariables > CDF_BLOCKS_MAX_VARIABLES)
+        return CDF_BLOCKS_ARGUMENTS;
+    if (nRecords == 0)
+        return CDF_BLOCKS_OK;
+    // Record numbers are 32-bit in the internal records
+    if (firstRecord + nRecords - 1 > INT32_MAX)
+        return CDF_BLOCKS_UNSUPPORTED;
+
+    int fd = open(cdfFilename, O_RDWR);
+    if (fd == -1)
+        return CDF_BLOCKS_READ;
+
+    CdfBlockVariable variables[CDF_BLOCKS_MAX_VARIABLES] = {0};
+    CdfBlock *blocks = NULL;
+    long nBlocks = 0;
+    uint8_t *vxr = NULL;
+    int status = CDF_BLOCKS_OK;
+
+    uint8_t header[CDR_OFFSET + CDR_FLAGS + 4];
+    status = readAt(fd, 0, header, sizeof header);
+    if (status != CDF_BLOCKS_OK)
+        goto cleanup;
+    uint32_t encoding = get32(header + CDR_OFFSET + CDR_ENCODING);
+    uint32_t cdrFlags = get32(header + CDR_OFFSET + CDR_FLAGS);
+    if (get32(header) != CDF_V3_MAGIC || get32(header + 4) != CDF_UNCOMPRESSED_FILE_MAGIC || get32(header + CDR_OFFSET + RECORD_TYPE) != 1 || (cdrFlags & CDR_FLAG_SINGLE_FILE) == 0 || (cdrFlags & CDR_FLAG_CHECKSUM) != 0 || (encoding != CDF_FILE_IBMPC_ENCODING && encoding != CDF_FILE_NETWORK_ENCODING))
+    {
+        status = CDF_BLOCKS_UNSUPPORTED;
+        goto cleanup;
+    }
+    bool swapBytes = (encoding == CDF_FILE_NETWORK_ENCODING) != hostIsBigEndian();
+
+    uint64_t gdrOffset = get64(header + CDR_OFFSET + CDR_GDR_OFFSET);
+    uint8_t gdr[GDR_NZVARS + 4];
+    status = readAt(fd, gdrOffset, gdr, sizeof gdr);
+    if (status != CDF_BLOCKS_OK)
+        goto cleanup;
+    uint64_t eof = get64(gdr + GDR_EOF);
+    for (int v = 0; v < nVariables; v++)
+    {
+        status = findVariable(fd, get64(gdr + GDR_ZVDR_HEAD), (long)get32(gdr + GDR_NZVARS), names[v], firstRecord, recordSizes[v], &variables[v]);
+        if (status != CDF_BLOCKS_OK)
+            break;
+        variables[v].values = buffers[v];
+        variables[v].firstBlock = nBlocks;
+        variables[v].nBlocks = (nRecords + variables[v].blockingFactor - 1) / variables[v].blockingFactor;
+        nBlocks += variables[v].nBlocks;
+    }
+    if (status != CDF_BLOCKS_OK)
+        goto cleanup;
+
+    blocks = calloc((size_t)nBlocks, sizeof(CdfBlock));
+    if (blocks == NULL)
+    {
+        status = CDF_BLOCKS_MEMORY;
+        goto cleanup;
+    }
+    for (int v = 0; v < nVariables; v++)
+    {
+        for (long b = 0; b < variables[v].nBlocks; b++)
+        {
+            CdfBlock *block = &blocks[variables[v].firstBlock + b];
+            block->variable = &variables[v];
+            block->firstRecord = b * variables[v].blockingFactor;
+            block->nRecords = nRecords - block->firstRecord < variables[v].blockingFactor ? nRecords - block->firstRecord : variables[v].blockingFactor;
+        }
+    }
+    status = compressBlocks(blocks, nBlocks, swapBytes, maxThreads);
+    if (status != CDF_BLOCKS_OK)
+        goto cleanup;
+
+    // New records go after the end of the file, so the file stays valid until the variables are linked to them
+    uint8_t cvvrHeader[CVVR_HEADER_SIZE] = {0};
+    uint64_t offset = eof;
+    uint64_t vxrOffset[CDF_BLOCKS_MAX_VARIABLES] = {0};
+    for (int v = 0; v < nVariables && status == CDF_BLOCKS_OK; v++)
+    {
+        long n = variables[v].nBlocks;
+        size_t vxrSize = VXR_HEADER_SIZE + 16 * (size_t)n;
+        uint8_t *p = realloc(vxr, vxrSize);
+        if (p == NULL)
+        {
+            status = CDF_BLOCKS_MEMORY;
+            break;
+        }
+        vxr = p;
+        memset(vxr, 0, vxrSize);
+        put64(vxr, (uint64_t)vxrSize);
+        put32(vxr + RECORD_TYPE, RECORD_TYPE_VXR);
+        put32(vxr + VXR_NENTRIES, (uint32_t)n);
+        put32(vxr + VXR_NUSED_ENTRIES, (uint32_t)n);
+        for (long b = 0; b < n && status == CDF_BLOCKS_OK; b++)
+        {
+            const CdfBlock *block = &blocks[variables[v].firstBlock + b];
+            put64(cvvrHeader, CVVR_HEADER_SIZE + (uint64_t)block->size);
+            put32(cvvrHeader + RECORD_TYPE, RECORD_TYPE_CVVR);
+            put64(cvvrHeader + CVVR_SIZE, (uint64_t)block->size);
+            put32(vxr + VXR_HEADER_SIZE + 4 * b, (uint32_t)(firstRecord + block->firstRecord));
+            put32(vxr + VXR_HEADER_SIZE + 4 * (n + b), (uint32_t)(firstRecord + block->firstRecord + block->nRecords - 1));
+            put64(vxr + VXR_HEADER_SIZE + 8 * (n + b), offset);
+            status = writeAt(fd, offset, cvvrHeader, sizeof cvvrHeader);
+            if (status == CDF_BLOCKS_OK)
+                status = writeAt(fd, offset + CVVR_HEADER_SIZE, block->data, block->size);
+            offset += CVVR_HEADER_SIZE + (uint64_t)block->size;
+        }
+        if (status != CDF_BLOCKS_OK)
+            break;
+        vxrOffset[v] = offset;
+        status = writeAt(fd, offset, vxr, vxrSize);
+        offset += vxrSize;
+    }
+
+    // Link each index after the last index of the variable, then move the end of file
+    for (int v = 0; v < nVariables && status == CDF_BLOCKS_OK; v++)
+    {
+        uint64_t vdr = variables[v].vdrOffset;
+        if (variables[v].vxrHead == 0)
+            status = writeField64(fd, vdr + VDR_VXR_HEAD, vxrOffset[v]);
+        else
+            status = writeField64(fd, variables[v].vxrTail + VXR_NEXT, vxrOffset[v]);
+        if (status == CDF_BLOCKS_OK)
+            status = writeField64(fd, vdr + VDR_VXR_TAIL, vxrOffset[v]);
+        if (status == CDF_BLOCKS_OK)
+            status = writeField32(fd, vdr + VDR_MAX_REC, (uint32_t)(firstRecord + nRecords - 1));
+    }
+    if (status == CDF_BLOCKS_OK)
+        status = writeField64(fd, gdrOffset + GDR_EOF, offset);
+
+cleanup:
+    for (long b = 0; blocks != NULL && b < nBlocks; b++)
+        free(blocks[b].data);
+    free(blocks);
+    free(vxr);
+    if (close(fd) != 0 && status == CDF_BLOCKS_OK)
+        status = CDF_BLOCKS_WRITE;
+
+    return status;
+}
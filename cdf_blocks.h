@@ -0,0 +1,54 @@
+/*
+
+    SLIDEM Processor: cdf_blocks.h
+
+    Copyright (C) 2024  Johnathan K Burchill
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _CDF_BLOCKS_H
+#define _CDF_BLOCKS_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Appends GZIP compressed records to zVariables of a closed CDF whose variables were defined by the CDF library.
+// The CDF library compresses blocks one at a time on the calling thread and cannot be called from several threads.
+// Here the blocks of all variables are compressed concurrently with zlib, then written in variable order
+// as the CVVR (compressed variable values) and VXR (variable index) records of the CDF internal format,
+// and linked to each variable's index. The variable definitions and attributes are not touched.
+//
+// Supported: single-file version 3 CDFs without checksums in IBMPC or NETWORK encoding, and
+// record-varying, non-sparse zVariables with GZIP compression and a blocking factor set.
+// Anything else returns CDF_BLOCKS_UNSUPPORTED before the file is modified, for the caller to write
+// the records through the CDF library instead.
+
+#define CDF_BLOCKS_MAX_VARIABLES 64
+
+// Records are in host byte order and are appended after the last record of each variable, which must be firstRecord - 1.
+// recordSizes are checked against the variable definitions.
+int appendCdfBlocks(const char *cdfFilename, long firstRecord, long nRecords, int nVariables, char **names, const size_t *recordSizes, void **buffers, int maxThreads);
+
+enum CDF_BLOCKS_STATUS {
+    CDF_BLOCKS_OK = 0,
+    CDF_BLOCKS_ARGUMENTS = -1,
+    CDF_BLOCKS_UNSUPPORTED = -2,
+    CDF_BLOCKS_READ = -3,
+    CDF_BLOCKS_WRITE = -4,
+    CDF_BLOCKS_MEMORY = -5,
+    CDF_BLOCKS_COMPRESSION = -6
+};
+
+#endif // _CDF_BLOCKS_H
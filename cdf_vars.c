@@ -24,74 +24,132 @@
 #include "utilities.h"
 #include "slidem_settings.h"
 
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include <ctype.h>
 
+// Compression and blocking of exported variables, settable at run time
+static ExportLayout layout = {GZIP_COMPRESSION, CDF_GZIP_COMPRESSION_LEVEL, CDF_BLOCKING_FACTOR};
+
+static const struct {
+    const char *name;
+    long type;
+    long defaultParameter;
+} compressionCodecs[] = {
+    {"none", NO_COMPRESSION, 0},
+    {"rle", RLE_COMPRESSION, RLE_OF_ZEROs},
+    {"huff", HUFF_COMPRESSION, OPTIMAL_ENCODING_TREES},
+    {"ahuff", AHUFF_COMPRESSION, OPTIMAL_ENCODING_TREES},
+    {"gzip", GZIP_COMPRESSION, CDF_GZIP_COMPRESSION_LEVEL}
+};
+#define N_COMPRESSION_CODECS (sizeof compressionCodecs / sizeof compressionCodecs[0])
+
+void setExportLayout(ExportLayout newLayout)
+{
+    layout = newLayout;
+
+    return;
+}
 
-CDFstatus createVarFrom1DVar(CDFid id, char *name, long dataType, long startIndex, long stopIndex, void *buffer)
+ExportLayout exportLayout(void)
 {
-    CDFstatus status;
-    long exportDimSizes[1] = {0};
-    long recVary = {VARY};
-    long dimNoVary = {NOVARY};
-    long varNumber;
-    long cType;
-    long cParams[CDF_MAX_PARMS];
+    return layout;
+}
 
-    status = CDFcreatezVar(id, name, dataType, 1, 0L, exportDimSizes, recVary, dimNoVary, &varNumber);
-    if (status != CDF_OK)
+int parseExportCompression(const char *text, ExportLayout *exportLayout)
+{
+    size_t nameLength = strcspn(text, ":");
+    for (size_t c = 0; c < N_COMPRESSION_CODECS; c++)
     {
-        printErrorMessage(status);
-        return status;
+        if (strlen(compressionCodecs[c].name) != nameLength || strncmp(text, compressionCodecs[c].name, nameLength) != 0)
+            continue;
+        exportLayout->compressionType = compressionCodecs[c].type;
+        exportLayout->compressionParameter = compressionCodecs[c].defaultParameter;
+        if (text[nameLength] == ':')
+        {
+            // Only GZIP takes a level
+            char *end = NULL;
+            long level = strtol(text + nameLength + 1, &end, 10);
+            if (compressionCodecs[c].type != GZIP_COMPRESSION || *end != '\0' || level < 1 || level > 9)
+                return 1;
+            exportLayout->compressionParameter = level;
+        }
+        return 0;
     }
-    status = CDFsetzVarSparseRecords(id, varNumber, NO_SPARSERECORDS);
-    if (status != CDF_OK)
+
+    return 1;
+}
+
+void exportLayoutString(ExportLayout exportLayout, char *text, size_t length)
+{
+    const char *name = "unknown";
+    for (size_t c = 0; c < N_COMPRESSION_CODECS; c++)
     {
-        printErrorMessage(status);
-        return status;
+        if (compressionCodecs[c].type == exportLayout.compressionType)
+            name = compressionCodecs[c].name;
     }
-    cType = GZIP_COMPRESSION;
-    cParams[0] = CDF_GZIP_COMPRESSION_LEVEL; // GZIP compression level 6 as suggested compromised between speed and size by CDF C reference 
-    status = CDFsetzVarCompression(id, varNumber, cType, cParams);
+    if (exportLayout.compressionType == GZIP_COMPRESSION)
+        snprintf(text, length, "%s:%ld blocking=%ld", name, exportLayout.compressionParameter, exportLayout.blockingFactor);
+    else
+        snprintf(text, length, "%s blocking=%ld", name, exportLayout.blockingFactor);
+
+    return;
+}
+
+static CDFstatus setVarLayout(CDFid id, long varNumber)
+{
+    long cParams[CDF_MAX_PARMS] = {0};
+    cParams[0] = layout.compressionParameter;
+    CDFstatus status = CDFsetzVarCompression(id, varNumber, layout.compressionType, cParams);
     if (status != CDF_OK)
     {
         printErrorMessage(status);
         return status;
     }
-    // Blocking factor 43200 as requested by DTU
-    status = CDFsetzVarBlockingFactor(id, varNumber, CDF_BLOCKING_FACTOR);
-    if (status != CDF_OK)
+    // 0 leaves the CDF library default
+    if (layout.blockingFactor > 0)
     {
-        printErrorMessage(status);
-        return status;
+        status = CDFsetzVarBlockingFactor(id, varNumber, layout.blockingFactor);
+        if (status != CDF_OK)
+            printErrorMessage(status);
     }
 
-    long dataTypeSize;
-    status = CDFgetDataTypeSize(dataType, &dataTypeSize);
+    return status;
+}
+
+
+CDFstatus create1DVar(CDFid id, char *name, long dataType)
+{
+    CDFstatus status;
+    long exportDimSizes[1] = {0};
+    long recVary = {VARY};
+    long dimNoVary = {NOVARY};
+    long varNumber;
+
+    status = CDFcreatezVar(id, name, dataType, 1, 0L, exportDimSizes, recVary, dimNoVary, &varNumber);
     if (status != CDF_OK)
     {
         printErrorMessage(status);
         return status;
     }
-    status = CDFputVarRangeRecordsByVarName(id, name, 0, stopIndex-startIndex, (void*)((uint8_t*)buffer + (dataTypeSize*startIndex)));
+    status = CDFsetzVarSparseRecords(id, varNumber, NO_SPARSERECORDS);
     if (status != CDF_OK)
     {
         printErrorMessage(status);
+        return status;
     }
-    return status;
+    return setVarLayout(id, varNumber);
 }
 
-CDFstatus createVarFrom2DVar(CDFid id, char *name, long dataType, long startIndex, long stopIndex, void *buffer1D, uint8_t dimSize)
+CDFstatus create2DVar(CDFid id, char *name, long dataType, uint8_t dimSize)
 {
     CDFstatus status = CDF_OK;
-    long long nRecs = stopIndex - startIndex + 1;
     long dimSizes[1] = {0};
     long recVary = {VARY};
     long dimVary[1] = {VARY};
     long varNumber;
-    long cType;
-    long cParams[CDF_MAX_PARMS];
 
     dimSizes[0] = dimSize;
 
@@ -101,35 +159,24 @@ CDFstatus createVarFrom2DVar(CDFid id, char *name, long dataType, long startInde
         printErrorMessage(status);
         return status;
     }
-    cType = GZIP_COMPRESSION;
-    cParams[0] = CDF_GZIP_COMPRESSION_LEVEL; // GZIP compression level 6 as suggested compromised between speed and size by CDF C reference 
-    status = CDFsetzVarCompression(id, varNumber, cType, cParams);
-    if (status != CDF_OK)
-    {
-        printErrorMessage(status);
-        return status;
-    }
-    // Blocking factor 43200 as requested by DTU
-    status = CDFsetzVarBlockingFactor(id, varNumber, CDF_BLOCKING_FACTOR);
+    status = setVarLayout(id, varNumber);
     if (status != CDF_OK)
-    {
-        printErrorMessage(status);
         return status;
-    }
     status = CDFsetzVarSparseRecords(id, varNumber, NO_SPARSERECORDS);
     if (status != CDF_OK)
     {
         printErrorMessage(status);
-        return status;
-    }
-    long dataSize;
-    status = CDFgetDataTypeSize(dataType, &dataSize);
-    if (status != CDF_OK)
-    {
-        printErrorMessage(status);
-        return status;
     }
-    status = CDFputVarRangeRecordsByVarName(id, name, 0, stopIndex-startIndex, (void *)buffer1D);
+
+    return status;
+}
+
+CDFstatus putVarRecords(CDFid id, char *name, long firstRecord, long nRecords, void *buffer)
+{
+    if (nRecords <= 0)
+        return CDF_OK;
+
+    CDFstatus status = CDFputVarRangeRecordsByVarName(id, name, firstRecord, firstRecord + nRecords - 1, buffer);
     if (status != CDF_OK)
     {
         printErrorMessage(status);
@@ -137,4 +184,3 @@ CDFstatus createVarFrom2DVar(CDFid id, char *name, long dataType, long startInde
 
     return status;
 }
-
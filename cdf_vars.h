@@ -22,10 +22,27 @@
 #define CDF_VARS_H
 
 #include <stdint.h>
+#include <stddef.h>
 
 #include <cdf.h>
 
-CDFstatus createVarFrom1DVar(CDFid id, char *name, long dataType, long startIndex, long stopIndex, void *buffer);
-CDFstatus createVarFrom2DVar(CDFid id, char *name, long dataType, long startIndex, long stopIndex, void *buffer1D, uint8_t dimSize);
+// Compression and blocking applied by create1DVar and create2DVar.
+// The default, GZIP level 6 with a blocking factor of 43200, was requested by DTU.
+typedef struct exportLayout {
+    long compressionType; // CDF library compression type
+    long compressionParameter; // GZIP level, or the RLE / Huffman parameter
+    long blockingFactor; // 0 for the CDF library default
+} ExportLayout;
+
+void setExportLayout(ExportLayout newLayout);
+ExportLayout exportLayout(void);
+// Parses none, rle, huff, ahuff or gzip[:level]. Returns 0 on success.
+int parseExportCompression(const char *text, ExportLayout *exportLayout);
+void exportLayoutString(ExportLayout exportLayout, char *text, size_t length);
+
+// Empty, compressed, record-varying variables to be filled with putVarRecords
+CDFstatus create1DVar(CDFid id, char *name, long dataType);
+CDFstatus create2DVar(CDFid id, char *name, long dataType, uint8_t dimSize);
+CDFstatus putVarRecords(CDFid id, char *name, long firstRecord, long nRecords, void *buffer);
 
 #endif // CDF_VARS_H
@@ -0,0 +1,250 @@
+/*
+
+    SLIDEM Processor: column_file.c
+
+    Copyright (C) 2024  Johnathan K Burchill
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "column_file.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static uint64_t alignOffset(uint64_t offset)
+{
+    return (offset + COLUMN_FILE_ALIGNMENT - 1) / COLUMN_FILE_ALIGNMENT * COLUMN_FILE_ALIGNMENT;
+}
+
+static int writePadding(FILE *fp, uint64_t *position, uint64_t target)
+{
+    static const uint8_t zeros[COLUMN_FILE_ALIGNMENT] = {0};
+    while (*position < target)
+    {
+        size_t n = (size_t)(target - *position);
+        if (n > COLUMN_FILE_ALIGNMENT)
+            n = COLUMN_FILE_ALIGNMENT;
+        if (fwrite(zeros, 1, n, fp) != n)
+            return COLUMN_FILE_WRITE;
+        *position += n;
+    }
+
+    return COLUMN_FILE_OK;
+}
+
+int writeColumnFile(const char *filename, const char *label, int nColumns, const char **names, const long *dataTypes, const size_t *recordSizes, const void **columns, long firstRecord, long nRecords)
+{
+    if (filename == NULL || names == NULL || dataTypes == NULL || recordSizes == NULL || columns == NULL || nColumns <= 0 || firstRecord < 0 || nRecords < 0)
+        return COLUMN_FILE_ARGUMENTS;
+
+    ColumnFileHeader header = {0};
+    memcpy(header.magic, COLUMN_FILE_MAGIC, sizeof header.magic);
+    header.version = COLUMN_FILE_VERSION;
+    header.nColumns = (uint32_t) nColumns;
+    header.nRecords = (int64_t) nRecords;
+    if (label != NULL)
+        snprintf(header.label, COLUMN_FILE_LABEL_LENGTH, "%s", label);
+
+    ColumnFileColumn *table = calloc((size_t)nColumns, sizeof(ColumnFileColumn));
+    if (table == NULL)
+        return COLUMN_FILE_WRITE;
+
+    uint64_t offset = alignOffset(sizeof(ColumnFileHeader) + (uint64_t)nColumns * sizeof(ColumnFileColumn));
+    for (int c = 0; c < nColumns; c++)
+    {
+        snprintf(table[c].name, COLUMN_FILE_NAME_LENGTH, "%s", names[c]);
+        table[c].dataType = (int32_t) dataTypes[c];
+        table[c].recordSize = (uint32_t) recordSizes[c];
+        table[c].offset = offset;
+        offset = alignOffset(offset + (uint64_t)recordSizes[c] * (uint64_t)nRecords);
+    }
+
+    char tmpFilename[FILENAME_MAX];
+    snprintf(tmpFilename, FILENAME_MAX, "%s.tmp%d", filename, (int)getpid());
+    FILE *fp = fopen(tmpFilename, "w");
+    if (fp == NULL)
+    {
+        free(table);
+        return COLUMN_FILE_OPEN;
+    }
+
+    int status = COLUMN_FILE_OK;
+    uint64_t position = 0;
+    if (fwrite(&header, sizeof header, 1, fp) != 1 || fwrite(table, sizeof(ColumnFileColumn), (size_t)nColumns, fp) != (size_t)nColumns)
+    {
+        status = COLUMN_FILE_WRITE;
+        goto cleanup;
+    }
+    position = sizeof header + (uint64_t)nColumns * sizeof(ColumnFileColumn);
+    for (int c = 0; c < nColumns; c++)
+    {
+        status = writePadding(fp, &position, table[c].offset);
+        if (status != COLUMN_FILE_OK)
+            goto cleanup;
+        size_t bytes = recordSizes[c] * (size_t)nRecords;
+        if (bytes > 0 && fwrite((const uint8_t*)columns[c] + recordSizes[c] * (size_t)firstRecord, 1, bytes, fp) != bytes)
+        {
+            status = COLUMN_FILE_WRITE;
+            goto cleanup;
+        }
+        position += bytes;
+    }
+    status = writePadding(fp, &position, alignOffset(position));
+
+cleanup:
+    free(table);
+    if (fclose(fp) != 0 && status == COLUMN_FILE_OK)
+        status = COLUMN_FILE_WRITE;
+    if (status == COLUMN_FILE_OK && rename(tmpFilename, filename) != 0)
+        status = COLUMN_FILE_RENAME;
+    if (status != COLUMN_FILE_OK)
+        unlink(tmpFilename);
+
+    return status;
+}
+
+int openColumnFile(const char *filename, ColumnFile *file)
+{
+    if (filename == NULL || file == NULL)
+        return COLUMN_FILE_ARGUMENTS;
+
+    memset(file, 0, sizeof(ColumnFile));
+    file->fd = -1;
+
+    int fd = open(filename, O_RDONLY);
+    if (fd == -1)
+        return COLUMN_FILE_OPEN;
+
+    struct stat fileInfo;
+    if (fstat(fd, &fileInfo) != 0 || (size_t)fileInfo.st_size < sizeof(ColumnFileHeader))
+    {
+        close(fd);
+        return COLUMN_FILE_FORMAT;
+    }
+
+    void *map = mmap(NULL, (size_t)fileInfo.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED)
+    {
+        close(fd);
+        return COLUMN_FILE_READ;
+    }
+    file->fd = fd;
+    file->size = (size_t)fileInfo.st_size;
+    file->map = (uint8_t*) map;
+    file->header = (const ColumnFileHeader*) map;
+    file->columns = (const ColumnFileColumn*)(file->map + sizeof(ColumnFileHeader));
+
+    // Validate before handing out pointers into the map
+    const ColumnFileHeader *header = file->header;
+    if (memcmp(header->magic, COLUMN_FILE_MAGIC, sizeof header->magic) != 0 || header->version != COLUMN_FILE_VERSION || header->nRecords < 0 || sizeof(ColumnFileHeader) + (size_t)header->nColumns * sizeof(ColumnFileColumn) > file->size)
+    {
+        closeColumnFile(file);
+        return COLUMN_FILE_FORMAT;
+    }
+    for (uint32_t c = 0; c < header->nColumns; c++)
+    {
+        if (file->columns[c].offset + (uint64_t)file->columns[c].recordSize * (uint64_t)header->nRecords > file->size)
+        {
+            closeColumnFile(file);
+            return COLUMN_FILE_FORMAT;
+        }
+    }
+
+    return COLUMN_FILE_OK;
+}
+
+void closeColumnFile(ColumnFile *file)
+{
+    if (file == NULL)
+        return;
+
+    if (file->map != NULL)
+        munmap(file->map, file->size);
+    if (file->fd != -1)
+        close(file->fd);
+    memset(file, 0, sizeof(ColumnFile));
+    file->fd = -1;
+
+    return;
+}
+
+const void *columnFileData(const ColumnFile *file, const char *name, size_t *recordSize, long *dataType)
+{
+    if (file == NULL || file->map == NULL || name == NULL)
+        return NULL;
+
+    for (uint32_t c = 0; c < file->header->nColumns; c++)
+    {
+        if (strncmp(file->columns[c].name, name, COLUMN_FILE_NAME_LENGTH) == 0)
+        {
+            if (recordSize != NULL)
+                *recordSize = file->columns[c].recordSize;
+            if (dataType != NULL)
+                *dataType = file->columns[c].dataType;
+            return file->map + file->columns[c].offset;
+        }
+    }
+
+    return NULL;
+}
+
+long columnFileTimeIndex(const ColumnFile *file, const char *timeColumn, double time)
+{
+    size_t recordSize = 0;
+    const double *times = (const double*) columnFileData(file, timeColumn, &recordSize, NULL);
+    if (times == NULL || recordSize != sizeof(double))
+        return -1;
+
+    long lower = 0;
+    long upper = (long) file->header->nRecords;
+    while (lower < upper)
+    {
+        long middle = lower + (upper - lower) / 2;
+        if (times[middle] < time)
+            lower = middle + 1;
+        else
+            upper = middle;
+    }
+
+    return lower;
+}
+
+void columnSidecarFilename(const char *productFilename, char *sidecarFilename, size_t length)
+{
+    size_t n = strlen(productFilename);
+    if (n > 4 && (strcasecmp(productFilename + n - 4, ".cdf") == 0 || strcasecmp(productFilename + n - 4, ".zip") == 0))
+        n -= 4;
+    snprintf(sidecarFilename, length, "%.*s%s", (int)n, productFilename, COLUMN_SIDECAR_EXTENSION);
+
+    return;
+}
+
+bool columnSidecarCurrent(const char *productFilename, const char *sidecarFilename)
+{
+    struct stat sidecarStat;
+    if (access(sidecarFilename, R_OK) != 0 || stat(sidecarFilename, &sidecarStat) != 0)
+        return false;
+    struct stat productStat;
+    if (stat(productFilename, &productStat) != 0)
+        return true;
+
+    return sidecarStat.st_mtime >= productStat.st_mtime;
+}
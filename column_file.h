@@ -0,0 +1,98 @@
+/*
+
+    SLIDEM Processor: column_file.h
+
+    Copyright (C) 2024  Johnathan K Burchill
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _COLUMN_FILE_H
+#define _COLUMN_FILE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+// Simple uncompressed column store used for processor caches.
+// Layout: header, column table, then each column's records contiguously,
+// every column starting on a COLUMN_FILE_ALIGNMENT byte boundary.
+// Values are stored in host byte order.
+
+#define COLUMN_FILE_MAGIC "SLDMCOL\0"
+#define COLUMN_FILE_VERSION 1
+#define COLUMN_FILE_NAME_LENGTH 48
+#define COLUMN_FILE_LABEL_LENGTH 512
+#define COLUMN_FILE_ALIGNMENT 64
+
+typedef struct columnFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t nColumns;
+    int64_t nRecords;
+    char label[COLUMN_FILE_LABEL_LENGTH]; // free text, e.g. the input files the columns came from
+} ColumnFileHeader;
+
+typedef struct columnFileColumn {
+    char name[COLUMN_FILE_NAME_LENGTH];
+    int32_t dataType; // CDF data type code
+    uint32_t recordSize; // bytes per record
+    uint64_t offset; // from start of file
+} ColumnFileColumn;
+
+typedef struct columnFile {
+    int fd;
+    size_t size;
+    uint8_t *map;
+    const ColumnFileHeader *header;
+    const ColumnFileColumn *columns;
+} ColumnFile;
+
+// Writes records firstRecord to firstRecord + nRecords - 1 of each column.
+// The file is written under a temporary name and renamed, so readers never see a partial file.
+int writeColumnFile(const char *filename, const char *label, int nColumns, const char **names, const long *dataTypes, const size_t *recordSizes, const void **columns, long firstRecord, long nRecords);
+
+// Maps a column file read-only
+int openColumnFile(const char *filename, ColumnFile *file);
+void closeColumnFile(ColumnFile *file);
+
+// Returns NULL if the column is not in the file
+const void *columnFileData(const ColumnFile *file, const char *name, size_t *recordSize, long *dataType);
+
+// Index of the first record with time >= the given time, using a sorted CDF_EPOCH or double column as the time index.
+// Returns nRecords if all records are earlier, or -1 if the column is missing or not a double.
+long columnFileTimeIndex(const ColumnFile *file, const char *timeColumn, double time);
+
+// SLIDEM products can be accompanied by a column file holding the same variables uncompressed,
+// so that analysis tools can map them rather than decompress the CDF.
+#define COLUMN_SIDECAR_EXTENSION ".col"
+
+// Replaces the .cdf or .ZIP extension of productFilename (or appends) with COLUMN_SIDECAR_EXTENSION
+void columnSidecarFilename(const char *productFilename, char *sidecarFilename, size_t length);
+
+// True if the sidecar is readable and was modified no earlier than the product, so that it
+// was not left behind by an earlier version of the product. Also true if the product does not exist.
+bool columnSidecarCurrent(const char *productFilename, const char *sidecarFilename);
+
+enum COLUMN_FILE_STATUS {
+    COLUMN_FILE_OK = 0,
+    COLUMN_FILE_ARGUMENTS = -1,
+    COLUMN_FILE_OPEN = -2,
+    COLUMN_FILE_WRITE = -3,
+    COLUMN_FILE_READ = -4,
+    COLUMN_FILE_FORMAT = -5,
+    COLUMN_FILE_RENAME = -6
+};
+
+#endif // _COLUMN_FILE_H
@@ -27,19 +27,35 @@
 #include "cdf_vars.h"
 #include "cdf_attrs.h"
 #include "utilities.h"
+#include "column_file.h"
+#include "fnv_hash.h"
+#include "cdf_blocks.h"
 
 #include <stdint.h>
+#include <stdbool.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 #include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
 
 #include <cdf.h>
 
 
 extern char infoHeader[50];
 
-CDFstatus exportProducts(const char *slidemFilename, char satellite, double beginTime, double endTime, uint8_t **hmDataBuffers, long nHmRecs, double *vn, double *ve, double *vc, double *ionEffectiveMass, double *ionDensity, double *ionDriftRaw, double *ionDrift, double *ionEffectiveMassError, double *ionDensityError, double *ionDriftError, double *fpAreaOML, double *rProbeOML, double *electronTemperature, double *spacecraftPotential, double *ionEffectiveMassTTS, uint32_t *mieffFlags, uint32_t *viFlags, uint32_t *niFlags, const char *fpFilename, const char *hmFilename, const char *modFilename, const char *modFilenamePrevious, const char *magFilename, long nVnecRecsPrev)
+static char skeletonDirectory[FILENAME_MAX] = "";
+
+void setSkeletonDirectory(const char *directory)
+{
+    snprintf(skeletonDirectory, FILENAME_MAX, "%s", directory != NULL ? directory : "");
+
+    return;
+}
+
+CDFstatus exportProducts(const char *slidemFilename, char satellite, double beginTime, double endTime, uint8_t **hmDataBuffers, long nHmRecs, double *vn, double *ve, double *vc, double *ionEffectiveMass, double *ionDensity, double *ionDriftRaw, double *ionDrift, double *ionEffectiveMassError, double *ionDensityError, double *ionDriftError, double *fpAreaOML, double *rProbeOML, double *electronTemperature, double *spacecraftPotential, double *ionEffectiveMassTTS, uint32_t *mieffFlags, uint32_t *viFlags, uint32_t *niFlags, uint16_t *passInfo, const char *fpFilename, const char *hmFilename, const char *modFilename, const char *modFilenamePrevious, const char *magFilename, long nVnecRecsPrev)
 {
     long hmTimeIndex = 0;
     beginTime = HMTIME();
@@ -48,7 +64,7 @@ CDFstatus exportProducts(const char *slidemFilename, char satellite, double begi
 
     CDFstatus status = CDF_OK;
 
-    status = exportSlidemCdf(slidemFilename, satellite, EXPORT_VERSION_STRING, hmDataBuffers, nHmRecs, vn, ve, vc, ionEffectiveMass, ionDensity, ionDriftRaw, ionDrift, ionEffectiveMassError, ionDensityError, ionDriftError, fpAreaOML, rProbeOML, electronTemperature, spacecraftPotential, ionEffectiveMassTTS, mieffFlags, viFlags, niFlags, fpFilename, hmFilename, modFilename, modFilenamePrevious, magFilename, nVnecRecsPrev);
+    status = exportSlidemCdf(slidemFilename, satellite, EXPORT_VERSION_STRING, hmDataBuffers, nHmRecs, vn, ve, vc, ionEffectiveMass, ionDensity, ionDriftRaw, ionDrift, ionEffectiveMassError, ionDensityError, ionDriftError, fpAreaOML, rProbeOML, electronTemperature, spacecraftPotential, ionEffectiveMassTTS, mieffFlags, viFlags, niFlags, passInfo, fpFilename, hmFilename, modFilename, modFilenamePrevious, magFilename, nVnecRecsPrev);
     if (status != CDF_OK)
     {
         return status;
@@ -62,80 +78,643 @@ CDFstatus exportProducts(const char *slidemFilename, char satellite, double begi
     return status;
 }
 
-CDFstatus exportSlidemCdf(const char *slidemFilename, const char satellite, const char *exportVersion, uint8_t **hmDataBuffers, long nHmRecs, double *vn, double *ve, double *vc, double *ionEffectiveMass, double *ionDensity, double *ionDriftRaw, double *ionDrift, double *ionEffectiveMassError, double *ionDensityError, double *ionDriftError, double *fpAreaOML, double *rProbeOML, double *electronTemperature, double *spacecraftPotential, double *ionEffectiveMassTTS, uint32_t *mieffFlags, uint32_t *viFlags, uint32_t *niFlags, const char *fpFilename, const char *hmFilename, const char *modFilename, const char *modFilenamePrevious, const char *magFilename, long nVnecRecsPrev)
-{
+// Exported variables in file order. V_sat_nec is the only multi-element variable.
+static char *exportVariableNames[NUM_EXPORT_VARIABLES] = {
+    "Timestamp", "Latitude", "Longitude", "Radius", "Height", "QDLatitude", "MLT", "V_sat_nec",
+    "M_i_eff", "M_i_eff_err", "M_i_eff_Flags", "M_i_eff_tbt_model",
+    "V_i", "V_i_err", "V_i_Flags", "V_i_raw",
+    "N_i", "N_i_err", "N_i_Flags",
+    "A_fp", "R_p", "T_e", "Phi_sc", "Pass_Index"
+};
+static const long exportVariableTypes[NUM_EXPORT_VARIABLES] = {
+    CDF_EPOCH, CDF_REAL8, CDF_REAL8, CDF_REAL8, CDF_REAL8, CDF_REAL8, CDF_REAL8, CDF_REAL8,
+    CDF_REAL8, CDF_REAL8, CDF_UINT4, CDF_REAL8,
+    CDF_REAL8, CDF_REAL8, CDF_UINT4, CDF_REAL8,
+    CDF_REAL8, CDF_REAL8, CDF_UINT4,
+    CDF_REAL8, CDF_REAL8, CDF_REAL8, CDF_REAL8, CDF_UINT2
+};
+#define EXPORT_VNEC_VARIABLE 7
 
+CDFstatus exportSlidemCdf(const char *slidemFilename, const char satellite, const char *exportVersion, uint8_t **hmDataBuffers, long nHmRecs, double *vn, double *ve, double *vc, double *ionEffectiveMass, double *ionDensity, double *ionDriftRaw, double *ionDrift, double *ionEffectiveMassError, double *ionDensityError, double *ionDriftError, double *fpAreaOML, double *rProbeOML, double *electronTemperature, double *spacecraftPotential, double *ionEffectiveMassTTS, uint32_t *mieffFlags, uint32_t *viFlags, uint32_t *niFlags, uint16_t *passInfo, const char *fpFilename, const char *hmFilename, const char *modFilename, const char *modFilenamePrevious, const char *magFilename, long nVnecRecsPrev)
+{
     fprintf(stdout, "%sExporting SLIDEM IDM data.\n", infoHeader);
 
+    CDFstatus status = createSlidemCdfFile(slidemFilename, satellite, exportVersion);
+    if (status != CDF_OK)
+        return status;
+
+    status = appendSlidemCdfFile(slidemFilename, 0, hmDataBuffers, nHmRecs, vn, ve, vc, ionEffectiveMass, ionDensity, ionDriftRaw, ionDrift, ionEffectiveMassError, ionDensityError, ionDriftError, fpAreaOML, rProbeOML, electronTemperature, spacecraftPotential, ionEffectiveMassTTS, mieffFlags, viFlags, niFlags, passInfo);
+    if (status != CDF_OK)
+        return status;
+
     CDFid exportCdfId;
+    status = CDFopenCDF((char *)slidemFilename, &exportCdfId);
+    if (status != CDF_OK)
+    {
+        printErrorMessage(status);
+        return status;
+    }
+
+    long hmTimeIndex = 0;
+    double minTime = HMTIME();
+    hmTimeIndex = nHmRecs - 1;
+    double maxTime = HMTIME();
+
+    return finishSlidemCdf(exportCdfId, slidemFilename, satellite, exportVersion, minTime, maxTime, nHmRecs, fpFilename, hmFilename, modFilename, modFilenamePrevious, magFilename, nVnecRecsPrev);
+}
+
+// Variables only, under the current ExportLayout
+static CDFstatus createEmptySlidemCdf(const char *cdfBaseFilename, CDFid *exportCdfId)
+{
+    CDFstatus status = CDFcreateCDF((char *)cdfBaseFilename, exportCdfId);
+    if (status != CDF_OK)
+    {
+        printErrorMessage(status);
+        return status;
+    }
+
+    for (int i = 0; i < NUM_EXPORT_VARIABLES; i++)
+    {
+        if (i == EXPORT_VNEC_VARIABLE)
+            status = create2DVar(*exportCdfId, exportVariableNames[i], exportVariableTypes[i], 3);
+        else
+            status = create1DVar(*exportCdfId, exportVariableNames[i], exportVariableTypes[i]);
+        if (status != CDF_OK)
+        {
+            closeCdf(*exportCdfId);
+            return status;
+        }
+    }
+
+    return CDF_OK;
+}
+
+// <skeleton directory>/<CDF_SKELETON_PREFIX><satellite>_<hash>, where the hash covers everything the static attributes
+// and the variable definitions depend on, so a skeleton from another software version or layout is never reused.
+static void skeletonBaseFilename(const char satellite, const char *exportVersion, char *skeletonFilename, size_t length)
+{
+    char layoutString[64];
+    exportLayoutString(exportLayout(), layoutString, sizeof layoutString);
+    char key[256];
+    snprintf(key, sizeof key, "%c %s %s %s %d%d%d", satellite, exportVersion, SOFTWARE_VERSION_STRING, layoutString, (int)POST_PROCESS_ION_DRIFT, (int)MIEFF_FROM_TBT2015_MODEL, (int)MODIFIED_OML_GEOMETRIES);
+    uint64_t hash = fnv1aHash(key);
+
+    snprintf(skeletonFilename, length, "%s/%s%c_%016llx", skeletonDirectory, CDF_SKELETON_PREFIX, satellite, (unsigned long long)hash);
+
+    return;
+}
+
+// Builds the skeleton once: later exports, including those of other processes using the same directory, reuse it
+static CDFstatus buildSlidemSkeleton(const char *skeletonFilename, const char satellite, const char *exportVersion)
+{
+    char cdfFilename[FILENAME_MAX];
+    snprintf(cdfFilename, FILENAME_MAX, "%s.cdf", skeletonFilename);
+    if (access(cdfFilename, R_OK) == 0)
+        return CDF_OK;
+
+    char tmpBaseFilename[FILENAME_MAX];
+    snprintf(tmpBaseFilename, FILENAME_MAX, "%s.tmp%d", skeletonFilename, (int)getpid());
+    char tmpFilename[FILENAME_MAX];
+    snprintf(tmpFilename, FILENAME_MAX, "%s.cdf", tmpBaseFilename);
+    unlink(tmpFilename);
+
+    CDFid id;
+    CDFstatus status = createEmptySlidemCdf(tmpBaseFilename, &id);
+    if (status != CDF_OK)
+        return status;
+    addStaticAttributes(id, SOFTWARE_VERSION_STRING, satellite, exportVersion);
+    status = CDFcloseCDF(id);
+    if (status != CDF_OK)
+    {
+        printErrorMessage(status);
+        unlink(tmpFilename);
+        return status;
+    }
+    if (rename(tmpFilename, cdfFilename) != 0)
+    {
+        unlink(tmpFilename);
+        return CDF_WRITE_ERROR;
+    }
+    fprintf(stdout, "%sBuilt CDF skeleton %s\n", infoHeader, cdfFilename);
+
+    return CDF_OK;
+}
+
+// Copies to a temporary file that is renamed over destination, which may be left from an earlier run
+static int copyFile(const char *source, const char *destination)
+{
+    char tmpFilename[FILENAME_MAX];
+    snprintf(tmpFilename, FILENAME_MAX, "%s.tmp%d", destination, (int)getpid());
+    unlink(tmpFilename);
+
+    int in = open(source, O_RDONLY);
+    if (in == -1)
+        return -1;
+    int out = open(tmpFilename, O_WRONLY | O_CREAT | O_EXCL, 0644);
+    if (out == -1)
+    {
+        close(in);
+        return -1;
+    }
+
+    int status = 0;
+    char buffer[65536];
+    ssize_t n = 0;
+    while ((n = read(in, buffer, sizeof buffer)) > 0)
+    {
+        if (write(out, buffer, (size_t)n) != n)
+        {
+            status = -1;
+            break;
+        }
+    }
+    if (n < 0)
+        status = -1;
+    close(in);
+    if (close(out) != 0)
+        status = -1;
+    if (status == 0 && rename(tmpFilename, destination) != 0)
+        status = -1;
+    if (status != 0)
+        unlink(tmpFilename);
+
+    return status;
+}
+
+CDFstatus createSlidemCdfFile(const char *slidemFilename, const char satellite, const char *exportVersion)
+{
+    char cdfFilename[FILENAME_MAX];
+    snprintf(cdfFilename, FILENAME_MAX, "%s.cdf", slidemFilename);
+
     CDFstatus status = CDF_OK;
-    status = CDFcreateCDF((char *)slidemFilename, &exportCdfId);
+    if (skeletonDirectory[0] != '\0')
+    {
+        char skeletonFilename[FILENAME_MAX];
+        skeletonBaseFilename(satellite, exportVersion, skeletonFilename, FILENAME_MAX);
+        char skeletonCdfFilename[FILENAME_MAX];
+        snprintf(skeletonCdfFilename, FILENAME_MAX, "%s.cdf", skeletonFilename);
+        status = buildSlidemSkeleton(skeletonFilename, satellite, exportVersion);
+        if (status == CDF_OK && copyFile(skeletonCdfFilename, cdfFilename) == 0)
+            return CDF_OK;
+        // The cache directory may not be writable for the skeleton
+        fprintf(stdout, "%sCDF skeleton unavailable. Creating %s directly.\n", infoHeader, cdfFilename);
+    }
+
+    // The library does not create over a file left by an earlier run
+    unlink(cdfFilename);
+    CDFid exportCdfId;
+    status = createEmptySlidemCdf(slidemFilename, &exportCdfId);
+    if (status != CDF_OK)
+        return status;
+    addStaticAttributes(exportCdfId, SOFTWARE_VERSION_STRING, satellite, exportVersion);
+    status = CDFcloseCDF(exportCdfId);
+    if (status != CDF_OK)
+        printErrorMessage(status);
+
+    return status;
+}
+
+CDFstatus createSlidemCdf(const char *slidemFilename, const char satellite, const char *exportVersion, CDFid *exportCdfId)
+{
+    CDFstatus status = createSlidemCdfFile(slidemFilename, satellite, exportVersion);
+    if (status != CDF_OK)
+        return status;
+
+    status = CDFopenCDF((char *)slidemFilename, exportCdfId);
+    if (status != CDF_OK)
+        printErrorMessage(status);
+
+    return status;
+}
+
+CDFstatus openSlidemCdf(const char *slidemFilename, CDFid *exportCdfId, long *nRecords)
+{
+    CDFstatus status = CDFopenCDF((char *)slidemFilename, exportCdfId);
     if (status != CDF_OK)
     {
         printErrorMessage(status);
-        goto cleanup;
+        return status;
+    }
+    long maxRecord = -1;
+    status = CDFgetzVarMaxWrittenRecNum(*exportCdfId, CDFgetVarNum(*exportCdfId, exportVariableNames[0]), &maxRecord);
+    if (status != CDF_OK)
+    {
+        printErrorMessage(status);
+        closeCdf(*exportCdfId);
+        return status;
+    }
+    *nRecords = maxRecord + 1;
+
+    return CDF_OK;
+}
+
+// velocity is a 1D variable (scalars are 0D in CDF parlance), per request of DTU
+static double *interleaveVnec(long nHmRecs, const double *vn, const double *ve, const double *vc)
+{
+    double * vnec = malloc((size_t) (nHmRecs * 3 * sizeof(double)));
+    if (vnec == NULL)
+    {
+        fprintf(stdout, "%s could not allocate memory to store VNEC.\n", infoHeader);
+        return NULL;
+    }
+    for (long hmTimeIndex = 0; hmTimeIndex < nHmRecs; hmTimeIndex++)
+    {
+        vnec[3*hmTimeIndex] = vn[hmTimeIndex];
+        vnec[3*hmTimeIndex + 1] = ve[hmTimeIndex];
+        vnec[3*hmTimeIndex + 2] = vc[hmTimeIndex];
+    }
+
+    return vnec;
+}
+
+// Variables 0 to EXPORT_VNEC_VARIABLE come from the inputs and are not changed by post-processing
+static void inputBuffers(void **buffers, uint8_t **hmDataBuffers, double *vnec)
+{
+    void *input[EXPORT_VNEC_VARIABLE + 1] = {
+        hmDataBuffers[0], hmDataBuffers[1], hmDataBuffers[2], hmDataBuffers[3], hmDataBuffers[4], hmDataBuffers[5], hmDataBuffers[7], vnec
+    };
+    memcpy(buffers, input, sizeof input);
+
+    return;
+}
+
+static void productBuffers(void **buffers, double *ionEffectiveMass, double *ionDensity, double *ionDriftRaw, double *ionDrift, double *ionEffectiveMassError, double *ionDensityError, double *ionDriftError, double *fpAreaOML, double *rProbeOML, double *electronTemperature, double *spacecraftPotential, double *ionEffectiveMassTTS, uint32_t *mieffFlags, uint32_t *viFlags, uint32_t *niFlags, uint16_t *passInfo)
+{
+    void *products[NUM_EXPORT_VARIABLES - EXPORT_VNEC_VARIABLE - 1] = {
+        ionEffectiveMass, ionEffectiveMassError, mieffFlags, ionEffectiveMassTTS,
+        ionDrift, ionDriftError, viFlags, ionDriftRaw,
+        ionDensity, ionDensityError, niFlags,
+        fpAreaOML, rProbeOML, electronTemperature, spacecraftPotential, passInfo
+    };
+    memcpy(buffers + EXPORT_VNEC_VARIABLE + 1, products, sizeof products);
+
+    return;
+}
+
+// Buffers of all exported variables in file order. vnec is allocated and returned for the caller to free.
+static double *slidemBuffers(void **buffers, uint8_t **hmDataBuffers, long nHmRecs, double *vn, double *ve, double *vc, double *ionEffectiveMass, double *ionDensity, double *ionDriftRaw, double *ionDrift, double *ionEffectiveMassError, double *ionDensityError, double *ionDriftError, double *fpAreaOML, double *rProbeOML, double *electronTemperature, double *spacecraftPotential, double *ionEffectiveMassTTS, uint32_t *mieffFlags, uint32_t *viFlags, uint32_t *niFlags, uint16_t *passInfo)
+{
+    double * vnec = interleaveVnec(nHmRecs, vn, ve, vc);
+    if (vnec == NULL)
+        return NULL;
+
+    inputBuffers(buffers, hmDataBuffers, vnec);
+    productBuffers(buffers, ionEffectiveMass, ionDensity, ionDriftRaw, ionDrift, ionEffectiveMassError, ionDensityError, ionDriftError, fpAreaOML, rProbeOML, electronTemperature, spacecraftPotential, ionEffectiveMassTTS, mieffFlags, viFlags, niFlags, passInfo);
+
+    return vnec;
+}
+
+static void exportRecordSizes(size_t *recordSizes)
+{
+    for (int i = 0; i < NUM_EXPORT_VARIABLES; i++)
+    {
+        long typeSize = 0;
+        CDFgetDataTypeSize(exportVariableTypes[i], &typeSize);
+        recordSizes[i] = (size_t)typeSize * (i == EXPORT_VNEC_VARIABLE ? 3 : 1);
+    }
+
+    return;
+}
+
+CDFstatus appendSlidemCdf(CDFid exportCdfId, long firstRecord, uint8_t **hmDataBuffers, long nHmRecs, double *vn, double *ve, double *vc, double *ionEffectiveMass, double *ionDensity, double *ionDriftRaw, double *ionDrift, double *ionEffectiveMassError, double *ionDensityError, double *ionDriftError, double *fpAreaOML, double *rProbeOML, double *electronTemperature, double *spacecraftPotential, double *ionEffectiveMassTTS, uint32_t *mieffFlags, uint32_t *viFlags, uint32_t *niFlags, uint16_t *passInfo)
+{
+    if (nHmRecs <= 0)
+        return CDF_OK;
+
+    void *buffers[NUM_EXPORT_VARIABLES];
+    double *vnec = slidemBuffers(buffers, hmDataBuffers, nHmRecs, vn, ve, vc, ionEffectiveMass, ionDensity, ionDriftRaw, ionDrift, ionEffectiveMassError, ionDensityError, ionDriftError, fpAreaOML, rProbeOML, electronTemperature, spacecraftPotential, ionEffectiveMassTTS, mieffFlags, viFlags, niFlags, passInfo);
+    if (vnec == NULL)
+        return EXPORT_MEM;
+
+    CDFstatus status = CDF_OK;
+    for (int i = 0; i < NUM_EXPORT_VARIABLES && status == CDF_OK; i++)
+    {
+        status = putVarRecords(exportCdfId, exportVariableNames[i], firstRecord, nHmRecs, buffers[i]);
+    }
+
+    free(vnec);
+
+    return status;
+}
+
+// GZIP blocks compressed on up to CDF_EXPORT_MAX_THREADS threads. Returns a CDF_BLOCKS_STATUS.
+static int appendSlidemCdfBlocks(const char *cdfFilename, long firstRecord, uint8_t **hmDataBuffers, long nHmRecs, double *vn, double *ve, double *vc, double *ionEffectiveMass, double *ionDensity, double *ionDriftRaw, double *ionDrift, double *ionEffectiveMassError, double *ionDensityError, double *ionDriftError, double *fpAreaOML, double *rProbeOML, double *electronTemperature, double *spacecraftPotential, double *ionEffectiveMassTTS, uint32_t *mieffFlags, uint32_t *viFlags, uint32_t *niFlags, uint16_t *passInfo)
+{
+    if (nHmRecs <= 0)
+        return CDF_BLOCKS_OK;
+
+    void *buffers[NUM_EXPORT_VARIABLES];
+    double *vnec = slidemBuffers(buffers, hmDataBuffers, nHmRecs, vn, ve, vc, ionEffectiveMass, ionDensity, ionDriftRaw, ionDrift, ionEffectiveMassError, ionDensityError, ionDriftError, fpAreaOML, rProbeOML, electronTemperature, spacecraftPotential, ionEffectiveMassTTS, mieffFlags, viFlags, niFlags, passInfo);
+    if (vnec == NULL)
+        return CDF_BLOCKS_MEMORY;
+    size_t recordSizes[NUM_EXPORT_VARIABLES];
+    exportRecordSizes(recordSizes);
+
+    int status = appendCdfBlocks(cdfFilename, firstRecord, nHmRecs, NUM_EXPORT_VARIABLES, exportVariableNames, recordSizes, buffers, CDF_EXPORT_MAX_THREADS);
+
+    free(vnec);
+
+    return status;
+}
+
+CDFstatus appendSlidemCdfFile(const char *slidemFilename, long firstRecord, uint8_t **hmDataBuffers, long nHmRecs, double *vn, double *ve, double *vc, double *ionEffectiveMass, double *ionDensity, double *ionDriftRaw, double *ionDrift, double *ionEffectiveMassError, double *ionDensityError, double *ionDriftError, double *fpAreaOML, double *rProbeOML, double *electronTemperature, double *spacecraftPotential, double *ionEffectiveMassTTS, uint32_t *mieffFlags, uint32_t *viFlags, uint32_t *niFlags, uint16_t *passInfo)
+{
+    char cdfFilename[FILENAME_MAX];
+    snprintf(cdfFilename, FILENAME_MAX, "%s.cdf", slidemFilename);
+
+    int blockStatus = appendSlidemCdfBlocks(cdfFilename, firstRecord, hmDataBuffers, nHmRecs, vn, ve, vc, ionEffectiveMass, ionDensity, ionDriftRaw, ionDrift, ionEffectiveMassError, ionDensityError, ionDriftError, fpAreaOML, rProbeOML, electronTemperature, spacecraftPotential, ionEffectiveMassTTS, mieffFlags, viFlags, niFlags, passInfo);
+    if (blockStatus == CDF_BLOCKS_OK)
+        return CDF_OK;
+    if (blockStatus != CDF_BLOCKS_UNSUPPORTED)
+    {
+        fprintf(stdout, "%sUnable to write compressed records to %s (status %d).\n", infoHeader, cdfFilename, blockStatus);
+        return blockStatus == CDF_BLOCKS_MEMORY ? EXPORT_MEM : CDF_WRITE_ERROR;
+    }
+
+    // Compression or layouts the block writer does not handle are written by the CDF library
+    CDFid exportCdfId;
+    CDFstatus status = CDFopenCDF((char *)slidemFilename, &exportCdfId);
+    if (status != CDF_OK)
+    {
+        printErrorMessage(status);
+        return status;
+    }
+    status = appendSlidemCdf(exportCdfId, firstRecord, hmDataBuffers, nHmRecs, vn, ve, vc, ionEffectiveMass, ionDensity, ionDriftRaw, ionDrift, ionEffectiveMassError, ionDensityError, ionDriftError, fpAreaOML, rProbeOML, electronTemperature, spacecraftPotential, ionEffectiveMassTTS, mieffFlags, viFlags, niFlags, passInfo);
+    closeCdf(exportCdfId);
+
+    return status;
+}
+
+CDFstatus finishSlidemCdf(CDFid exportCdfId, const char *slidemFilename, const char satellite, const char *exportVersion, double minTime, double maxTime, long nRecords, const char *fpFilename, const char *hmFilename, const char *modFilename, const char *modFilenamePrevious, const char *magFilename, long nVnecRecsPrev)
+{
+    // add attributes
+    char cdfFilename[FILENAME_MAX];
+    snprintf(cdfFilename, FILENAME_MAX - 4, "%s.cdf", slidemFilename); 
+
+    // The static attributes came with the skeleton
+    addFileAttributes(exportCdfId, minTime, maxTime, cdfFilename, fpFilename, hmFilename, modFilename, modFilenamePrevious, magFilename, nVnecRecsPrev);
+
+    fprintf(stdout, "%sExported %ld records to %s\n", infoHeader, nRecords, cdfFilename);
+    fflush(stdout);
+
+    closeCdf(exportCdfId);
+
+    return CDF_OK;
+}
+
+CDFstatus updateSlidemCdfTimeRange(CDFid exportCdfId, double minTime, double maxTime)
+{
+    // Only the Timestamp valid range depends on the records written
+    CDFstatus status = addTimeRangeAttributes(exportCdfId, minTime, maxTime);
+
+    closeCdf(exportCdfId);
+
+    return status;
+}
+
+CDFstatus exportSlidemColumnFile(const char *slidemFilename)
+{
+    char cdfFilename[FILENAME_MAX];
+    snprintf(cdfFilename, FILENAME_MAX, "%s.cdf", slidemFilename);
+    CDFid id;
+    CDFstatus status = CDFopenCDF((char *)cdfFilename, &id);
+    if (status != CDF_OK)
+    {
+        printErrorMessage(status);
+        return status;
     }
-    else
+    long maxRecord = -1;
+    status = CDFgetzVarMaxWrittenRecNum(id, CDFgetVarNum(id, exportVariableNames[0]), &maxRecord);
+    if (status != CDF_OK)
+    {
+        printErrorMessage(status);
+        closeCdf(id);
+        return status;
+    }
+    long nRecords = maxRecord + 1;
+
+    const char *names[NUM_EXPORT_VARIABLES] = {0};
+    size_t recordSizes[NUM_EXPORT_VARIABLES] = {0};
+    void *columns[NUM_EXPORT_VARIABLES] = {0};
+    exportRecordSizes(recordSizes);
+    for (int i = 0; i < NUM_EXPORT_VARIABLES; i++)
     {
-        // velocity is a 1D variable (scalars are 0D in CDF parlance), per request of DTU
-        double * vnec = malloc((size_t) (nHmRecs * 3 * sizeof(double)));
-        if (vnec == NULL)
+        names[i] = exportVariableNames[i];
+        columns[i] = malloc(recordSizes[i] * (size_t)(nRecords > 0 ? nRecords : 1));
+        if (columns[i] == NULL)
         {
-            fprintf(stdout, "%s could not allocate memory to store VNEC.\n", infoHeader);
             status = EXPORT_MEM;
             goto cleanup;
         }
-        for (long hmTimeIndex = 0; hmTimeIndex < nHmRecs; hmTimeIndex++)
+        if (nRecords > 0)
         {
-            vnec[3*hmTimeIndex] = vn[hmTimeIndex];
-            vnec[3*hmTimeIndex + 1] = ve[hmTimeIndex];
-            vnec[3*hmTimeIndex + 2] = vc[hmTimeIndex];
+            status = CDFgetVarRangeRecordsByVarName(id, exportVariableNames[i], 0, nRecords - 1, columns[i]);
+            if (status != CDF_OK)
+            {
+                printErrorMessage(status);
+                goto cleanup;
+            }
         }
+    }
 
-        // export fpVariables
-        createVarFrom1DVar(exportCdfId, "Timestamp", CDF_EPOCH, 0, nHmRecs-1, hmDataBuffers[0]);
-        createVarFrom1DVar(exportCdfId, "Latitude", CDF_REAL8, 0, nHmRecs-1, hmDataBuffers[1]);
-        createVarFrom1DVar(exportCdfId, "Longitude", CDF_REAL8, 0, nHmRecs-1, hmDataBuffers[2]);
-        createVarFrom1DVar(exportCdfId, "Radius", CDF_REAL8, 0, nHmRecs-1, hmDataBuffers[3]);
-        createVarFrom1DVar(exportCdfId, "Height", CDF_REAL8, 0, nHmRecs-1, hmDataBuffers[4]);
-        createVarFrom1DVar(exportCdfId, "QDLatitude", CDF_REAL8, 0, nHmRecs-1, hmDataBuffers[5]);
-        createVarFrom1DVar(exportCdfId, "MLT", CDF_REAL8, 0, nHmRecs-1, hmDataBuffers[7]);
-        createVarFrom2DVar(exportCdfId, "V_sat_nec", CDF_REAL8, 0, nHmRecs-1, vnec, 3);
-        createVarFrom1DVar(exportCdfId, "M_i_eff", CDF_REAL8, 0, nHmRecs-1, ionEffectiveMass);
-        createVarFrom1DVar(exportCdfId, "M_i_eff_err", CDF_REAL8, 0, nHmRecs-1, ionEffectiveMassError);
-        createVarFrom1DVar(exportCdfId, "M_i_eff_Flags", CDF_UINT4, 0, nHmRecs-1, mieffFlags);
-        createVarFrom1DVar(exportCdfId, "M_i_eff_tbt_model", CDF_REAL8, 0, nHmRecs-1, ionEffectiveMassTTS);
-        createVarFrom1DVar(exportCdfId, "V_i", CDF_REAL8, 0, nHmRecs-1, ionDrift);
-        createVarFrom1DVar(exportCdfId, "V_i_err", CDF_REAL8, 0, nHmRecs-1, ionDriftError);
-        createVarFrom1DVar(exportCdfId, "V_i_Flags", CDF_UINT4, 0, nHmRecs-1, viFlags);
-        createVarFrom1DVar(exportCdfId, "V_i_raw", CDF_REAL8, 0, nHmRecs-1, ionDriftRaw);
-        createVarFrom1DVar(exportCdfId, "N_i", CDF_REAL8, 0, nHmRecs-1, ionDensity);
-        createVarFrom1DVar(exportCdfId, "N_i_err", CDF_REAL8, 0, nHmRecs-1, ionDensityError);
-        createVarFrom1DVar(exportCdfId, "N_i_Flags", CDF_UINT4, 0, nHmRecs-1, niFlags);
-        createVarFrom1DVar(exportCdfId, "A_fp", CDF_REAL8, 0, nHmRecs-1, fpAreaOML);
-        createVarFrom1DVar(exportCdfId, "R_p", CDF_REAL8, 0, nHmRecs-1, rProbeOML);
-        createVarFrom1DVar(exportCdfId, "T_e", CDF_REAL8, 0, nHmRecs-1, electronTemperature);
-        createVarFrom1DVar(exportCdfId, "Phi_sc", CDF_REAL8, 0, nHmRecs-1, spacecraftPotential);
-
-        // add attributes
-        long hmTimeIndex = 0;
-        double minTime = HMTIME();
-        hmTimeIndex = nHmRecs - 1;
-        double maxTime = HMTIME();
-
-        char cdfFilename[FILENAME_MAX];
-        snprintf(cdfFilename, FILENAME_MAX - 4, "%s.cdf", slidemFilename); 
-
-        addAttributes(exportCdfId, SOFTWARE_VERSION_STRING, satellite, exportVersion, minTime, maxTime, cdfFilename, fpFilename, hmFilename, modFilename, modFilenamePrevious, magFilename, nVnecRecsPrev);
-
-        fprintf(stdout, "%sExported %ld records to %s\n", infoHeader, nHmRecs, cdfFilename);
-        fflush(stdout);
-        status = CDF_OK;
+    char sidecarFilename[FILENAME_MAX];
+    columnSidecarFilename(slidemFilename, sidecarFilename, FILENAME_MAX);
+    const char *baseFilename = slidemFilename + strlen(slidemFilename) - SLIDEM_BASE_FILENAME_LENGTH;
+    if (writeColumnFile(sidecarFilename, baseFilename, NUM_EXPORT_VARIABLES, names, exportVariableTypes, recordSizes, (const void **)columns, 0, nRecords) != COLUMN_FILE_OK)
+    {
+        fprintf(stdout, "%sUnable to write column sidecar %s\n", infoHeader, sidecarFilename);
+        status = EXPORT_MEM;
+        goto cleanup;
+    }
+    fprintf(stdout, "%sWrote %ld records to column sidecar %s\n", infoHeader, nRecords, sidecarFilename);
 
+cleanup:
+    for (int i = 0; i < NUM_EXPORT_VARIABLES; i++)
+        free(columns[i]);
+    closeCdf(id);
+
+    return status;
+}
+
+// Reads every record of every exported variable, as a downstream reader would
+static CDFstatus readSlidemCdf(const char *cdfFilename, long nRecords)
+{
+    CDFid id;
+    CDFstatus status = CDFopenCDF((char *)cdfFilename, &id);
+    if (status != CDF_OK)
+    {
+        printErrorMessage(status);
+        return status;
+    }
+
+    uint8_t *buffer = malloc((size_t)nRecords * 3 * sizeof(double));
+    if (buffer == NULL)
+    {
+        closeCdf(id);
+        return EXPORT_MEM;
+    }
+    for (int i = 0; i < NUM_EXPORT_VARIABLES && status == CDF_OK; i++)
+    {
+        status = CDFgetVarRangeRecordsByVarName(id, exportVariableNames[i], 0, nRecords - 1, buffer);
+        if (status != CDF_OK)
+            printErrorMessage(status);
+    }
+    free(buffer);
+    closeCdf(id);
+
+    return status;
+}
+
+// Compares the values of every exported variable in two files
+static CDFstatus compareSlidemCdfs(const char *cdfFilename1, const char *cdfFilename2, long nRecords, bool *same)
+{
+    *same = false;
+    CDFid id1, id2;
+    CDFstatus status = CDFopenCDF((char *)cdfFilename1, &id1);
+    if (status != CDF_OK)
+    {
+        printErrorMessage(status);
+        return status;
+    }
+    status = CDFopenCDF((char *)cdfFilename2, &id2);
+    if (status != CDF_OK)
+    {
+        printErrorMessage(status);
+        closeCdf(id1);
+        return status;
+    }
+
+    size_t recordSizes[NUM_EXPORT_VARIABLES];
+    exportRecordSizes(recordSizes);
+    uint8_t *buffer1 = malloc((size_t)nRecords * 3 * sizeof(double));
+    uint8_t *buffer2 = malloc((size_t)nRecords * 3 * sizeof(double));
+    if (buffer1 == NULL || buffer2 == NULL)
+    {
+        status = EXPORT_MEM;
+        goto cleanup;
+    }
+    *same = true;
+    for (int i = 0; i < NUM_EXPORT_VARIABLES && *same; i++)
+    {
+        status = CDFgetVarRangeRecordsByVarName(id1, exportVariableNames[i], 0, nRecords - 1, buffer1);
+        if (status == CDF_OK)
+            status = CDFgetVarRangeRecordsByVarName(id2, exportVariableNames[i], 0, nRecords - 1, buffer2);
+        if (status != CDF_OK)
+        {
+            printErrorMessage(status);
+            *same = false;
+            goto cleanup;
+        }
+        *same = memcmp(buffer1, buffer2, (size_t)nRecords * recordSizes[i]) == 0;
     }
 
 cleanup:
-    closeCdf(exportCdfId);
+    free(buffer1);
+    free(buffer2);
+    closeCdf(id1);
+    closeCdf(id2);
+
     return status;
+}
+
+static double secondsSince(const struct timespec *start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (double)(now.tv_sec - start->tv_sec) + (double)(now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+CDFstatus benchmarkSlidemExport(const char *slidemFilename, uint8_t **hmDataBuffers, long nHmRecs, double *vn, double *ve, double *vc, double *ionEffectiveMass, double *ionDensity, double *ionDriftRaw, double *ionDrift, double *ionEffectiveMassError, double *ionDensityError, double *ionDriftError, double *fpAreaOML, double *rProbeOML, double *electronTemperature, double *spacecraftPotential, double *ionEffectiveMassTTS, uint32_t *mieffFlags, uint32_t *viFlags, uint32_t *niFlags, uint16_t *passInfo)
+{
+    static const char *codecs[] = {EXPORT_BENCHMARK_CODECS};
+    static const long blockingFactors[] = {EXPORT_BENCHMARK_BLOCKING_FACTORS};
+    const int nCodecs = sizeof codecs / sizeof codecs[0];
+    const int nBlockingFactors = sizeof blockingFactors / sizeof blockingFactors[0];
+
+    char benchmarkFilename[FILENAME_MAX];
+    char cdfFilename[FILENAME_MAX];
+    snprintf(benchmarkFilename, FILENAME_MAX - 4, "%s_benchmark", slidemFilename);
+    snprintf(cdfFilename, FILENAME_MAX, "%s.cdf", benchmarkFilename);
+    // Written by the concurrent block writer and compared with the CDF library's file
+    char blocksFilename[FILENAME_MAX];
+    char blocksCdfFilename[FILENAME_MAX];
+    snprintf(blocksFilename, FILENAME_MAX - 4, "%s_benchmark_blocks", slidemFilename);
+    snprintf(blocksCdfFilename, FILENAME_MAX, "%s.cdf", blocksFilename);
+
+    ExportLayout defaultLayout = exportLayout();
+    char layoutString[64];
+    CDFstatus status = CDF_OK;
+    struct timespec start;
+    struct stat fileInfo;
+
+    fprintf(stdout, "%sExport benchmark for %ld records:\n", infoHeader, nHmRecs);
+    fprintf(stdout, "%s%-26s %10s %12s %10s %11s %12s\n", infoHeader, "layout", "write (s)", "size (MB)", "read (s)", "blocks (s)", "same values");
+    for (int c = 0; c < nCodecs; c++)
+    {
+        for (int b = 0; b < nBlockingFactors; b++)
+        {
+            ExportLayout layout = defaultLayout;
+            parseExportCompression(codecs[c], &layout);
+            layout.blockingFactor = blockingFactors[b];
+            setExportLayout(layout);
+            exportLayoutString(layout, layoutString, sizeof layoutString);
+            unlink(cdfFilename);
+
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            CDFid id;
+            status = createEmptySlidemCdf(benchmarkFilename, &id);
+            if (status != CDF_OK)
+                goto cleanup;
+            status = appendSlidemCdf(id, 0, hmDataBuffers, nHmRecs, vn, ve, vc, ionEffectiveMass, ionDensity, ionDriftRaw, ionDrift, ionEffectiveMassError, ionDensityError, ionDriftError, fpAreaOML, rProbeOML, electronTemperature, spacecraftPotential, ionEffectiveMassTTS, mieffFlags, viFlags, niFlags, passInfo);
+            // Compression finishes when the file is closed
+            closeCdf(id);
+            if (status != CDF_OK)
+                goto cleanup;
+            double writeTime = secondsSince(&start);
+            double size = stat(cdfFilename, &fileInfo) == 0 ? (double)fileInfo.st_size / 1024. / 1024. : -1.0;
 
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            status = readSlidemCdf(cdfFilename, nHmRecs);
+            if (status != CDF_OK)
+                goto cleanup;
+            double readTime = secondsSince(&start);
+
+            // Layouts the block writer does not handle are written by the CDF library alone
+            char blocksTimeString[16] = "-";
+            const char *sameValues = "-";
+            unlink(blocksCdfFilename);
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            status = createEmptySlidemCdf(blocksFilename, &id);
+            if (status != CDF_OK)
+                goto cleanup;
+            closeCdf(id);
+            int blockStatus = appendSlidemCdfBlocks(blocksCdfFilename, 0, hmDataBuffers, nHmRecs, vn, ve, vc, ionEffectiveMass, ionDensity, ionDriftRaw, ionDrift, ionEffectiveMassError, ionDensityError, ionDriftError, fpAreaOML, rProbeOML, electronTemperature, spacecraftPotential, ionEffectiveMassTTS, mieffFlags, viFlags, niFlags, passInfo);
+            if (blockStatus == CDF_BLOCKS_OK)
+            {
+                snprintf(blocksTimeString, sizeof blocksTimeString, "%.3f", secondsSince(&start));
+                bool same = false;
+                status = compareSlidemCdfs(cdfFilename, blocksCdfFilename, nHmRecs, &same);
+                if (status != CDF_OK)
+                    goto cleanup;
+                sameValues = same ? "yes" : "NO";
+            }
+            else if (blockStatus != CDF_BLOCKS_UNSUPPORTED)
+            {
+                fprintf(stdout, "%sUnable to write compressed records to %s (status %d).\n", infoHeader, blocksCdfFilename, blockStatus);
+                status = CDF_WRITE_ERROR;
+                goto cleanup;
+            }
+
+            fprintf(stdout, "%s%-26s %10.3f %12.2f %10.3f %11s %12s\n", infoHeader, layoutString, writeTime, size, readTime, blocksTimeString, sameValues);
+            fflush(stdout);
+        }
+    }
+
+cleanup:
+    unlink(cdfFilename);
+    unlink(blocksCdfFilename);
+    setExportLayout(defaultLayout);
+
+    return status;
 }
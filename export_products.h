@@ -26,9 +26,32 @@
 
 #include <cdf.h>
 
-CDFstatus exportProducts(const char *slidemFilename, char satellite, double beginTime, double endTime, uint8_t **hmDataBuffers, long nHmRecs, double *vn, double *ve, double *vc, double *ionEffectiveMass, double *ionDensity, double *ionDriftRaw, double *ionDrift, double *ionEffectiveMassError, double *ionDensityError, double *ionDriftError, double *fpAreaOML, double *rProbeOML, double *electronTemperature, double *spacecraftPotential, double *ionEffectiveMassTTS, uint32_t *mieffFlags, uint32_t *viFlags, uint32_t *niFlags, const char *fpFilename, const char *hmFilename, const char *modFilename, const char *modFilenamePrevious, const char *magFilename, long nVnecRecsPrev);
-
-CDFstatus exportSlidemCdf(const char *cdfFilename, const char satellite, const char *exportVersion, uint8_t **hmDataBuffers, long nHmRecs, double *vn, double *ve, double *vc, double *ionEffectiveMass, double *ionDensity, double *ionDriftRaw, double *ionDrift, double *ionEffectiveMassError, double *ionDensityError, double *ionDriftError, double *fpAreaOML, double *rProbeOML, double *electronTemperature, double *spacecraftPotential, double *ionEffectiveMassTTS, uint32_t *mieffFlags, uint32_t *viFlags, uint32_t *niFlags, const char *fpFilename, const char *hmFilename, const char *modFilename, const char *modFilenamePrevious, const char *magFilename, long nVnecRecsPrev);
+// CDF skeletons are built in and copied from directory. Without one, each file is created from scratch.
+void setSkeletonDirectory(const char *directory);
+
+CDFstatus exportProducts(const char *slidemFilename, char satellite, double beginTime, double endTime, uint8_t **hmDataBuffers, long nHmRecs, double *vn, double *ve, double *vc, double *ionEffectiveMass, double *ionDensity, double *ionDriftRaw, double *ionDrift, double *ionEffectiveMassError, double *ionDensityError, double *ionDriftError, double *fpAreaOML, double *rProbeOML, double *electronTemperature, double *spacecraftPotential, double *ionEffectiveMassTTS, uint32_t *mieffFlags, uint32_t *viFlags, uint32_t *niFlags, uint16_t *passInfo, const char *fpFilename, const char *hmFilename, const char *modFilename, const char *modFilenamePrevious, const char *magFilename, long nVnecRecsPrev);
+
+CDFstatus exportSlidemCdf(const char *cdfFilename, const char satellite, const char *exportVersion, uint8_t **hmDataBuffers, long nHmRecs, double *vn, double *ve, double *vc, double *ionEffectiveMass, double *ionDensity, double *ionDriftRaw, double *ionDrift, double *ionEffectiveMassError, double *ionDensityError, double *ionDriftError, double *fpAreaOML, double *rProbeOML, double *electronTemperature, double *spacecraftPotential, double *ionEffectiveMassTTS, uint32_t *mieffFlags, uint32_t *viFlags, uint32_t *niFlags, uint16_t *passInfo, const char *fpFilename, const char *hmFilename, const char *modFilename, const char *modFilenamePrevious, const char *magFilename, long nVnecRecsPrev);
+
+// Incremental export: create the file from the skeleton, append records in time order, then add the per-file attributes and close.
+// The skeleton holds the variables and static attributes and is built once per satellite, version and layout in the export directory.
+CDFstatus createSlidemCdfFile(const char *slidemFilename, const char satellite, const char *exportVersion);
+CDFstatus createSlidemCdf(const char *slidemFilename, const char satellite, const char *exportVersion, CDFid *exportCdfId);
+CDFstatus appendSlidemCdf(CDFid exportCdfId, long firstRecord, uint8_t **hmDataBuffers, long nHmRecs, double *vn, double *ve, double *vc, double *ionEffectiveMass, double *ionDensity, double *ionDriftRaw, double *ionDrift, double *ionEffectiveMassError, double *ionDensityError, double *ionDriftError, double *fpAreaOML, double *rProbeOML, double *electronTemperature, double *spacecraftPotential, double *ionEffectiveMassTTS, uint32_t *mieffFlags, uint32_t *viFlags, uint32_t *niFlags, uint16_t *passInfo);
+// Appends to a closed file, compressing GZIP blocks concurrently and falling back to the CDF library for other layouts
+CDFstatus appendSlidemCdfFile(const char *slidemFilename, long firstRecord, uint8_t **hmDataBuffers, long nHmRecs, double *vn, double *ve, double *vc, double *ionEffectiveMass, double *ionDensity, double *ionDriftRaw, double *ionDrift, double *ionEffectiveMassError, double *ionDensityError, double *ionDriftError, double *fpAreaOML, double *rProbeOML, double *electronTemperature, double *spacecraftPotential, double *ionEffectiveMassTTS, uint32_t *mieffFlags, uint32_t *viFlags, uint32_t *niFlags, uint16_t *passInfo);
+// Reopens a file written by an earlier incremental run. nRecords returns the number of records already written.
+CDFstatus openSlidemCdf(const char *slidemFilename, CDFid *exportCdfId, long *nRecords);
+// Updates the Timestamp valid range of a reopened file and closes it
+CDFstatus updateSlidemCdfTimeRange(CDFid exportCdfId, double minTime, double maxTime);
+CDFstatus finishSlidemCdf(CDFid exportCdfId, const char *slidemFilename, const char satellite, const char *exportVersion, double minTime, double maxTime, long nRecords, const char *fpFilename, const char *hmFilename, const char *modFilename, const char *modFilenamePrevious, const char *magFilename, long nVnecRecsPrev);
+
+// Writes the variables of <slidemFilename>.cdf uncompressed to the column sidecar <slidemFilename>.col
+CDFstatus exportSlidemColumnFile(const char *slidemFilename);
+
+// Writes and rereads the products under each combination of EXPORT_BENCHMARK_CODECS and EXPORT_BENCHMARK_BLOCKING_FACTORS,
+// reporting write time, file size and read time. The benchmark file is removed afterwards.
+CDFstatus benchmarkSlidemExport(const char *slidemFilename, uint8_t **hmDataBuffers, long nHmRecs, double *vn, double *ve, double *vc, double *ionEffectiveMass, double *ionDensity, double *ionDriftRaw, double *ionDrift, double *ionEffectiveMassError, double *ionDensityError, double *ionDriftError, double *fpAreaOML, double *rProbeOML, double *electronTemperature, double *spacecraftPotential, double *ionEffectiveMassTTS, uint32_t *mieffFlags, uint32_t *viFlags, uint32_t *niFlags, uint16_t *passInfo);
 
 enum EXPORT_FLAGS {
     EXPORT_OK = 0,
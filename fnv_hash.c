@@ -0,0 +1,33 @@
+/*
+
+    SLIDEM Processor: fnv_hash.c
+
+    Copyright (C) 2024  Johnathan K Burchill
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "fnv_hash.h"
+
+uint64_t fnv1aHash(const char *text)
+{
+    uint64_t hash = 14695981039346656037ULL;
+    for (const char *c = text; *c != '\0'; c++)
+    {
+        hash ^= (uint8_t)*c;
+        hash *= 1099511628211ULL;
+    }
+
+    return hash;
+}
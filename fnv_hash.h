@@ -0,0 +1,29 @@
+/*
+
+    SLIDEM Processor: fnv_hash.h
+
+    Copyright (C) 2024  Johnathan K Burchill
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _FNV_HASH_H
+#define _FNV_HASH_H
+
+#include <stdint.h>
+
+// 64-bit FNV-1a hash, used to name cache files after the inputs they depend on
+uint64_t fnv1aHash(const char *text);
+
+#endif // _FNV_HASH_H
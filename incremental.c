@@ -0,0 +1,256 @@
+/*
+
+    SLIDEM Processor: incremental.c
+
+    Copyright (C) 2024  Johnathan K Burchill
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "incremental.h"
+
+#include "main.h"
+#include "slidem_settings.h"
+#include "pass_index.h"
+#include "stream_inputs.h"
+#include "stream_products.h"
+#include "export_products.h"
+#include "utilities.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <cdf.h>
+
+extern char infoHeader[50];
+
+static void checkpointFilename(const char *slidemFilename, char *filename)
+{
+    snprintf(filename, FILENAME_MAX, "%s.%s", slidemFilename, INCREMENTAL_CHECKPOINT_EXTENSION);
+
+    return;
+}
+
+int readCheckpoint(const char *slidemFilename, IncrementalCheckpoint *checkpoint)
+{
+    memset(checkpoint, 0, sizeof(IncrementalCheckpoint));
+
+    char filename[FILENAME_MAX];
+    checkpointFilename(slidemFilename, filename);
+    FILE *fp = fopen(filename, "r");
+    if (fp == NULL)
+        return INCREMENTAL_NO_CHECKPOINT;
+
+    unsigned int passNumber = 0;
+    unsigned int numFits[OFFSET_FIT_NUMBER_OF_REGION_TYPES] = {0};
+    int missingFpData[OFFSET_FIT_NUMBER_OF_REGION_TYPES] = {0};
+    int valuesRead = fscanf(fp, "%lf %ld %u %u %d %u %d", &checkpoint->resumeTime, &checkpoint->exportedRecords, &passNumber, &numFits[0], &missingFpData[0], &numFits[1], &missingFpData[1]);
+    fclose(fp);
+    if (valuesRead != 7 || checkpoint->exportedRecords < 0)
+    {
+        memset(checkpoint, 0, sizeof(IncrementalCheckpoint));
+        return INCREMENTAL_CHECKPOINT;
+    }
+    checkpoint->passNumber = (uint16_t) passNumber;
+    for (int t = 0; t < OFFSET_FIT_NUMBER_OF_REGION_TYPES; t++)
+    {
+        checkpoint->fitState.numFits[t] = (uint16_t) numFits[t];
+        checkpoint->fitState.missingFpData[t] = missingFpData[t] != 0;
+    }
+
+    return INCREMENTAL_OK;
+}
+
+int writeCheckpoint(const char *slidemFilename, const IncrementalCheckpoint *checkpoint)
+{
+    char filename[FILENAME_MAX];
+    char tmpFilename[FILENAME_MAX];
+    checkpointFilename(slidemFilename, filename);
+    snprintf(tmpFilename, FILENAME_MAX, "%s.tmp%d", filename, (int)getpid());
+
+    FILE *fp = fopen(tmpFilename, "w");
+    if (fp == NULL)
+        return INCREMENTAL_CHECKPOINT;
+    // Replaced atomically so that an interrupted run resumes from the previous checkpoint
+    int n = fprintf(fp, "%.1f %ld %u %u %d %u %d\n", checkpoint->resumeTime, checkpoint->exportedRecords, (unsigned int)checkpoint->passNumber, (unsigned int)checkpoint->fitState.numFits[0], (int)checkpoint->fitState.missingFpData[0], (unsigned int)checkpoint->fitState.numFits[1], (int)checkpoint->fitState.missingFpData[1]);
+    if (fclose(fp) != 0 || n < 0 || rename(tmpFilename, filename) != 0)
+    {
+        unlink(tmpFilename);
+        return INCREMENTAL_CHECKPOINT;
+    }
+
+    return INCREMENTAL_OK;
+}
+
+void removeCheckpoint(const char *slidemFilename)
+{
+    char filename[FILENAME_MAX];
+    checkpointFilename(slidemFilename, filename);
+    unlink(filename);
+
+    return;
+}
+
+int processIncrement(const char *slidemFilename, const char *fitLogBaseFilename, const char satellite, char **hmVariables, const char *fpFilename, const char *hmFilename, const char *modFilename, const char *modFilenamePrevious, const char *magFilename, const char *boundaryCacheFilenameToday, const char *boundaryCacheFilenamePrevious, const char *boundaryCacheFilenameNext, bool inputsComplete, double dayEndTime, double f107Adj, int dayOfYear, probeParams sphericalProbeParams, bool *dayComplete, double *firstMeasurementTime, double *lastMeasurementTime, long *nVnecRecsPrev, long *numberOfSlidemEstimates, long *nNewRecords)
+{
+    *dayComplete = false;
+    *numberOfSlidemEstimates = 0;
+    *nNewRecords = 0;
+
+    IncrementalCheckpoint checkpoint;
+    int checkpointStatus = readCheckpoint(slidemFilename, &checkpoint);
+    if (checkpointStatus == INCREMENTAL_CHECKPOINT)
+    {
+        fprintf(stdout, "%sUnable to read the incremental checkpoint.\n", infoHeader);
+        return INCREMENTAL_CHECKPOINT;
+    }
+    bool firstRun = checkpointStatus == INCREMENTAL_NO_CHECKPOINT;
+
+    // Only the HM record times are read here; other inputs are read with range reads from the resume time onward
+    StreamInputs inputs;
+    if (openStreamInputs(&inputs, fpFilename, hmFilename, modFilename, modFilenamePrevious, magFilename, hmVariables, boundaryCacheFilenamePrevious, boundaryCacheFilenameNext) != STREAM_INPUTS_OK)
+        return INCREMENTAL_INPUTS;
+    *nVnecRecsPrev = inputs.nVnecRecsPrev;
+
+    int status = INCREMENTAL_OK;
+    FILE *fitFile = NULL;
+    long dayFirst = inputs.previous.nRecs;
+    long dayEnd = dayFirst + inputs.nHmFileRecs;
+    if (streamInputTime(&inputs, dayFirst, firstMeasurementTime) != STREAM_INPUTS_OK || streamInputTime(&inputs, dayEnd - 1, lastMeasurementTime) != STREAM_INPUTS_OK)
+    {
+        status = INCREMENTAL_INPUTS;
+        goto cleanup;
+    }
+    // The input files are complete once they reach the end of the day
+    *dayComplete = inputsComplete || *lastMeasurementTime >= dayEndTime - 1000.0;
+    if (*dayComplete && boundaryCacheFilenameToday != NULL && writeStreamBoundaryCache(&inputs, boundaryCacheFilenameToday, SECONDS_OF_BOUNDARY_DATA_REQUIRED_FOR_PROCESSING) != STREAM_INPUTS_OK)
+        fprintf(stdout, "%sUnable to write boundary cache.\n", infoHeader);
+
+    // First record not yet processed. Pass numbering resumes at the equator crossing there,
+    // so no earlier records are needed.
+    long first = 0;
+    if (!firstRun && streamInputRecordAt(&inputs, checkpoint.resumeTime, &first) != STREAM_INPUTS_OK)
+    {
+        status = INCREMENTAL_INPUTS;
+        goto cleanup;
+    }
+    if (first >= inputs.nRecs && !*dayComplete)
+    {
+        fprintf(stdout, "%sNo new pass to process since the last checkpoint.\n", infoHeader);
+        goto cleanup;
+    }
+
+    if (POST_PROCESS_ION_DRIFT)
+        fitFile = openFitLog(fitLogBaseFilename, !firstRun);
+
+    char cdfFilename[FILENAME_MAX];
+    snprintf(cdfFilename, FILENAME_MAX, "%s.cdf", slidemFilename);
+    CDFid exportCdfId;
+    CDFstatus cdfStatus = CDF_OK;
+    long nCdfRecords = 0;
+    if (firstRun)
+    {
+        // Remove the output of an interrupted first run
+        unlink(cdfFilename);
+        cdfStatus = createSlidemCdfFile(slidemFilename, satellite, EXPORT_VERSION_STRING);
+    }
+    else
+    {
+        cdfStatus = openSlidemCdf(slidemFilename, &exportCdfId, &nCdfRecords);
+        if (cdfStatus == CDF_OK)
+            closeCdf(exportCdfId);
+        // Records written after the checkpoint by an interrupted run are overwritten
+        if (cdfStatus == CDF_OK && nCdfRecords < checkpoint.exportedRecords)
+        {
+            fprintf(stdout, "%sSLIDEM CDF file has fewer records than the checkpoint.\n", infoHeader);
+            status = INCREMENTAL_CHECKPOINT;
+            goto cleanup;
+        }
+    }
+    if (cdfStatus != CDF_OK)
+    {
+        status = INCREMENTAL_EXPORT;
+        goto cleanup;
+    }
+
+    // Records are appended to the closed file a window at a time, then it is reopened for the attributes.
+    // Unless the day is complete, records after the last equator crossing are left for the next run.
+    long nextRecord = first;
+    long nExportRecs = 0;
+    long nChunks = 0;
+    long maxChunkRecs = 0;
+    long maxWindowRecs = 0;
+    int streamStatus = processStreamWindows(&inputs, first, *dayComplete, slidemFilename, checkpoint.exportedRecords, fitFile, satellite, f107Adj, dayOfYear, sphericalProbeParams, &checkpoint.passNumber, &checkpoint.fitState, &nextRecord, &nExportRecs, numberOfSlidemEstimates, &nChunks, &maxChunkRecs, &maxWindowRecs);
+    if (streamStatus != STREAM_OK)
+    {
+        status = streamStatus == STREAM_EXPORT ? INCREMENTAL_EXPORT : INCREMENTAL_INPUTS;
+        goto cleanup;
+    }
+    if (nextRecord == first && !*dayComplete)
+    {
+        fprintf(stdout, "%sNo new pass to process since the last checkpoint.\n", infoHeader);
+        goto cleanup;
+    }
+    cdfStatus = CDFopenCDF((char *)slidemFilename, &exportCdfId);
+    if (cdfStatus != CDF_OK)
+    {
+        status = INCREMENTAL_EXPORT;
+        goto cleanup;
+    }
+
+    long nRecords = checkpoint.exportedRecords + nExportRecs;
+    double minTime = *firstMeasurementTime;
+    double maxTime = minTime;
+    long lastExported = nextRecord < dayEnd ? nextRecord - 1 : dayEnd - 1;
+    if (lastExported >= dayFirst && streamInputTime(&inputs, lastExported, &maxTime) != STREAM_INPUTS_OK)
+        maxTime = minTime;
+    // Attributes are added once; later runs only extend the Timestamp valid range
+    if (firstRun)
+        cdfStatus = finishSlidemCdf(exportCdfId, slidemFilename, satellite, EXPORT_VERSION_STRING, minTime, maxTime, nRecords, fpFilename, hmFilename, modFilename, modFilenamePrevious, magFilename, inputs.nVnecRecsPrev);
+    else
+        cdfStatus = updateSlidemCdfTimeRange(exportCdfId, minTime, maxTime);
+    if (cdfStatus != CDF_OK)
+    {
+        status = INCREMENTAL_EXPORT;
+        goto cleanup;
+    }
+    *nNewRecords = nExportRecs;
+    fprintf(stdout, "%sCalculated %ld SLIDEM IDM products for %ld new records in %ld chunks. %ld records exported so far.\n", infoHeader, *numberOfSlidemEstimates, nextRecord - first, nChunks, nRecords);
+
+    if (*dayComplete)
+    {
+        removeCheckpoint(slidemFilename);
+    }
+    else
+    {
+        if (streamInputTime(&inputs, nextRecord, &checkpoint.resumeTime) != STREAM_INPUTS_OK)
+        {
+            status = INCREMENTAL_INPUTS;
+            goto cleanup;
+        }
+        checkpoint.exportedRecords = nRecords;
+        status = writeCheckpoint(slidemFilename, &checkpoint);
+        if (status != INCREMENTAL_OK)
+            fprintf(stdout, "%sUnable to write the incremental checkpoint.\n", infoHeader);
+    }
+
+cleanup:
+    if (fitFile != NULL)
+        fclose(fitFile);
+    closeStreamInputs(&inputs);
+
+    return status;
+}
@@ -0,0 +1,66 @@
+/*
+
+    SLIDEM Processor: incremental.h
+
+    Copyright (C) 2024  Johnathan K Burchill
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _INCREMENTAL_H
+#define _INCREMENTAL_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "modified_oml.h"
+#include "post_process.h"
+
+// Near-real-time processing of growing input files. Each run processes the records
+// after the checkpoint up to the last equator crossing, appends them to <product>.cdf,
+// and records where to resume in <product>.checkpoint. No fit region spans an equator
+// crossing, so the products match those of a single run on the complete day.
+
+#define INCREMENTAL_CHECKPOINT_EXTENSION "checkpoint"
+
+typedef struct incrementalCheckpoint {
+    double resumeTime; // CDF_EPOCH of the first record not yet processed
+    long exportedRecords; // Records already in the CDF
+    uint16_t passNumber; // Pass number of the first record not yet processed
+    OffsetFitState fitState;
+} IncrementalCheckpoint;
+
+// Returns INCREMENTAL_NO_CHECKPOINT and a zeroed checkpoint if there is none
+int readCheckpoint(const char *slidemFilename, IncrementalCheckpoint *checkpoint);
+int writeCheckpoint(const char *slidemFilename, const IncrementalCheckpoint *checkpoint);
+void removeCheckpoint(const char *slidemFilename);
+
+// Processes and exports the records not yet covered by the checkpoint, reading the inputs with range reads
+// from the checkpoint's resume time onward rather than reloading the day.
+// The day is complete if inputsComplete or the HM file reaches dayEndTime; then all remaining records are processed,
+// this day's boundary cache is written (if boundaryCacheFilenameToday is not NULL), the CDF is finished and the checkpoint is removed.
+// nNewRecords returns the number of records appended to the CDF by this run.
+int processIncrement(const char *slidemFilename, const char *fitLogBaseFilename, const char satellite, char **hmVariables, const char *fpFilename, const char *hmFilename, const char *modFilename, const char *modFilenamePrevious, const char *magFilename, const char *boundaryCacheFilenameToday, const char *boundaryCacheFilenamePrevious, const char *boundaryCacheFilenameNext, bool inputsComplete, double dayEndTime, double f107Adj, int dayOfYear, probeParams sphericalProbeParams, bool *dayComplete, double *firstMeasurementTime, double *lastMeasurementTime, long *nVnecRecsPrev, long *numberOfSlidemEstimates, long *nNewRecords);
+
+enum INCREMENTAL_STATUS {
+    INCREMENTAL_OK = 0,
+    INCREMENTAL_NO_CHECKPOINT = -1,
+    INCREMENTAL_CHECKPOINT = -2,
+    INCREMENTAL_PASS_INDEX = -3,
+    INCREMENTAL_EXPORT = -4,
+    INCREMENTAL_INPUTS = -5
+};
+
+#endif // _INCREMENTAL_H
@@ -0,0 +1,204 @@
+/*
+
+    SLIDEM Processor: input_cache.c
+
+    Copyright (C) 2024  Johnathan K Burchill
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "input_cache.h"
+#include "column_file.h"
+#include "fnv_hash.h"
+#include "slidem_settings.h"
+#include "utilities.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include <cdf.h>
+
+#define INPUT_CACHE_NUM_DERIVED_VARIABLES 5
+#define INPUT_CACHE_NUM_INPUT_FILES 5
+
+static char *derivedVariables[INPUT_CACHE_NUM_DERIVED_VARIABLES] = {
+    "FP_Current",
+    "V_North",
+    "V_East",
+    "V_Centre",
+    "Dip_Latitude"
+};
+
+static const char *baseName(const char *filename)
+{
+    const char *slash = strrchr(filename, '/');
+    return slash == NULL ? filename : slash + 1;
+}
+
+int inputCacheKey(const char *fpFilename, const char *hmFilename, const char *modFilename, const char *modFilenamePrevious, const char *magFilename, char *key, size_t length)
+{
+    const char *inputs[INPUT_CACHE_NUM_INPUT_FILES] = {fpFilename, hmFilename, modFilename, modFilenamePrevious, magFilename};
+    size_t used = 0;
+    int n = snprintf(key, length, "%s", SOFTWARE_VERSION_STRING);
+    for (int f = 0; f < INPUT_CACHE_NUM_INPUT_FILES && n >= 0 && used + (size_t)n < length; f++)
+    {
+        used += (size_t)n;
+        // A regenerated input keeps its name, so its size and modification time are part of the key.
+        // Inputs that do not exist, such as an unavailable previous-day MOD file, are keyed by name alone.
+        struct stat info;
+        if (stat(inputs[f], &info) != 0)
+        {
+            info.st_size = -1;
+            info.st_mtime = -1;
+        }
+        n = snprintf(key + used, length - used, "\n%s %lld %lld", baseName(inputs[f]), (long long)info.st_size, (long long)info.st_mtime);
+    }
+    if (n < 0 || used + (size_t)n >= length)
+        return INPUT_CACHE_ARGUMENTS;
+
+    return INPUT_CACHE_OK;
+}
+
+void inputCacheFilename(const char *cacheDirectory, const char *slidemFilename, const char *key, char *cacheFilename, size_t length)
+{
+    snprintf(cacheFilename, length, "%s/%s_%016llx.%s", cacheDirectory, slidemFilename + strlen(slidemFilename) - SLIDEM_BASE_FILENAME_LENGTH, (unsigned long long)fnv1aHash(key), INPUT_CACHE_EXTENSION);
+
+    return;
+}
+
+int writeInputCache(const char *cacheFilename, const char *key, long nVnecRecsPrev, char **hmVariables, int nHmVariables, uint8_t **hmDataBuffers, const long *hmDataTypes, const size_t *hmRecordSizes, long nHmRecs, double *fpCurrent, double *vn, double *ve, double *vc, double *dipLatitude)
+{
+    if (cacheFilename == NULL || key == NULL || hmVariables == NULL || hmDataBuffers == NULL || hmDataTypes == NULL || hmRecordSizes == NULL || nHmRecs <= 0)
+        return INPUT_CACHE_ARGUMENTS;
+
+    int nColumns = nHmVariables + INPUT_CACHE_NUM_DERIVED_VARIABLES;
+    const char **names = calloc((size_t)nColumns, sizeof(char*));
+    long *dataTypes = calloc((size_t)nColumns, sizeof(long));
+    size_t *recordSizes = calloc((size_t)nColumns, sizeof(size_t));
+    const void **columns = calloc((size_t)nColumns, sizeof(void*));
+    const double *derived[INPUT_CACHE_NUM_DERIVED_VARIABLES] = {fpCurrent, vn, ve, vc, dipLatitude};
+    int status = INPUT_CACHE_OK;
+    if (names == NULL || dataTypes == NULL || recordSizes == NULL || columns == NULL)
+    {
+        status = INPUT_CACHE_MEMORY;
+        goto cleanup;
+    }
+
+    for (int c = 0; c < nColumns; c++)
+    {
+        if (c < nHmVariables)
+        {
+            names[c] = hmVariables[c];
+            dataTypes[c] = hmDataTypes[c];
+            recordSizes[c] = hmRecordSizes[c];
+            columns[c] = hmDataBuffers[c];
+        }
+        else
+        {
+            names[c] = derivedVariables[c - nHmVariables];
+            dataTypes[c] = CDF_REAL8;
+            recordSizes[c] = sizeof(double);
+            columns[c] = derived[c - nHmVariables];
+        }
+    }
+
+    // The key is checked on reading in case of a hash collision
+    char label[COLUMN_FILE_LABEL_LENGTH];
+    int n = snprintf(label, COLUMN_FILE_LABEL_LENGTH, "%s\nnVnecRecsPrev=%ld", key, nVnecRecsPrev);
+    if (n < 0 || n >= COLUMN_FILE_LABEL_LENGTH)
+        status = INPUT_CACHE_ARGUMENTS;
+    else if (writeColumnFile(cacheFilename, label, nColumns, names, dataTypes, recordSizes, columns, 0, nHmRecs) != COLUMN_FILE_OK)
+        status = INPUT_CACHE_WRITE;
+
+cleanup:
+    free(columns);
+    free(recordSizes);
+    free(dataTypes);
+    free(names);
+
+    return status;
+}
+
+static int copyColumn(const ColumnFile *file, const char *name, size_t expectedRecordSize, long *dataType, size_t *recordSize, uint8_t **buffer)
+{
+    size_t size = 0;
+    const uint8_t *data = columnFileData(file, name, &size, dataType);
+    if (data == NULL || (expectedRecordSize > 0 && size != expectedRecordSize))
+        return INPUT_CACHE_MISMATCH;
+
+    // Copied rather than used in place: the boundary data from adjacent days is added by reallocation
+    size_t bytes = size * (size_t)file->header->nRecords;
+    *buffer = malloc(bytes > 0 ? bytes : 1);
+    if (*buffer == NULL)
+        return INPUT_CACHE_MEMORY;
+    memcpy(*buffer, data, bytes);
+    if (recordSize != NULL)
+        *recordSize = size;
+
+    return INPUT_CACHE_OK;
+}
+
+int readInputCache(const char *cacheFilename, const char *key, char **hmVariables, int nHmVariables, uint8_t **hmDataBuffers, long *hmDataTypes, size_t *hmRecordSizes, long *nHmRecs, double **fpCurrent, double **vn, double **ve, double **vc, double **dipLatitude, long *nVnecRecsPrev)
+{
+    if (cacheFilename == NULL || key == NULL || hmVariables == NULL || hmDataBuffers == NULL || hmDataTypes == NULL || hmRecordSizes == NULL || nHmRecs == NULL || fpCurrent == NULL || vn == NULL || ve == NULL || vc == NULL || dipLatitude == NULL || nVnecRecsPrev == NULL)
+        return INPUT_CACHE_ARGUMENTS;
+
+    ColumnFile file = {.fd = -1};
+    if (openColumnFile(cacheFilename, &file) != COLUMN_FILE_OK)
+        return INPUT_CACHE_UNAVAILABLE;
+
+    int status = INPUT_CACHE_OK;
+    size_t keyLength = strlen(key);
+    long nVnecPrev = 0;
+    if (strncmp(file.header->label, key, keyLength) != 0 || sscanf(file.header->label + keyLength, "\nnVnecRecsPrev=%ld", &nVnecPrev) != 1 || file.header->nRecords <= 0)
+    {
+        closeColumnFile(&file);
+        return INPUT_CACHE_MISMATCH;
+    }
+
+    uint8_t **buffers = calloc((size_t)(nHmVariables + INPUT_CACHE_NUM_DERIVED_VARIABLES), sizeof(uint8_t*));
+    if (buffers == NULL)
+    {
+        closeColumnFile(&file);
+        return INPUT_CACHE_MEMORY;
+    }
+    for (int c = 0; c < nHmVariables && status == INPUT_CACHE_OK; c++)
+        status = copyColumn(&file, hmVariables[c], 0, &hmDataTypes[c], &hmRecordSizes[c], &buffers[c]);
+    for (int c = 0; c < INPUT_CACHE_NUM_DERIVED_VARIABLES && status == INPUT_CACHE_OK; c++)
+        status = copyColumn(&file, derivedVariables[c], sizeof(double), NULL, NULL, &buffers[nHmVariables + c]);
+    if (status != INPUT_CACHE_OK)
+    {
+        for (int c = 0; c < nHmVariables + INPUT_CACHE_NUM_DERIVED_VARIABLES; c++)
+            free(buffers[c]);
+        goto cleanup;
+    }
+
+    for (int c = 0; c < nHmVariables; c++)
+        hmDataBuffers[c] = buffers[c];
+    *fpCurrent = (double*)buffers[nHmVariables];
+    *vn = (double*)buffers[nHmVariables + 1];
+    *ve = (double*)buffers[nHmVariables + 2];
+    *vc = (double*)buffers[nHmVariables + 3];
+    *dipLatitude = (double*)buffers[nHmVariables + 4];
+    *nHmRecs = (long)file.header->nRecords;
+    *nVnecRecsPrev = nVnecPrev;
+
+cleanup:
+    free(buffers);
+    closeColumnFile(&file);
+
+    return status;
+}
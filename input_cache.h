@@ -0,0 +1,56 @@
+/*
+
+    SLIDEM Processor: input_cache.h
+
+    Copyright (C) 2024  Johnathan K Burchill
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _INPUT_CACHE_H
+#define _INPUT_CACHE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Optional cache of a day's HM-aligned inputs: the HM columns, FP current, VNEC and dip latitude,
+// after reading, downsampling and interpolation. Reprocessing the same inputs with changed
+// algorithms can then start at the product calculation.
+// The cache is keyed by the software version and by the name, size and modification time of each input file.
+
+#define INPUT_CACHE_EXTENSION "inp"
+#define INPUT_CACHE_KEY_LENGTH 480 // leaves room for nVnecRecsPrev in the column file label
+
+// Returns INPUT_CACHE_ARGUMENTS if the key does not fit in length
+int inputCacheKey(const char *fpFilename, const char *hmFilename, const char *modFilename, const char *modFilenamePrevious, const char *magFilename, char *key, size_t length);
+
+// <cacheDirectory>/<SLIDEM base filename>_<hash of key>.inp
+void inputCacheFilename(const char *cacheDirectory, const char *slidemFilename, const char *key, char *cacheFilename, size_t length);
+
+int writeInputCache(const char *cacheFilename, const char *key, long nVnecRecsPrev, char **hmVariables, int nHmVariables, uint8_t **hmDataBuffers, const long *hmDataTypes, const size_t *hmRecordSizes, long nHmRecs, double *fpCurrent, double *vn, double *ve, double *vc, double *dipLatitude);
+
+// Allocates and fills the HM buffers and derived arrays from the cache.
+// Nothing is allocated unless INPUT_CACHE_OK is returned.
+int readInputCache(const char *cacheFilename, const char *key, char **hmVariables, int nHmVariables, uint8_t **hmDataBuffers, long *hmDataTypes, size_t *hmRecordSizes, long *nHmRecs, double **fpCurrent, double **vn, double **ve, double **vc, double **dipLatitude, long *nVnecRecsPrev);
+
+enum INPUT_CACHE_STATUS {
+    INPUT_CACHE_OK = 0,
+    INPUT_CACHE_ARGUMENTS = -1,
+    INPUT_CACHE_MEMORY = -2,
+    INPUT_CACHE_WRITE = -3,
+    INPUT_CACHE_UNAVAILABLE = -4,
+    INPUT_CACHE_MISMATCH = -5
+};
+
+#endif // _INPUT_CACHE_H
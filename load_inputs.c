@@ -31,7 +31,7 @@
 
 extern char infoHeader[50];
 
-void loadInputs(const char *cdfFile, char *variables[], int nVariables, uint8_t **dataBuffers, long *numberOfRecords)
+void loadInputs(const char *cdfFile, char *variables[], int nVariables, uint8_t **dataBuffers, long *numberOfRecords, long *dataTypes, size_t *recordSizes)
 {
     if (dataBuffers == NULL || numberOfRecords == NULL)
         return;
@@ -113,6 +113,10 @@ void loadInputs(const char *cdfFile, char *variables[], int nVariables, uint8_t
         dataBuffers[i] = (uint8_t*) realloc(dataBuffers[i], (size_t) numBytesToAdd);
         memcpy(dataBuffers[i], data, numBytesToAdd);
         CDFdataFree(data);
+        if (dataTypes != NULL)
+            dataTypes[i] = dataType;
+        if (recordSizes != NULL)
+            recordSizes[i] = (size_t)(numValues * numVarBytes);
     }
     // close CDF
     closeCdf(cdfId);
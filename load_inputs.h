@@ -22,9 +22,10 @@
 #define _LOAD_INPUTS_H
 
 #include <stdint.h>
+#include <stddef.h>
 
-
-void loadInputs(const char *cdfFile, char *variables[], int nVariables, uint8_t **dataBuffers, long *numberOfRecords);
+// dataTypes and recordSizes are optional (NULL): CDF data type and bytes per record of each variable
+void loadInputs(const char *cdfFile, char *variables[], int nVariables, uint8_t **dataBuffers, long *numberOfRecords, long *dataTypes, size_t *recordSizes);
 
 #endif // _LOAD_INPUTS_H
 
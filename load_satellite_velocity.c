@@ -33,9 +33,11 @@
 
 extern char infoHeader[50];
 
-int loadSatelliteVelocity(const char *modFilename, uint8_t **vnecDataBuffers, long *nVnecRecs)
+int openSatelliteVelocity(const char *modFilename, SatelliteVelocityFile *file)
 {
-    int status = (int) SAT_VEL_ERROR_UNAVAILABLE;
+    file->fp = NULL;
+    file->epochs = 0;
+    file->records = 0;
 
     FILE *modFP = fopen(modFilename, "r");
     if (modFP == NULL)
@@ -54,58 +56,52 @@ int loadSatelliteVelocity(const char *modFilename, uint8_t **vnecDataBuffers, lo
     int sec;
     int msec;
 
-    double x, y, z;
-    double vx, vy, vz;
-    double dummy;
-
-    double cdfTime;
-
-    char * str = NULL;
-    int itemsConverted = 0;
-    long records = 0;
-
-    double cx, cy, cz, ex, ey, ez, nx, ny, nz;
-    double cm, em, nm;
-    double vn, ve, vc;
-
     long epochs = 0;
-    int a, b, c, d;
-    double e;
 
-    itemsConverted = fscanf(modFP, "%3c%d %d %d %d %d %lf %ld %5c %5c %3c %4c\n", buf, &year, &month, &day, &hour, &minute, &seconds, &epochs, buf, buf, buf, buf);
+    int itemsConverted = fscanf(modFP, "%3c%d %d %d %d %d %lf %ld %5c %5c %3c %4c\n", buf, &year, &month, &day, &hour, &minute, &seconds, &epochs, buf, buf, buf, buf);
 
     if (epochs < MINIMUM_VELOCITY_EPOCHS)
     {
-        status = SAT_VEL_ERROR_TOO_FEW_EPOCHS;
-        goto cleanup;
+        fclose(modFP);
+        return SAT_VEL_ERROR_TOO_FEW_EPOCHS;
     }
 
-    for (int i = 0; i < 4; i++)
-    {
-        vnecDataBuffers[i] = (uint8_t*) malloc((size_t) (epochs * sizeof(double)));
-        if (vnecDataBuffers[i] == NULL)
-        {
-            for (int j = 0; j < i; j++)
-            {
-                free(vnecDataBuffers[j]);
-            }
-            status = SAT_VEL_ERROR_MEMORY;
-            goto cleanup;
-        }
-    }
-
-    long lines = 1;
-
     sec = (int)floor(seconds);
     msec = (int)floor(1000.0 * (seconds - (double)sec));
     double gpsEpoch = computeEPOCH(year, month, day, hour, minute, sec, msec);
     double utEpoch = computeEPOCH(year, month, day, 0, 0, 0, 0);
-    double gpsTimeOffset = gpsEpoch - utEpoch;
+
+    file->fp = modFP;
+    file->epochs = epochs;
+    file->gpsTimeOffset = gpsEpoch - utEpoch;
+    file->dataOffset = ftell(modFP);
+
+    return SAT_VEL_OK;
+}
+
+int nextSatelliteVelocity(SatelliteVelocityFile *file, double *cdfTime, double *vn, double *ve, double *vc)
+{
+    char buf[100] = {0};
+
+    int year;
+    int month;
+    int day;
+    int hour;
+    int minute;
+    double seconds;
+    int sec;
+    int msec;
+
+    double x, y, z;
+    double vx, vy, vz;
+
+    double cx, cy, cz, ex, ey, ez, nx, ny, nz;
+    double cm, em, nm;
+
     double gpsTime = 0.0;
 
-    while(fgets(buf, 100, modFP) != NULL)
+    while(fgets(buf, 100, file->fp) != NULL)
     {
-        lines++;
         if (buf[0] != '*')
         {
             continue;
@@ -114,22 +110,18 @@ int loadSatelliteVelocity(const char *modFilename, uint8_t **vnecDataBuffers, lo
         sec = (int) floor(seconds);
         msec = 1000 * (int)floor(seconds - (double)sec);
         gpsTime = computeEPOCH(year, month, day, hour, minute, sec, msec);
-        cdfTime = gpsTime - gpsTimeOffset;
-        if(fgets(buf, 100, modFP) == NULL || buf[0] != 'P')
+        *cdfTime = gpsTime - file->gpsTimeOffset;
+        if(fgets(buf, 100, file->fp) == NULL || buf[0] != 'P')
         {
-            status = SAT_VEL_ERROR_FILE;
-            goto cleanup;
+            return SAT_VEL_ERROR_FILE;
         }
-        lines++;
         sscanf(buf+5, "%lf %lf %lf", &x, &y, &z);
-        if(fgets(buf, 100, modFP) == NULL || buf[0] != 'V')
+        if(fgets(buf, 100, file->fp) == NULL || buf[0] != 'V')
         {
-            status = SAT_VEL_ERROR_FILE;
-            goto cleanup;
+            return SAT_VEL_ERROR_FILE;
         }
         sscanf(buf+5, "%lf %lf %lf", &vx, &vy, &vz);
-        lines++;
-        records++;
+        file->records++;
         vx /= 10.;
         vy /= 10.;
         vz /= 10.;
@@ -149,30 +141,83 @@ int loadSatelliteVelocity(const char *modFilename, uint8_t **vnecDataBuffers, lo
         nx /= nm; ny /= nm; nz /= nm;
 
         // vnec
-        vn = vx * nx + vy * ny + vz * nz;
-        ve = vx * ex + vy * ey + vz * ez;
-        vc = vx * cx + vy * cy + vz * cz;
+        *vn = vx * nx + vy * ny + vz * nz;
+        *ve = vx * ex + vy * ey + vz * ez;
+        *vc = vx * cx + vy * cy + vz * cz;
 
-        ((double*)vnecDataBuffers[0])[records-1] = cdfTime;
-        ((double*)vnecDataBuffers[1])[records-1] = vn;
-        ((double*)vnecDataBuffers[2])[records-1] = ve;
-        ((double*)vnecDataBuffers[3])[records-1] = vc;
+        return SAT_VEL_OK;
+    }
 
+    return SAT_VEL_END_OF_FILE;
+}
+
+int rewindSatelliteVelocity(SatelliteVelocityFile *file)
+{
+    if (file->fp == NULL || fseek(file->fp, file->dataOffset, SEEK_SET) != 0)
+        return SAT_VEL_ERROR_FILE;
+    file->records = 0;
+
+    return SAT_VEL_OK;
+}
+
+void closeSatelliteVelocity(SatelliteVelocityFile *file)
+{
+    if (file->fp != NULL)
+        fclose(file->fp);
+    file->fp = NULL;
+
+    return;
+}
+
+int loadSatelliteVelocity(const char *modFilename, uint8_t **vnecDataBuffers, long *nVnecRecs)
+{
+    SatelliteVelocityFile file;
+    int status = openSatelliteVelocity(modFilename, &file);
+    if (status != SAT_VEL_OK)
+        return status;
+
+    for (int i = 0; i < 4; i++)
+    {
+        vnecDataBuffers[i] = (uint8_t*) malloc((size_t) (file.epochs * sizeof(double)));
+        if (vnecDataBuffers[i] == NULL)
+        {
+            for (int j = 0; j < i; j++)
+            {
+                free(vnecDataBuffers[j]);
+            }
+            status = SAT_VEL_ERROR_MEMORY;
+            goto cleanup;
+        }
+    }
+
+    double cdfTime, vn, ve, vc;
+    while ((status = nextSatelliteVelocity(&file, &cdfTime, &vn, &ve, &vc)) == SAT_VEL_OK)
+    {
+        if (file.records > file.epochs)
+        {
+            status = SAT_VEL_ERROR_WRONG_NUMBER_OF_RECORDS_READ;
+            goto cleanup;
+        }
+        ((double*)vnecDataBuffers[0])[file.records-1] = cdfTime;
+        ((double*)vnecDataBuffers[1])[file.records-1] = vn;
+        ((double*)vnecDataBuffers[2])[file.records-1] = ve;
+        ((double*)vnecDataBuffers[3])[file.records-1] = vc;
     }
+    if (status != SAT_VEL_END_OF_FILE)
+        goto cleanup;
 
-    if (records != epochs)
+    if (file.records != file.epochs)
     {
         status = SAT_VEL_ERROR_WRONG_NUMBER_OF_RECORDS_READ;
         goto cleanup;
     }
 
-    *nVnecRecs = records;
+    *nVnecRecs = file.records;
     status = SAT_VEL_OK;
 
 cleanup:
+    closeSatelliteVelocity(&file);
 
-    fclose(modFP);
     return status;
 
 }
-
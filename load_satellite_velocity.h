@@ -22,6 +22,7 @@
 #define _LOAD_SATELLITE_VELOCITY_H
 
 #include <stdint.h>
+#include <stdio.h>
 
 enum SAT_VEL_ERRORS {
     SAT_VEL_OK = 0,
@@ -29,9 +30,26 @@ enum SAT_VEL_ERRORS {
     SAT_VEL_ERROR_UNAVAILABLE = -2,
     SAT_VEL_ERROR_TOO_FEW_EPOCHS = -3,
     SAT_VEL_ERROR_MEMORY = -4,
-    SAT_VEL_ERROR_WRONG_NUMBER_OF_RECORDS_READ = -5
+    SAT_VEL_ERROR_WRONG_NUMBER_OF_RECORDS_READ = -5,
+    SAT_VEL_END_OF_FILE = -6
 };
 
+// A MODx file read one record at a time, for inputs read a window at a time
+typedef struct satelliteVelocityFile {
+    FILE *fp;
+    long epochs; // Number of epochs given in the header
+    long records; // Records read so far
+    double gpsTimeOffset;
+    long dataOffset; // File position of the first record
+} SatelliteVelocityFile;
+
+int openSatelliteVelocity(const char *modFilename, SatelliteVelocityFile *file);
+// Reads the next record as CDF_EPOCH and VNEC. Returns SAT_VEL_END_OF_FILE after the last record.
+int nextSatelliteVelocity(SatelliteVelocityFile *file, double *cdfTime, double *vn, double *ve, double *vc);
+// Returns to the first record
+int rewindSatelliteVelocity(SatelliteVelocityFile *file);
+void closeSatelliteVelocity(SatelliteVelocityFile *file);
+
 // Using long to be consistent with CDF epoch parsing in slidem.c
 int loadSatelliteVelocity(const char *modFilename, uint8_t **vnecDataBuffers, long *nVnecRecs);
 
@@ -33,6 +33,7 @@
 #include <stdbool.h>
 #include <time.h>
 #include <unistd.h>
+#include <errno.h>
 
 #include "load_inputs.h"
 #include "utilities.h"
@@ -44,7 +45,14 @@
 #include "calculate_diplatitude.h"
 #include "calculate_products.h"
 #include "post_process.h"
+#include "pass_index.h"
+#include "boundary_cache.h"
 #include "export_products.h"
+#include "stream_products.h"
+#include "incremental.h"
+#include "zip_archive.h"
+#include "input_cache.h"
+#include "sweep.h"
 #include "write_header.h"
 
 #include "f107.h"
@@ -58,6 +66,59 @@
 
 char infoHeader[50];
 
+// Writes the HDR file for L2 archiving and stores it with the CDF file in the ZIP file
+static void archiveSlidemProducts(const char *slidemFilename, const char *slidemFullFilename, const char *fpFilename, const char *hmFilename, const char *modFilename, const char *modFilenamePrevious, const char *magFilename, time_t processingStartTime, double firstMeasurementTime, double lastMeasurementTime, long nVnecRecsPrev, bool columnSidecar)
+{
+    time_t processingStopTime = time(NULL);
+    char *headerText = NULL;
+    size_t headerLength = 0;
+    int status = writeSlidemHeader(slidemFilename, fpFilename, hmFilename, modFilename, modFilenamePrevious, magFilename, processingStartTime, firstMeasurementTime, lastMeasurementTime, nVnecRecsPrev, &headerText, &headerLength);
+
+    if (status != HEADER_OK)
+    {
+        fprintf(stdout, "%sError writing HDR file.\n", infoHeader);
+        return;
+    }
+
+    // The sidecar is optional: the product is still archived if it cannot be written
+    if (columnSidecar)
+        exportSlidemColumnFile(slidemFilename);
+
+    // Archive the CDF and HDR files in a ZIP file
+    char cdfFilename[FILENAME_MAX];
+    char entryName[FILENAME_MAX];
+    snprintf(cdfFilename, FILENAME_MAX, "%s.cdf", slidemFilename);
+    const char *baseFilename = slidemFilename + strlen(slidemFilename) - SLIDEM_BASE_FILENAME_LENGTH;
+    ZipArchive zip;
+    int zipStatus = openZipArchive(&zip, slidemFullFilename, processingStopTime);
+    if (zipStatus == ZIP_ARCHIVE_OK)
+    {
+        snprintf(entryName, FILENAME_MAX, "%s.HDR", baseFilename);
+        zipStatus = addZipBuffer(&zip, entryName, headerText, headerLength);
+    }
+    if (zipStatus == ZIP_ARCHIVE_OK)
+    {
+        snprintf(entryName, FILENAME_MAX, "%s.cdf", baseFilename);
+        zipStatus = addZipFile(&zip, entryName, cdfFilename);
+    }
+    if (zipStatus == ZIP_ARCHIVE_OK)
+        zipStatus = closeZipArchive(&zip);
+    else
+        abortZipArchive(&zip);
+    free(headerText);
+    if (zipStatus == ZIP_ARCHIVE_OK)
+    {
+        unlink(cdfFilename);
+        fprintf(stdout, "%sStored HDR and CDF files in %s.ZIP\n", infoHeader, slidemFilename);
+    }
+    else
+    {
+        fprintf(stderr, "%sFailed to archive HDR and CDF files.\n", infoHeader);
+    }
+
+    return;
+}
+
 int main(int argc, char* argv[])
 {
 
@@ -65,6 +126,69 @@ int main(int argc, char* argv[])
 
     fprintf(stdout, "SLIDEM Swarm Langmuir Probe Ion Drift, Density and Effective Mass processor.\n");
 
+    // Options may appear anywhere. Remove them so that the positional arguments keep their places.
+    bool streamingMode = false;
+    bool incrementalMode = false;
+    bool finalizeDay = false;
+    bool benchmarkExport = false;
+    bool columnSidecar = false;
+    char *inputCacheDir = NULL;
+    char *cacheDirOption = NULL;
+    char *sweepFilename = NULL;
+    ExportLayout layout = exportLayout();
+    int nArgs = 1;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--streaming") == 0)
+            streamingMode = true;
+        else if (strcmp(argv[i], "--incremental") == 0)
+            incrementalMode = true;
+        else if (strcmp(argv[i], "--finalize") == 0)
+            finalizeDay = true;
+        else if (strcmp(argv[i], "--benchmark-export") == 0)
+            benchmarkExport = true;
+        else if (strcmp(argv[i], "--column-sidecar") == 0)
+            columnSidecar = true;
+        else if (strncmp(argv[i], "--input-cache=", 14) == 0 && strlen(argv[i]) > 14)
+            inputCacheDir = argv[i] + 14;
+        else if (strncmp(argv[i], "--cache-dir=", 12) == 0 && strlen(argv[i]) > 12)
+            cacheDirOption = argv[i] + 12;
+        else if (strncmp(argv[i], "--sweep=", 8) == 0 && strlen(argv[i]) > 8)
+            sweepFilename = argv[i] + 8;
+        else if (strncmp(argv[i], "--compression=", 14) == 0)
+        {
+            if (parseExportCompression(argv[i] + 14, &layout) != 0)
+            {
+                fprintf(stdout, "Unable to parse %s. Exiting.\n", argv[i]);
+                exit(1);
+            }
+        }
+        else if (strncmp(argv[i], "--blocking-factor=", 18) == 0)
+        {
+            char *end = NULL;
+            errno = 0;
+            layout.blockingFactor = strtol(argv[i] + 18, &end, 10);
+            if (errno != 0 || end == argv[i] + 18 || *end != '\0' || layout.blockingFactor < 0)
+            {
+                fprintf(stdout, "Unable to parse %s. Exiting.\n", argv[i]);
+                exit(1);
+            }
+        }
+        else
+            argv[nArgs++] = argv[i];
+    }
+    argc = nArgs;
+    setExportLayout(layout);
+    // Input files grow under the same names during the day, and streaming reads them a window at a time
+    if (incrementalMode || streamingMode)
+        inputCacheDir = NULL;
+    // The benchmark and the parameter sweep need the whole day's products in memory
+    if (benchmarkExport || sweepFilename != NULL)
+    {
+        streamingMode = false;
+        incrementalMode = false;
+    }
+
     for (int i = 1; i < argc; i++)
     {
         if (strcmp(argv[i], "--about") == 0)
@@ -87,6 +211,16 @@ int main(int argc, char* argv[])
         }
         fprintf(stdout, "\"\n");
         fprintf(stdout, "usage:\tslidem satellite yyyymmdd lpDirectory modDirectory magDirectory exportDirectory\n\t\tprocesses Swarm LP data to generate SLIDEM product for specified satellite and date.\n");
+        fprintf(stdout, "\toptions:\n\t\t--streaming\tread inputs and calculate and export products about one orbit at a time, so that memory scales with an orbit rather than the day.\n");
+        fprintf(stdout, "\t\t--incremental\tprocess only the passes added to the input files since the previous run, appending to the SLIDEM CDF.\n");
+        fprintf(stdout, "\t\t--finalize\twith --incremental, treat the input files as complete even if the next day's LP_HM file is not yet available.\n");
+        fprintf(stdout, "\t\t--compression=codec\tCDF variable compression: none, rle, huff, ahuff or gzip[:level] (default gzip:%ld).\n", CDF_GZIP_COMPRESSION_LEVEL);
+        fprintf(stdout, "\t\t--blocking-factor=n\tCDF variable blocking factor, 0 for the CDF library default (default %ld).\n", CDF_BLOCKING_FACTOR);
+        fprintf(stdout, "\t\t--benchmark-export\treport export time, file size and read time for a matrix of compression settings instead of exporting.\n");
+        fprintf(stdout, "\t\t--input-cache=dir\treuse HM-aligned inputs cached in dir by an earlier run with the same input files, caching them otherwise. Ignored with --streaming and --incremental.\n");
+        fprintf(stdout, "\t\t--cache-dir=dir\tdirectory for the adjacent-day boundary caches and CDF skeletons (default $HOME/.cache/%s).\n", SLIDEM_CACHE_DIRECTORY_NAME);
+        fprintf(stdout, "\t\t--sweep=file\tevaluate products for each modified OML parameter set in file (radiusModifier alpha bravo charlie per line), writing summary statistics to a .sweep file instead of exporting.\n");
+        fprintf(stdout, "\t\t--column-sidecar\talso write the product variables uncompressed to a memory-mappable .col file next to the ZIP file.\n");
         fprintf(stdout, "\tslidem --about\n\t\tprints version and license information.\n");
         exit(1);
     }
@@ -119,6 +253,14 @@ int main(int argc, char* argv[])
         exit(1);
     }
 
+    // Boundary caches and CDF skeletons are kept out of the export directory
+    char cacheDir[FILENAME_MAX];
+    bool useCacheDirectory = slidemCacheDirectory(cacheDirOption, cacheDir, FILENAME_MAX) == UTIL_NO_ERROR;
+    if (useCacheDirectory)
+        setSkeletonDirectory(cacheDir);
+    else
+        fprintf(stdout, "%sUnable to use a cache directory. Not using boundary caches or CDF skeletons.\n", infoHeader);
+
     char fpFilename[FILENAME_MAX];
     if (getInputFilename(satellite, year, month, day, lppath, "LP_FP", fpFilename))
     {
@@ -160,7 +302,8 @@ int main(int argc, char* argv[])
     // Exit if SLIDEM CDF file exists.
     char slidemFullFilename[FILENAME_MAX];
     sprintf(slidemFullFilename, "%s.ZIP", slidemFilename);
-    if (access(slidemFullFilename, F_OK) == 0)
+    // A sweep does not export, so it can be run on days already processed
+    if (sweepFilename == NULL && access(slidemFullFilename, F_OK) == 0)
     {
         fprintf(stdout, "%sSLIDEM CDF file exists. Skipping this date.\n", infoHeader);
         exit(1);
@@ -227,6 +370,8 @@ int main(int argc, char* argv[])
 
     CDFstatus status;
 
+    PassIndex passIndex = {0};
+
     // Turn off GSL failsafe error handler. We typically check the GSL return codes.
     gsl_set_error_handler_off();
 
@@ -240,10 +385,6 @@ int main(int argc, char* argv[])
     {
         fpDataBuffers[i] = NULL;
     }
-    long nFp16HzRecs = 0;
-    loadInputs(fpFilename, fpVariables, NUM_FP_VARIABLES, fpDataBuffers, &nFp16HzRecs);
-    fflush(stdout);
-
     char *hmVariables[NUM_HM_VARIABLES] = {
         "Timestamp",
         "Latitude",
@@ -267,20 +408,9 @@ int main(int argc, char* argv[])
     {
         hmDataBuffers[i] = NULL;
     }
+    long hmDataTypes[NUM_HM_VARIABLES];
+    size_t hmRecordSizes[NUM_HM_VARIABLES] = {0};
     long nHmRecs = 0;
-    loadInputs(hmFilename, hmVariables, NUM_HM_VARIABLES, hmDataBuffers, &nHmRecs);
-    // Convert heights from km to m
-    // Ensure longitude is within the range -180 to +180
-    for (long hmTimeIndex = 0; hmTimeIndex < nHmRecs; hmTimeIndex++)
-    {
-        ((double*)hmDataBuffers[4])[hmTimeIndex] = 1000. * HEIGHT();
-        if (LON() > 180.0)
-            ((double*)hmDataBuffers[2])[hmTimeIndex] = LON() - 360.0;
-        if (LON() < -180.0)
-            ((double*)hmDataBuffers[2])[hmTimeIndex] = LON() + 360.0;
-    }
-
-    // Magnetic field for dip latitude calculation
     char *magVariables[NUM_MAG_VARIABLES] = {
         "Timestamp",
         "B_NEC",
@@ -292,183 +422,323 @@ int main(int argc, char* argv[])
     {
         magDataBuffers[i] = NULL;
     }
-    long nMagRecs = 0;
-    loadInputs(magFilename, magVariables, NUM_MAG_VARIABLES, magDataBuffers, &nMagRecs);
-    if (nMagRecs == 0)
-    {
-        fprintf(stdout, "%sUnable to load magnetic field. Skipping this date.\n", infoHeader);
-        goto cleanup;
-
-    }
-    double * dipLat = (double*)malloc((size_t)(sizeof(double) * nMagRecs));
-    long nDipLatRecs = nMagRecs;
-    calculateDipLatitude(magDataBuffers, nMagRecs, dipLat);
-
-    // Satellite velocity
     uint8_t * vnecDataBuffers[4];
     for (uint8_t i = 0; i < 4; i++)
     {
         vnecDataBuffers[i] = NULL;
     }
-    long nVnecRecs = 0, nVnecRecsPrev = 0;
-    if(loadSatelliteVelocity(modFilename, vnecDataBuffers, &nVnecRecs))
+    long nFp16HzRecs = 0, nMagRecs = 0, nVnecRecs = 0, nVnecRecsPrev = 0;
+    double *dipLat = NULL;
+    double *fpCurrent = NULL;
+    double *vn = NULL;
+    double *ve = NULL;
+    double *vc = NULL;
+    double *dipLatitude = NULL;
+    // Every pointer freed at cleanup is initialised before the first goto
+    double *fpVoltage = NULL;
+    double *ionEffectiveMass = NULL;
+    double *ionDensity = NULL;
+    double *ionDriftRaw = NULL;
+    double *ionDrift = NULL;
+    double *ionEffectiveMassError = NULL;
+    double *ionDensityError = NULL;
+    double *ionDriftError = NULL;
+    double *fpAreaOML = NULL;
+    double *rProbeOML = NULL;
+    double *electronTemperature = NULL;
+    double *spacecraftPotential = NULL;
+    uint32_t *electronTemperatureSource = NULL;
+    uint32_t *spacecraftPotentialSource = NULL;
+    double *ionEffectiveMassTTS = NULL;
+    uint32_t *mieffFlags = NULL;
+    uint32_t *viFlags = NULL;
+    uint32_t *niFlags = NULL;
+    uint16_t *iterationCount = NULL;
+
+    // Boundary caches of this day and the adjacent days
+    long yearnext, monthnext, daynext, hournext, minutenext, secondnext, msecnext;
+    EPOCHbreakdown(beginTime + 86400000, &yearnext, &monthnext, &daynext, &hournext, &minutenext, &secondnext, &msecnext);
+    bool useBoundaryCaches = useCacheDirectory;
+    char boundaryCacheFilenameToday[FILENAME_MAX];
+    char boundaryFilenamePrevious[CDF_PATHNAME_LEN+1];
+    char boundaryFilenameNext[CDF_PATHNAME_LEN+1];
+    char boundaryCacheFilenamePrevious[FILENAME_MAX];
+    char boundaryCacheFilenameNext[FILENAME_MAX];
+    double adjacentBeginTime, adjacentEndTime;
+    constructExportFileName(satellite, yearprev, monthprev, dayprev, exportDir, &adjacentBeginTime, &adjacentEndTime, boundaryFilenamePrevious);
+    constructExportFileName(satellite, yearnext, monthnext, daynext, exportDir, &adjacentBeginTime, &adjacentEndTime, boundaryFilenameNext);
+    if (useBoundaryCaches)
+    {
+        boundaryCacheFilename(cacheDir, slidemFilename, boundaryCacheFilenameToday, FILENAME_MAX);
+        boundaryCacheFilename(cacheDir, boundaryFilenamePrevious, boundaryCacheFilenamePrevious, FILENAME_MAX);
+        boundaryCacheFilename(cacheDir, boundaryFilenameNext, boundaryCacheFilenameNext, FILENAME_MAX);
+    }
+
+    // Calculate SLIDEM products
+    long numberOfSlidemEstimates = 0;
+    double firstMeasurementTime = 0.0;
+    double lastMeasurementTime = 0.0;
+
+    if (incrementalMode)
+    {
+        // Only the passes added since the previous run are read, processed and appended.
+        // Input files grow during the day; they are complete once they reach the end of the day,
+        // or once the next day's HM file exists, for days with a data gap at the end.
+        char hmFilenameNext[FILENAME_MAX];
+        bool inputsComplete = finalizeDay || getInputFilename(satellite, yearnext, monthnext, daynext, lppath, "LP_HM", hmFilenameNext) == 0;
+        bool dayComplete = false;
+        long nNewRecords = 0;
+        int incrementalStatus = processIncrement(slidemFilename, slidemFullFilename, satellite, hmVariables, fpFilename, hmFilename, modFilename, modFilenamePrevious, magFilename, useBoundaryCaches ? boundaryCacheFilenameToday : NULL, useBoundaryCaches ? boundaryCacheFilenamePrevious : NULL, useBoundaryCaches ? boundaryCacheFilenameNext : NULL, inputsComplete, endTime, f107Adj, yday, sphericalProbeParams, &dayComplete, &firstMeasurementTime, &lastMeasurementTime, &nVnecRecsPrev, &numberOfSlidemEstimates, &nNewRecords);
+        if (incrementalStatus == INCREMENTAL_INPUTS)
+            fprintf(stdout, "%sUnable to read input data. Skipping this date.\n", infoHeader);
+        else if (incrementalStatus != INCREMENTAL_OK)
+            fprintf(stdout, "%sIncremental processing failed. Not generating metainfo.\n", infoHeader);
+        else if (!dayComplete)
+            fprintf(stdout, "%sAppended %ld records. Input files are incomplete; not archiving.\n", infoHeader, nNewRecords);
+        else
+            archiveSlidemProducts(slidemFilename, slidemFullFilename, fpFilename, hmFilename, modFilename, modFilenamePrevious, magFilename, processingStartTime, firstMeasurementTime, lastMeasurementTime, nVnecRecsPrev, columnSidecar);
+        goto cleanup;
+    }
+
+    if (streamingMode)
     {
-        fprintf(stdout, "%sUnable to load satellite velocity. Skipping this date.\n", infoHeader);
+        // Inputs are read and products calculated, post-processed and exported about one orbit at a time
+        int streamStatus = streamProducts(slidemFilename, slidemFullFilename, satellite, hmVariables, fpFilename, hmFilename, modFilename, modFilenamePrevious, magFilename, useBoundaryCaches ? boundaryCacheFilenameToday : NULL, useBoundaryCaches ? boundaryCacheFilenamePrevious : NULL, useBoundaryCaches ? boundaryCacheFilenameNext : NULL, f107Adj, yday, sphericalProbeParams, &firstMeasurementTime, &lastMeasurementTime, &nVnecRecsPrev, &numberOfSlidemEstimates);
+        if (streamStatus == STREAM_INPUTS)
+            fprintf(stdout, "%sUnable to read input data. Skipping this date.\n", infoHeader);
+        else if (streamStatus != STREAM_OK)
+            fprintf(stdout, "%sCDF export failed. Not generating metainfo.\n", infoHeader);
+        else
+            archiveSlidemProducts(slidemFilename, slidemFullFilename, fpFilename, hmFilename, modFilename, modFilenamePrevious, magFilename, processingStartTime, firstMeasurementTime, lastMeasurementTime, nVnecRecsPrev, columnSidecar);
         goto cleanup;
     }
-    // Previous date
-    uint8_t * vnecDataBuffersPrev[4];
-    for (uint8_t i = 0; i < 4; i++)
+
+    // HM-aligned inputs cached by an earlier run with the same input files skip reading, downsampling and interpolation
+    char cacheKey[INPUT_CACHE_KEY_LENGTH];
+    char inputCacheFile[FILENAME_MAX];
+    bool inputsFromCache = false;
+    if (inputCacheDir != NULL && inputCacheKey(fpFilename, hmFilename, modFilename, modFilenamePrevious, magFilename, cacheKey, INPUT_CACHE_KEY_LENGTH) != INPUT_CACHE_OK)
     {
-        vnecDataBuffersPrev[i] = NULL;
+        fprintf(stdout, "%sInput file names are too long for the input cache key. Not using the input cache.\n", infoHeader);
+        inputCacheDir = NULL;
     }
-    // Previous day used if available but not required, so do not exit if could not read velocities
-    loadSatelliteVelocity(modFilenamePrevious, vnecDataBuffersPrev, &nVnecRecsPrev);
-    if (nVnecRecsPrev > 0)
+    if (inputCacheDir != NULL)
     {
-        for (uint8_t i = 0; i < 4; i++)
+        inputCacheFilename(inputCacheDir, slidemFilename, cacheKey, inputCacheFile, FILENAME_MAX);
+        int cacheStatus = readInputCache(inputCacheFile, cacheKey, hmVariables, NUM_HM_VARIABLES, hmDataBuffers, hmDataTypes, hmRecordSizes, &nHmRecs, &fpCurrent, &vn, &ve, &vc, &dipLatitude, &nVnecRecsPrev);
+        if (cacheStatus == INPUT_CACHE_OK)
         {
-            vnecDataBuffersPrev[i] = (uint8_t*) realloc(vnecDataBuffersPrev[i], (size_t) sizeof(double)*(nVnecRecsPrev + nVnecRecs));
-            memcpy(vnecDataBuffersPrev[i] + (size_t)(sizeof(double)*nVnecRecsPrev), vnecDataBuffers[i], (size_t)(sizeof(double)*nVnecRecs));
-            free(vnecDataBuffers[i]);
-            vnecDataBuffers[i] = vnecDataBuffersPrev[i];
+            inputsFromCache = true;
+            fprintf(stdout, "%sRead %ld s of HM-aligned inputs from %s\n", infoHeader, nHmRecs / 2, inputCacheFile);
         }
-        nVnecRecs += nVnecRecsPrev;
+        else if (cacheStatus == INPUT_CACHE_MISMATCH)
+            fprintf(stdout, "%sIgnoring incompatible input cache %s\n", infoHeader, inputCacheFile);
     }
 
-    // Update radius variable
-    for (long hmTimeIndex = 0; hmTimeIndex < nHmRecs; hmTimeIndex++)
+    if (!inputsFromCache)
     {
-        //(*((double*)hmDataBuffers[3]+(hmTimeIndex))) = RADIUS() * 1000.0; // m
-    	// Radius is 0 in recent LP files. Temporary workaround:
-        (*((double*)hmDataBuffers[3]+(hmTimeIndex))) = (6371.0 * 1000.0 + HEIGHT()); // m
-    }
+        loadInputs(fpFilename, fpVariables, NUM_FP_VARIABLES, fpDataBuffers, &nFp16HzRecs, NULL, NULL);
+        fflush(stdout);
+
+        loadInputs(hmFilename, hmVariables, NUM_HM_VARIABLES, hmDataBuffers, &nHmRecs, hmDataTypes, hmRecordSizes);
+        // Convert heights from km to m
+        // Ensure longitude is within the range -180 to +180
+        for (long hmTimeIndex = 0; hmTimeIndex < nHmRecs; hmTimeIndex++)
+        {
+            ((double*)hmDataBuffers[4])[hmTimeIndex] = 1000. * HEIGHT();
+            if (LON() > 180.0)
+                ((double*)hmDataBuffers[2])[hmTimeIndex] = LON() - 360.0;
+            if (LON() < -180.0)
+                ((double*)hmDataBuffers[2])[hmTimeIndex] = LON() + 360.0;
+        }
+
+        // Magnetic field for dip latitude calculation
+        loadInputs(magFilename, magVariables, NUM_MAG_VARIABLES, magDataBuffers, &nMagRecs, NULL, NULL);
+        if (nMagRecs == 0)
+        {
+            fprintf(stdout, "%sUnable to load magnetic field. Skipping this date.\n", infoHeader);
+            goto cleanup;
+
+        }
+        dipLat = (double*)malloc((size_t)(sizeof(double) * nMagRecs));
+        long nDipLatRecs = nMagRecs;
+        calculateDipLatitude(magDataBuffers, nMagRecs, dipLat);
+
+        // Satellite velocity
+        if(loadSatelliteVelocity(modFilename, vnecDataBuffers, &nVnecRecs))
+        {
+            fprintf(stdout, "%sUnable to load satellite velocity. Skipping this date.\n", infoHeader);
+            goto cleanup;
+        }
+        // Previous date
+        uint8_t * vnecDataBuffersPrev[4];
+        for (uint8_t i = 0; i < 4; i++)
+        {
+            vnecDataBuffersPrev[i] = NULL;
+        }
+        // Previous day used if available but not required, so do not exit if could not read velocities
+        loadSatelliteVelocity(modFilenamePrevious, vnecDataBuffersPrev, &nVnecRecsPrev);
+        if (nVnecRecsPrev > 0)
+        {
+            for (uint8_t i = 0; i < 4; i++)
+            {
+                vnecDataBuffersPrev[i] = (uint8_t*) realloc(vnecDataBuffersPrev[i], (size_t) sizeof(double)*(nVnecRecsPrev + nVnecRecs));
+                memcpy(vnecDataBuffersPrev[i] + (size_t)(sizeof(double)*nVnecRecsPrev), vnecDataBuffers[i], (size_t)(sizeof(double)*nVnecRecs));
+                free(vnecDataBuffers[i]);
+                vnecDataBuffers[i] = vnecDataBuffersPrev[i];
+            }
+            nVnecRecs += nVnecRecsPrev;
+        }
+
+        // Update radius variable
+        for (long hmTimeIndex = 0; hmTimeIndex < nHmRecs; hmTimeIndex++)
+        {
+            //(*((double*)hmDataBuffers[3]+(hmTimeIndex))) = RADIUS() * 1000.0; // m
+        	// Radius is 0 in recent LP files. Temporary workaround:
+            (*((double*)hmDataBuffers[3]+(hmTimeIndex))) = (6371.0 * 1000.0 + HEIGHT()); // m
+        }
  
-    // Number of records obtained for this date
-    fprintf(stdout, "%sRead input data. FP: %ld s HM: %ld s VNEC: %ld s MAG: %ld s.\n", infoHeader, nFp16HzRecs / 16, nHmRecs / 2, nVnecRecs, nMagRecs);
-    fflush(stdout);
+        // Number of records obtained for this date
+        fprintf(stdout, "%sRead input data. FP: %ld s HM: %ld s VNEC: %ld s MAG: %ld s.\n", infoHeader, nFp16HzRecs / 16, nHmRecs / 2, nVnecRecs, nMagRecs);
+        fflush(stdout);
 
-    if (nHmRecs == 0 || nFp16HzRecs == 0 || nVnecRecs == 0)
+        if (nHmRecs == 0 || nFp16HzRecs == 0 || nVnecRecs == 0)
+        {
+            fprintf(stdout, "%sError: one or more input files does not have records. Skipping this date.\n", infoHeader);
+            fflush(stdout);
+            goto cleanup;
+        }
+
+        // Downsample Faceplate data
+        long nFpRecs = nFp16HzRecs;
+        downSample(fpDataBuffers, NUM_FP_VARIABLES, &nFpRecs);
+
+        fpCurrent = (double*) malloc((size_t) (nHmRecs * sizeof(double)));
+        // If there are no measurements within 0.5 s of the HM input time, this sets fpCurrent to NaN.
+        interpolateFpCurrent(fpDataBuffers, nFpRecs, hmDataBuffers, nHmRecs, fpCurrent);
+        fprintf(stdout, "%sDownsampled and interpolated FP current to HM times.\n", infoHeader);
+
+        // Interpolate satellite V NEC data
+        vn = (double*) malloc((size_t) (nHmRecs * sizeof(double)));
+        ve = (double*) malloc((size_t) (nHmRecs * sizeof(double)));
+        vc = (double*) malloc((size_t) (nHmRecs * sizeof(double)));
+        interpolateVNEC(vnecDataBuffers, nVnecRecs, hmDataBuffers, nHmRecs, vn, 1);
+        interpolateVNEC(vnecDataBuffers, nVnecRecs, hmDataBuffers, nHmRecs, ve, 2);
+        interpolateVNEC(vnecDataBuffers, nVnecRecs, hmDataBuffers, nHmRecs, vc, 3);
+        fprintf(stdout, "%sInterpolated VNEC to HM times.\n", infoHeader);
+    
+        // Interpolate dip latitude to 2 Hz HM times
+        dipLatitude = (double*) malloc((size_t) (nHmRecs * sizeof(double)));
+        interpolateDipLatitude((double*)magDataBuffers[0], dipLat, nDipLatRecs, hmDataBuffers, nHmRecs, dipLatitude);
+        fprintf(stdout, "%sInterpolated dip latitude to HM times.\n", infoHeader);
+
+        if (inputCacheDir != NULL && writeInputCache(inputCacheFile, cacheKey, nVnecRecsPrev, hmVariables, NUM_HM_VARIABLES, hmDataBuffers, hmDataTypes, hmRecordSizes, nHmRecs, fpCurrent, vn, ve, vc, dipLatitude) != INPUT_CACHE_OK)
+            fprintf(stdout, "%sUnable to write input cache %s\n", infoHeader, inputCacheFile);
+    }
+
+    // Cache this day's boundary windows for the adjacent days, then extend with theirs
+    // so that fit regions straddling midnight can be completed
+    if (useBoundaryCaches && writeBoundaryCache(boundaryCacheFilenameToday, hmVariables, NUM_HM_VARIABLES, hmDataBuffers, hmDataTypes, hmRecordSizes, nHmRecs, fpCurrent, vn, ve, vc, dipLatitude, SECONDS_OF_BOUNDARY_DATA_REQUIRED_FOR_PROCESSING) != BOUNDARY_CACHE_OK)
+        fprintf(stdout, "%sUnable to write boundary cache.\n", infoHeader);
+    long nBoundaryRecsPrev = 0, nBoundaryRecsNext = 0;
+    if (addBoundaryData(useBoundaryCaches ? boundaryCacheFilenamePrevious : NULL, useBoundaryCaches ? boundaryCacheFilenameNext : NULL, hmVariables, NUM_HM_VARIABLES, hmDataBuffers, hmRecordSizes, &nHmRecs, &fpCurrent, &vn, &ve, &vc, &dipLatitude, &nBoundaryRecsPrev, &nBoundaryRecsNext) != BOUNDARY_CACHE_OK)
     {
-        fprintf(stdout, "%sError: one or more input files does not have records. Skipping this date.\n", infoHeader);
-        fflush(stdout);
+        fprintf(stdout, "%sUnable to add boundary data from adjacent days. Skipping this date.\n", infoHeader);
         goto cleanup;
     }
+    fprintf(stdout, "%sAdded boundary data: previous day %ld s, next day %ld s.\n", infoHeader, nBoundaryRecsPrev / 2, nBoundaryRecsNext / 2);
+    // Records of this day in the extended arrays
+    long dayRecOffset = nBoundaryRecsPrev;
+    long nDayRecs = nHmRecs - nBoundaryRecsPrev - nBoundaryRecsNext;
 
-    // Downsample Faceplate data
-    long nFpRecs = nFp16HzRecs;
-    downSample(fpDataBuffers, NUM_FP_VARIABLES, &nFpRecs);
-
-    double *fpCurrent = (double*) malloc((size_t) (nHmRecs * sizeof(double)));
-    // If there are no measurements within 0.5 s of the HM input time, this sets fpCurrent to NaN.
-    interpolateFpCurrent(fpDataBuffers, nFpRecs, hmDataBuffers, nHmRecs, fpCurrent);
-    fprintf(stdout, "%sDownsampled and interpolated FP current to HM times.\n", infoHeader);
+    // Orbit and pass segmentation shared by post-processing and export
+    if (buildPassIndex(&passIndex, hmDataBuffers, nHmRecs) != PASS_INDEX_OK)
+    {
+        fprintf(stdout, "%sUnable to build pass index. Skipping this date.\n", infoHeader);
+        goto cleanup;
+    }
 
-    double *fpVoltage = (double*) malloc((size_t) (nHmRecs * sizeof(double)));
+    fpVoltage = (double*) malloc((size_t) (nHmRecs * sizeof(double)));
     for (long i = 0; i < nHmRecs; i++)
     {
         //for now assume -3.5 V 
         fpVoltage[i] = FACEPLATE_VOLTAGE;
     }    
 
-    // Interpolate satellite V NEC data
-    double *vn = (double*) malloc((size_t) (nHmRecs * sizeof(double)));
-    double *ve = (double*) malloc((size_t) (nHmRecs * sizeof(double)));
-    double *vc = (double*) malloc((size_t) (nHmRecs * sizeof(double)));
-    interpolateVNEC(vnecDataBuffers, nVnecRecs, hmDataBuffers, nHmRecs, vn, 1);
-    interpolateVNEC(vnecDataBuffers, nVnecRecs, hmDataBuffers, nHmRecs, ve, 2);
-    interpolateVNEC(vnecDataBuffers, nVnecRecs, hmDataBuffers, nHmRecs, vc, 3);
-    fprintf(stdout, "%sInterpolated VNEC to HM times.\n", infoHeader);
-    
-    // Interpolate dip latitude to 2 Hz HM times
-    double *dipLatitude = (double*) malloc((size_t) (nHmRecs * sizeof(double)));
-    interpolateDipLatitude((double*)magDataBuffers[0], dipLat, nDipLatRecs, hmDataBuffers, nHmRecs, dipLatitude);
-    fprintf(stdout, "%sInterpolated dip latitude to HM times.\n", infoHeader);
-    
-    // Calculate SLIDEM products
-    double *ionEffectiveMass = malloc((size_t) (nHmRecs * sizeof(double)));
-    double *ionDensity = malloc((size_t) (nHmRecs * sizeof(double)));
-    double *ionDriftRaw = malloc((size_t) (nHmRecs * sizeof(double)));
-    double *ionDrift = malloc((size_t) (nHmRecs * sizeof(double)));
-    double *ionEffectiveMassError = malloc((size_t) (nHmRecs * sizeof(double)));
-    double *ionDensityError = malloc((size_t) (nHmRecs * sizeof(double)));
-    double *ionDriftError = malloc((size_t) (nHmRecs * sizeof(double)));
-    double *fpAreaOML = malloc((size_t) (nHmRecs * sizeof(double)));
-    double *rProbeOML = malloc((size_t) (nHmRecs * sizeof(double)));
-    double *electronTemperature = malloc((size_t) (nHmRecs * sizeof(double)));
-    double *spacecraftPotential = malloc((size_t) (nHmRecs * sizeof(double)));
-    uint32_t *electronTemperatureSource = malloc((size_t) (nHmRecs * sizeof(uint32_t)));
-    uint32_t *spacecraftPotentialSource = malloc((size_t) (nHmRecs * sizeof(uint32_t)));
-    double *ionEffectiveMassTTS = malloc((size_t) (nHmRecs * sizeof(double)));
-    uint32_t *mieffFlags = malloc((size_t) (nHmRecs * sizeof(uint32_t)));
-    uint32_t *viFlags = malloc((size_t) (nHmRecs * sizeof(uint32_t)));
-    uint32_t *niFlags = malloc((size_t) (nHmRecs * sizeof(uint32_t)));
-    uint16_t *iterationCount = malloc((size_t) (nHmRecs * sizeof(uint16_t)));
-    long numberOfSlidemEstimates = 0;
+    if (sweepFilename != NULL)
+    {
+        // Inputs, pass index and fit regions are shared by all parameter sets
+        char summaryFilename[FILENAME_MAX];
+        snprintf(summaryFilename, FILENAME_MAX, "%s%s", slidemFilename, SWEEP_SUMMARY_EXTENSION);
+        int sweepStatus = runParameterSweep(sweepFilename, summaryFilename, satellite, hmDataBuffers, nHmRecs, dayRecOffset, nDayRecs, fpCurrent, vn, ve, vc, dipLatitude, fpVoltage, f107Adj, yday, &passIndex);
+        if (sweepStatus != SWEEP_OK)
+            fprintf(stdout, "%sParameter sweep failed with status %d.\n", infoHeader, sweepStatus);
+        else
+            fprintf(stdout, "%sWrote parameter sweep summary to %s\n", infoHeader, summaryFilename);
+        goto cleanup;
+    }
+
+    ionEffectiveMass = malloc((size_t) (nHmRecs * sizeof(double)));
+    ionDensity = malloc((size_t) (nHmRecs * sizeof(double)));
+    ionDriftRaw = malloc((size_t) (nHmRecs * sizeof(double)));
+    ionDrift = malloc((size_t) (nHmRecs * sizeof(double)));
+    ionEffectiveMassError = malloc((size_t) (nHmRecs * sizeof(double)));
+    ionDensityError = malloc((size_t) (nHmRecs * sizeof(double)));
+    ionDriftError = malloc((size_t) (nHmRecs * sizeof(double)));
+    fpAreaOML = malloc((size_t) (nHmRecs * sizeof(double)));
+    rProbeOML = malloc((size_t) (nHmRecs * sizeof(double)));
+    electronTemperature = malloc((size_t) (nHmRecs * sizeof(double)));
+    spacecraftPotential = malloc((size_t) (nHmRecs * sizeof(double)));
+    electronTemperatureSource = malloc((size_t) (nHmRecs * sizeof(uint32_t)));
+    spacecraftPotentialSource = malloc((size_t) (nHmRecs * sizeof(uint32_t)));
+    ionEffectiveMassTTS = malloc((size_t) (nHmRecs * sizeof(double)));
+    mieffFlags = malloc((size_t) (nHmRecs * sizeof(uint32_t)));
+    viFlags = malloc((size_t) (nHmRecs * sizeof(uint32_t)));
+    niFlags = malloc((size_t) (nHmRecs * sizeof(uint32_t)));
+    iterationCount = malloc((size_t) (nHmRecs * sizeof(uint16_t)));
 
     calculateProducts(satellite, hmDataBuffers, fpCurrent, vn, ve, vc, dipLatitude, fpVoltage, f107Adj, yday, ionEffectiveMass, ionDensity, ionDriftRaw, ionDrift, ionEffectiveMassError, ionDensityError, ionDriftError, fpAreaOML, rProbeOML, electronTemperature, spacecraftPotential, electronTemperatureSource, spacecraftPotentialSource, ionEffectiveMassTTS, mieffFlags, viFlags, niFlags, iterationCount, nHmRecs, sphericalProbeParams, &numberOfSlidemEstimates);
     fprintf(stdout, "%sCalculated %ld SLIDEM IDM products.\n", infoHeader, numberOfSlidemEstimates);
 
+    uint8_t * dayHmDataBuffers[NUM_HM_VARIABLES];
+    for (uint8_t i = 0; i < NUM_HM_VARIABLES; i++)
+    {
+        dayHmDataBuffers[i] = hmDataBuffers[i] + hmRecordSizes[i] * (size_t)dayRecOffset;
+    }
+    long d = dayRecOffset;
     if (POST_PROCESS_ION_DRIFT)
     {
-        postProcessIonDrift(slidemFullFilename, satellite, hmDataBuffers, vn, ve, vc, dipLatitude, fpCurrent, fpVoltage, fpAreaOML, rProbeOML, electronTemperature, spacecraftPotential, electronTemperatureSource, spacecraftPotentialSource, ionEffectiveMassTTS, ionDrift, ionDriftError, ionEffectiveMass, ionEffectiveMassError, ionDensity, ionDensityError, viFlags, mieffFlags, niFlags, iterationCount, sphericalProbeParams, nHmRecs);
+        postProcessIonDrift(slidemFullFilename, satellite, hmDataBuffers, vn, ve, vc, dipLatitude, fpCurrent, fpVoltage, fpAreaOML, rProbeOML, electronTemperature, spacecraftPotential, electronTemperatureSource, spacecraftPotentialSource, ionEffectiveMassTTS, ionDrift, ionDriftError, ionEffectiveMass, ionEffectiveMassError, ionDensity, ionDensityError, viFlags, mieffFlags, niFlags, iterationCount, sphericalProbeParams, &passIndex);
     }
 
-    // Write CDF file
-    status = exportProducts(slidemFilename, satellite, beginTime, endTime, hmDataBuffers, nHmRecs, vn, ve, vc, ionEffectiveMass, ionDensity, ionDriftRaw, ionDrift, ionEffectiveMassError, ionDensityError, ionDriftError, fpAreaOML, rProbeOML, electronTemperature, spacecraftPotential, ionEffectiveMassTTS, mieffFlags, viFlags, niFlags, fpFilename, hmFilename, modFilename, modFilenamePrevious, magFilename, nVnecRecsPrev);
-
-    if (status != CDF_OK)
+    if (benchmarkExport)
     {
-        fprintf(stdout, "%sCDF export failed. Not generating metainfo.\n", infoHeader);
+        benchmarkSlidemExport(slidemFilename, dayHmDataBuffers, nDayRecs, vn + d, ve + d, vc + d, ionEffectiveMass + d, ionDensity + d, ionDriftRaw + d, ionDrift + d, ionEffectiveMassError + d, ionDensityError + d, ionDriftError + d, fpAreaOML + d, rProbeOML + d, electronTemperature + d, spacecraftPotential + d, ionEffectiveMassTTS + d, mieffFlags + d, viFlags + d, niFlags + d, passIndex.recordInfo + d);
         goto cleanup;
     }
 
-    // Write Header file for L2 archiving
-    time_t processingStopTime = time(NULL);
-    long hmTimeIndex = 0;
-    double firstMeasurementTime = HMTIME();
-    hmTimeIndex = nHmRecs-1;
-    double lastMeasurementTime = HMTIME();
-    status = writeSlidemHeader(slidemFilename, fpFilename, hmFilename, modFilename, modFilenamePrevious, magFilename, processingStartTime, firstMeasurementTime, lastMeasurementTime, nVnecRecsPrev);
-
-    if (status != HEADER_OK)
-    {
-        fprintf(stdout, "%sError writing HDR file.\n", infoHeader);
-        goto cleanup;        
-    }
+    // Write CDF file for this day's records only
+    status = exportProducts(slidemFilename, satellite, beginTime, endTime, dayHmDataBuffers, nDayRecs, vn + d, ve + d, vc + d, ionEffectiveMass + d, ionDensity + d, ionDriftRaw + d, ionDrift + d, ionEffectiveMassError + d, ionDensityError + d, ionDriftError + d, fpAreaOML + d, rProbeOML + d, electronTemperature + d, spacecraftPotential + d, ionEffectiveMassTTS + d, mieffFlags + d, viFlags + d, niFlags + d, passIndex.recordInfo + d, fpFilename, hmFilename, modFilename, modFilenamePrevious, magFilename, nVnecRecsPrev);
 
-    // Archive the CDF and HDR files in a ZIP file
-    int sysStatus = system(NULL);
-    if (sysStatus == 0)
+    if (status != CDF_OK)
     {
-        fprintf(stderr, "%sSystem shell call not available. Not archiving CDF.\n", infoHeader);
+        fprintf(stdout, "%sCDF export failed. Not generating metainfo.\n", infoHeader);
         goto cleanup;
     }
-    sysStatus = system("zip -q 1 > /dev/null");
-    if (WIFEXITED(sysStatus) && WEXITSTATUS(sysStatus) == 12)
-    {
-        char command[5*FILENAME_MAX + 100];
-        sprintf(command, "zip -Z store -q -r -j %s.ZIP %s.HDR %s.cdf && rm %s.HDR %s.cdf", slidemFilename, slidemFilename, slidemFilename, slidemFilename, slidemFilename);
-        sysStatus = system(command);
-        if (WIFEXITED(sysStatus) && (WEXITSTATUS(sysStatus) == 0))
-        {
-            fprintf(stdout, "%sStored HDR and CDF files in %s.ZIP\n", infoHeader, slidemFilename);
-        }
-        else
-        {
-            fprintf(stderr, "%sFailed to archive HDR and CDF files.\n", infoHeader);
-        }
-    }
-    else
-    {
-        fprintf(stderr, "zip is unusable. Not archiving CDF.\n");
-    }
-
 
+    long hmTimeIndex = dayRecOffset;
+    firstMeasurementTime = HMTIME();
+    hmTimeIndex = dayRecOffset + nDayRecs - 1;
+    lastMeasurementTime = HMTIME();
+    archiveSlidemProducts(slidemFilename, slidemFullFilename, fpFilename, hmFilename, modFilename, modFilenamePrevious, magFilename, processingStartTime, firstMeasurementTime, lastMeasurementTime, nVnecRecsPrev, columnSidecar);
 
 cleanup:
     fflush(stdout);
 
+    freePassIndex(&passIndex);
+    free(electronTemperatureSource);
+    free(spacecraftPotentialSource);
+
     freeMemory(fpDataBuffers, hmDataBuffers, vnecDataBuffers, magDataBuffers, fpCurrent, vn, ve, vc, dipLat, dipLatitude, ionEffectiveMass, ionDensity, ionDriftRaw, ionDrift, ionEffectiveMassError, ionDensityError, ionDriftError, fpAreaOML, rProbeOML, electronTemperature, spacecraftPotential, fpVoltage, ionEffectiveMassTTS, mieffFlags, viFlags, niFlags, iterationCount);
 
     return 0;
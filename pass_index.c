@@ -0,0 +1,206 @@
+/*
+
+    SLIDEM Processor: pass_index.c
+
+    Copyright (C) 2024  Johnathan K Burchill
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "pass_index.h"
+
+#include "main.h"
+#include "slidem_settings.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+extern char infoHeader[50];
+
+static int addCrossing(PassIndex *passIndex, long index, double time, uint16_t mask)
+{
+    if (passIndex->nCrossings == passIndex->maxCrossings)
+    {
+        long newSize = passIndex->maxCrossings + PASS_INDEX_CROSSING_BLOCK_SIZE;
+        PassCrossing *mem = realloc(passIndex->crossings, (size_t)(newSize * sizeof(PassCrossing)));
+        if (mem == NULL)
+            return PASS_INDEX_MEMORY;
+        passIndex->crossings = mem;
+        passIndex->maxCrossings = newSize;
+    }
+    passIndex->crossings[passIndex->nCrossings].index = index;
+    passIndex->crossings[passIndex->nCrossings].time = time;
+    passIndex->crossings[passIndex->nCrossings].mask = mask;
+    passIndex->nCrossings++;
+
+    return PASS_INDEX_OK;
+}
+
+int buildPassIndex(PassIndex *passIndex, uint8_t **hmDataBuffers, long nHmRecs)
+{
+    if (passIndex == NULL || hmDataBuffers == NULL || nHmRecs <= 0)
+        return PASS_INDEX_ARGUMENTS;
+
+    double lat1 = SLIDEM_QDLAT_CUTOFF;
+    double lat2 = lat1 + SLIDEM_POST_PROCESSING_QDLAT_WIDTH;
+    passIndex->boundaries[PASS_BOUNDARY_EQUATOR] = 0.0;
+    passIndex->boundaries[PASS_BOUNDARY_NORTH_CUTOFF] = lat1;
+    passIndex->boundaries[PASS_BOUNDARY_NORTH_FIT_EDGE] = lat2;
+    passIndex->boundaries[PASS_BOUNDARY_SOUTH_CUTOFF] = -lat1;
+    passIndex->boundaries[PASS_BOUNDARY_SOUTH_FIT_EDGE] = -lat2;
+
+    passIndex->nRecs = 0;
+    passIndex->nCrossings = 0;
+    passIndex->recordInfo = malloc((size_t)(nHmRecs * sizeof(uint16_t)));
+    if (passIndex->recordInfo == NULL)
+        return PASS_INDEX_MEMORY;
+    passIndex->nRecs = nHmRecs;
+
+    long hmTimeIndex = 0;
+    double previousQDLat = QDLAT();
+    double qdlat = 0.0;
+    double absQDLat = 0.0;
+    uint16_t passNumber = 0;
+    uint16_t mask = 0;
+    uint16_t info = 0;
+    // Direction is undefined until the latitude changes; use the next record that moves
+    bool northward = true;
+    for (long i = 1; i < nHmRecs; i++)
+    {
+        double dlat = *((double*)hmDataBuffers[5] + i) - previousQDLat;
+        if (dlat != 0.0 && isfinite(dlat))
+        {
+            northward = dlat > 0.0;
+            break;
+        }
+    }
+
+    for (hmTimeIndex = 0; hmTimeIndex < nHmRecs; hmTimeIndex++)
+    {
+        qdlat = QDLAT();
+        mask = 0;
+        if (hmTimeIndex > 0)
+        {
+            for (int b = 0; b < PASS_NUMBER_OF_BOUNDARIES; b++)
+            {
+                if (qdlat >= passIndex->boundaries[b] && previousQDLat < passIndex->boundaries[b])
+                    mask |= passCrossingBit(b, 1);
+                else if (qdlat <= passIndex->boundaries[b] && previousQDLat > passIndex->boundaries[b])
+                    mask |= passCrossingBit(b, -1);
+            }
+            if (qdlat > previousQDLat)
+                northward = true;
+            else if (qdlat < previousQDLat)
+                northward = false;
+        }
+        if (mask != 0)
+        {
+            if ((mask & (passCrossingBit(PASS_BOUNDARY_EQUATOR, 1) | passCrossingBit(PASS_BOUNDARY_EQUATOR, -1))) && passNumber < PASS_INDEX_MAX_PASS_NUMBER)
+                passNumber++;
+            if (addCrossing(passIndex, hmTimeIndex, HMTIME(), mask) != PASS_INDEX_OK)
+            {
+                freePassIndex(passIndex);
+                return PASS_INDEX_MEMORY;
+            }
+        }
+
+        absQDLat = fabs(qdlat);
+        info = (uint16_t)(passNumber << PASS_INDEX_FLAG_BITS);
+        if (qdlat >= 0.0)
+            info |= PASS_INDEX_NORTHERN_HEMISPHERE;
+        if (northward)
+            info |= PASS_INDEX_NORTHWARD;
+        if (absQDLat >= lat1)
+            info |= PASS_INDEX_POLEWARD_OF_CUTOFF;
+        if (absQDLat >= lat1 && absQDLat < lat2)
+            info |= PASS_INDEX_IN_FIT_BAND;
+        passIndex->recordInfo[hmTimeIndex] = info;
+
+        previousQDLat = qdlat;
+    }
+
+    fprintf(stdout, "%sPass index: %d equator crossings, %ld boundary crossings.\n", infoHeader, passNumber, passIndex->nCrossings);
+
+    return PASS_INDEX_OK;
+}
+
+void freePassIndex(PassIndex *passIndex)
+{
+    if (passIndex == NULL)
+        return;
+
+    free(passIndex->recordInfo);
+    passIndex->recordInfo = NULL;
+    passIndex->nRecs = 0;
+    free(passIndex->crossings);
+    passIndex->crossings = NULL;
+    passIndex->nCrossings = 0;
+    passIndex->maxCrossings = 0;
+
+    return;
+}
+
+void offsetPassNumbers(PassIndex *passIndex, uint16_t firstPassNumber)
+{
+    if (passIndex == NULL || passIndex->recordInfo == NULL || firstPassNumber == 0)
+        return;
+
+    uint16_t passNumber = 0;
+    for (long i = 0; i < passIndex->nRecs; i++)
+    {
+        passNumber = PASS_INDEX_PASS_NUMBER(passIndex->recordInfo[i]) + firstPassNumber;
+        if (passNumber > PASS_INDEX_MAX_PASS_NUMBER)
+            passNumber = PASS_INDEX_MAX_PASS_NUMBER;
+        passIndex->recordInfo[i] = (uint16_t)((passNumber << PASS_INDEX_FLAG_BITS) | (passIndex->recordInfo[i] & PASS_INDEX_FLAG_MASK));
+    }
+
+    return;
+}
+
+long lastEquatorCrossing(uint8_t **hmDataBuffers, long firstRecord, long nHmRecs)
+{
+    long hmTimeIndex = 0;
+    double qdlat = 0.0;
+    double previousQDLat = 0.0;
+    for (hmTimeIndex = nHmRecs - 1; hmTimeIndex > firstRecord; hmTimeIndex--)
+    {
+        qdlat = QDLAT();
+        previousQDLat = *((double*)hmDataBuffers[5] + hmTimeIndex - 1);
+        if ((qdlat >= 0.0 && previousQDLat < 0.0) || (qdlat <= 0.0 && previousQDLat > 0.0))
+            return hmTimeIndex;
+    }
+
+    return -1;
+}
+
+int passBoundaryNumber(const PassIndex *passIndex, float qdlat)
+{
+    for (int b = 0; b < PASS_NUMBER_OF_BOUNDARIES; b++)
+    {
+        if (fabsf((float)passIndex->boundaries[b] - qdlat) <= PASS_BOUNDARY_TOLERANCE)
+            return b;
+    }
+
+    return -1;
+}
+
+uint16_t passCrossingBit(int boundary, int8_t direction)
+{
+    if (boundary < 0 || boundary >= PASS_NUMBER_OF_BOUNDARIES || direction == 0)
+        return 0;
+
+    return (uint16_t)(1 << (2 * boundary + (direction > 0 ? 0 : 1)));
+}
@@ -0,0 +1,94 @@
+/*
+
+    SLIDEM Processor: pass_index.h
+
+    Copyright (C) 2024  Johnathan K Burchill
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _PASS_INDEX_H
+#define _PASS_INDEX_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Quasi-dipole latitude boundaries tracked by the pass index
+enum PASS_BOUNDARIES {
+    PASS_BOUNDARY_EQUATOR = 0,
+    PASS_BOUNDARY_NORTH_CUTOFF,
+    PASS_BOUNDARY_NORTH_FIT_EDGE,
+    PASS_BOUNDARY_SOUTH_CUTOFF,
+    PASS_BOUNDARY_SOUTH_FIT_EDGE,
+    PASS_NUMBER_OF_BOUNDARIES
+};
+
+// Per-record pass information, exported as the Pass_Index CDF variable.
+// The lowest PASS_INDEX_FLAG_BITS bits are flags, the remaining bits hold the pass number,
+// which increments at each equator crossing.
+// Also used by util/slidembin to identify ascending and descending passes.
+enum PASS_INDEX_BITS {
+    PASS_INDEX_NORTHERN_HEMISPHERE = 1,
+    PASS_INDEX_NORTHWARD = 1 << 1,
+    PASS_INDEX_POLEWARD_OF_CUTOFF = 1 << 2,
+    PASS_INDEX_IN_FIT_BAND = 1 << 3
+};
+#define PASS_INDEX_FLAG_BITS 4
+#define PASS_INDEX_FLAG_MASK ((1 << PASS_INDEX_FLAG_BITS) - 1)
+#define PASS_INDEX_MAX_PASS_NUMBER 4095
+#define PASS_INDEX_PASS_NUMBER(info) ((uint16_t)(info) >> PASS_INDEX_FLAG_BITS)
+
+#define PASS_INDEX_CROSSING_BLOCK_SIZE 256 // Number of crossings to grow the crossing list by at a time
+
+typedef struct passCrossing {
+    long index; // First record at or beyond the boundary
+    double time; // CDF_EPOCH of that record
+    uint16_t mask; // Bit 2*boundary is a northward crossing, bit 2*boundary+1 is a southward crossing
+} PassCrossing;
+
+typedef struct passIndex {
+    double boundaries[PASS_NUMBER_OF_BOUNDARIES];
+    long nRecs;
+    uint16_t *recordInfo;
+    long nCrossings;
+    long maxCrossings;
+    PassCrossing *crossings;
+} PassIndex;
+
+// Scans QD latitude once to get the boundary crossings and the per-record pass information
+int buildPassIndex(PassIndex *passIndex, uint8_t **hmDataBuffers, long nHmRecs);
+
+void freePassIndex(PassIndex *passIndex);
+
+// Adds firstPassNumber to the pass number of every record, for pass indexes built on part of a day
+void offsetPassNumbers(PassIndex *passIndex, uint16_t firstPassNumber);
+
+// Index of the last record after firstRecord that is at or beyond the equator relative to its predecessor, or -1.
+// No fit region spans an equator crossing, so processing can be split there.
+long lastEquatorCrossing(uint8_t **hmDataBuffers, long firstRecord, long nHmRecs);
+
+// Returns the boundary number for the given QD latitude, or -1 if that latitude is not tracked.
+// Fit region latitudes are floats, so boundaries are rounded to float and matched within PASS_BOUNDARY_TOLERANCE.
+#define PASS_BOUNDARY_TOLERANCE 1e-3f // degrees
+int passBoundaryNumber(const PassIndex *passIndex, float qdlat);
+
+uint16_t passCrossingBit(int boundary, int8_t direction);
+
+enum PASS_INDEX_STATUS {
+    PASS_INDEX_OK = 0,
+    PASS_INDEX_MEMORY = -1,
+    PASS_INDEX_ARGUMENTS = -2
+};
+
+#endif // _PASS_INDEX_H
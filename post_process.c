@@ -26,48 +26,95 @@
 #include "slidem_settings.h"
 #include "slidem_flags.h"
 #include "calculate_products.h"
+#include "pass_index.h"
+#include "selection_statistics.h"
 
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
+#include <unistd.h>
+#include <pthread.h>
 
 #include <gsl/gsl_errno.h>
 #include <gsl/gsl_multifit.h>
-#include <gsl/gsl_statistics_double.h>
 
 extern char infoHeader[50];
 
-void postProcessIonDrift(const char *slidemFilename, const char satellite, uint8_t **hmDataBuffers, double *vn, double *ve, double *vc, double *dipLatitude, double *fpCurrent, double *faceplateVoltage, double *fpAreaOML, double *rProbeOML, double *electronTemperature, double *spacecraftPotential, uint32_t *electronTemperatureSource, uint32_t *spacecraftPotentialSource, double *ionEffectiveMassTTS, double *ionDrift, double *ionDriftError, double *ionEffectiveMass, double *ionEffectiveMassError, double *ionDensity, double *ionDensityError, uint32_t *viFlags, uint32_t *mieffFlags, uint32_t *niFlags, uint16_t *iterationCount, probeParams sphericalProbeParams, long nHmRecs)
+// Offset model parameters
+#define OFFSET_FIT_LAT1 (SLIDEM_QDLAT_CUTOFF)
+#define OFFSET_FIT_LAT2 (SLIDEM_QDLAT_CUTOFF + SLIDEM_POST_PROCESSING_QDLAT_WIDTH)
+static const offset_model_fit_arguments ionDriftFitArgs[OFFSET_FIT_NUMBER_OF_REGION_TYPES] = {
+    {0, "Northern ascending", OFFSET_FIT_LAT1, OFFSET_FIT_LAT2, OFFSET_FIT_LAT2, OFFSET_FIT_LAT1},
+    {1, "Southern descending", -OFFSET_FIT_LAT1, -OFFSET_FIT_LAT2, -OFFSET_FIT_LAT2, -OFFSET_FIT_LAT1}
+};
+
+void postProcessIonDrift(const char *slidemFilename, const char satellite, uint8_t **hmDataBuffers, double *vn, double *ve, double *vc, double *dipLatitude, double *fpCurrent, double *faceplateVoltage, double *fpAreaOML, double *rProbeOML, double *electronTemperature, double *spacecraftPotential, uint32_t *electronTemperatureSource, uint32_t *spacecraftPotentialSource, double *ionEffectiveMassTTS, double *ionDrift, double *ionDriftError, double *ionEffectiveMass, double *ionEffectiveMassError, double *ionDensity, double *ionDensityError, uint32_t *viFlags, uint32_t *mieffFlags, uint32_t *niFlags, uint16_t *iterationCount, probeParams sphericalProbeParams, const PassIndex *passIndex)
 {
     fprintf(stdout, "%sPost-processing ion drift\n", infoHeader);
 
     // Turn off GSL failsafe error handler. We typically check the GSL return codes.
     gsl_set_error_handler_off();
 
-    // Offset model parameters
-    double lat1 = SLIDEM_QDLAT_CUTOFF;
-    double lat2 = lat1 + SLIDEM_POST_PROCESSING_QDLAT_WIDTH;
-    offset_model_fit_arguments fitargs[4] = {
-        {0, "Northern ascending", lat1, lat2, lat2, lat1},
-        {1, "Southern descending", -lat1, -lat2, -lat2, -lat1}
+    FILE *fitFile = openFitLog(slidemFilename, false);
+    if (fitFile == NULL)
+        return;
+
+    // Locate all fit regions first
+    OffsetFitJob *jobs = NULL;
+    long nJobs = 0;
+    long nFitJobs = 0;
+    size_t maxPoints = 0;
+    if (findOffsetFitJobs(passIndex, fpCurrent, NULL, &jobs, &nJobs, &nFitJobs, &maxPoints) != OFFSET_FIT_OK)
+    {
+        fprintf(stdout, "%sUnable to allocate memory for ion drift offset fits. Aborting post processing.\n", infoHeader);
+        goto cleanup;
+    }
+
+    OffsetFitData data = {
+        satellite, hmDataBuffers, *((double*)hmDataBuffers[0]), vn, ve, vc, dipLatitude, fpCurrent, faceplateVoltage, fpAreaOML, rProbeOML, electronTemperature, spacecraftPotential, electronTemperatureSource, spacecraftPotentialSource, ionEffectiveMassTTS, ionDrift, ionDriftError, ionEffectiveMass, ionEffectiveMassError, ionDensity, ionDensityError, viFlags, mieffFlags, niFlags, iterationCount, sphericalProbeParams
     };
+    fitOffsetJobs(jobs, nJobs, nFitJobs, maxPoints, &data);
+
+    // Log results in region order
+    for (long job = 0; job < nJobs; job++)
+    {
+        reportOffsetFit(&jobs[job], fitFile);
+    }
+
+cleanup:
+    free(jobs);
+
+    fclose(fitFile);
+
+}
 
+FILE *openFitLog(const char *slidemFilename, bool append)
+{
     // Open the fit log file for writing
     char fitLogFileName[FILENAME_MAX];
     sprintf(fitLogFileName, "%s.fitlog", slidemFilename);
     FILE *fitFile = NULL;
-    fitFile = fopen(fitLogFileName, "w");
+    if (append)
+    {
+        fitFile = fopen(fitLogFileName, "a");
+        if (fitFile != NULL && ftell(fitFile) > 0)
+            return fitFile;
+    }
+    else
+        fitFile = fopen(fitLogFileName, "w");
     if (fitFile == NULL)
     {
         fprintf(stdout, "%sCould not open fit log file:\n  %s\nAborting post processing.\n", infoHeader, fitLogFileName);
-        return;
+        return NULL;
     }
+    const offset_model_fit_arguments *fitargs = ionDriftFitArgs;
     fprintf(fitFile, "EFI IDM Along-track ion drift fit results by fit region.\n");
     fprintf(fitFile, "Each region consists of two mid-latitude segments denoted by CDF_EPOCH times T11, T12, T21, and T22.\n");
     fprintf(fitFile, "Linear models based on robust least squares (GNU Scientific Library) are subtracted from each region for which a fit can be obtained.\n");
     fprintf(fitFile, "Regions:\n");
-    for (uint8_t ind = 0; ind < 2; ind++)
+    for (uint8_t ind = 0; ind < OFFSET_FIT_NUMBER_OF_REGION_TYPES; ind++)
     {
         fprintf(fitFile, "%d %21s: (% 5.1f, % 5.1f) -> (% 5.1f, % 5.1f)\n", fitargs[ind].regionNumber, fitargs[ind].regionName, fitargs[ind].lat1, fitargs[ind].lat2, fitargs[ind].lat3, fitargs[ind].lat4);
     }
@@ -78,36 +125,164 @@ void postProcessIonDrift(const char *slidemFilename, const char satellite, uint8
     fflush(fitFile);
     fflush(stdout);
 
-    for (uint8_t ind = 0; ind < 2; ind++)
+    return fitFile;
+}
+
+int findOffsetFitJobs(const PassIndex *passIndex, const double *fpCurrent, const OffsetFitState *initialState, OffsetFitJob **jobsOut, long *nJobsOut, long *nFitJobsOut, size_t *maxPointsOut)
+{
+    *jobsOut = NULL;
+    *nJobsOut = 0;
+    *nFitJobsOut = 0;
+    *maxPointsOut = 0;
+
+    const offset_model_fit_arguments *fitargs = ionDriftFitArgs;
+    OffsetFitJob *jobs = NULL;
+    long nJobs = 0;
+    FitRegion *regions[OFFSET_FIT_NUMBER_OF_REGION_TYPES] = {NULL, NULL};
+    long nRegions[OFFSET_FIT_NUMBER_OF_REGION_TYPES] = {0, 0};
+    int regionStatus = FIT_REGION_OK;
+    int status = OFFSET_FIT_OK;
+    for (uint8_t ind = 0; ind < OFFSET_FIT_NUMBER_OF_REGION_TYPES; ind++)
     {
-        removeOffsetsAndSetFlags(satellite, fitargs[ind], nHmRecs, hmDataBuffers, vn, ve, vc, dipLatitude, fpCurrent, faceplateVoltage, fpAreaOML, rProbeOML, electronTemperature, spacecraftPotential, electronTemperatureSource, spacecraftPotentialSource, ionEffectiveMassTTS, ionDrift, ionDriftError, ionEffectiveMass, ionEffectiveMassError, ionDensity, ionDensityError, viFlags, mieffFlags, niFlags, iterationCount, sphericalProbeParams, fitFile);
+        regionStatus = findFitRegions(passIndex, fitargs[ind], fpCurrent, initialState != NULL && initialState->missingFpData[ind], &regions[ind], &nRegions[ind]);
+        if (regionStatus != FIT_REGION_OK)
+        {
+            fprintf(stdout, "%sUnable to locate fit regions for %s passes (status %d): not removing offsets.\n", infoHeader, fitargs[ind].regionName, regionStatus);
+            nRegions[ind] = 0;
+        }
+        nJobs += nRegions[ind];
+    }
+    if (nJobs > 0)
+    {
+        jobs = calloc((size_t)nJobs, sizeof(OffsetFitJob));
+        if (jobs == NULL)
+        {
+            status = OFFSET_FIT_MEMORY;
+            goto cleanup;
+        }
     }
 
-    fclose(fitFile);
+    size_t maxPoints = 0;
+    size_t nPoints = 0;
+    long nFitJobs = 0;
+    long job = 0;
+    uint16_t numFits = 0;
+    for (uint8_t ind = 0; ind < OFFSET_FIT_NUMBER_OF_REGION_TYPES; ind++)
+    {
+        numFits = initialState != NULL ? initialState->numFits[ind] : 0;
+        for (long r = 0; r < nRegions[ind]; r++)
+        {
+            jobs[job].fitargs = &fitargs[ind];
+            jobs[job].region = regions[ind][r];
+            if (jobs[job].region.complete && !jobs[job].region.missingFpData)
+            {
+                jobs[job].fitNumber = ++numFits;
+                nPoints = (size_t)(jobs[job].region.beginIndex1 - jobs[job].region.beginIndex0 + jobs[job].region.endIndex1 - jobs[job].region.endIndex0);
+                if (nPoints > maxPoints)
+                    maxPoints = nPoints;
+                nFitJobs++;
+            }
+            job++;
+        }
+    }
+
+    *jobsOut = jobs;
+    *nJobsOut = nJobs;
+    *nFitJobsOut = nFitJobs;
+    *maxPointsOut = maxPoints;
 
+cleanup:
+    free(regions[0]);
+    free(regions[1]);
+
+    return status;
 }
 
-void removeOffsetsAndSetFlags(const char satellite, offset_model_fit_arguments fitargs, long nHmRecs, uint8_t **hmDataBuffers, double *vn, double *ve, double *vc, double *dipLatitude, double *fpCurrent, double *faceplateVoltage, double *fpAreaOML, double *rProbeOML, double *electronTemperature, double *spacecraftPotential, uint32_t *electronTemperatureSource, uint32_t *spacecraftPotentialSource, double *ionEffectiveMassTTS, double *ionDrift, double *ionDriftError, double *ionEffectiveMass, double *ionEffectiveMassError, double *ionDensity, double *ionDensityError, uint32_t *viFlags, uint32_t *mieffFlags, uint32_t *niFlags, uint16_t *iterationCount, probeParams sphericalProbeParams, FILE* fitFile)
+void offsetFitStateAt(const OffsetFitJob *jobs, long nJobs, const double *fpCurrent, long endIndex, const OffsetFitState *initialState, OffsetFitState *state)
 {
-    long hmTimeIndex = 0;
-    double epoch0 = HMTIME();
-    double previousQDLat = QDLAT();
-    double driftValue;
-    bool regionBegin = false;
-    long beginIndex0 = 0, beginIndex1 = 0, endIndex0 = 0, endIndex1 = 0, modelDataIndex = 0, modelDataMidPoint = 0;
+    for (uint8_t ind = 0; ind < OFFSET_FIT_NUMBER_OF_REGION_TYPES; ind++)
+    {
+        state->numFits[ind] = initialState != NULL ? initialState->numFits[ind] : 0;
+        bool missing = initialState != NULL && initialState->missingFpData[ind];
+        // Same tally as findFitRegions: from two records after the end of the last region of this type
+        long missingFrom = 0;
+        for (long job = 0; job < nJobs; job++)
+        {
+            if (jobs[job].fitargs->regionNumber != ind || jobs[job].region.endIndex1 >= endIndex)
+                continue;
+            if (jobs[job].fitNumber > state->numFits[ind])
+                state->numFits[ind] = jobs[job].fitNumber;
+            missingFrom = jobs[job].region.endIndex1 + 2;
+            missing = false;
+        }
+        for (long i = missingFrom; i < endIndex && !missing; i++)
+        {
+            if (!isfinite(fpCurrent[i]))
+                missing = true;
+        }
+        state->missingFpData[ind] = missing;
+    }
 
-    double c0, c1, cov00, cov01, cov11, sumsq;
-    double driftOffset;
-    double seconds, fitTime;
-    int gslStatus;
-    long numModelPoints, numModel1Points, numModel2Points; // data for fit, and for median calculations at each end
-    long actualNumModel1Points, actualNumModel2Points, actualNumModelPoints;
-    bool gotFirstModelData = false;
-    bool gotStartOfSecondModelData = false;
-    bool gotSecondModelData = false;
-    uint16_t numFits = 0;
+    return;
+}
 
-    char startString[EPOCH_STRING_LEN+1], stopString[EPOCH_STRING_LEN+1];
+int fitOffsetJobs(OffsetFitJob *jobs, long nJobs, long nFitJobs, size_t maxPoints, const OffsetFitData *data)
+{
+    if (nFitJobs <= 0)
+        return OFFSET_FIT_OK;
+
+    // Fit regions concurrently. Each worker takes every nWorkers-th region.
+    int nWorkers = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    if (nWorkers > POST_PROCESSING_MAX_THREADS)
+        nWorkers = POST_PROCESSING_MAX_THREADS;
+    if (nWorkers > nFitJobs)
+        nWorkers = (int) nFitJobs;
+    if (nWorkers < 1)
+        nWorkers = 1;
+    OffsetFitWorker workers[POST_PROCESSING_MAX_THREADS];
+    pthread_t threadIds[POST_PROCESSING_MAX_THREADS];
+    bool threadStarted[POST_PROCESSING_MAX_THREADS] = {0};
+    for (int w = 0; w < nWorkers; w++)
+    {
+        workers[w].workerNumber = w;
+        workers[w].nWorkers = nWorkers;
+        workers[w].jobs = jobs;
+        workers[w].nJobs = nJobs;
+        workers[w].maxPoints = maxPoints;
+        workers[w].data = data;
+        workers[w].status = OFFSET_FIT_OK;
+    }
+    for (int w = 1; w < nWorkers; w++)
+    {
+        threadStarted[w] = pthread_create(&threadIds[w], NULL, &offsetFitThread, (void*) &workers[w]) == 0;
+    }
+    offsetFitThread((void*) &workers[0]);
+    for (int w = 1; w < nWorkers; w++)
+    {
+        // Regions of a worker that could not be started are fitted by the calling thread
+        if (threadStarted[w])
+            pthread_join(threadIds[w], NULL);
+        else
+            offsetFitThread((void*) &workers[w]);
+    }
+    int status = OFFSET_FIT_OK;
+    for (int w = 0; w < nWorkers; w++)
+    {
+        if (workers[w].status != OFFSET_FIT_OK)
+        {
+            fprintf(stdout, "%sUnable to allocate ion drift offset fit buffers for worker %d. Some regions were not fitted.\n", infoHeader, w);
+            status = workers[w].status;
+        }
+    }
+    fprintf(stdout, "%sFitted %ld ion drift offset regions using %d thread%s.\n", infoHeader, nFitJobs, nWorkers, nWorkers == 1 ? "" : "s");
+
+    return status;
+}
+
+int findFitRegions(const PassIndex *passIndex, offset_model_fit_arguments fitargs, const double *fpCurrent, bool missingFpDataBefore, FitRegion **regions, long *nRegions)
+{
+    *regions = NULL;
+    *nRegions = 0;
 
     double dlatfirst = fitargs.lat2 - fitargs.lat1;
     double dlatsecond = fitargs.lat4 - fitargs.lat3;
@@ -121,303 +296,423 @@ void removeOffsetsAndSetFlags(const char satellite, offset_model_fit_arguments f
         secondDirection = 1;
     else if (dlatsecond < 0)
         secondDirection = -1;
-    double location = (fitargs.lat2 + fitargs.lat3) / 2.;
-    int8_t region; // For flagging
-    if (location >= 44. )
-        region = 1; // North
-    else if (location <= -44.)
-        region = -1; // South
-    else
-        region = 0; // Equator
-
-    // Buffers for mid-latitude linear fit data
-    const gsl_multifit_robust_type * fitType = gsl_multifit_robust_bisquare;
-    gsl_matrix *modelTimesMatrix, *cov;
-    gsl_vector *modelValues, *model1Values, *model2Values, *fitCoefficients, *work1, *work2;
-    gsl_multifit_robust_workspace * gslFitWorkspace;
-    gsl_multifit_robust_stats stats;
-    const size_t p = 2; // linear fit
-
-    double tregion11, tregion12, tregion21, tregion22;
 
-    bool missingFpData = false;
-
-    double ifp = 0;
-    double ni = 0;
-    double vions = 0;
-    double vionsram = 0;
-    double mieffmodel = 0;
-    double di = 0;
-    double mieff = 0;
-    uint32_t viFlag = 0;
-    uint32_t mieffFlag = 0;
-    uint32_t niFlag = 0;
-    double fpArea = 0;
-    double rProbe = 0;
-    double te = 0;
-    double vs = 0;
-    int iterations = 0;
+    int b1 = passBoundaryNumber(passIndex, fitargs.lat1);
+    int b2 = passBoundaryNumber(passIndex, fitargs.lat2);
+    int b3 = passBoundaryNumber(passIndex, fitargs.lat3);
+    int b4 = passBoundaryNumber(passIndex, fitargs.lat4);
+    if (b1 < 0 || b2 < 0 || b3 < 0 || b4 < 0)
+        return FIT_REGION_BOUNDARY;
+
+    uint16_t lat1Bit = passCrossingBit(b1, firstDirection);
+    uint16_t lat2Bit = passCrossingBit(b2, firstDirection);
+    uint16_t lat3Bit = passCrossingBit(b3, secondDirection);
+    uint16_t lat4Bit = passCrossingBit(b4, secondDirection);
+
+    // At most one region per lat4 crossing
+    long maxRegions = 0;
+    for (long c = 0; c < passIndex->nCrossings; c++)
+    {
+        if (passIndex->crossings[c].mask & lat4Bit)
+            maxRegions++;
+    }
+    if (maxRegions == 0)
+        return FIT_REGION_OK;
+    FitRegion *found = malloc((size_t)(maxRegions * sizeof(FitRegion)));
+    if (found == NULL)
+        return FIT_REGION_MEMORY;
 
-    for (hmTimeIndex = 0; hmTimeIndex < nHmRecs; hmTimeIndex++)
+    bool regionBegin = false;
+    bool gotFirstModelData = false;
+    bool gotStartOfSecondModelData = false;
+    long beginIndex0 = 0, beginIndex1 = 0, endIndex0 = 0;
+    double tregion11 = 0.0, tregion12 = 0.0, tregion21 = 0.0;
+    // Missing FP data are tallied from the end of the previous region
+    long missingFrom = 0;
+    // The record following the end of a region is not examined for crossings
+    long skipIndex = -1;
+    long n = 0;
+
+    const PassCrossing *crossing = NULL;
+    for (long c = 0; c < passIndex->nCrossings; c++)
     {
-        missingFpData |= !isfinite(fpCurrent[hmTimeIndex]);
-        c0 = 0.0;
-        c1 = 0.0;
-        seconds = (HMTIME() - epoch0) / 1000.;
-        if ((firstDirection == 1 && QDLAT() >= fitargs.lat1 && previousQDLat < fitargs.lat1) || (firstDirection == -1 && QDLAT() <= fitargs.lat1 && previousQDLat > fitargs.lat1))
+        crossing = &passIndex->crossings[c];
+        if (crossing->index == skipIndex)
+            continue;
+
+        if (crossing->mask & lat1Bit)
         {
             // Start a new region search
-            regionBegin = true; // Found start of region to remove offset from
+            regionBegin = true;
             gotFirstModelData = false;
             gotStartOfSecondModelData = false;
-            gotSecondModelData = false;
-            beginIndex0 = hmTimeIndex;
-            tregion11 = HMTIME();
-
+            beginIndex0 = crossing->index;
+            tregion11 = crossing->time;
         }
-        else if (regionBegin && ((firstDirection == 1 && QDLAT() >= fitargs.lat2 && previousQDLat < fitargs.lat2) || (firstDirection == -1 && QDLAT() <= fitargs.lat2 && previousQDLat > fitargs.lat2)))
+        else if (regionBegin && (crossing->mask & lat2Bit))
         {
-            if ((HMTIME() - tregion11)/1000. < (5400. / 2.)) // Should be within 1/2 an orbit of start of segment
+            if ((crossing->time - tregion11)/1000. < (5400. / 2.)) // Should be within 1/2 an orbit of start of segment
             {
                 gotFirstModelData = true;
-                beginIndex1 = hmTimeIndex;
-                tregion12 = HMTIME();
+                beginIndex1 = crossing->index;
+                tregion12 = crossing->time;
             }
             else
             {
                 // reset search
                 gotFirstModelData = false;
                 gotStartOfSecondModelData = false;
-                gotSecondModelData = false;
                 regionBegin = false;
             }
         }
-        else if (gotFirstModelData && ((secondDirection == -1 && QDLAT() <= fitargs.lat3 && previousQDLat > fitargs.lat3) || (secondDirection == 1 && QDLAT() >= fitargs.lat3 && previousQDLat < fitargs.lat3)))
+        else if (gotFirstModelData && (crossing->mask & lat3Bit))
         {
-            if ((HMTIME() - tregion12)/1000. < (5400. / 2.)) // Should be within 1/2 an orbit of start of segment
+            if ((crossing->time - tregion12)/1000. < (5400. / 2.)) // Should be within 1/2 an orbit of start of segment
             {
                 gotStartOfSecondModelData = true;
-                endIndex0 = hmTimeIndex;
-                tregion21 = HMTIME();
+                endIndex0 = crossing->index;
+                tregion21 = crossing->time;
             }
             else
             {
                 // reset search
                 gotFirstModelData = false;
                 gotStartOfSecondModelData = false;
-                gotSecondModelData = false;
                 regionBegin = false;
             }
         }
-        else if (gotStartOfSecondModelData && ((secondDirection == -1 && QDLAT() <= fitargs.lat4 && previousQDLat > fitargs.lat4) || (secondDirection == 1 && QDLAT() >= fitargs.lat4 && previousQDLat < fitargs.lat4)))
+        else if (gotStartOfSecondModelData && (crossing->mask & lat4Bit))
         {
-            if ((HMTIME() - tregion21)/1000. < (5400. / 2.)) // Should be within 1/2 an orbit of start of segment
+            FitRegion *region = &found[n++];
+            region->beginIndex0 = beginIndex0;
+            region->beginIndex1 = beginIndex1;
+            region->endIndex0 = endIndex0;
+            region->endIndex1 = crossing->index;
+            region->tregion11 = tregion11;
+            region->tregion12 = tregion12;
+            region->tregion21 = tregion21;
+            region->tregion22 = crossing->time;
+            region->complete = (crossing->time - tregion21)/1000. < (5400. / 2.); // Should be within 1/2 an orbit of start of segment
+            region->missingFpData = false;
+            if (region->complete)
             {
-                // We have a complete region - remove linear offset model
-                endIndex1 = hmTimeIndex;
-                tregion22 = HMTIME();
-                gotSecondModelData = true;
-            }
-            else
-            {
-                // reset search
-                missingFpData = false;
-                gotFirstModelData = false;
-                gotStartOfSecondModelData = false;
-                gotSecondModelData = false;
-                regionBegin = false;
-            }
-            if (gotFirstModelData && gotSecondModelData && !missingFpData)
-            {
-                numFits++;
-                // Estimating maximum number of model points, will be fewer if drifts are flagged invalid
-                numModel1Points = beginIndex1 - beginIndex0;
-                numModel2Points = endIndex1 - endIndex0;
-                numModelPoints = numModel1Points + numModel2Points;
-                fprintf(fitFile, "%d %d %ld %ld %f %f %f %f", fitargs.regionNumber, numFits, numModel1Points, numModel2Points, tregion11, tregion12, tregion21, tregion22);
-                // Allocate fit buffers
-                modelTimesMatrix = gsl_matrix_alloc(numModelPoints, p);
-                model1Values = gsl_vector_alloc(numModel1Points);
-                model2Values = gsl_vector_alloc(numModel2Points);
-                work1 = gsl_vector_alloc(numModel1Points);
-                work2 = gsl_vector_alloc(numModel2Points);
-                modelValues = gsl_vector_alloc(numModelPoints);
-                fitCoefficients = gsl_vector_alloc(p);
-                cov = gsl_matrix_alloc(p, p);
-
-                // Load times into the model data buffer
-                modelDataIndex = 0;
-                actualNumModel1Points = 0;
-                actualNumModel2Points = 0;
-                for (hmTimeIndex = beginIndex0; hmTimeIndex < beginIndex1; hmTimeIndex++)
-                {
-                    // Do not include drift point in model if it is flagged
-                    if ((viFlags[hmTimeIndex] & ION_DRIFT_POST_CALIBRATION_FLAG_MASK) == 0)
-                    {
-                        actualNumModel1Points++;
-                        fitTime = (HMTIME() - epoch0)/1000.;
-                        gsl_matrix_set(modelTimesMatrix, modelDataIndex, 0, 1.0);
-                        gsl_matrix_set(modelTimesMatrix, modelDataIndex++, 1, fitTime); // seconds from start of file
-                    }
-                }
-                for (hmTimeIndex = endIndex0; hmTimeIndex < endIndex1; hmTimeIndex++)
+                // FP data missing before the start of the pass index count against the first region
+                if (missingFrom == 0 && missingFpDataBefore)
+                    region->missingFpData = true;
+                for (long i = missingFrom; i <= crossing->index && !region->missingFpData; i++)
                 {
-                    if ((viFlags[hmTimeIndex] & ION_DRIFT_POST_CALIBRATION_FLAG_MASK) == 0)
+                    if (!isfinite(fpCurrent[i]))
                     {
-                        actualNumModel2Points++;
-                        fitTime = (HMTIME() - epoch0)/1000.;
-                        gsl_matrix_set(modelTimesMatrix, modelDataIndex, 0, 1.0);
-                        gsl_matrix_set(modelTimesMatrix, modelDataIndex++, 1, fitTime); // seconds from start of file
+                        region->missingFpData = true;
+                        break;
                     }
                 }
-                // Load values into model data buffer
-                modelDataIndex = 0;
-                for (hmTimeIndex = beginIndex0; hmTimeIndex < beginIndex1; hmTimeIndex++)
-                {
-                    if ((viFlags[hmTimeIndex] & ION_DRIFT_POST_CALIBRATION_FLAG_MASK) == 0)
-                    {
-                        gsl_vector_set(model1Values, modelDataIndex, ionDrift[hmTimeIndex]); 
-                        gsl_vector_set(modelValues, modelDataIndex++, ionDrift[hmTimeIndex]); 
-                    }
-                }
-                modelDataMidPoint = modelDataIndex;
-                for (hmTimeIndex = endIndex0; hmTimeIndex < endIndex1; hmTimeIndex++)
-                {
-                    if ((viFlags[hmTimeIndex] & ION_DRIFT_POST_CALIBRATION_FLAG_MASK) == 0)
-                    {
-                        gsl_vector_set(model2Values, modelDataIndex - modelDataMidPoint, ionDrift[hmTimeIndex]); 
-                        gsl_vector_set(modelValues, modelDataIndex++, ionDrift[hmTimeIndex]); 
-                    }
-                }
-                // Robust linear model fit and removal
-                actualNumModelPoints = actualNumModel1Points + actualNumModel2Points;
-                if ((actualNumModel1Points >= MINIMUM_POINTS_PER_FIT_REGION) && (actualNumModel2Points >= MINIMUM_POINTS_PER_FIT_REGION))
-                {
-                    gslFitWorkspace = gsl_multifit_robust_alloc(fitType, actualNumModelPoints, p);
-                    gsl_multifit_robust_maxiter(GSL_FIT_MAXIMUM_ITERATIONS, gslFitWorkspace);
-                    gslStatus = gsl_multifit_robust(modelTimesMatrix, modelValues, fitCoefficients, cov, gslFitWorkspace);
-                    if (gslStatus)
-                    {
-                        toEncodeEPOCH(tregion11, 0, startString);
-                        toEncodeEPOCH(tregion22, 0, stopString);
-                        if (!missingFpData)
-                        {
-                            fprintf(stdout, "%s<GSL Fit Error: %s> for fit region from %s to %s spanning latitudes %.0f to %.0f.\n", infoHeader, gsl_strerror(gslStatus), startString, stopString, fitargs.lat1, fitargs.lat4);
-                            // Print "-9999999999.GSLERRORNUMBER" for each of the nine fit parameters
-                            fprintf(fitFile, " -9999999999.%d -9999999999.%d -9999999999.%d -9999999999.%d -9999999999.%d -9999999999.%d -9999999999.%d -9999999999.%d -9999999999.%d", gslStatus, gslStatus, gslStatus, gslStatus, gslStatus, gslStatus, gslStatus, gslStatus, gslStatus);
-                         }
-                   }
-                    else
-                    {
-                        c0 = gsl_vector_get(fitCoefficients, 0);
-                        c1 = gsl_vector_get(fitCoefficients, 1);
-                        stats = gsl_multifit_robust_statistics(gslFitWorkspace);
-                        gsl_multifit_robust_free(gslFitWorkspace);
-                        // check median absolute deviation and median of signal
-                        // Note that median calculation sorts the array, so do this last
-                        double mad = stats.sigma_mad; // For full data fitted
-                        double mad1 = gsl_stats_mad(model1Values->data, 1, actualNumModel1Points, work1->data); // For first segment
-                        double mad2 = gsl_stats_mad(model2Values->data, 1, actualNumModel2Points, work2->data); // For last segment
-                        double median1 = gsl_stats_median(model1Values->data, 1, actualNumModel1Points);
-                        double median2 = gsl_stats_median(model2Values->data, 1, actualNumModel2Points);
-                        fprintf(fitFile, " %f %f %f %f %f %f %f %f %f", c0, c1, stats.adj_Rsq, stats.rmse, median1, median2, mad, mad1, mad2);
-                        // Remove the offsets and assign flags for this region
-                        for (hmTimeIndex = beginIndex0; hmTimeIndex < endIndex1; hmTimeIndex++)
-                        {
-                            // remove ion drift offset
-                            driftOffset = (((HMTIME() - epoch0)/1000.0) * c1 + c0);
-                            if (isfinite(driftOffset) && isfinite(mad))
-                            {
-                                ionDrift[hmTimeIndex] -= driftOffset;
-                                driftValue = ionDrift[hmTimeIndex];
-                                // Assign ion drift resolution (uncertainty) estimate
-                                ionDriftError[hmTimeIndex] = mad;
-                                // Unset the post processing error flag bit (this was set in calculate_products.c)
-                                viFlags[hmTimeIndex] &= (~SLIDEM_FLAG_POST_PROCESSING_ERROR); 
-
-                                if (POST_PROCESS_ION_EFFECTIVE_MASS_AND_DENSITY)
-                                {
-                                    // Update ion effective mass and density using the estimates along-track ion drift 
-                                    if(isfinite(fpCurrent[hmTimeIndex]))
-                                    {
-                                        vionsram = sqrt(vn[hmTimeIndex]*vn[hmTimeIndex] + ve[hmTimeIndex]*ve[hmTimeIndex] + vc[hmTimeIndex]*vc[hmTimeIndex]);
-                                        vions = vionsram - ionDrift[hmTimeIndex];
-                                        viFlag = viFlags[hmTimeIndex];
-                                        ni = ionDensity[hmTimeIndex] * 1e6;
-                                        niFlag = niFlags[hmTimeIndex];
-                                        di = NI() * 1e6 / (16.0 * SLIDEM_MAMU) / vionsram * (2.0 * M_PI * SLIDEM_RP * SLIDEM_RP * SLIDEM_QE * SLIDEM_QE); // A/V
-                                        ifp = -fpCurrent[hmTimeIndex] * 1e-9; // A
-                                        mieff = ionEffectiveMass[hmTimeIndex];
-                                        mieffFlag = mieffFlags[hmTimeIndex];
-                                        fpArea = fpAreaOML[hmTimeIndex];
-                                        rProbe = rProbeOML[hmTimeIndex];
-                                        te = electronTemperature[hmTimeIndex];
-                                        vs = spacecraftPotential[hmTimeIndex];
-                                        mieffmodel = ionEffectiveMassTTS[hmTimeIndex];
-
-                                        iterations = iterateEquations(&ni, ni, &vions, &mieff, &viFlag, &mieffFlag, &niFlag, &fpArea, &rProbe, te, vs, faceplateVoltage[hmTimeIndex], sphericalProbeParams, ifp, di, vionsram, mieffmodel, QDLAT(), true, satellite);
-
-                                        updateFlags(iterations, &mieff, &ionEffectiveMassError[hmTimeIndex], &ionDrift[hmTimeIndex], &ionDensityError[hmTimeIndex], &ni, &ionDensityError[hmTimeIndex], &fpAreaOML[hmTimeIndex], &rProbeOML[hmTimeIndex], te, vs, electronTemperatureSource[hmTimeIndex], spacecraftPotentialSource[hmTimeIndex], vionsram, dipLatitude[hmTimeIndex], vn, ve, vc, &mieffFlag, NULL, &niFlag, NULL, hmDataBuffers, hmTimeIndex);
-
-                                        ionDensity[hmTimeIndex] = ni / 1e6;
-                                        niFlags[hmTimeIndex] = niFlag;
-                                        ionEffectiveMass[hmTimeIndex] = mieff;
-                                        mieffFlags[hmTimeIndex] = mieffFlag;
-                                        fpAreaOML[hmTimeIndex] = fpArea;
-                                        rProbeOML[hmTimeIndex] = rProbe;
-                                        iterationCount[hmTimeIndex] += iterations;
-
-
-                                    }
-                                }
-                            }
-                        }
-                    }
-                }
-                else
-                {
-                    if (!missingFpData)
-                    {
-                        fprintf(stdout, "%s Fit error: did not get enough fit points for region defined for CDF_EPOCHS %f, %f, %f, %f: not fitting and not removing offsets.\n", infoHeader, tregion11, tregion12, tregion21, tregion22);
-                    }
-                }
-                fprintf(fitFile, "\n");
-                gsl_matrix_free(modelTimesMatrix);
-                gsl_vector_free(model1Values);
-                gsl_vector_free(model2Values);
-                gsl_vector_free(modelValues);
-                gsl_vector_free(work1);
-                gsl_vector_free(work2);
-                gsl_vector_free(fitCoefficients);
-                gsl_matrix_free(cov);
-            }
-            else
-            {
-                if (!missingFpData)
-                {
-                    fprintf(stdout, "%s Fit error: did not get both endpoints of region defined for CDF_EPOCHS %f, %f, %f, %f: not fitting and not removing offsets.\n", infoHeader, tregion11, tregion12, tregion21, tregion22);
-                }
             }
-            
-            missingFpData = false;
             regionBegin = false;
             gotFirstModelData = false;
             gotStartOfSecondModelData = false;
-            gotSecondModelData = false;
-            if (hmTimeIndex == nHmRecs)
-            {
-                break;
-            }
-            else
+            missingFrom = crossing->index + 2;
+            skipIndex = crossing->index + 1;
+        }
+    }
+
+    if (n == 0)
+    {
+        free(found);
+        found = NULL;
+    }
+    *regions = found;
+    *nRegions = n;
+
+    return FIT_REGION_OK;
+}
+
+int allocOffsetFitPool(OffsetFitPool *pool, size_t maxPoints)
+{
+    const size_t p = 2; // linear fit
+
+    memset(pool, 0, sizeof(OffsetFitPool));
+    if (maxPoints == 0)
+        return OFFSET_FIT_OK;
+
+    pool->maxPoints = maxPoints;
+    pool->modelTimesMatrix = gsl_matrix_alloc(maxPoints, p);
+    pool->modelValues = gsl_vector_alloc(maxPoints);
+    pool->model1Values = gsl_vector_alloc(maxPoints);
+    pool->model2Values = gsl_vector_alloc(maxPoints);
+    pool->work1 = gsl_vector_alloc(maxPoints);
+    pool->work2 = gsl_vector_alloc(maxPoints);
+    pool->fitCoefficients = gsl_vector_alloc(p);
+    pool->cov = gsl_matrix_alloc(p, p);
+    if (pool->modelTimesMatrix == NULL || pool->modelValues == NULL || pool->model1Values == NULL || pool->model2Values == NULL || pool->work1 == NULL || pool->work2 == NULL || pool->fitCoefficients == NULL || pool->cov == NULL)
+    {
+        freeOffsetFitPool(pool);
+        return OFFSET_FIT_MEMORY;
+    }
+
+    return OFFSET_FIT_OK;
+}
+
+void freeOffsetFitPool(OffsetFitPool *pool)
+{
+    if (pool->modelTimesMatrix != NULL)
+        gsl_matrix_free(pool->modelTimesMatrix);
+    if (pool->modelValues != NULL)
+        gsl_vector_free(pool->modelValues);
+    if (pool->model1Values != NULL)
+        gsl_vector_free(pool->model1Values);
+    if (pool->model2Values != NULL)
+        gsl_vector_free(pool->model2Values);
+    if (pool->work1 != NULL)
+        gsl_vector_free(pool->work1);
+    if (pool->work2 != NULL)
+        gsl_vector_free(pool->work2);
+    if (pool->fitCoefficients != NULL)
+        gsl_vector_free(pool->fitCoefficients);
+    if (pool->cov != NULL)
+        gsl_matrix_free(pool->cov);
+    if (pool->workspace != NULL)
+        gsl_multifit_robust_free(pool->workspace);
+    memset(pool, 0, sizeof(OffsetFitPool));
+
+    return;
+}
+
+void *offsetFitThread(void *arg)
+{
+    OffsetFitWorker *worker = (OffsetFitWorker*) arg;
+    OffsetFitPool pool;
+
+    worker->status = allocOffsetFitPool(&pool, worker->maxPoints);
+
+    for (long job = worker->workerNumber; job < worker->nJobs; job += worker->nWorkers)
+    {
+        if (worker->jobs[job].fitNumber == 0)
+            continue;
+        worker->jobs[job].status = worker->status;
+        if (worker->status == OFFSET_FIT_OK)
+            removeOffsetsAndSetFlags(&worker->jobs[job], &pool, worker->data);
+    }
+
+    freeOffsetFitPool(&pool);
+
+    return NULL;
+}
+
+void removeOffsetsAndSetFlags(OffsetFitJob *job, OffsetFitPool *pool, const OffsetFitData *data)
+{
+    uint8_t **hmDataBuffers = data->hmDataBuffers;
+    long hmTimeIndex = 0;
+    double epoch0 = data->epoch0;
+    double driftValue;
+    long beginIndex0 = job->region.beginIndex0;
+    long beginIndex1 = job->region.beginIndex1;
+    long endIndex0 = job->region.endIndex0;
+    long endIndex1 = job->region.endIndex1;
+    long modelDataIndex = 0, modelDataMidPoint = 0;
+
+    double c0 = 0.0, c1 = 0.0;
+    double driftOffset;
+    double fitTime;
+    long actualNumModel1Points, actualNumModel2Points, actualNumModelPoints;
+
+    const gsl_multifit_robust_type * fitType = gsl_multifit_robust_bisquare;
+    gsl_multifit_robust_stats stats;
+    const size_t p = 2; // linear fit
+
+    double *ionDrift = data->ionDrift;
+    uint32_t *viFlags = data->viFlags;
+
+    double ifp = 0;
+    double ni = 0;
+    double vions = 0;
+    double vionsram = 0;
+    double mieffmodel = 0;
+    double di = 0;
+    double mieff = 0;
+    uint32_t viFlag = 0;
+    uint32_t mieffFlag = 0;
+    uint32_t niFlag = 0;
+    double fpArea = 0;
+    double rProbe = 0;
+    double te = 0;
+    double vs = 0;
+    int iterations = 0;
+
+    // Estimating maximum number of model points, will be fewer if drifts are flagged invalid
+    job->numModel1Points = beginIndex1 - beginIndex0;
+    job->numModel2Points = endIndex1 - endIndex0;
+    job->enoughPoints = false;
+    job->gslStatus = GSL_SUCCESS;
+
+    // Load times and values into the pooled model data buffers
+    modelDataIndex = 0;
+    actualNumModel1Points = 0;
+    actualNumModel2Points = 0;
+    for (hmTimeIndex = beginIndex0; hmTimeIndex < beginIndex1; hmTimeIndex++)
+    {
+        // Do not include drift point in model if it is flagged
+        if ((viFlags[hmTimeIndex] & ION_DRIFT_POST_CALIBRATION_FLAG_MASK) == 0)
+        {
+            fitTime = (HMTIME() - epoch0)/1000.;
+            gsl_matrix_set(pool->modelTimesMatrix, modelDataIndex, 0, 1.0);
+            gsl_matrix_set(pool->modelTimesMatrix, modelDataIndex, 1, fitTime); // seconds from start of file
+            gsl_vector_set(pool->model1Values, actualNumModel1Points++, ionDrift[hmTimeIndex]);
+            gsl_vector_set(pool->modelValues, modelDataIndex++, ionDrift[hmTimeIndex]);
+        }
+    }
+    modelDataMidPoint = modelDataIndex;
+    for (hmTimeIndex = endIndex0; hmTimeIndex < endIndex1; hmTimeIndex++)
+    {
+        if ((viFlags[hmTimeIndex] & ION_DRIFT_POST_CALIBRATION_FLAG_MASK) == 0)
+        {
+            fitTime = (HMTIME() - epoch0)/1000.;
+            gsl_matrix_set(pool->modelTimesMatrix, modelDataIndex, 0, 1.0);
+            gsl_matrix_set(pool->modelTimesMatrix, modelDataIndex, 1, fitTime); // seconds from start of file
+            gsl_vector_set(pool->model2Values, modelDataIndex - modelDataMidPoint, ionDrift[hmTimeIndex]);
+            gsl_vector_set(pool->modelValues, modelDataIndex++, ionDrift[hmTimeIndex]);
+            actualNumModel2Points++;
+        }
+    }
+
+    // Robust linear model fit and removal
+    actualNumModelPoints = actualNumModel1Points + actualNumModel2Points;
+    if ((actualNumModel1Points < MINIMUM_POINTS_PER_FIT_REGION) || (actualNumModel2Points < MINIMUM_POINTS_PER_FIT_REGION))
+        return;
+    job->enoughPoints = true;
+
+    if (pool->workspace == NULL || pool->workspacePoints != (size_t)actualNumModelPoints)
+    {
+        if (pool->workspace != NULL)
+            gsl_multifit_robust_free(pool->workspace);
+        pool->workspace = gsl_multifit_robust_alloc(fitType, actualNumModelPoints, p);
+        if (pool->workspace == NULL)
+        {
+            pool->workspacePoints = 0;
+            job->gslStatus = GSL_ENOMEM;
+            return;
+        }
+        pool->workspacePoints = (size_t)actualNumModelPoints;
+        gsl_multifit_robust_maxiter(GSL_FIT_MAXIMUM_ITERATIONS, pool->workspace);
+    }
+
+    gsl_matrix_view modelTimes = gsl_matrix_submatrix(pool->modelTimesMatrix, 0, 0, actualNumModelPoints, p);
+    gsl_vector_view modelValues = gsl_vector_subvector(pool->modelValues, 0, actualNumModelPoints);
+    job->gslStatus = gsl_multifit_robust(&modelTimes.matrix, &modelValues.vector, pool->fitCoefficients, pool->cov, pool->workspace);
+    if (job->gslStatus)
+        return;
+
+    c0 = gsl_vector_get(pool->fitCoefficients, 0);
+    c1 = gsl_vector_get(pool->fitCoefficients, 1);
+    stats = gsl_multifit_robust_statistics(pool->workspace);
+    // check median absolute deviation and median of signal
+    // Note that median selection reorders the segment values, so do this last
+    double mad = stats.sigma_mad; // For full data fitted
+    job->c0 = c0;
+    job->c1 = c1;
+    job->adjRsq = stats.adj_Rsq;
+    job->rmse = stats.rmse;
+    job->mad = mad;
+    SelectionStatistics segment1, segment2;
+    selectionStatistics(pool->model1Values->data, actualNumModel1Points, pool->work1->data, &segment1); // For first segment
+    selectionStatistics(pool->model2Values->data, actualNumModel2Points, pool->work2->data, &segment2); // For last segment
+    job->mad1 = segment1.mad;
+    job->mad2 = segment2.mad;
+    job->median1 = segment1.median;
+    job->median2 = segment2.median;
+
+    // Remove the offsets and assign flags for this region
+    for (hmTimeIndex = beginIndex0; hmTimeIndex < endIndex1; hmTimeIndex++)
+    {
+        // remove ion drift offset
+        driftOffset = (((HMTIME() - epoch0)/1000.0) * c1 + c0);
+        if (isfinite(driftOffset) && isfinite(mad))
+        {
+            ionDrift[hmTimeIndex] -= driftOffset;
+            driftValue = ionDrift[hmTimeIndex];
+            // Assign ion drift resolution (uncertainty) estimate
+            data->ionDriftError[hmTimeIndex] = mad;
+            // Unset the post processing error flag bit (this was set in calculate_products.c)
+            viFlags[hmTimeIndex] &= (~SLIDEM_FLAG_POST_PROCESSING_ERROR); 
+
+            if (POST_PROCESS_ION_EFFECTIVE_MASS_AND_DENSITY)
             {
-                hmTimeIndex++;
+                // Update ion effective mass and density using the estimates along-track ion drift 
+                if(isfinite(data->fpCurrent[hmTimeIndex]))
+                {
+                    vionsram = sqrt(data->vn[hmTimeIndex]*data->vn[hmTimeIndex] + data->ve[hmTimeIndex]*data->ve[hmTimeIndex] + data->vc[hmTimeIndex]*data->vc[hmTimeIndex]);
+                    vions = vionsram - ionDrift[hmTimeIndex];
+                    viFlag = viFlags[hmTimeIndex];
+                    ni = data->ionDensity[hmTimeIndex] * 1e6;
+                    niFlag = data->niFlags[hmTimeIndex];
+                    di = NI() * 1e6 / (16.0 * SLIDEM_MAMU) / vionsram * (2.0 * M_PI * SLIDEM_RP * SLIDEM_RP * SLIDEM_QE * SLIDEM_QE); // A/V
+                    ifp = -data->fpCurrent[hmTimeIndex] * 1e-9; // A
+                    mieff = data->ionEffectiveMass[hmTimeIndex];
+                    mieffFlag = data->mieffFlags[hmTimeIndex];
+                    fpArea = data->fpAreaOML[hmTimeIndex];
+                    rProbe = data->rProbeOML[hmTimeIndex];
+                    te = data->electronTemperature[hmTimeIndex];
+                    vs = data->spacecraftPotential[hmTimeIndex];
+                    mieffmodel = data->ionEffectiveMassTTS[hmTimeIndex];
+
+                    iterations = iterateEquations(&ni, ni, &vions, &mieff, &viFlag, &mieffFlag, &niFlag, &fpArea, &rProbe, te, vs, data->faceplateVoltage[hmTimeIndex], data->sphericalProbeParams, ifp, di, vionsram, mieffmodel, QDLAT(), true, data->satellite);
+
+                    updateFlags(iterations, &mieff, &data->ionEffectiveMassError[hmTimeIndex], &ionDrift[hmTimeIndex], &data->ionDensityError[hmTimeIndex], &ni, &data->ionDensityError[hmTimeIndex], &data->fpAreaOML[hmTimeIndex], &data->rProbeOML[hmTimeIndex], te, vs, data->electronTemperatureSource[hmTimeIndex], data->spacecraftPotentialSource[hmTimeIndex], vionsram, data->dipLatitude[hmTimeIndex], data->vn, data->ve, data->vc, &mieffFlag, NULL, &niFlag, NULL, hmDataBuffers, hmTimeIndex);
+
+                    data->ionDensity[hmTimeIndex] = ni / 1e6;
+                    data->niFlags[hmTimeIndex] = niFlag;
+                    data->ionEffectiveMass[hmTimeIndex] = mieff;
+                    data->mieffFlags[hmTimeIndex] = mieffFlag;
+                    data->fpAreaOML[hmTimeIndex] = fpArea;
+                    data->rProbeOML[hmTimeIndex] = rProbe;
+                    data->iterationCount[hmTimeIndex] += iterations;
+
+                }
             }
-            
         }
+    }
 
-        previousQDLat = QDLAT();
-    
+    return;
+}
+
+void reportOffsetFit(const OffsetFitJob *job, FILE *fitFile)
+{
+    const FitRegion *region = &job->region;
+    char startString[EPOCH_STRING_LEN+1], stopString[EPOCH_STRING_LEN+1];
+    int gslStatus = job->gslStatus;
+
+    if (!region->complete)
+    {
+        fprintf(stdout, "%s Fit error: did not get both endpoints of region defined for CDF_EPOCHS %f, %f, %f, %f: not fitting and not removing offsets.\n", infoHeader, region->tregion11, region->tregion12, region->tregion21, region->tregion22);
+        return;
     }
+    if (job->fitNumber == 0)
+        return;
 
+    fprintf(fitFile, "%d %d %ld %ld %f %f %f %f", job->fitargs->regionNumber, job->fitNumber, job->numModel1Points, job->numModel2Points, region->tregion11, region->tregion12, region->tregion21, region->tregion22);
+    if (job->status == OFFSET_FIT_MEMORY)
+    {
+        fprintf(stdout, "%s Fit error: unable to allocate fit buffers for region defined for CDF_EPOCHS %f, %f, %f, %f: not fitting and not removing offsets.\n", infoHeader, region->tregion11, region->tregion12, region->tregion21, region->tregion22);
+        // Same placeholders as a GSL allocation failure
+        fprintf(fitFile, " -9999999999.%d -9999999999.%d -9999999999.%d -9999999999.%d -9999999999.%d -9999999999.%d -9999999999.%d -9999999999.%d -9999999999.%d", GSL_ENOMEM, GSL_ENOMEM, GSL_ENOMEM, GSL_ENOMEM, GSL_ENOMEM, GSL_ENOMEM, GSL_ENOMEM, GSL_ENOMEM, GSL_ENOMEM);
+    }
+    else if (!job->enoughPoints)
+    {
+        fprintf(stdout, "%s Fit error: did not get enough fit points for region defined for CDF_EPOCHS %f, %f, %f, %f: not fitting and not removing offsets.\n", infoHeader, region->tregion11, region->tregion12, region->tregion21, region->tregion22);
+    }
+    else if (gslStatus)
+    {
+        toEncodeEPOCH(region->tregion11, 0, startString);
+        toEncodeEPOCH(region->tregion22, 0, stopString);
+        fprintf(stdout, "%s<GSL Fit Error: %s> for fit region from %s to %s spanning latitudes %.0f to %.0f.\n", infoHeader, gsl_strerror(gslStatus), startString, stopString, job->fitargs->lat1, job->fitargs->lat4);
+        // Print "-9999999999.GSLERRORNUMBER" for each of the nine fit parameters
+        fprintf(fitFile, " -9999999999.%d -9999999999.%d -9999999999.%d -9999999999.%d -9999999999.%d -9999999999.%d -9999999999.%d -9999999999.%d -9999999999.%d", gslStatus, gslStatus, gslStatus, gslStatus, gslStatus, gslStatus, gslStatus, gslStatus, gslStatus);
+    }
+    else
+    {
+        fprintf(fitFile, " %f %f %f %f %f %f %f %f %f", job->c0, job->c1, job->adjRsq, job->rmse, job->median1, job->median2, job->mad, job->mad1, job->mad2);
+    }
+    fprintf(fitFile, "\n");
 
+    return;
 }
@@ -23,8 +23,14 @@
 
 #include <stdint.h>
 #include <stdio.h>
+#include <stdbool.h>
 
 #include "modified_oml.h"
+#include "pass_index.h"
+
+#include <gsl/gsl_matrix.h>
+#include <gsl/gsl_vector.h>
+#include <gsl/gsl_multifit.h>
 
 // After EFI TCT processor
 // Background IP
@@ -38,13 +44,148 @@ typedef struct offset_model_fit_arguments {
     const float lat4;
 } offset_model_fit_arguments;
 
-
-void postProcessIonDrift(const char *slidemFilename, const char satellite, uint8_t **hmDataBuffers, double *vn, double *ve, double *vc, double *dipLatitude, double *fpCurrent, double *faceplateVoltage, double *fpAreaOML, double *rProbeOML, double *electronTemperature, double *spacecraftPotential, uint32_t *electronTemperatureSource, uint32_t *spacecraftPotentialSource, double *ionEffectiveMassTTS, double *ionDrift, double *ionDriftError, double *ionEffectiveMass, double *ionEffectiveMassError, double *ionDensity, double *ionDensityError, uint32_t *viFlags, uint32_t *mieffFlags, uint32_t *niFlags, uint16_t *iterationCount, probeParams sphericalProbeParams, long nHmRecs);
-
-void removeOffsetsAndSetFlags(const char satellite, offset_model_fit_arguments fitargs, long nHmRecs, uint8_t **hmDataBuffers, double *vn, double *ve, double *vc, double *dipLatitude, double *fpCurrent, double *faceplateVoltage, double *fpAreaOML, double *rProbeOML, double *electronTemperature, double *spacecraftPotential, uint32_t *electronTemperatureSource, uint32_t *spacecraftPotentialSource, double *ionEffectiveMassTTS, double *ionDrift, double *ionDriftError, double *ionEffectiveMass, double *ionEffectiveMassError, double *ionDensity, double *ionDensityError, uint32_t *viFlags, uint32_t *mieffFlags, uint32_t *niFlags, uint16_t *iterationCount, probeParams sphericalProbeParams, FILE* fitFile);
-
-
-
-
+// A candidate fit region found from the pass index crossings
+typedef struct fitRegion {
+    long beginIndex0;
+    long beginIndex1;
+    long endIndex0;
+    long endIndex1;
+    double tregion11;
+    double tregion12;
+    double tregion21;
+    double tregion22;
+    bool complete; // false if the last segment was not found within 1/2 orbit
+    bool missingFpData;
+} FitRegion;
+
+enum FIT_REGION_STATUS {
+    FIT_REGION_OK = 0,
+    FIT_REGION_MEMORY = -1,
+    FIT_REGION_BOUNDARY = -2
+};
+
+// Runs the fit region search over the pass index crossings instead of every HM record
+// missingFpDataBefore carries the missing FP data tally from records preceding the pass index.
+int findFitRegions(const PassIndex *passIndex, offset_model_fit_arguments fitargs, const double *fpCurrent, bool missingFpDataBefore, FitRegion **regions, long *nRegions);
+
+void postProcessIonDrift(const char *slidemFilename, const char satellite, uint8_t **hmDataBuffers, double *vn, double *ve, double *vc, double *dipLatitude, double *fpCurrent, double *faceplateVoltage, double *fpAreaOML, double *rProbeOML, double *electronTemperature, double *spacecraftPotential, uint32_t *electronTemperatureSource, uint32_t *spacecraftPotentialSource, double *ionEffectiveMassTTS, double *ionDrift, double *ionDriftError, double *ionEffectiveMass, double *ionEffectiveMassError, double *ionDensity, double *ionDensityError, uint32_t *viFlags, uint32_t *mieffFlags, uint32_t *niFlags, uint16_t *iterationCount, probeParams sphericalProbeParams, const PassIndex *passIndex);
+
+// Arrays shared by the offset fit workers. Fit regions do not overlap, so workers update disjoint records.
+typedef struct offsetFitData {
+    char satellite;
+    uint8_t **hmDataBuffers;
+    double epoch0;
+    double *vn;
+    double *ve;
+    double *vc;
+    double *dipLatitude;
+    double *fpCurrent;
+    double *faceplateVoltage;
+    double *fpAreaOML;
+    double *rProbeOML;
+    double *electronTemperature;
+    double *spacecraftPotential;
+    uint32_t *electronTemperatureSource;
+    uint32_t *spacecraftPotentialSource;
+    double *ionEffectiveMassTTS;
+    double *ionDrift;
+    double *ionDriftError;
+    double *ionEffectiveMass;
+    double *ionEffectiveMassError;
+    double *ionDensity;
+    double *ionDensityError;
+    uint32_t *viFlags;
+    uint32_t *mieffFlags;
+    uint32_t *niFlags;
+    uint16_t *iterationCount;
+    probeParams sphericalProbeParams;
+} OffsetFitData;
+
+// One fit region and its results, reported in region order after all fits finish
+typedef struct offsetFitJob {
+    const offset_model_fit_arguments *fitargs;
+    FitRegion region;
+    uint16_t fitNumber; // 0 if the region is not fitted
+    int status; // OFFSET_FIT_MEMORY if the worker fitting this region could not allocate its buffers
+    long numModel1Points;
+    long numModel2Points;
+    bool enoughPoints;
+    int gslStatus;
+    double c0;
+    double c1;
+    double adjRsq;
+    double rmse;
+    double median1;
+    double median2;
+    double mad;
+    double mad1;
+    double mad2;
+} OffsetFitJob;
+
+// GSL buffers sized for the longest region, reused by a worker for each of its fits via views.
+// The robust workspace must match the number of fit points, so it is only reallocated when that changes.
+typedef struct offsetFitPool {
+    size_t maxPoints;
+    gsl_matrix *modelTimesMatrix;
+    gsl_vector *modelValues;
+    gsl_vector *model1Values;
+    gsl_vector *model2Values;
+    gsl_vector *work1;
+    gsl_vector *work2;
+    gsl_vector *fitCoefficients;
+    gsl_matrix *cov;
+    gsl_multifit_robust_workspace *workspace;
+    size_t workspacePoints;
+} OffsetFitPool;
+
+typedef struct offsetFitWorker {
+    int workerNumber;
+    int nWorkers;
+    OffsetFitJob *jobs;
+    long nJobs;
+    size_t maxPoints;
+    const OffsetFitData *data;
+    int status;
+} OffsetFitWorker;
+
+// Northern ascending and southern descending regions
+#define OFFSET_FIT_NUMBER_OF_REGION_TYPES 2
+
+// State of the fit region search carried between incremental runs, by region type
+typedef struct offsetFitState {
+    uint16_t numFits[OFFSET_FIT_NUMBER_OF_REGION_TYPES]; // last fit number assigned
+    bool missingFpData[OFFSET_FIT_NUMBER_OF_REGION_TYPES]; // FP data missing since the end of the last region
+} OffsetFitState;
+
+enum OFFSET_FIT_STATUS {
+    OFFSET_FIT_OK = 0,
+    OFFSET_FIT_MEMORY = -1
+};
+
+int allocOffsetFitPool(OffsetFitPool *pool, size_t maxPoints);
+void freeOffsetFitPool(OffsetFitPool *pool);
+
+// Fits the robust linear offset model to one region and removes it from the ion drift
+void removeOffsetsAndSetFlags(OffsetFitJob *job, OffsetFitPool *pool, const OffsetFitData *data);
+
+void *offsetFitThread(void *arg);
+
+// Opens <slidemFilename>.fitlog and writes its header. Returns NULL on failure.
+// With append, an existing non-empty log is continued without a new header.
+FILE *openFitLog(const char *slidemFilename, bool append);
+
+// Fit jobs for both region types over the whole pass index, northern regions first.
+// Regions are numbered and sized here so that callers can fit them in any grouping.
+// initialState continues numbering and the missing FP data tally from an earlier run (NULL to start fresh).
+int findOffsetFitJobs(const PassIndex *passIndex, const double *fpCurrent, const OffsetFitState *initialState, OffsetFitJob **jobs, long *nJobs, long *nFitJobs, size_t *maxPoints);
+
+// Fit region search state for resuming at record endIndex, which must not lie within a region
+void offsetFitStateAt(const OffsetFitJob *jobs, long nJobs, const double *fpCurrent, long endIndex, const OffsetFitState *initialState, OffsetFitState *state);
+
+// Fits the numbered jobs on up to POST_PROCESSING_MAX_THREADS threads.
+// Returns OFFSET_FIT_MEMORY if some regions could not be fitted for lack of memory.
+int fitOffsetJobs(OffsetFitJob *jobs, long nJobs, long nFitJobs, size_t maxPoints, const OffsetFitData *data);
+
+void reportOffsetFit(const OffsetFitJob *job, FILE *fitFile);
 
 #endif // _POST_PROCESS_H
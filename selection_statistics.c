@@ -0,0 +1,184 @@
+/*
+
+    SLIDEM Processor: selection_statistics.c
+
+    Copyright (C) 2024  Johnathan K Burchill
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "selection_statistics.h"
+
+#include <math.h>
+
+static inline void swapValues(double *a, double *b)
+{
+    double tmp = *a;
+    *a = *b;
+    *b = tmp;
+}
+
+static void siftDown(double *data, size_t start, size_t end)
+{
+    size_t root = start;
+    size_t child = 0;
+    while ((child = 2 * root + 1) <= end)
+    {
+        if (child + 1 <= end && data[child] < data[child + 1])
+            child++;
+        if (data[root] < data[child])
+        {
+            swapValues(&data[root], &data[child]);
+            root = child;
+        }
+        else
+            break;
+    }
+}
+
+// Fallback for introselect when partitioning degrades
+static void heapSort(double *data, size_t n)
+{
+    if (n < 2)
+        return;
+    for (size_t start = (n - 2) / 2 + 1; start-- > 0;)
+        siftDown(data, start, n - 1);
+    for (size_t end = n - 1; end > 0; end--)
+    {
+        swapValues(&data[0], &data[end]);
+        siftDown(data, 0, end - 1);
+    }
+}
+
+static double medianOfThree(double a, double b, double c)
+{
+    if (a < b)
+    {
+        if (b < c)
+            return b;
+        return a < c ? c : a;
+    }
+    if (a < c)
+        return a;
+    return b < c ? c : b;
+}
+
+double selectKth(double *data, size_t n, size_t k)
+{
+    size_t lo = 0;
+    size_t hi = n - 1;
+    int depthBudget = 0;
+    for (size_t m = n; m > 0; m >>= 1)
+        depthBudget += 2;
+
+    while (hi > lo)
+    {
+        if (depthBudget-- == 0)
+        {
+            heapSort(data + lo, hi - lo + 1);
+            break;
+        }
+        double pivot = medianOfThree(data[lo], data[lo + (hi - lo) / 2], data[hi]);
+        // Three-way partition: [lo, lt) < pivot, [lt, gt] == pivot, (gt, hi] > pivot
+        // Values that do not compare (NaN) stay with the pivot, so each pass shrinks the range
+        size_t lt = lo;
+        size_t gt = hi;
+        size_t i = lo;
+        while (i <= gt)
+        {
+            if (data[i] < pivot)
+                swapValues(&data[lt++], &data[i++]);
+            else if (data[i] > pivot)
+            {
+                swapValues(&data[i], &data[gt]);
+                if (gt == 0)
+                    break;
+                gt--;
+            }
+            else
+                i++;
+        }
+        if (k < lt)
+            hi = lt - 1;
+        else if (k > gt)
+            lo = gt + 1;
+        else
+            break;
+    }
+
+    return data[k];
+}
+
+// After selectKth(data, n, k), the largest value below k is the (k-1)th smallest
+static double maxBelow(const double *data, size_t k)
+{
+    double value = data[0];
+    for (size_t i = 1; i < k; i++)
+    {
+        if (data[i] > value)
+            value = data[i];
+    }
+    return value;
+}
+
+double selectionMedian(double *data, size_t n)
+{
+    if (data == NULL || n == 0)
+        return NAN;
+
+    size_t k = n / 2;
+    double upper = selectKth(data, n, k);
+    if (n % 2 == 1)
+        return upper;
+
+    return (maxBelow(data, k) + upper) / 2.0;
+}
+
+int selectionStatistics(double *data, size_t n, double *scratch, SelectionStatistics *stats)
+{
+    if (data == NULL || stats == NULL)
+        return SELECTION_POINTER;
+
+    stats->n = n;
+    stats->median = NAN;
+    stats->mad = NAN;
+    stats->min = NAN;
+    stats->max = NAN;
+    if (n == 0)
+        return SELECTION_NO_DATA;
+
+    double min = data[0];
+    double max = data[0];
+    for (size_t i = 1; i < n; i++)
+    {
+        if (data[i] < min)
+            min = data[i];
+        if (data[i] > max)
+            max = data[i];
+    }
+    stats->min = min;
+    stats->max = max;
+
+    double median = selectionMedian(data, n);
+    stats->median = median;
+
+    if (scratch != NULL)
+    {
+        for (size_t i = 0; i < n; i++)
+            scratch[i] = fabs(data[i] - median);
+        stats->mad = SELECTION_MAD_SCALE * selectionMedian(scratch, n);
+    }
+
+    return SELECTION_OK;
+}
@@ -0,0 +1,56 @@
+/*
+
+    SLIDEM Processor: selection_statistics.h
+
+    Copyright (C) 2024  Johnathan K Burchill
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _SELECTION_STATISTICS_H
+#define _SELECTION_STATISTICS_H
+
+#include <stddef.h>
+
+// Same scaling as gsl_stats_mad: MAD is an estimate of the standard deviation for Gaussian data
+#define SELECTION_MAD_SCALE 1.482602218505602
+
+typedef struct selectionStatistics {
+    size_t n;
+    double median;
+    double mad;
+    double min;
+    double max;
+} SelectionStatistics;
+
+enum SELECTION_STATISTICS_STATUS {
+    SELECTION_OK = 0,
+    SELECTION_NO_DATA = -1,
+    SELECTION_POINTER = -2
+};
+
+// Median, MAD, min and max of data using introselect instead of a full sort.
+// data are reordered in place. scratch must hold n values and is needed only for the MAD;
+// pass NULL to skip the MAD (returned as NaN).
+// Results match gsl_stats_median and gsl_stats_mad, including the mean of the two middle values for even n.
+int selectionStatistics(double *data, size_t n, double *scratch, SelectionStatistics *stats);
+
+// Median of data, reordering data in place
+double selectionMedian(double *data, size_t n);
+
+// Returns the k-th smallest value (k from 0), reordering data so that data[k] holds it,
+// with no larger values before k and no smaller values after k.
+double selectKth(double *data, size_t n, size_t k);
+
+#endif // _SELECTION_STATISTICS_H
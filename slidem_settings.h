@@ -52,7 +52,9 @@
 
 #define SECONDS_OF_DATA_REQUIRED_FOR_PROCESSING 1 // 1 second
 #define SECONDS_OF_DATA_REQUIRED_FOR_EXPORTING 1 // 1 second
-#define SECONDS_OF_BOUNDARY_DATA_REQUIRED_FOR_PROCESSING 0 // 25 minutes to ensure coverage of each fit region
+#define SECONDS_OF_BOUNDARY_DATA_REQUIRED_FOR_PROCESSING 5700 // about one orbit cached at each end of the day so that fit regions straddling midnight can be completed
+#define STREAMING_CHUNK_SECONDS 5700 // about one orbit of HM records per chunk in --streaming mode; extended as needed to keep fit regions whole
+#define STREAMING_INPUT_MARGIN_SECONDS 10 // FP, MAG and MODx records read beyond each end of a window of HM records; interpolation uses neighbours within 2 s
 #define MINIMUM_POINTS_PER_FIT_REGION 10 // at least 10 data points needed for each end of the polar pass for ion drift offset estimation
 
 // Do not include points in the ion drift post-calibration offset model if any of the bits in the mask have been raised
@@ -101,7 +103,7 @@
 #define NUM_MAG_VARIABLES 4
 #define NUM_MAGFILE_VARIABLES 22
 #define NUM_VNEC_VARIABLES 4
-#define NUM_EXPORT_VARIABLES 23
+#define NUM_EXPORT_VARIABLES 24
 
 #define MISSING_MIEFF_VALUE -1.0
 #define MISSING_VI_VALUE -100000.0
@@ -115,8 +117,16 @@
 #define MISSING_VS_VALUE -1.0
 
 #define GSL_FIT_MAXIMUM_ITERATIONS 500
+#define POST_PROCESSING_MAX_THREADS 8 // Ion drift offset regions are fitted concurrently on up to this many threads
+#define CDF_EXPORT_MAX_THREADS 8 // GZIP blocks of exported variables are compressed concurrently on up to this many threads
 
 #define CDF_GZIP_COMPRESSION_LEVEL 6L
 #define CDF_BLOCKING_FACTOR 43200L
+// Combinations tried by --benchmark-export. A blocking factor of 0 is the CDF library default.
+#define EXPORT_BENCHMARK_CODECS "none", "rle", "huff", "ahuff", "gzip:1", "gzip:6", "gzip:9"
+#define EXPORT_BENCHMARK_BLOCKING_FACTORS 0L, 4096L, 43200L, 172800L
+
+// Exports start from a copy of a CDF holding the variables and static attributes, kept in the cache directory
+#define CDF_SKELETON_PREFIX ".slidem_skeleton_"
 
 #endif // _SLIDEM_SETTING_H
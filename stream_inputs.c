@@ -0,0 +1,770 @@
+/*
+
+    SLIDEM Processor: stream_inputs.c
+
+    Copyright (C) 2024  Johnathan K Burchill
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "stream_inputs.h"
+
+#include "main.h"
+#include "slidem_settings.h"
+#include "utilities.h"
+#include "downsample.h"
+#include "interpolate.h"
+#include "calculate_diplatitude.h"
+#include "boundary_cache.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <gsl/gsl_math.h>
+
+extern char infoHeader[50];
+
+static char *fpVariables[NUM_FP_VARIABLES] = {
+    "Timestamp",
+    "Current"
+};
+
+static char *magVariables[NUM_MAG_VARIABLES] = {
+    "Timestamp",
+    "B_NEC",
+    "Flags_B",
+    "Flags_q"
+};
+
+#define VELOCITY_WINDOW_BLOCK_SIZE 4096 // Records to grow a velocity window by at a time
+
+static int growBuffer(uint8_t **buffer, size_t recordSize, long nRecs)
+{
+    void *mem = realloc(*buffer, recordSize * (size_t)nRecs);
+    if (mem == NULL)
+        return STREAM_INPUTS_MEMORY;
+    *buffer = mem;
+
+    return STREAM_INPUTS_OK;
+}
+
+static int reserveHmAlignedInputs(const StreamInputs *inputs, HmAlignedInputs *window, long nRecs)
+{
+    if (nRecs <= window->capacity)
+        return STREAM_INPUTS_OK;
+
+    int status = STREAM_INPUTS_OK;
+    for (int i = 0; i < NUM_HM_VARIABLES; i++)
+        status |= growBuffer(&window->hmDataBuffers[i], inputs->hmRecordSizes[i], nRecs);
+    status |= growBuffer((uint8_t**)&window->fpCurrent, sizeof(double), nRecs);
+    status |= growBuffer((uint8_t**)&window->vn, sizeof(double), nRecs);
+    status |= growBuffer((uint8_t**)&window->ve, sizeof(double), nRecs);
+    status |= growBuffer((uint8_t**)&window->vc, sizeof(double), nRecs);
+    status |= growBuffer((uint8_t**)&window->dipLatitude, sizeof(double), nRecs);
+    if (status != STREAM_INPUTS_OK)
+        return STREAM_INPUTS_MEMORY;
+
+    window->capacity = nRecs;
+
+    return STREAM_INPUTS_OK;
+}
+
+void freeHmAlignedInputs(HmAlignedInputs *inputs)
+{
+    for (int i = 0; i < NUM_HM_VARIABLES; i++)
+        free(inputs->hmDataBuffers[i]);
+    free(inputs->fpCurrent);
+    free(inputs->vn);
+    free(inputs->ve);
+    free(inputs->vc);
+    free(inputs->dipLatitude);
+    memset(inputs, 0, sizeof(HmAlignedInputs));
+
+    return;
+}
+
+static CDFstatus openInputCdf(const char *cdfFilename, CDFid *cdfId)
+{
+    CDFstatus status = CDFopenCDF((char *)cdfFilename, cdfId);
+    if (status != CDF_OK)
+    {
+        printErrorMessage(status);
+        fprintf(stdout, "%sCould not open %s.\n", infoHeader, cdfFilename);
+        *cdfId = NULL;
+    }
+
+    return status;
+}
+
+// Bytes per record of a variable, and its data type if dataType is not NULL
+static CDFstatus variableRecordSize(CDFid cdfId, char *variable, long *dataType, size_t *recordSize)
+{
+    long varNum = CDFgetVarNum(cdfId, variable);
+    if (varNum < 0)
+        return (CDFstatus) varNum;
+
+    long type = 0;
+    long numVarBytes = 0;
+    long numDims = 0;
+    long dimSizes[CDF_MAX_DIMS] = {0};
+    CDFstatus status = CDFgetzVarDataType(cdfId, varNum, &type);
+    if (status == CDF_OK)
+        status = CDFgetzVarNumDims(cdfId, varNum, &numDims);
+    if (status == CDF_OK)
+        status = CDFgetzVarDimSizes(cdfId, varNum, dimSizes);
+    if (status == CDF_OK)
+        status = CDFgetDataTypeSize(type, &numVarBytes);
+    if (status != CDF_OK)
+        return status;
+
+    long numValues = 1;
+    for (long j = 0; j < numDims; j++)
+        numValues *= dimSizes[j];
+    *recordSize = (size_t)(numValues * numVarBytes);
+    if (dataType != NULL)
+        *dataType = type;
+
+    return CDF_OK;
+}
+
+static CDFstatus inputRecordSizes(CDFid cdfId, char **variables, int nVariables, long *dataTypes, size_t *recordSizes, long *nRecs)
+{
+    CDFstatus status = CDF_OK;
+    for (int i = 0; i < nVariables && status == CDF_OK; i++)
+    {
+        status = variableRecordSize(cdfId, variables[i], dataTypes != NULL ? &dataTypes[i] : NULL, &recordSizes[i]);
+        if (status != CDF_OK)
+        {
+            printErrorMessage(status);
+            fprintf(stdout, "%sError reading variable %s from CDF file.\n", infoHeader, variables[i]);
+        }
+    }
+    if (status != CDF_OK)
+        return status;
+
+    long maxRecord = -1;
+    status = CDFgetzVarMaxWrittenRecNum(cdfId, CDFgetVarNum(cdfId, variables[0]), &maxRecord);
+    if (status != CDF_OK)
+        printErrorMessage(status);
+    *nRecs = maxRecord + 1;
+
+    return status;
+}
+
+static CDFstatus recordTime(CDFid cdfId, long record, double *time)
+{
+    return CDFgetVarRangeRecordsByVarName(cdfId, "Timestamp", record, record, time);
+}
+
+// First record with a time at or after (inclusive) or after (not inclusive) time, by bisection of the Timestamps
+static CDFstatus firstRecordAfter(CDFid cdfId, long nRecs, double time, bool inclusive, long *record)
+{
+    long low = 0;
+    long high = nRecs;
+    double t = 0.0;
+    CDFstatus status = CDF_OK;
+    while (low < high)
+    {
+        long middle = low + (high - low) / 2;
+        status = recordTime(cdfId, middle, &t);
+        if (status != CDF_OK)
+            return status;
+        if (inclusive ? t < time : t <= time)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+    *record = low;
+
+    return CDF_OK;
+}
+
+// Records from first to first + nRecs - 1 of each variable, into newly allocated buffers
+static int readRecordRange(CDFid cdfId, char **variables, int nVariables, const size_t *recordSizes, long first, long nRecs, uint8_t **dataBuffers)
+{
+    for (int i = 0; i < nVariables; i++)
+    {
+        dataBuffers[i] = malloc(recordSizes[i] * (size_t)nRecs);
+        if (dataBuffers[i] == NULL)
+            return STREAM_INPUTS_MEMORY;
+        CDFstatus status = CDFgetVarRangeRecordsByVarName(cdfId, variables[i], first, first + nRecs - 1, dataBuffers[i]);
+        if (status != CDF_OK)
+        {
+            printErrorMessage(status);
+            return STREAM_INPUTS_READ;
+        }
+    }
+
+    return STREAM_INPUTS_OK;
+}
+
+static void freeBuffers(uint8_t **dataBuffers, int nBuffers)
+{
+    for (int i = 0; i < nBuffers; i++)
+    {
+        free(dataBuffers[i]);
+        dataBuffers[i] = NULL;
+    }
+
+    return;
+}
+
+static int openVelocityWindow(VelocityWindow *window, const char *modFilename, long *nVnecRecs)
+{
+    memset(window, 0, sizeof(VelocityWindow));
+    window->skippedUntil = -1.0e300;
+    *nVnecRecs = 0;
+
+    int status = openSatelliteVelocity(modFilename, &window->file);
+    if (status != SAT_VEL_OK)
+        return status;
+
+    // The whole file is checked as loadSatelliteVelocity would, then read again a window at a time
+    double cdfTime, vn, ve, vc;
+    while ((status = nextSatelliteVelocity(&window->file, &cdfTime, &vn, &ve, &vc)) == SAT_VEL_OK);
+    if (status == SAT_VEL_END_OF_FILE)
+        status = window->file.records == window->file.epochs ? SAT_VEL_OK : SAT_VEL_ERROR_WRONG_NUMBER_OF_RECORDS_READ;
+    if (status == SAT_VEL_OK)
+    {
+        *nVnecRecs = window->file.records;
+        status = rewindSatelliteVelocity(&window->file);
+    }
+    if (status != SAT_VEL_OK)
+    {
+        closeSatelliteVelocity(&window->file);
+        return status;
+    }
+    window->available = true;
+
+    return SAT_VEL_OK;
+}
+
+static void closeVelocityWindow(VelocityWindow *window)
+{
+    closeSatelliteVelocity(&window->file);
+    freeBuffers(window->vnecDataBuffers, NUM_VNEC_VARIABLES);
+    window->available = false;
+    window->nRecs = 0;
+    window->capacity = 0;
+
+    return;
+}
+
+// Keeps the records from the last one before beginTime to the first one after endTime,
+// the neighbours whole-day interpolation would use
+static int moveVelocityWindow(VelocityWindow *window, double beginTime, double endTime)
+{
+    if (!window->available)
+        return STREAM_INPUTS_OK;
+
+    double *times = (double*)window->vnecDataBuffers[0];
+    if (window->skippedUntil > -1.0e300 && (window->nRecs == 0 || beginTime <= times[0]))
+    {
+        if (rewindSatelliteVelocity(&window->file) != SAT_VEL_OK)
+            return STREAM_INPUTS_READ;
+        window->nRecs = 0;
+        window->endOfFile = false;
+        window->skippedUntil = -1.0e300;
+    }
+
+    long drop = 0;
+    while (drop + 1 < window->nRecs && times[drop + 1] < beginTime)
+        drop++;
+    if (drop > 0)
+    {
+        window->skippedUntil = times[drop - 1];
+        window->nRecs -= drop;
+        for (int i = 0; i < NUM_VNEC_VARIABLES; i++)
+            memmove(window->vnecDataBuffers[i], window->vnecDataBuffers[i] + sizeof(double) * (size_t)drop, sizeof(double) * (size_t)window->nRecs);
+    }
+
+    double cdfTime, vn, ve, vc;
+    while (!window->endOfFile && (window->nRecs == 0 || times[window->nRecs - 1] <= endTime))
+    {
+        int status = nextSatelliteVelocity(&window->file, &cdfTime, &vn, &ve, &vc);
+        if (status == SAT_VEL_END_OF_FILE)
+        {
+            window->endOfFile = true;
+            break;
+        }
+        if (status != SAT_VEL_OK)
+            return STREAM_INPUTS_READ;
+        // Only the latest record before beginTime is kept
+        if (cdfTime < beginTime && window->nRecs > 0 && times[window->nRecs - 1] < beginTime)
+        {
+            window->skippedUntil = times[window->nRecs - 1];
+            window->nRecs--;
+        }
+        if (window->nRecs == window->capacity)
+        {
+            long capacity = window->capacity + VELOCITY_WINDOW_BLOCK_SIZE;
+            for (int i = 0; i < NUM_VNEC_VARIABLES; i++)
+            {
+                if (growBuffer(&window->vnecDataBuffers[i], sizeof(double), capacity) != STREAM_INPUTS_OK)
+                    return STREAM_INPUTS_MEMORY;
+            }
+            window->capacity = capacity;
+            times = (double*)window->vnecDataBuffers[0];
+        }
+        times[window->nRecs] = cdfTime;
+        ((double*)window->vnecDataBuffers[1])[window->nRecs] = vn;
+        ((double*)window->vnecDataBuffers[2])[window->nRecs] = ve;
+        ((double*)window->vnecDataBuffers[3])[window->nRecs] = vc;
+        window->nRecs++;
+    }
+
+    return STREAM_INPUTS_OK;
+}
+
+static void fillValue(double *values, long nRecs, double value)
+{
+    for (long i = 0; i < nRecs; i++)
+        values[i] = value;
+
+    return;
+}
+
+// Interpolates whatever FP, VNEC and MAG records were found near the HM times.
+// Without records the values are those of whole-day interpolation far from any record.
+static void interpolateInputs(uint8_t **fpDataBuffers, long nFpRecs, uint8_t **vnecDataBuffers, long nVnecRecs, uint8_t **magDataBuffers, double *dipLat, long nMagRecs, uint8_t **hmDataBuffers, long nRecs, double *fpCurrent, double *vn, double *ve, double *vc, double *dipLatitude)
+{
+    if (nFpRecs > 0)
+        interpolateFpCurrent(fpDataBuffers, nFpRecs, hmDataBuffers, nRecs, fpCurrent);
+    else
+        fillValue(fpCurrent, nRecs, GSL_NAN);
+    if (nVnecRecs > 0)
+    {
+        interpolateVNEC(vnecDataBuffers, nVnecRecs, hmDataBuffers, nRecs, vn, 1);
+        interpolateVNEC(vnecDataBuffers, nVnecRecs, hmDataBuffers, nRecs, ve, 2);
+        interpolateVNEC(vnecDataBuffers, nVnecRecs, hmDataBuffers, nRecs, vc, 3);
+    }
+    else
+    {
+        fillValue(vn, nRecs, MISSING_VNEC_VALUE);
+        fillValue(ve, nRecs, MISSING_VNEC_VALUE);
+        fillValue(vc, nRecs, MISSING_VNEC_VALUE);
+    }
+    if (nMagRecs > 0)
+        interpolateDipLatitude((double*)magDataBuffers[0], dipLat, nMagRecs, hmDataBuffers, nRecs, dipLatitude);
+    else
+        fillValue(dipLatitude, nRecs, MISSING_DIPLAT_VALUE);
+
+    return;
+}
+
+// downSample averages the 16 Hz samples up to and including the last one of each half second
+static bool closesHalfSecond(double time)
+{
+    double t0 = time / 1000.;
+    double dt = t0 - floor(t0);
+
+    return (dt >= 0.4375 && dt < 0.5) || (dt >= 0.9375 && dt < 1);
+}
+
+// 2 Hz FP samples for HM times from beginTime to endTime. Whole half seconds are read, as downsampled from the start
+// of the file, with a sample either side that whole-day interpolation would use across a gap.
+static int readFpSamples(StreamInputs *inputs, double beginTime, double endTime, uint8_t **fpDataBuffers, long *nFpRecs)
+{
+    CDFid cdfId = inputs->fpCdfId;
+    long n = inputs->nFp16HzRecs;
+    long first = 0, end = 0;
+    *nFpRecs = 0;
+    CDFstatus cdfStatus = firstRecordAfter(cdfId, n, beginTime, true, &first);
+    if (cdfStatus == CDF_OK)
+        cdfStatus = firstRecordAfter(cdfId, n, endTime, false, &end);
+    if (cdfStatus != CDF_OK)
+        return STREAM_INPUTS_READ;
+    if (first > 0)
+        first--;
+    if (end < n)
+        end++;
+
+    double t = 0.0;
+    for (;;)
+    {
+        while (first > 0 && (cdfStatus = recordTime(cdfId, first - 1, &t)) == CDF_OK && !closesHalfSecond(t))
+            first--;
+        while (end < n && cdfStatus == CDF_OK && (cdfStatus = recordTime(cdfId, end - 1, &t)) == CDF_OK && !closesHalfSecond(t))
+            end++;
+        if (cdfStatus != CDF_OK)
+            return STREAM_INPUTS_READ;
+
+        freeBuffers(fpDataBuffers, NUM_FP_VARIABLES);
+        *nFpRecs = end - first;
+        if (*nFpRecs <= 0)
+            return STREAM_INPUTS_OK;
+        int status = readRecordRange(cdfId, fpVariables, NUM_FP_VARIABLES, inputs->fpRecordSizes, first, *nFpRecs, fpDataBuffers);
+        if (status != STREAM_INPUTS_OK)
+            return status;
+        downSample(fpDataBuffers, NUM_FP_VARIABLES, nFpRecs);
+
+        // Half seconds spanning a gap can average to times inside the window
+        double *times = (double*)fpDataBuffers[0];
+        if (first > 0 && (*nFpRecs == 0 || times[0] >= beginTime))
+            first--;
+        else if (end < n && (*nFpRecs == 0 || times[*nFpRecs - 1] <= endTime))
+            end++;
+        else
+            break;
+    }
+
+    return STREAM_INPUTS_OK;
+}
+
+// Reads records first to first + nRecs - 1 of this day's HM file into window from record offset,
+// with the FP, MAG and MODx records near those times
+static int readDayRecords(StreamInputs *inputs, long first, long nRecs, HmAlignedInputs *window, long offset)
+{
+    uint8_t *hmDataBuffers[NUM_HM_VARIABLES];
+    for (int i = 0; i < NUM_HM_VARIABLES; i++)
+        hmDataBuffers[i] = window->hmDataBuffers[i] + inputs->hmRecordSizes[i] * (size_t)offset;
+    CDFstatus cdfStatus = CDF_OK;
+    for (int i = 0; i < NUM_HM_VARIABLES && cdfStatus == CDF_OK; i++)
+        cdfStatus = CDFgetVarRangeRecordsByVarName(inputs->hmCdfId, inputs->hmVariables[i], first, first + nRecs - 1, hmDataBuffers[i]);
+    if (cdfStatus != CDF_OK)
+    {
+        printErrorMessage(cdfStatus);
+        return STREAM_INPUTS_READ;
+    }
+
+    // Same corrections as for whole-day loading
+    for (long hmTimeIndex = 0; hmTimeIndex < nRecs; hmTimeIndex++)
+    {
+        // Convert heights from km to m
+        ((double*)hmDataBuffers[4])[hmTimeIndex] = 1000. * HEIGHT();
+        // Ensure longitude is within the range -180 to +180
+        if (LON() > 180.0)
+            ((double*)hmDataBuffers[2])[hmTimeIndex] = LON() - 360.0;
+        if (LON() < -180.0)
+            ((double*)hmDataBuffers[2])[hmTimeIndex] = LON() + 360.0;
+        // Radius is 0 in recent LP files. Temporary workaround:
+        (*((double*)hmDataBuffers[3]+(hmTimeIndex))) = (6371.0 * 1000.0 + HEIGHT()); // m
+    }
+
+    long hmTimeIndex = 0;
+    double beginTime = HMTIME() - STREAMING_INPUT_MARGIN_SECONDS * 1000.0;
+    hmTimeIndex = nRecs - 1;
+    double endTime = HMTIME() + STREAMING_INPUT_MARGIN_SECONDS * 1000.0;
+
+    uint8_t *fpDataBuffers[NUM_FP_VARIABLES] = {NULL};
+    uint8_t *vnecDataBuffers[NUM_VNEC_VARIABLES] = {NULL};
+    uint8_t *magDataBuffers[NUM_MAG_VARIABLES] = {NULL};
+    double *dipLat = NULL;
+    int status = STREAM_INPUTS_OK;
+
+    // Faceplate current downsampled to 2 Hz
+    long nFpRecs = 0;
+    status = readFpSamples(inputs, beginTime, endTime, fpDataBuffers, &nFpRecs);
+    if (status != STREAM_INPUTS_OK)
+        goto cleanup;
+
+    // Satellite velocity, with the previous day's MODx records ahead of this day's as for whole-day loading
+    status = moveVelocityWindow(&inputs->velocityPrevious, beginTime, endTime);
+    if (status == STREAM_INPUTS_OK)
+        status = moveVelocityWindow(&inputs->velocity, beginTime, endTime);
+    if (status != STREAM_INPUTS_OK)
+        goto cleanup;
+    long nPrevious = inputs->velocityPrevious.nRecs;
+    long nVnecRecs = nPrevious + inputs->velocity.nRecs;
+    for (int i = 0; i < NUM_VNEC_VARIABLES && nVnecRecs > 0; i++)
+    {
+        vnecDataBuffers[i] = malloc(sizeof(double) * (size_t)nVnecRecs);
+        if (vnecDataBuffers[i] == NULL)
+        {
+            status = STREAM_INPUTS_MEMORY;
+            goto cleanup;
+        }
+        if (nPrevious > 0)
+            memcpy(vnecDataBuffers[i], inputs->velocityPrevious.vnecDataBuffers[i], sizeof(double) * (size_t)nPrevious);
+        if (inputs->velocity.nRecs > 0)
+            memcpy(vnecDataBuffers[i] + sizeof(double) * (size_t)nPrevious, inputs->velocity.vnecDataBuffers[i], sizeof(double) * (size_t)inputs->velocity.nRecs);
+    }
+
+    // Magnetic field for dip latitude, with the records either side that whole-day interpolation would use across a gap
+    long magFirst = 0, magEnd = 0;
+    cdfStatus = firstRecordAfter(inputs->magCdfId, inputs->nMagRecs, beginTime, true, &magFirst);
+    if (cdfStatus == CDF_OK)
+        cdfStatus = firstRecordAfter(inputs->magCdfId, inputs->nMagRecs, endTime, false, &magEnd);
+    if (cdfStatus != CDF_OK)
+    {
+        status = STREAM_INPUTS_READ;
+        goto cleanup;
+    }
+    if (magFirst > 0)
+        magFirst--;
+    if (magEnd < inputs->nMagRecs)
+        magEnd++;
+    long nMagRecs = magEnd - magFirst;
+    if (nMagRecs > 0)
+        status = readRecordRange(inputs->magCdfId, magVariables, NUM_MAG_VARIABLES, inputs->magRecordSizes, magFirst, nMagRecs, magDataBuffers);
+    if (status != STREAM_INPUTS_OK)
+        goto cleanup;
+    if (nMagRecs > 0)
+    {
+        dipLat = malloc(sizeof(double) * (size_t)nMagRecs);
+        if (dipLat == NULL)
+        {
+            status = STREAM_INPUTS_MEMORY;
+            goto cleanup;
+        }
+        // calculateDipLatitude marks a flagged record missing at dipLat[0], the first record of the file for whole-day loading
+        double firstDipLat = MISSING_DIPLAT_VALUE;
+        calculateDipLatitude(magDataBuffers, 1, &firstDipLat);
+        calculateDipLatitude(magDataBuffers, nMagRecs, dipLat);
+        if (magFirst > 0)
+            dipLat[0] = firstDipLat;
+    }
+
+    if (nRecs > 1)
+    {
+        interpolateInputs(fpDataBuffers, nFpRecs, vnecDataBuffers, nVnecRecs, magDataBuffers, dipLat, nMagRecs, hmDataBuffers, nRecs, window->fpCurrent + offset, window->vn + offset, window->ve + offset, window->vc + offset, window->dipLatitude + offset);
+    }
+    else
+    {
+        // The interpolation allocates a GSL spline per HM record, which needs at least two points
+        double times[2] = {*((double*)hmDataBuffers[0]), *((double*)hmDataBuffers[0])};
+        uint8_t *timeBuffers[1] = {(uint8_t*)times};
+        double values[5][2];
+        interpolateInputs(fpDataBuffers, nFpRecs, vnecDataBuffers, nVnecRecs, magDataBuffers, dipLat, nMagRecs, timeBuffers, 2, values[0], values[1], values[2], values[3], values[4]);
+        window->fpCurrent[offset] = values[0][0];
+        window->vn[offset] = values[1][0];
+        window->ve[offset] = values[2][0];
+        window->vc[offset] = values[3][0];
+        window->dipLatitude[offset] = values[4][0];
+    }
+
+cleanup:
+    freeBuffers(fpDataBuffers, NUM_FP_VARIABLES);
+    freeBuffers(vnecDataBuffers, NUM_VNEC_VARIABLES);
+    freeBuffers(magDataBuffers, NUM_MAG_VARIABLES);
+    free(dipLat);
+
+    return status;
+}
+
+// Copies cached boundary records into window from record offset
+static void copyRecords(const StreamInputs *inputs, const HmAlignedInputs *source, long first, long nRecs, HmAlignedInputs *window, long offset)
+{
+    for (int i = 0; i < NUM_HM_VARIABLES; i++)
+        memcpy(window->hmDataBuffers[i] + inputs->hmRecordSizes[i] * (size_t)offset, source->hmDataBuffers[i] + inputs->hmRecordSizes[i] * (size_t)first, inputs->hmRecordSizes[i] * (size_t)nRecs);
+    memcpy(window->fpCurrent + offset, source->fpCurrent + first, sizeof(double) * (size_t)nRecs);
+    memcpy(window->vn + offset, source->vn + first, sizeof(double) * (size_t)nRecs);
+    memcpy(window->ve + offset, source->ve + first, sizeof(double) * (size_t)nRecs);
+    memcpy(window->vc + offset, source->vc + first, sizeof(double) * (size_t)nRecs);
+    memcpy(window->dipLatitude + offset, source->dipLatitude + first, sizeof(double) * (size_t)nRecs);
+
+    return;
+}
+
+static int readBoundaryRecords(StreamInputs *inputs, const char *cacheFilename, int cacheWindow, double dayFirstTime, double dayLastTime, HmAlignedInputs *records)
+{
+    int status = readBoundaryWindow(cacheFilename, cacheWindow, dayFirstTime, dayLastTime, inputs->hmVariables, NUM_HM_VARIABLES, inputs->hmRecordSizes, records->hmDataBuffers, &records->fpCurrent, &records->vn, &records->ve, &records->vc, &records->dipLatitude, &records->nRecs);
+    if (status == BOUNDARY_CACHE_MISMATCH)
+        fprintf(stdout, "%sIgnoring incompatible boundary cache %s\n", infoHeader, cacheFilename);
+    if (status != BOUNDARY_CACHE_OK)
+        freeHmAlignedInputs(records);
+    records->capacity = records->nRecs;
+
+    return status == BOUNDARY_CACHE_MEMORY ? STREAM_INPUTS_MEMORY : STREAM_INPUTS_OK;
+}
+
+int openStreamInputs(StreamInputs *inputs, const char *fpFilename, const char *hmFilename, const char *modFilename, const char *modFilenamePrevious, const char *magFilename, char **hmVariables, const char *previousCacheFilename, const char *nextCacheFilename)
+{
+    if (inputs == NULL || hmVariables == NULL)
+        return STREAM_INPUTS_ARGUMENTS;
+
+    memset(inputs, 0, sizeof(StreamInputs));
+    inputs->hmVariables = hmVariables;
+
+    CDFsetValidate(VALIDATEFILEoff);
+    int status = STREAM_INPUTS_FILE;
+    if (openInputCdf(fpFilename, &inputs->fpCdfId) != CDF_OK || inputRecordSizes(inputs->fpCdfId, fpVariables, NUM_FP_VARIABLES, NULL, inputs->fpRecordSizes, &inputs->nFp16HzRecs) != CDF_OK)
+        goto error;
+    if (openInputCdf(hmFilename, &inputs->hmCdfId) != CDF_OK || inputRecordSizes(inputs->hmCdfId, hmVariables, NUM_HM_VARIABLES, inputs->hmDataTypes, inputs->hmRecordSizes, &inputs->nHmFileRecs) != CDF_OK)
+        goto error;
+    if (openInputCdf(magFilename, &inputs->magCdfId) != CDF_OK || inputRecordSizes(inputs->magCdfId, magVariables, NUM_MAG_VARIABLES, NULL, inputs->magRecordSizes, &inputs->nMagRecs) != CDF_OK || inputs->nMagRecs == 0)
+    {
+        fprintf(stdout, "%sUnable to load magnetic field.\n", infoHeader);
+        goto error;
+    }
+    if (openVelocityWindow(&inputs->velocity, modFilename, &inputs->nVnecRecs) != SAT_VEL_OK)
+    {
+        fprintf(stdout, "%sUnable to load satellite velocity.\n", infoHeader);
+        goto error;
+    }
+    // Previous day used if available but not required
+    openVelocityWindow(&inputs->velocityPrevious, modFilenamePrevious, &inputs->nVnecRecsPrev);
+
+    fprintf(stdout, "%sInput data. FP: %ld s HM: %ld s VNEC: %ld s MAG: %ld s.\n", infoHeader, inputs->nFp16HzRecs / 16, inputs->nHmFileRecs / 2, inputs->nVnecRecs + inputs->nVnecRecsPrev, inputs->nMagRecs);
+    if (inputs->nHmFileRecs == 0 || inputs->nFp16HzRecs == 0 || inputs->nVnecRecs == 0)
+    {
+        fprintf(stdout, "%sError: one or more input files does not have records.\n", infoHeader);
+        goto error;
+    }
+
+    double dayFirstTime = 0.0, dayLastTime = 0.0;
+    if (recordTime(inputs->hmCdfId, 0, &dayFirstTime) != CDF_OK || recordTime(inputs->hmCdfId, inputs->nHmFileRecs - 1, &dayLastTime) != CDF_OK)
+    {
+        status = STREAM_INPUTS_READ;
+        goto error;
+    }
+    status = readBoundaryRecords(inputs, previousCacheFilename, BOUNDARY_CACHE_TAIL, dayFirstTime, dayLastTime, &inputs->previous);
+    if (status == STREAM_INPUTS_OK)
+        status = readBoundaryRecords(inputs, nextCacheFilename, BOUNDARY_CACHE_HEAD, dayFirstTime, dayLastTime, &inputs->next);
+    if (status != STREAM_INPUTS_OK)
+        goto error;
+    inputs->nRecs = inputs->previous.nRecs + inputs->nHmFileRecs + inputs->next.nRecs;
+
+    return STREAM_INPUTS_OK;
+
+error:
+    closeStreamInputs(inputs);
+
+    return status;
+}
+
+void closeStreamInputs(StreamInputs *inputs)
+{
+    if (inputs->fpCdfId != NULL)
+        closeCdf(inputs->fpCdfId);
+    if (inputs->hmCdfId != NULL)
+        closeCdf(inputs->hmCdfId);
+    if (inputs->magCdfId != NULL)
+        closeCdf(inputs->magCdfId);
+    inputs->fpCdfId = NULL;
+    inputs->hmCdfId = NULL;
+    inputs->magCdfId = NULL;
+    closeVelocityWindow(&inputs->velocity);
+    closeVelocityWindow(&inputs->velocityPrevious);
+    freeHmAlignedInputs(&inputs->previous);
+    freeHmAlignedInputs(&inputs->next);
+    inputs->nRecs = 0;
+
+    return;
+}
+
+int readStreamInputs(StreamInputs *inputs, long first, long nRecs, HmAlignedInputs *window)
+{
+    if (inputs == NULL || window == NULL || first < 0 || nRecs <= 0 || first + nRecs > inputs->nRecs)
+        return STREAM_INPUTS_ARGUMENTS;
+
+    if (reserveHmAlignedInputs(inputs, window, nRecs) != STREAM_INPUTS_OK)
+        return STREAM_INPUTS_MEMORY;
+
+    long end = first + nRecs;
+    long dayFirst = inputs->previous.nRecs;
+    long dayEnd = dayFirst + inputs->nHmFileRecs;
+    int status = STREAM_INPUTS_OK;
+    if (first < dayFirst)
+        copyRecords(inputs, &inputs->previous, first, (end < dayFirst ? end : dayFirst) - first, window, 0);
+    if (end > dayFirst && first < dayEnd)
+    {
+        long a = first > dayFirst ? first : dayFirst;
+        long b = end < dayEnd ? end : dayEnd;
+        status = readDayRecords(inputs, a - dayFirst, b - a, window, a - first);
+    }
+    if (status == STREAM_INPUTS_OK && end > dayEnd)
+    {
+        long a = first > dayEnd ? first : dayEnd;
+        copyRecords(inputs, &inputs->next, a - dayEnd, end - a, window, a - first);
+    }
+    window->nRecs = status == STREAM_INPUTS_OK ? nRecs : 0;
+
+    return status;
+}
+
+int streamInputTime(StreamInputs *inputs, long record, double *time)
+{
+    if (inputs == NULL || time == NULL || record < 0 || record >= inputs->nRecs)
+        return STREAM_INPUTS_ARGUMENTS;
+
+    long dayFirst = inputs->previous.nRecs;
+    long dayEnd = dayFirst + inputs->nHmFileRecs;
+    if (record < dayFirst)
+        *time = ((double*)inputs->previous.hmDataBuffers[0])[record];
+    else if (record >= dayEnd)
+        *time = ((double*)inputs->next.hmDataBuffers[0])[record - dayEnd];
+    else if (recordTime(inputs->hmCdfId, record - dayFirst, time) != CDF_OK)
+        return STREAM_INPUTS_READ;
+
+    return STREAM_INPUTS_OK;
+}
+
+int streamInputRecordAt(StreamInputs *inputs, double time, long *record)
+{
+    if (inputs == NULL || record == NULL)
+        return STREAM_INPUTS_ARGUMENTS;
+
+    long low = 0;
+    long high = inputs->nRecs;
+    double t = 0.0;
+    while (low < high)
+    {
+        long middle = low + (high - low) / 2;
+        int status = streamInputTime(inputs, middle, &t);
+        if (status != STREAM_INPUTS_OK)
+            return status;
+        if (t < time)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+    *record = low;
+
+    return STREAM_INPUTS_OK;
+}
+
+int writeStreamBoundaryCache(StreamInputs *inputs, const char *cacheFilename, double windowSeconds)
+{
+    if (inputs == NULL || cacheFilename == NULL || inputs->nHmFileRecs <= 0)
+        return STREAM_INPUTS_ARGUMENTS;
+
+    // Same head and tail windows as writeBoundaryCache selects from the whole day
+    long n = inputs->nHmFileRecs;
+    double firstTime = 0.0, lastTime = 0.0;
+    long nHead = 0, tailStart = 0;
+    CDFstatus cdfStatus = recordTime(inputs->hmCdfId, 0, &firstTime);
+    if (cdfStatus == CDF_OK)
+        cdfStatus = recordTime(inputs->hmCdfId, n - 1, &lastTime);
+    if (cdfStatus == CDF_OK)
+        cdfStatus = firstRecordAfter(inputs->hmCdfId, n, firstTime + windowSeconds * 1000.0, true, &nHead);
+    if (cdfStatus == CDF_OK)
+        cdfStatus = firstRecordAfter(inputs->hmCdfId, n, lastTime - windowSeconds * 1000.0, false, &tailStart);
+    if (cdfStatus != CDF_OK)
+        return STREAM_INPUTS_READ;
+    // Short days are read whole
+    if (tailStart <= nHead)
+    {
+        nHead = n;
+        tailStart = n;
+    }
+
+    HmAlignedInputs windows = {0};
+    int status = reserveHmAlignedInputs(inputs, &windows, nHead + n - tailStart);
+    if (status == STREAM_INPUTS_OK)
+        status = readDayRecords(inputs, 0, nHead, &windows, 0);
+    if (status == STREAM_INPUTS_OK && tailStart < n)
+        status = readDayRecords(inputs, tailStart, n - tailStart, &windows, nHead);
+    if (status == STREAM_INPUTS_OK)
+    {
+        windows.nRecs = nHead + n - tailStart;
+        if (writeBoundaryCache(cacheFilename, inputs->hmVariables, NUM_HM_VARIABLES, windows.hmDataBuffers, inputs->hmDataTypes, inputs->hmRecordSizes, windows.nRecs, windows.fpCurrent, windows.vn, windows.ve, windows.vc, windows.dipLatitude, windowSeconds) != BOUNDARY_CACHE_OK)
+            status = STREAM_INPUTS_FILE;
+    }
+    freeHmAlignedInputs(&windows);
+
+    return status;
+}
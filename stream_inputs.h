@@ -0,0 +1,111 @@
+/*
+
+    SLIDEM Processor: stream_inputs.h
+
+    Copyright (C) 2024  Johnathan K Burchill
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _STREAM_INPUTS_H
+#define _STREAM_INPUTS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "slidem_settings.h"
+#include "load_satellite_velocity.h"
+
+#include <cdf.h>
+
+// HM-aligned inputs read a window of HM records at a time, so that memory scales with the window rather than the day.
+// HM records are read with CDF record-range reads. FP and MAG records are read for the same times plus
+// STREAMING_INPUT_MARGIN_SECONDS at each end and the neighbouring records that whole-day interpolation
+// would use across a data gap, then downsampled and interpolated as for whole-day loading.
+// MODx files are text and are read forward, keeping only the records near the current window.
+// Records are numbered as in the whole-day arrays: the previous day's boundary records from its
+// boundary cache come first, then this day's HM records, then the next day's boundary records.
+
+// HM variables and the FP current, VNEC and dip latitude interpolated to the HM times
+typedef struct hmAlignedInputs {
+    uint8_t *hmDataBuffers[NUM_HM_VARIABLES];
+    double *fpCurrent;
+    double *vn;
+    double *ve;
+    double *vc;
+    double *dipLatitude;
+    long nRecs;
+    long capacity;
+} HmAlignedInputs;
+
+// Records of a MODx file around the current window
+typedef struct velocityWindow {
+    SatelliteVelocityFile file;
+    bool available;
+    bool endOfFile;
+    double skippedUntil; // Time of the latest record read and no longer kept
+    uint8_t *vnecDataBuffers[NUM_VNEC_VARIABLES];
+    long nRecs;
+    long capacity;
+} VelocityWindow;
+
+typedef struct streamInputs {
+    char **hmVariables;
+    long hmDataTypes[NUM_HM_VARIABLES];
+    size_t hmRecordSizes[NUM_HM_VARIABLES];
+    size_t fpRecordSizes[NUM_FP_VARIABLES];
+    size_t magRecordSizes[NUM_MAG_VARIABLES];
+    CDFid fpCdfId;
+    CDFid hmCdfId;
+    CDFid magCdfId;
+    long nFp16HzRecs;
+    long nHmFileRecs;
+    long nMagRecs;
+    VelocityWindow velocity;
+    VelocityWindow velocityPrevious;
+    long nVnecRecs;
+    long nVnecRecsPrev;
+    HmAlignedInputs previous; // Previous day's boundary records
+    HmAlignedInputs next; // Next day's boundary records
+    long nRecs; // Previous day's, this day's and next day's records
+} StreamInputs;
+
+// Opens the input files and reads the adjacent days' boundary records from their caches (either cache filename may be NULL).
+// Returns STREAM_INPUTS_FILE if a required input cannot be read, as whole-day loading would skip the date.
+int openStreamInputs(StreamInputs *inputs, const char *fpFilename, const char *hmFilename, const char *modFilename, const char *modFilenamePrevious, const char *magFilename, char **hmVariables, const char *previousCacheFilename, const char *nextCacheFilename);
+void closeStreamInputs(StreamInputs *inputs);
+
+// Reads records first to first + nRecs - 1 into window, whose arrays are grown as needed.
+// Windows should move forward through the day: MODx files are reread from the start when a window moves back.
+int readStreamInputs(StreamInputs *inputs, long first, long nRecs, HmAlignedInputs *window);
+void freeHmAlignedInputs(HmAlignedInputs *inputs);
+
+// CDF_EPOCH of a record
+int streamInputTime(StreamInputs *inputs, long record, double *time);
+// First record at or after time, or nRecs if there is none
+int streamInputRecordAt(StreamInputs *inputs, double time, long *record);
+
+// Writes this day's boundary cache from its head and tail windows without reading the rest of the day
+int writeStreamBoundaryCache(StreamInputs *inputs, const char *cacheFilename, double windowSeconds);
+
+enum STREAM_INPUTS_STATUS {
+    STREAM_INPUTS_OK = 0,
+    STREAM_INPUTS_ARGUMENTS = -1,
+    STREAM_INPUTS_MEMORY = -2,
+    STREAM_INPUTS_FILE = -3,
+    STREAM_INPUTS_READ = -4
+};
+
+#endif // _STREAM_INPUTS_H
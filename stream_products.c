@@ -0,0 +1,431 @@
+/*
+
+    SLIDEM Processor: stream_products.c
+
+    Copyright (C) 2024  Johnathan K Burchill
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "stream_products.h"
+
+#include "main.h"
+#include "slidem_settings.h"
+#include "calculate_products.h"
+#include "post_process.h"
+#include "export_products.h"
+#include "utilities.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <gsl/gsl_errno.h>
+
+extern char infoHeader[50];
+
+static int growArray(void **array, size_t elementSize, long nRecs)
+{
+    void *mem = realloc(*array, elementSize * (size_t)nRecs);
+    if (mem == NULL)
+        return STREAM_MEMORY;
+    *array = mem;
+
+    return STREAM_OK;
+}
+
+int reserveProductChunk(ProductChunk *chunk, long nRecs)
+{
+    if (nRecs <= chunk->capacity)
+        return STREAM_OK;
+
+    int status = STREAM_OK;
+    status |= growArray((void**)&chunk->ionEffectiveMass, sizeof(double), nRecs);
+    status |= growArray((void**)&chunk->ionDensity, sizeof(double), nRecs);
+    status |= growArray((void**)&chunk->ionDriftRaw, sizeof(double), nRecs);
+    status |= growArray((void**)&chunk->ionDrift, sizeof(double), nRecs);
+    status |= growArray((void**)&chunk->ionEffectiveMassError, sizeof(double), nRecs);
+    status |= growArray((void**)&chunk->ionDensityError, sizeof(double), nRecs);
+    status |= growArray((void**)&chunk->ionDriftError, sizeof(double), nRecs);
+    status |= growArray((void**)&chunk->fpAreaOML, sizeof(double), nRecs);
+    status |= growArray((void**)&chunk->rProbeOML, sizeof(double), nRecs);
+    status |= growArray((void**)&chunk->electronTemperature, sizeof(double), nRecs);
+    status |= growArray((void**)&chunk->spacecraftPotential, sizeof(double), nRecs);
+    status |= growArray((void**)&chunk->electronTemperatureSource, sizeof(uint32_t), nRecs);
+    status |= growArray((void**)&chunk->spacecraftPotentialSource, sizeof(uint32_t), nRecs);
+    status |= growArray((void**)&chunk->ionEffectiveMassTTS, sizeof(double), nRecs);
+    status |= growArray((void**)&chunk->mieffFlags, sizeof(uint32_t), nRecs);
+    status |= growArray((void**)&chunk->viFlags, sizeof(uint32_t), nRecs);
+    status |= growArray((void**)&chunk->niFlags, sizeof(uint32_t), nRecs);
+    status |= growArray((void**)&chunk->iterationCount, sizeof(uint16_t), nRecs);
+    if (status != STREAM_OK)
+        return STREAM_MEMORY;
+
+    chunk->capacity = nRecs;
+
+    return STREAM_OK;
+}
+
+void freeProductChunk(ProductChunk *chunk)
+{
+    free(chunk->ionEffectiveMass);
+    free(chunk->ionDensity);
+    free(chunk->ionDriftRaw);
+    free(chunk->ionDrift);
+    free(chunk->ionEffectiveMassError);
+    free(chunk->ionDensityError);
+    free(chunk->ionDriftError);
+    free(chunk->fpAreaOML);
+    free(chunk->rProbeOML);
+    free(chunk->electronTemperature);
+    free(chunk->spacecraftPotential);
+    free(chunk->electronTemperatureSource);
+    free(chunk->spacecraftPotentialSource);
+    free(chunk->ionEffectiveMassTTS);
+    free(chunk->mieffFlags);
+    free(chunk->viFlags);
+    free(chunk->niFlags);
+    free(chunk->iterationCount);
+    memset(chunk, 0, sizeof(ProductChunk));
+
+    return;
+}
+
+// Moves the end of a chunk forward until no fitted region straddles it
+static long chunkEnd(long start, long nHmRecs, const OffsetFitJob *jobs, long nJobs)
+{
+    long end = start + (long)(2 * STREAMING_CHUNK_SECONDS);
+    if (end > nHmRecs)
+        return nHmRecs;
+
+    bool moved = true;
+    while (moved && end < nHmRecs)
+    {
+        moved = false;
+        for (long j = 0; j < nJobs; j++)
+        {
+            if (jobs[j].fitNumber > 0 && jobs[j].region.beginIndex0 < end && jobs[j].region.endIndex1 > end)
+            {
+                end = jobs[j].region.endIndex1;
+                moved = true;
+            }
+        }
+    }
+    if (end > nHmRecs)
+        end = nHmRecs;
+
+    return end;
+}
+
+CDFstatus processProductChunks(const char *slidemFilename, long firstCdfRecord, FILE *fitFile, const char satellite, uint8_t **hmDataBuffers, const size_t *hmRecordSizes, long nHmRecs, double epoch0, long firstExportRecord, long nExportRecords, double *fpCurrent, double *vn, double *ve, double *vc, double *dipLatitude, double *fpVoltage, double f107Adj, int dayOfYear, probeParams sphericalProbeParams, const PassIndex *passIndex, const OffsetFitState *initialFitState, OffsetFitState *finalFitState, long *numberOfSlidemEstimates, long *nChunks, long *maxChunkRecs)
+{
+    *numberOfSlidemEstimates = 0;
+    *nChunks = 0;
+    *maxChunkRecs = 0;
+
+    gsl_set_error_handler_off();
+
+    // Fit regions come from the pass index of all records so that region numbering
+    // and missing FP data checks are the same as for whole-day processing
+    OffsetFitJob *jobs = NULL;
+    long nJobs = 0;
+    long nFitJobs = 0;
+    size_t maxPoints = 0;
+    if (POST_PROCESS_ION_DRIFT && fitFile != NULL)
+    {
+        if (findOffsetFitJobs(passIndex, fpCurrent, initialFitState, &jobs, &nJobs, &nFitJobs, &maxPoints) != OFFSET_FIT_OK)
+            fprintf(stdout, "%sUnable to allocate memory for ion drift offset fits. Not removing offsets.\n", infoHeader);
+    }
+    OffsetFitJob *chunkJobs = NULL;
+    if (nJobs > 0)
+    {
+        chunkJobs = malloc((size_t)nJobs * sizeof(OffsetFitJob));
+        if (chunkJobs == NULL)
+        {
+            fprintf(stdout, "%sUnable to allocate memory for ion drift offset fits. Not removing offsets.\n", infoHeader);
+            free(jobs);
+            jobs = NULL;
+            nJobs = 0;
+        }
+    }
+    if (finalFitState != NULL)
+        offsetFitStateAt(jobs, nJobs, fpCurrent, nHmRecs, initialFitState, finalFitState);
+
+    ProductChunk chunk = {0};
+    CDFstatus status = CDF_OK;
+
+    uint8_t *chunkHmDataBuffers[NUM_HM_VARIABLES];
+    long exportEnd = firstExportRecord + nExportRecords;
+    long end = 0;
+    for (long start = 0; start < nHmRecs; start = end)
+    {
+        end = chunkEnd(start, nHmRecs, jobs, nJobs);
+        long n = end - start;
+        if (reserveProductChunk(&chunk, n) != STREAM_OK)
+        {
+            fprintf(stdout, "%sUnable to allocate memory for a %ld record chunk.\n", infoHeader, n);
+            status = EXPORT_MEM;
+            goto cleanup;
+        }
+        if (n > *maxChunkRecs)
+            *maxChunkRecs = n;
+        for (uint8_t i = 0; i < NUM_HM_VARIABLES; i++)
+            chunkHmDataBuffers[i] = hmDataBuffers[i] + hmRecordSizes[i] * (size_t)start;
+
+        long chunkEstimates = 0;
+        calculateProducts(satellite, chunkHmDataBuffers, fpCurrent + start, vn + start, ve + start, vc + start, dipLatitude + start, fpVoltage + start, f107Adj, dayOfYear, chunk.ionEffectiveMass, chunk.ionDensity, chunk.ionDriftRaw, chunk.ionDrift, chunk.ionEffectiveMassError, chunk.ionDensityError, chunk.ionDriftError, chunk.fpAreaOML, chunk.rProbeOML, chunk.electronTemperature, chunk.spacecraftPotential, chunk.electronTemperatureSource, chunk.spacecraftPotentialSource, chunk.ionEffectiveMassTTS, chunk.mieffFlags, chunk.viFlags, chunk.niFlags, chunk.iterationCount, n, sphericalProbeParams, &chunkEstimates);
+        *numberOfSlidemEstimates += chunkEstimates;
+
+        // Fit the regions that lie within this chunk, using chunk-relative indices
+        if (chunkJobs != NULL)
+        {
+            long nChunkJobs = 0;
+            for (long j = 0; j < nJobs; j++)
+            {
+                if (jobs[j].fitNumber > 0 && jobs[j].region.beginIndex0 >= start && jobs[j].region.endIndex1 <= end)
+                {
+                    chunkJobs[nChunkJobs] = jobs[j];
+                    chunkJobs[nChunkJobs].region.beginIndex0 -= start;
+                    chunkJobs[nChunkJobs].region.beginIndex1 -= start;
+                    chunkJobs[nChunkJobs].region.endIndex0 -= start;
+                    chunkJobs[nChunkJobs].region.endIndex1 -= start;
+                    nChunkJobs++;
+                }
+            }
+            OffsetFitData data = {
+                satellite, chunkHmDataBuffers, epoch0, vn + start, ve + start, vc + start, dipLatitude + start, fpCurrent + start, fpVoltage + start, chunk.fpAreaOML, chunk.rProbeOML, chunk.electronTemperature, chunk.spacecraftPotential, chunk.electronTemperatureSource, chunk.spacecraftPotentialSource, chunk.ionEffectiveMassTTS, chunk.ionDrift, chunk.ionDriftError, chunk.ionEffectiveMass, chunk.ionEffectiveMassError, chunk.ionDensity, chunk.ionDensityError, chunk.viFlags, chunk.mieffFlags, chunk.niFlags, chunk.iterationCount, sphericalProbeParams
+            };
+            fitOffsetJobs(chunkJobs, nChunkJobs, nChunkJobs, maxPoints, &data);
+            // Keep the results with the regions for the fit log
+            for (long j = 0, c = 0; j < nJobs && c < nChunkJobs; j++)
+            {
+                if (jobs[j].fitNumber > 0 && jobs[j].region.beginIndex0 >= start && jobs[j].region.endIndex1 <= end)
+                {
+                    FitRegion region = jobs[j].region;
+                    jobs[j] = chunkJobs[c++];
+                    jobs[j].region = region;
+                }
+            }
+        }
+
+        // Append the part of the chunk that belongs to the exported records
+        long a = start > firstExportRecord ? start : firstExportRecord;
+        long b = end < exportEnd ? end : exportEnd;
+        if (b > a)
+        {
+            long o = a - start;
+            for (uint8_t i = 0; i < NUM_HM_VARIABLES; i++)
+                chunkHmDataBuffers[i] = hmDataBuffers[i] + hmRecordSizes[i] * (size_t)a;
+            status = appendSlidemCdfFile(slidemFilename, firstCdfRecord + a - firstExportRecord, chunkHmDataBuffers, b - a, vn + a, ve + a, vc + a, chunk.ionEffectiveMass + o, chunk.ionDensity + o, chunk.ionDriftRaw + o, chunk.ionDrift + o, chunk.ionEffectiveMassError + o, chunk.ionDensityError + o, chunk.ionDriftError + o, chunk.fpAreaOML + o, chunk.rProbeOML + o, chunk.electronTemperature + o, chunk.spacecraftPotential + o, chunk.ionEffectiveMassTTS + o, chunk.mieffFlags + o, chunk.viFlags + o, chunk.niFlags + o, passIndex->recordInfo + a);
+            if (status != CDF_OK)
+                goto cleanup;
+        }
+        (*nChunks)++;
+    }
+
+    if (fitFile != NULL)
+    {
+        for (long job = 0; job < nJobs; job++)
+        {
+            reportOffsetFit(&jobs[job], fitFile);
+        }
+    }
+
+cleanup:
+    freeProductChunk(&chunk);
+    free(chunkJobs);
+    free(jobs);
+
+    return status;
+}
+
+int processStreamWindows(StreamInputs *inputs, long first, bool toEnd, const char *slidemFilename, long firstCdfRecord, FILE *fitFile, const char satellite, double f107Adj, int dayOfYear, probeParams sphericalProbeParams, uint16_t *passNumber, OffsetFitState *fitState, long *nextRecord, long *nExported, long *numberOfSlidemEstimates, long *nChunks, long *maxChunkRecs, long *maxWindowRecs)
+{
+    *nextRecord = first;
+    *nExported = 0;
+    *numberOfSlidemEstimates = 0;
+    *nChunks = 0;
+    *maxChunkRecs = 0;
+    *maxWindowRecs = 0;
+
+    // Records of this day among the previous day's, this day's and the next day's records
+    long dayFirst = inputs->previous.nRecs;
+    long dayEnd = dayFirst + inputs->nHmFileRecs;
+    // Fit times are relative to the first record, as for whole-day processing
+    double epoch0 = 0.0;
+    if (streamInputTime(inputs, 0, &epoch0) != STREAM_INPUTS_OK)
+        return STREAM_INPUTS;
+
+    HmAlignedInputs window = {0};
+    PassIndex passIndex = {0};
+    double *fpVoltage = NULL;
+    int status = STREAM_OK;
+
+    // Inputs are read a window at a time and processed up to the window's last equator crossing.
+    // No fit region spans an equator crossing, so only the pass number and fit region search state
+    // are carried to the next window.
+    long windowRecs = (long)(4 * STREAMING_CHUNK_SECONDS);
+    long end = first;
+    for (long start = first; start < inputs->nRecs; start = end)
+    {
+        long n = inputs->nRecs - start < windowRecs ? inputs->nRecs - start : windowRecs;
+        if (readStreamInputs(inputs, start, n, &window) != STREAM_INPUTS_OK)
+        {
+            fprintf(stdout, "%sUnable to read inputs for records %ld to %ld.\n", infoHeader, start, start + n - 1);
+            status = STREAM_INPUTS;
+            goto cleanup;
+        }
+        end = start + n;
+        bool atCrossing = false;
+        if (end < inputs->nRecs || !toEnd)
+        {
+            long crossing = lastEquatorCrossing(window.hmDataBuffers, 0, n);
+            if (crossing <= 0)
+            {
+                // No complete pass after the last crossing
+                if (end == inputs->nRecs)
+                    break;
+                // Data gap: read a longer window
+                windowRecs *= 2;
+                end = start;
+                continue;
+            }
+            n = crossing;
+            end = start + n;
+            atCrossing = true;
+        }
+        if (n > *maxWindowRecs)
+            *maxWindowRecs = n;
+
+        if (buildPassIndex(&passIndex, window.hmDataBuffers, n) != PASS_INDEX_OK)
+        {
+            fprintf(stdout, "%sUnable to build pass index.\n", infoHeader);
+            status = STREAM_MEMORY;
+            goto cleanup;
+        }
+        offsetPassNumbers(&passIndex, *passNumber);
+
+        double *mem = realloc(fpVoltage, sizeof(double) * (size_t)n);
+        if (mem == NULL)
+        {
+            status = STREAM_MEMORY;
+            goto cleanup;
+        }
+        fpVoltage = mem;
+        for (long i = 0; i < n; i++)
+            fpVoltage[i] = FACEPLATE_VOLTAGE;
+
+        // Exported records of this date within the window
+        long exportBegin = start > dayFirst ? start : dayFirst;
+        long exportEnd = end < dayEnd ? end : dayEnd;
+        long nExportRecs = exportEnd > exportBegin ? exportEnd - exportBegin : 0;
+
+        long windowEstimates = 0;
+        long windowChunks = 0;
+        long windowMaxChunkRecs = 0;
+        OffsetFitState nextFitState = {0};
+        CDFstatus cdfStatus = processProductChunks(slidemFilename, firstCdfRecord + *nExported, fitFile, satellite, window.hmDataBuffers, inputs->hmRecordSizes, n, epoch0, exportBegin - start, nExportRecs, window.fpCurrent, window.vn, window.ve, window.vc, window.dipLatitude, fpVoltage, f107Adj, dayOfYear, sphericalProbeParams, &passIndex, fitState, &nextFitState, &windowEstimates, &windowChunks, &windowMaxChunkRecs);
+        if (cdfStatus != CDF_OK)
+        {
+            status = STREAM_EXPORT;
+            goto cleanup;
+        }
+        *numberOfSlidemEstimates += windowEstimates;
+        *nChunks += windowChunks;
+        if (windowMaxChunkRecs > *maxChunkRecs)
+            *maxChunkRecs = windowMaxChunkRecs;
+        *nExported += nExportRecs;
+        *fitState = nextFitState;
+        if (atCrossing)
+            *passNumber = PASS_INDEX_PASS_NUMBER(passIndex.recordInfo[n - 1]) + 1;
+        *nextRecord = end;
+        freePassIndex(&passIndex);
+    }
+
+cleanup:
+    free(fpVoltage);
+    freePassIndex(&passIndex);
+    freeHmAlignedInputs(&window);
+
+    return status;
+}
+
+int streamProducts(const char *slidemFilename, const char *fitLogBaseFilename, const char satellite, char **hmVariables, const char *fpFilename, const char *hmFilename, const char *modFilename, const char *modFilenamePrevious, const char *magFilename, const char *boundaryCacheFilenameToday, const char *boundaryCacheFilenamePrevious, const char *boundaryCacheFilenameNext, double f107Adj, int dayOfYear, probeParams sphericalProbeParams, double *firstMeasurementTime, double *lastMeasurementTime, long *nVnecRecsPrev, long *numberOfSlidemEstimates)
+{
+    *numberOfSlidemEstimates = 0;
+
+    StreamInputs inputs;
+    if (openStreamInputs(&inputs, fpFilename, hmFilename, modFilename, modFilenamePrevious, magFilename, hmVariables, boundaryCacheFilenamePrevious, boundaryCacheFilenameNext) != STREAM_INPUTS_OK)
+        return STREAM_INPUTS;
+    *nVnecRecsPrev = inputs.nVnecRecsPrev;
+    fprintf(stdout, "%sAdded boundary data: previous day %ld s, next day %ld s.\n", infoHeader, inputs.previous.nRecs / 2, inputs.next.nRecs / 2);
+
+    if (boundaryCacheFilenameToday != NULL && writeStreamBoundaryCache(&inputs, boundaryCacheFilenameToday, SECONDS_OF_BOUNDARY_DATA_REQUIRED_FOR_PROCESSING) != STREAM_INPUTS_OK)
+        fprintf(stdout, "%sUnable to write boundary cache.\n", infoHeader);
+
+    long dayFirst = inputs.previous.nRecs;
+    long dayEnd = dayFirst + inputs.nHmFileRecs;
+    if (streamInputTime(&inputs, dayFirst, firstMeasurementTime) != STREAM_INPUTS_OK || streamInputTime(&inputs, dayEnd - 1, lastMeasurementTime) != STREAM_INPUTS_OK)
+    {
+        closeStreamInputs(&inputs);
+        return STREAM_INPUTS;
+    }
+
+    FILE *fitFile = NULL;
+    if (POST_PROCESS_ION_DRIFT)
+        fitFile = openFitLog(fitLogBaseFilename, false);
+
+    fprintf(stdout, "%sExporting SLIDEM IDM data in chunks of about %.0f s.\n", infoHeader, (double)STREAMING_CHUNK_SECONDS);
+    int status = STREAM_OK;
+    CDFstatus cdfStatus = createSlidemCdfFile(slidemFilename, satellite, EXPORT_VERSION_STRING);
+    if (cdfStatus != CDF_OK)
+    {
+        status = STREAM_EXPORT;
+        goto cleanup;
+    }
+
+    uint16_t passNumber = 0;
+    OffsetFitState fitState = {0};
+    long nextRecord = 0;
+    long nExported = 0;
+    long nChunks = 0;
+    long maxChunkRecs = 0;
+    long maxWindowRecs = 0;
+    status = processStreamWindows(&inputs, 0, true, slidemFilename, 0, fitFile, satellite, f107Adj, dayOfYear, sphericalProbeParams, &passNumber, &fitState, &nextRecord, &nExported, numberOfSlidemEstimates, &nChunks, &maxChunkRecs, &maxWindowRecs);
+    if (status != STREAM_OK)
+        goto cleanup;
+
+    CDFid exportCdfId;
+    cdfStatus = CDFopenCDF((char *)slidemFilename, &exportCdfId);
+    if (cdfStatus == CDF_OK)
+        cdfStatus = finishSlidemCdf(exportCdfId, slidemFilename, satellite, EXPORT_VERSION_STRING, *firstMeasurementTime, *lastMeasurementTime, nExported, fpFilename, hmFilename, modFilename, modFilenamePrevious, magFilename, inputs.nVnecRecsPrev);
+    else
+        printErrorMessage(cdfStatus);
+    if (cdfStatus != CDF_OK)
+    {
+        status = STREAM_EXPORT;
+        goto cleanup;
+    }
+
+    double minutesExported = (*lastMeasurementTime - *firstMeasurementTime)/1000./60.;
+    fprintf(stdout, "%sCalculated %ld SLIDEM IDM products in %ld chunks of at most %ld records from input windows of at most %ld records.\n", infoHeader, *numberOfSlidemEstimates, nChunks, maxChunkRecs, maxWindowRecs);
+    fprintf(stdout, "%sExported ~%.0f orbits (%ld 2 Hz records) of SLIDEM IDM data. %.1f%% coverage.\n", infoHeader, minutesExported/94., nExported, minutesExported/1440.0*100.0);
+
+cleanup:
+    if (fitFile != NULL)
+        fclose(fitFile);
+    closeStreamInputs(&inputs);
+
+    return status;
+}
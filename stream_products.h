@@ -0,0 +1,89 @@
+/*
+
+    SLIDEM Processor: stream_products.h
+
+    Copyright (C) 2024  Johnathan K Burchill
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _STREAM_PRODUCTS_H
+#define _STREAM_PRODUCTS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdbool.h>
+
+#include "modified_oml.h"
+#include "pass_index.h"
+#include "post_process.h"
+#include "stream_inputs.h"
+
+#include <cdf.h>
+
+// Product arrays for one chunk of HM records
+typedef struct productChunk {
+    long capacity;
+    double *ionEffectiveMass;
+    double *ionDensity;
+    double *ionDriftRaw;
+    double *ionDrift;
+    double *ionEffectiveMassError;
+    double *ionDensityError;
+    double *ionDriftError;
+    double *fpAreaOML;
+    double *rProbeOML;
+    double *electronTemperature;
+    double *spacecraftPotential;
+    uint32_t *electronTemperatureSource;
+    uint32_t *spacecraftPotentialSource;
+    double *ionEffectiveMassTTS;
+    uint32_t *mieffFlags;
+    uint32_t *viFlags;
+    uint32_t *niFlags;
+    uint16_t *iterationCount;
+} ProductChunk;
+
+int reserveProductChunk(ProductChunk *chunk, long nRecs);
+void freeProductChunk(ProductChunk *chunk);
+
+// Reads inputs, then calculates, post-processes and exports products a window of about two orbits at a time,
+// so that both input and product memory scale with the window rather than the day.
+// Windows end at an equator crossing, which no fit region spans, and pass numbers and the fit region search
+// state are carried to the next window as for --incremental, so results match whole-day processing.
+// Within a window, chunk boundaries are moved forward so that no fitted ion drift offset region is split.
+// This day's boundary cache is written if boundaryCacheFilenameToday is not NULL; the adjacent days' caches may be NULL.
+// Returns STREAM_INPUTS if the inputs cannot be read, as whole-day loading would skip the date.
+int streamProducts(const char *slidemFilename, const char *fitLogBaseFilename, const char satellite, char **hmVariables, const char *fpFilename, const char *hmFilename, const char *modFilename, const char *modFilenamePrevious, const char *magFilename, const char *boundaryCacheFilenameToday, const char *boundaryCacheFilenamePrevious, const char *boundaryCacheFilenameNext, double f107Adj, int dayOfYear, probeParams sphericalProbeParams, double *firstMeasurementTime, double *lastMeasurementTime, long *nVnecRecsPrev, long *numberOfSlidemEstimates);
+
+// Reads, calculates, post-processes and exports records from first onward a window at a time, appending to the closed CDF
+// slidemFilename from CDF record firstCdfRecord. Unless toEnd, records after the last equator crossing are left for a later run.
+// passNumber and fitState are those of record first and are updated; nextRecord returns the first record not processed.
+int processStreamWindows(StreamInputs *inputs, long first, bool toEnd, const char *slidemFilename, long firstCdfRecord, FILE *fitFile, const char satellite, double f107Adj, int dayOfYear, probeParams sphericalProbeParams, uint16_t *passNumber, OffsetFitState *fitState, long *nextRecord, long *nExported, long *numberOfSlidemEstimates, long *nChunks, long *maxChunkRecs, long *maxWindowRecs);
+
+// Chunked calculation, post-processing and export of nHmRecs records, appended to the closed CDF slidemFilename.
+// Exported records are written from CDF record firstCdfRecord. Offsets are fitted and logged only if fitFile is not NULL.
+// Fit times are relative to epoch0, the first record of the day's extended records.
+// initialFitState (may be NULL) continues the fit region search of an earlier run; finalFitState (may be NULL) returns the state at the last record.
+CDFstatus processProductChunks(const char *slidemFilename, long firstCdfRecord, FILE *fitFile, const char satellite, uint8_t **hmDataBuffers, const size_t *hmRecordSizes, long nHmRecs, double epoch0, long firstExportRecord, long nExportRecords, double *fpCurrent, double *vn, double *ve, double *vc, double *dipLatitude, double *fpVoltage, double f107Adj, int dayOfYear, probeParams sphericalProbeParams, const PassIndex *passIndex, const OffsetFitState *initialFitState, OffsetFitState *finalFitState, long *numberOfSlidemEstimates, long *nChunks, long *maxChunkRecs);
+
+enum STREAM_STATUS {
+    STREAM_OK = 0,
+    STREAM_MEMORY = -1,
+    STREAM_INPUTS = -2,
+    STREAM_EXPORT = -3
+};
+
+#endif // _STREAM_PRODUCTS_H
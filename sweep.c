@@ -0,0 +1,251 @@
+/*
+
+    SLIDEM Processor: sweep.c
+
+    Copyright (C) 2024  Johnathan K Burchill
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "sweep.h"
+#include "calculate_products.h"
+#include "post_process.h"
+#include "selection_statistics.h"
+#include "slidem_settings.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+extern char infoHeader[50];
+
+#define SWEEP_LINE_LENGTH 1024
+
+int loadSweepParams(const char *sweepFilename, probeParams **sets, long *nSets)
+{
+    if (sweepFilename == NULL || sets == NULL || nSets == NULL)
+        return SWEEP_ARGUMENTS;
+
+    *sets = NULL;
+    *nSets = 0;
+
+    FILE *sweepFile = fopen(sweepFilename, "r");
+    if (sweepFile == NULL)
+        return SWEEP_PARAMETER_FILE;
+
+    int status = SWEEP_OK;
+    long capacity = 0;
+    char line[SWEEP_LINE_LENGTH];
+    long lineNumber = 0;
+    while (fgets(line, SWEEP_LINE_LENGTH, sweepFile) != NULL)
+    {
+        lineNumber++;
+        char *comment = strchr(line, '#');
+        if (comment != NULL)
+            *comment = '\0';
+        probeParams params;
+        char extra = 0;
+        int nRead = sscanf(line, "%lf %lf %lf %lf %c", &params.radiusModifier, &params.alpha, &params.bravo, &params.charlie, &extra);
+        if (nRead == EOF || nRead == 0)
+            continue;
+        if (nRead != 4)
+        {
+            fprintf(stdout, "%sUnable to parse line %ld of %s\n", infoHeader, lineNumber, sweepFilename);
+            status = SWEEP_PARAMETER_FILE;
+            goto cleanup;
+        }
+        if (*nSets == capacity)
+        {
+            capacity = capacity == 0 ? 16 : 2 * capacity;
+            probeParams *more = realloc(*sets, (size_t)capacity * sizeof(probeParams));
+            if (more == NULL)
+            {
+                status = SWEEP_MEMORY;
+                goto cleanup;
+            }
+            *sets = more;
+        }
+        (*sets)[(*nSets)++] = params;
+    }
+    if (*nSets == 0)
+        status = SWEEP_PARAMETER_FILE;
+
+cleanup:
+    fclose(sweepFile);
+    if (status != SWEEP_OK)
+    {
+        free(*sets);
+        *sets = NULL;
+        *nSets = 0;
+    }
+
+    return status;
+}
+
+// Median and MAD of the values whose flags are zero (all finite values if flags is NULL)
+static void summarizeProduct(FILE *summaryFile, const double *values, const uint32_t *flags, long nRecs, double *work, double *scratch)
+{
+    size_t n = 0;
+    for (long i = 0; i < nRecs; i++)
+    {
+        if ((flags == NULL || flags[i] == 0) && isfinite(values[i]))
+            work[n++] = values[i];
+    }
+    SelectionStatistics stats = {0};
+    if (selectionStatistics(work, n, scratch, &stats) != SELECTION_OK)
+    {
+        stats.median = NAN;
+        stats.mad = NAN;
+    }
+    fprintf(summaryFile, " %zu %g %g", n, stats.median, stats.mad);
+
+    return;
+}
+
+int runParameterSweep(const char *sweepFilename, const char *summaryFilename, const char satellite, uint8_t **hmDataBuffers, long nHmRecs, long dayRecOffset, long nDayRecs, double *fpCurrent, double *vn, double *ve, double *vc, double *dipLatitude, double *fpVoltage, double f107Adj, int dayOfYear, const PassIndex *passIndex)
+{
+    if (sweepFilename == NULL || summaryFilename == NULL || hmDataBuffers == NULL || nHmRecs <= 0 || dayRecOffset < 0 || nDayRecs <= 0 || dayRecOffset + nDayRecs > nHmRecs)
+        return SWEEP_ARGUMENTS;
+
+    probeParams *sets = NULL;
+    long nSets = 0;
+    int status = loadSweepParams(sweepFilename, &sets, &nSets);
+    if (status != SWEEP_OK)
+        return status;
+
+    FILE *summaryFile = NULL;
+    OffsetFitJob *jobTemplate = NULL;
+    OffsetFitJob *jobs = NULL;
+    long nJobs = 0;
+    long nFitJobs = 0;
+    size_t maxPoints = 0;
+
+    // Product arrays are reused for every set
+    size_t nBytes = (size_t)nHmRecs * sizeof(double);
+    size_t nFlagBytes = (size_t)nHmRecs * sizeof(uint32_t);
+    double *ionEffectiveMass = malloc(nBytes);
+    double *ionDensity = malloc(nBytes);
+    double *ionDriftRaw = malloc(nBytes);
+    double *ionDrift = malloc(nBytes);
+    double *ionEffectiveMassError = malloc(nBytes);
+    double *ionDensityError = malloc(nBytes);
+    double *ionDriftError = malloc(nBytes);
+    double *fpAreaOML = malloc(nBytes);
+    double *rProbeOML = malloc(nBytes);
+    double *electronTemperature = malloc(nBytes);
+    double *spacecraftPotential = malloc(nBytes);
+    uint32_t *electronTemperatureSource = malloc(nFlagBytes);
+    uint32_t *spacecraftPotentialSource = malloc(nFlagBytes);
+    double *ionEffectiveMassTTS = malloc(nBytes);
+    uint32_t *mieffFlags = malloc(nFlagBytes);
+    uint32_t *viFlags = malloc(nFlagBytes);
+    uint32_t *niFlags = malloc(nFlagBytes);
+    uint16_t *iterationCount = malloc((size_t)nHmRecs * sizeof(uint16_t));
+    double *work = malloc((size_t)nDayRecs * sizeof(double));
+    double *scratch = malloc((size_t)nDayRecs * sizeof(double));
+    if (ionEffectiveMass == NULL || ionDensity == NULL || ionDriftRaw == NULL || ionDrift == NULL || ionEffectiveMassError == NULL || ionDensityError == NULL || ionDriftError == NULL || fpAreaOML == NULL || rProbeOML == NULL || electronTemperature == NULL || spacecraftPotential == NULL || electronTemperatureSource == NULL || spacecraftPotentialSource == NULL || ionEffectiveMassTTS == NULL || mieffFlags == NULL || viFlags == NULL || niFlags == NULL || iterationCount == NULL || work == NULL || scratch == NULL)
+    {
+        status = SWEEP_MEMORY;
+        goto cleanup;
+    }
+
+    // Fit regions depend only on the pass index and FP current availability, so they are found once
+    if (POST_PROCESS_ION_DRIFT)
+    {
+        if (findOffsetFitJobs(passIndex, fpCurrent, NULL, &jobTemplate, &nJobs, &nFitJobs, &maxPoints) != OFFSET_FIT_OK)
+        {
+            status = SWEEP_MEMORY;
+            goto cleanup;
+        }
+        if (nJobs > 0)
+        {
+            jobs = malloc((size_t)nJobs * sizeof(OffsetFitJob));
+            if (jobs == NULL)
+            {
+                status = SWEEP_MEMORY;
+                goto cleanup;
+            }
+        }
+    }
+
+    summaryFile = fopen(summaryFilename, "w");
+    if (summaryFile == NULL)
+    {
+        status = SWEEP_SUMMARY_FILE;
+        goto cleanup;
+    }
+    fprintf(summaryFile, "# SLIDEM modified OML parameter sweep, %ld records, %ld parameter sets from %s\n", nDayRecs, nSets, sweepFilename);
+    fprintf(summaryFile, "# Each product: number of unflagged finite values, median, MAD. A_fp and R_p use all finite values.\n");
+    fprintf(summaryFile, "set radiusModifier alpha bravo charlie nEstimates M_i_eff_n M_i_eff_median M_i_eff_mad V_i_n V_i_median V_i_mad N_i_n N_i_median N_i_mad A_fp_n A_fp_median A_fp_mad R_p_n R_p_median R_p_mad\n");
+
+    long d = dayRecOffset;
+    for (long s = 0; s < nSets; s++)
+    {
+        probeParams params = sets[s];
+        long numberOfSlidemEstimates = 0;
+        calculateProducts(satellite, hmDataBuffers, fpCurrent, vn, ve, vc, dipLatitude, fpVoltage, f107Adj, dayOfYear, ionEffectiveMass, ionDensity, ionDriftRaw, ionDrift, ionEffectiveMassError, ionDensityError, ionDriftError, fpAreaOML, rProbeOML, electronTemperature, spacecraftPotential, electronTemperatureSource, spacecraftPotentialSource, ionEffectiveMassTTS, mieffFlags, viFlags, niFlags, iterationCount, nHmRecs, params, &numberOfSlidemEstimates);
+
+        if (jobs != NULL)
+        {
+            // Fit results are written into the jobs, so each set starts from a fresh copy
+            memcpy(jobs, jobTemplate, (size_t)nJobs * sizeof(OffsetFitJob));
+            OffsetFitData data = {
+                satellite, hmDataBuffers, *((double*)hmDataBuffers[0]), vn, ve, vc, dipLatitude, fpCurrent, fpVoltage, fpAreaOML, rProbeOML, electronTemperature, spacecraftPotential, electronTemperatureSource, spacecraftPotentialSource, ionEffectiveMassTTS, ionDrift, ionDriftError, ionEffectiveMass, ionEffectiveMassError, ionDensity, ionDensityError, viFlags, mieffFlags, niFlags, iterationCount, params
+            };
+            fitOffsetJobs(jobs, nJobs, nFitJobs, maxPoints, &data);
+        }
+
+        fprintf(summaryFile, "%ld %g %g %g %g %ld", s + 1, params.radiusModifier, params.alpha, params.bravo, params.charlie, numberOfSlidemEstimates);
+        summarizeProduct(summaryFile, ionEffectiveMass + d, mieffFlags + d, nDayRecs, work, scratch);
+        summarizeProduct(summaryFile, ionDrift + d, viFlags + d, nDayRecs, work, scratch);
+        summarizeProduct(summaryFile, ionDensity + d, niFlags + d, nDayRecs, work, scratch);
+        summarizeProduct(summaryFile, fpAreaOML + d, NULL, nDayRecs, work, scratch);
+        summarizeProduct(summaryFile, rProbeOML + d, NULL, nDayRecs, work, scratch);
+        fprintf(summaryFile, "\n");
+        fflush(summaryFile);
+
+        fprintf(stdout, "%sSweep set %ld of %ld (radiusModifier=%g alpha=%g bravo=%g charlie=%g): %ld estimates.\n", infoHeader, s + 1, nSets, params.radiusModifier, params.alpha, params.bravo, params.charlie, numberOfSlidemEstimates);
+        fflush(stdout);
+    }
+
+cleanup:
+    if (summaryFile != NULL && fclose(summaryFile) != 0 && status == SWEEP_OK)
+        status = SWEEP_SUMMARY_FILE;
+    free(jobs);
+    free(jobTemplate);
+    free(scratch);
+    free(work);
+    free(iterationCount);
+    free(niFlags);
+    free(viFlags);
+    free(mieffFlags);
+    free(ionEffectiveMassTTS);
+    free(spacecraftPotentialSource);
+    free(electronTemperatureSource);
+    free(spacecraftPotential);
+    free(electronTemperature);
+    free(rProbeOML);
+    free(fpAreaOML);
+    free(ionDriftError);
+    free(ionDensityError);
+    free(ionEffectiveMassError);
+    free(ionDrift);
+    free(ionDriftRaw);
+    free(ionDensity);
+    free(ionEffectiveMass);
+    free(sets);
+
+    return status;
+}
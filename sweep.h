@@ -0,0 +1,50 @@
+/*
+
+    SLIDEM Processor: sweep.h
+
+    Copyright (C) 2024  Johnathan K Burchill
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _SWEEP_H
+#define _SWEEP_H
+
+#include <stdint.h>
+
+#include "modified_oml.h"
+#include "pass_index.h"
+
+// Parameter sweep for calibrating the modified OML spherical probe parameters.
+// The day's inputs, pass index and offset fit regions are prepared once; products and
+// post-processing are then evaluated for each parameter set and summarized instead of exported.
+
+#define SWEEP_SUMMARY_EXTENSION ".sweep"
+
+// One set per line: radiusModifier alpha bravo charlie, as in the modified OML config file. # starts a comment.
+int loadSweepParams(const char *sweepFilename, probeParams **sets, long *nSets);
+
+// Writes one line of summary statistics per parameter set to summaryFilename.
+// Statistics cover records dayRecOffset to dayRecOffset + nDayRecs - 1 of the extended arrays.
+int runParameterSweep(const char *sweepFilename, const char *summaryFilename, const char satellite, uint8_t **hmDataBuffers, long nHmRecs, long dayRecOffset, long nDayRecs, double *fpCurrent, double *vn, double *ve, double *vc, double *dipLatitude, double *fpVoltage, double f107Adj, int dayOfYear, const PassIndex *passIndex);
+
+enum SWEEP_STATUS {
+    SWEEP_OK = 0,
+    SWEEP_ARGUMENTS = -1,
+    SWEEP_MEMORY = -2,
+    SWEEP_PARAMETER_FILE = -3,
+    SWEEP_SUMMARY_FILE = -4
+};
+
+#endif // _SWEEP_H
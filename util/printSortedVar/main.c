@@ -30,154 +30,31 @@
 #include <stdbool.h>
 #include <stdlib.h>
 #include <float.h>
+#include <unistd.h>
 
-int variables(const char *filename);
-int load(const char *filename, char *variable, void **varData, long *count, long *variableBytes);
-
-int compare(const void *a, const void *b)
-{
-	uint8_t ignorea = *(uint8_t*)(a+1);
-	uint8_t ignoreb = *(uint8_t*)(b+1);
-
-	// Place ignored data at the beginning
-	if (ignorea > ignoreb)
-		return -1;
-
-	else if (ignorea < ignoreb)
-		return 1;
-
-	// Otherwise compare values
-
-	uint8_t type = *(uint8_t*)a;
-
-	double x, y;
-
-	void *pa = (void*)a + 2;
-	void *pb = (void*)b + 2;
-
-	switch(type)
-	{
-		case CDF_REAL8:
-		case CDF_DOUBLE:
-		case CDF_EPOCH:
-			x = *(double*)pa;
-			y = *(double*)pb;
-			break;
-
-		case CDF_REAL4:
-		case CDF_FLOAT:
-			x = (double)*(float*)pa;
-			y = (double)*(float*)pb;
-			break;
-
-		case CDF_UINT1:
-		case CDF_UCHAR:
-		case CDF_BYTE:
-			x = (double)*(uint8_t*)pa;
-			y = (double)*(uint8_t*)pb;
-			break;
-
-		case CDF_UINT2:
-			x = (double)*(uint16_t*)pa;
-			y = (double)*(uint16_t*)pb;
-			break;
-
-		case CDF_UINT4:
-			x = (double)*(uint32_t*)pa;
-			y = (double)*(uint32_t*)pb;
-			break;
-
-		case CDF_INT1:
-		case CDF_CHAR:
-			x = (double)*(int8_t*)pa;
-			y = (double)*(int8_t*)pb;
-			break;
-
-		case CDF_INT2:
-			x = (double)*(int16_t*)pa;
-			y = (double)*(int16_t*)pb;
-			break;
-
-		case CDF_INT4:
-			x = (double)*(int32_t*)pa;
-			y = (double)*(int32_t*)pb;
-			break;
-
-		case CDF_INT8:
-			x = (double)*(int64_t*)pa;
-			y = (double)*(int64_t*)pb;
-			break;
-
-		default:
-			x = 0.0;
-			y = 0.0;
-	}
-
-	if (x > y)
-		return 1;
-	else if (x < y)
-		return -1;
-	else
-		return 0;
-}
-
-void printValue(void *pointer, size_t index, long variableBytes)
-{
-	void *offset = pointer + index*(variableBytes + 2);
-	uint8_t type = *(uint8_t*)offset;
-	switch(type)
-	{
-		case CDF_REAL8:
-		case CDF_DOUBLE:
-		case CDF_EPOCH:
-			printf("%lf", *(double*)(offset+2));
-			break;
-
-		case CDF_REAL4:
-		case CDF_FLOAT:
-			printf("%f", *(float*)(offset+2));
-			break;
-
-		case CDF_UINT1:
-		case CDF_UCHAR:
-		case CDF_BYTE:
-			printf("%u", *(uint8_t*)(offset+2));
-			break;
-
-		case CDF_UINT2:
-			printf("%u", *(uint16_t*)(offset+2));
-			break;
-
-		case CDF_UINT4:
-			printf("%u", *(uint32_t*)(offset+2));
-			break;
-
-		case CDF_INT1:
-		case CDF_CHAR:
-			printf("%d", *(int8_t*)(offset+2));
-			break;
-
-		case CDF_INT2:
-			printf("%d", *(int16_t*)(offset+2));
-			break;
-
-		case CDF_INT4:
-			printf("%d", *(int32_t*)(offset+2));
-			break;
-
-		case CDF_INT8:
-			printf("%ld", *(int64_t*)(offset+2));
-			break;
-
-		default:
-			printf("x");
-	}
+#include "column_file.h"
+#include "radix_sort.h"
+#include "value_summary.h"
 
+#define OUTPUT_BUFFER_SIZE (1 << 20)
 
-}
+int variables(const char *filename);
+int printSummaries(const void *values, long dataType, long variableBytes, size_t count, const uint8_t *ignore, char *percentileList, char *histogramSpecification, bool logarithmicHistogram);
+int load(const char *filename, char *variable, void **varData, long *count, long *variableBytes, long *dataType);
+bool sidecarFor(const char *filename, char *sidecarFilename, size_t length);
+int sidecarVariables(const char *sidecarFilename);
+int sidecarLoad(const char *sidecarFilename, char *variable, void **varData, long *count, long *variableBytes, long *dataType);
 
 int main(int argc, char *argv[])
 {
+    int nThreads = 1;
+    // Summary modes print these instead of every sorted value
+    char *percentileList = NULL;
+    char *histogramSpecification = NULL;
+    bool logarithmicHistogram = false;
+    // Program name and positional arguments
+    int nArgs = 1;
+    char *args[4] = {argv[0], NULL, NULL, NULL};
 
     for (int i = 1; i < argc; i++)
     {
@@ -190,7 +67,34 @@ int main(int argc, char *argv[])
             fprintf(stdout, "under the terms of the GNU General Public License.\n");
             exit(0);
         }
+        else if (strncmp(argv[i], "--threads=", 10) == 0)
+        {
+            nThreads = atoi(argv[i] + 10);
+            if (nThreads < 1)
+            {
+                printf("Could not parse %s\n", argv[i]);
+                exit(1);
+            }
+        }
+        else if (strncmp(argv[i], "--percentiles=", 14) == 0)
+            percentileList = argv[i] + 14;
+        else if (strncmp(argv[i], "--histogram=", 12) == 0)
+        {
+            histogramSpecification = argv[i] + 12;
+            logarithmicHistogram = false;
+        }
+        else if (strncmp(argv[i], "--log-histogram=", 16) == 0)
+        {
+            histogramSpecification = argv[i] + 16;
+            logarithmicHistogram = true;
+        }
+        else if (nArgs < 4)
+            args[nArgs++] = argv[i];
+        else
+            nArgs++;
     }
+    argc = nArgs;
+    argv = args;
 
 	if (argc <2 || argc > 4)
 	{
@@ -198,6 +102,10 @@ int main(int argc, char *argv[])
 		printf("\t%s cdffile variable\n\t\tprints a sorted list (minimum to maximum) for the variable.\n", argv[0]);
 		printf("\t%s cdffile variable ignoredValue\n\t\tprints list of varibles in cdffile.\n", argv[0]);
 		printf("\t%s --about\n\t\tprints copyright and license information.\n", argv[0]);
+		printf("\toption --threads=n sorts with n threads (default 1).\n");
+		printf("\toption --percentiles=p1,p2,... prints Min, Max and the percentiles (0 to 100) without sorting.\n");
+		printf("\toption --histogram=min:max:width prints counts in bins of the given width without sorting.\n");
+		printf("\toption --log-histogram=min:max:binsPerDecade prints counts in logarithmic bins without sorting.\n");
 		exit(0);
 	}
 
@@ -210,100 +118,83 @@ int main(int argc, char *argv[])
 	void *param = NULL;
 	long count = 0;
 	long variableBytes = 0;
-	int status = load(argv[1], argv[2], &param, &count, &variableBytes);
+	long dataType = 0;
+	int status = load(argv[1], argv[2], &param, &count, &variableBytes, &dataType);
 
 	printf("%ld \"%s\" records\n", count, argv[2]);
 
-	double ignored = -DBL_MAX;
-	if (argc == 4)
-		ignored = atof(argv[3]);
+	if (status != CDF_OK)
+	{
+		free(param);
+		return 0;
+	}
+	if (sortKeyBytes(dataType) != variableBytes)
+	{
+		fprintf(stderr, "Unsupported data type %ld for variable \"%s\".\n", dataType, argv[2]);
+		free(param);
+		return 1;
+	}
 
-	bool ignore = false;
-	long type = 0;
-	void *offset = 0;
-	for (size_t i = 0; i < count; i++)
+	// Ignored values are dropped before sorting
+	uint8_t *ignore = NULL;
+	if (argc == 4)
 	{
-		offset = param + i * (variableBytes + 2);
-		type = (long) (*(uint8_t*)offset);
-		switch(type)
+		ignore = calloc(count > 0 ? (size_t)count : 1, sizeof *ignore);
+		if (ignore == NULL)
 		{
-			case CDF_DOUBLE:
-			case CDF_REAL8:
-			case CDF_EPOCH:
-				ignore = (*(double*)(offset + 2) == ignored);
-				break;
-
-			case CDF_REAL4:
-			case CDF_FLOAT:
-				ignore = ((double)(*(float*)(offset + 2)) == ignored);
-				break;
-
-			case CDF_UINT1:
-			case CDF_UCHAR:
-			case CDF_BYTE:
-				ignore = ((double)(*(uint8_t*)(offset + 2)) == ignored);
-				break;
-
-			case CDF_UINT2:
-				ignore = ((double)(*(uint16_t*)(offset + 2)) == ignored);
-				break;
-
-			case CDF_UINT4:
-				ignore = ((double)(*(uint32_t*)(offset + 2)) == ignored);
-				break;
-
-			case CDF_INT1:
-			case CDF_CHAR:
-				ignore = ((double)(*(int8_t*)(offset + 2)) == ignored);
-				break;
-
-			case CDF_INT2:
-				ignore = ((double)(*(int16_t*)(offset + 2)) == ignored);
-				break;
-
-			case CDF_INT4:
-				ignore = ((double)(*(int32_t*)(offset + 2)) == ignored);
-				break;
-
-			case CDF_INT8:
-				ignore = ((double)(*(int64_t*)(offset + 2)) == ignored);
-				break;
-
-			default:
-				ignore = 0;
+			printf("Could not allocate heap.\n");
+			exit(42);
 		}
-		if (ignore)
-			*(uint8_t*)(offset+1) = 1;
+		ignoreMatchingValues(param, dataType, (size_t)count, atof(argv[3]), ignore);
+	}
+
+	if (percentileList != NULL || histogramSpecification != NULL)
+	{
+		status = printSummaries(param, dataType, variableBytes, (size_t)count, ignore, percentileList, histogramSpecification, logarithmicHistogram);
+		free(ignore);
+		free(param);
+		return status == VALUE_SUMMARY_OK ? 0 : 1;
+	}
+
+	uint64_t *keys = malloc((count > 0 ? (size_t)count : 1) * sizeof *keys);
+	if (keys == NULL)
+	{
+		printf("Could not allocate heap.\n");
+		exit(42);
+	}
+	size_t nKeys = sortKeys(param, dataType, (size_t)count, ignore, keys);
+	free(ignore);
+	free(param);
+
+	if (radixSort(keys, nKeys, (int)variableBytes, nThreads) != RADIX_SORT_OK)
+	{
+		printf("Could not allocate heap.\n");
+		exit(42);
 	}
 
-	qsort(param, count, variableBytes + 2, &compare);
+	// NaNs are sorted last and are not the maximum
+	size_t nNumbers = nKeys;
+	while (nNumbers > 0 && sortKeyIsNaN(keys[nNumbers - 1], dataType))
+		nNumbers--;
 
-	size_t index = 0;
-	if (count > 0)
-		while (((bool)(*(uint8_t*)(param + (index++) * (variableBytes + 2) + 1))) && index < count);
-	if (index < count)
+	setvbuf(stdout, NULL, _IOFBF, OUTPUT_BUFFER_SIZE);
+	if (nNumbers > 0)
 	{
 		printf("Min:\t");
-		printValue(param, index, variableBytes);
+		printSortKey(stdout, keys[0], dataType);
 		printf("\n");
 		printf("Max:\t");
-		printValue(param, count-1, variableBytes);
+		printSortKey(stdout, keys[nNumbers - 1], dataType);
 		printf("\n");
 	}
 
-	for (size_t i = 0; i < count; i++)
+	for (size_t i = 0; i < nKeys; i++)
 	{
-		offset = param + i * (variableBytes + 2); 
-		if (*(uint8_t*)(offset+1) == 0)
-		{
-			printValue(param, i, variableBytes);
-			printf("\n");
-		}
-
+		printSortKey(stdout, keys[i], dataType);
+		printf("\n");
 	}
 
-
-	free(param);
+	free(keys);
 
 	return 0;
 
@@ -330,6 +221,11 @@ int variables(const char *filename)
     long dimSizes[CDF_MAX_DIMS], dimVarys[CDF_MAX_DIMS];
     CDFdata data;
 
+    // Prefer the uncompressed column sidecar
+    char sidecarFilename[FILENAME_MAX];
+    if (sidecarFor(filename, sidecarFilename, FILENAME_MAX) && sidecarVariables(sidecarFilename) == COLUMN_FILE_OK)
+        return CDF_OK;
+
     status = CDFopenCDF(filename, &cdfId);
     if (status != CDF_OK) 
     {
@@ -364,7 +260,7 @@ int variables(const char *filename)
     
 }
 
-int load(const char *filename, char *variable, void **varData, long *count, long *variableBytes)
+int load(const char *filename, char *variable, void **varData, long *count, long *variableBytes, long *dataTypeOut)
 {
 
     // Open the CDF file with validation
@@ -385,6 +281,11 @@ int load(const char *filename, char *variable, void **varData, long *count, long
     long dimSizes[CDF_MAX_DIMS], dimVarys[CDF_MAX_DIMS];
     CDFdata data;
 
+    // Prefer the uncompressed column sidecar
+    char sidecarFilename[FILENAME_MAX];
+    if (sidecarFor(filename, sidecarFilename, FILENAME_MAX) && sidecarLoad(sidecarFilename, variable, varData, count, variableBytes, dataTypeOut) == COLUMN_FILE_OK)
+        return CDF_OK;
+
     status = CDFopenCDF(filename, &cdfId);
     if (status != CDF_OK) 
     {
@@ -417,10 +318,10 @@ int load(const char *filename, char *variable, void **varData, long *count, long
 		numValuesPerRec *= dimSizes[j];
 	}
 	numBytesToAdd = numValuesPerRec * numRecs * numVarBytes;
-	// Prepend two bytes for each record to track the data type and whether the record should be ignored
+	// Values are kept in their native type
 	if (varData != NULL)
 	{
-		*varData = (void*) malloc((size_t) (numBytesToAdd + 2*numRecs*numValuesPerRec));
+		*varData = malloc((size_t) (numBytesToAdd > 0 ? numBytesToAdd : 1));
 		if (*varData == NULL)
 		{
 			printf("Could not allocate heap.\n");
@@ -428,19 +329,7 @@ int load(const char *filename, char *variable, void **varData, long *count, long
 			CDFcloseCDF(cdfId);
 			exit(42);
 		}
-		uint8_t *p = (uint8_t *)(*(uint8_t**)varData);
-		bzero(p, (numBytesToAdd + numRecs*numValuesPerRec));
-		for (size_t i = 0; i < numRecs * numValuesPerRec; i++)
-		{
-			p[i*(numVarBytes+2)] = (uint8_t)dataType;
-			p[i*(numVarBytes+2) + 1] = 0;
-			for (int j = 0; j < numVarBytes; j++)
-			{
-				p[i*(numVarBytes+2) + j + 2] = ((uint8_t*)data)[i*numVarBytes+j];
-			}
-		}
-		
-		// memcpy(*varData, data, numBytesToAdd);
+		memcpy(*varData, data, (size_t) numBytesToAdd);
 	}
 	CDFdataFree(data);
 
@@ -453,6 +342,149 @@ int load(const char *filename, char *variable, void **varData, long *count, long
 	if (variableBytes != NULL)
 		*variableBytes = numVarBytes;
 
+	if (dataTypeOut != NULL)
+		*dataTypeOut = dataType;
+
 	return status;
     
 }
+
+// True if filename is a column sidecar, or is a CDF with a sidecar next to it
+bool sidecarFor(const char *filename, char *sidecarFilename, size_t length)
+{
+    size_t n = strlen(filename);
+    size_t extensionLength = strlen(COLUMN_SIDECAR_EXTENSION);
+    if (n > extensionLength && strcmp(COLUMN_SIDECAR_EXTENSION, filename + n - extensionLength) == 0)
+    {
+        snprintf(sidecarFilename, length, "%s", filename);
+        return access(sidecarFilename, R_OK) == 0;
+    }
+    columnSidecarFilename(filename, sidecarFilename, length);
+
+    // A sidecar older than the product is from an earlier version of it
+    return columnSidecarCurrent(filename, sidecarFilename);
+}
+
+int sidecarVariables(const char *sidecarFilename)
+{
+    ColumnFile file;
+    int status = openColumnFile(sidecarFilename, &file);
+    if (status != COLUMN_FILE_OK)
+        return status;
+
+    for (uint32_t c = 0; c < file.header->nColumns; c++)
+        printf("%.*s\n", COLUMN_FILE_NAME_LENGTH, file.columns[c].name);
+
+    closeColumnFile(&file);
+
+    return COLUMN_FILE_OK;
+}
+
+int sidecarLoad(const char *sidecarFilename, char *variable, void **varData, long *count, long *variableBytes, long *dataTypeOut)
+{
+    ColumnFile file;
+    int status = openColumnFile(sidecarFilename, &file);
+    if (status != COLUMN_FILE_OK)
+        return status;
+
+    size_t recordSize = 0;
+    long dataType = 0;
+    const uint8_t *data = (const uint8_t *) columnFileData(&file, variable, &recordSize, &dataType);
+    long numVarBytes = 0;
+    if (data == NULL || CDFgetDataTypeSize(dataType, &numVarBytes) != CDF_OK || numVarBytes <= 0)
+    {
+        closeColumnFile(&file);
+        return COLUMN_FILE_FORMAT;
+    }
+    size_t numValues = (size_t) file.header->nRecords * (recordSize / (size_t) numVarBytes);
+
+    // Same native layout as load()
+    if (varData != NULL)
+    {
+        uint8_t *p = malloc(numValues > 0 ? numValues * (size_t) numVarBytes : 1);
+        if (p == NULL)
+        {
+            printf("Could not allocate heap.\n");
+            closeColumnFile(&file);
+            exit(42);
+        }
+        memcpy(p, data, numValues * (size_t) numVarBytes);
+        *varData = p;
+    }
+
+    closeColumnFile(&file);
+
+    if (count != NULL)
+        *count += (long) numValues;
+
+    if (variableBytes != NULL)
+        *variableBytes = numVarBytes;
+
+    if (dataTypeOut != NULL)
+        *dataTypeOut = dataType;
+
+    return COLUMN_FILE_OK;
+}
+
+// Prints a histogram, accumulated block by block without copying the variable, then percentiles by selection
+// on a copy converted to double. Each makes its own pass over the values, skipping ignored values.
+int printSummaries(const void *values, long dataType, long variableBytes, size_t count, const uint8_t *ignore, char *percentileList, char *histogramSpecification, bool logarithmicHistogram)
+{
+    int status = VALUE_SUMMARY_OK;
+
+    if (histogramSpecification != NULL)
+    {
+        Histogram histogram;
+        status = initHistogram(histogramSpecification, logarithmicHistogram, &histogram);
+        if (status != VALUE_SUMMARY_OK)
+        {
+            printf("Could not parse histogram specification %s\n", histogramSpecification);
+            return status;
+        }
+        // Converted a block at a time, so no copy of the variable is made
+        double block[VALUE_SUMMARY_BLOCK_SIZE];
+        for (size_t first = 0; first < count; first += VALUE_SUMMARY_BLOCK_SIZE)
+        {
+            size_t n = count - first < VALUE_SUMMARY_BLOCK_SIZE ? count - first : VALUE_SUMMARY_BLOCK_SIZE;
+            n = valuesAsDoubles((const uint8_t *)values + first * (size_t)variableBytes, dataType, n, ignore != NULL ? ignore + first : NULL, block);
+            histogramAdd(&histogram, block, n);
+        }
+        printHistogram(stdout, &histogram);
+        freeHistogram(&histogram);
+    }
+
+    if (percentileList != NULL)
+    {
+        double percentiles[VALUE_SUMMARY_MAX_PERCENTILES + 2] = {0.0, 100.0};
+        int nPercentiles = parsePercentiles(percentileList, percentiles + 2, VALUE_SUMMARY_MAX_PERCENTILES - 2);
+        if (nPercentiles < 0)
+        {
+            printf("Could not parse percentiles %s\n", percentileList);
+            return VALUE_SUMMARY_SPECIFICATION;
+        }
+        double *data = malloc((count > 0 ? count : 1) * sizeof *data);
+        if (data == NULL)
+        {
+            printf("Could not allocate heap.\n");
+            exit(42);
+        }
+        size_t n = valuesAsDoubles(values, dataType, count, ignore, data);
+        // Min and Max are the 0th and 100th percentiles
+        double results[VALUE_SUMMARY_MAX_PERCENTILES + 2];
+        size_t nNumbers = 0;
+        status = selectPercentiles(data, n, percentiles, nPercentiles + 2, results, &nNumbers);
+        free(data);
+        if (status != VALUE_SUMMARY_OK)
+            return status;
+        printf("%zu values\n", nNumbers);
+        if (nNumbers > 0)
+        {
+            printf("Min:\t%lf\n", results[0]);
+            printf("Max:\t%lf\n", results[1]);
+            for (int p = 0; p < nPercentiles; p++)
+                printf("Percentile%g:\t%lf\n", percentiles[p + 2], results[p + 2]);
+        }
+    }
+
+    return status;
+}
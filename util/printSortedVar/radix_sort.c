@@ -0,0 +1,393 @@
+/*
+
+    SLIDEM Processor: util/printSortedVar/radix_sort.c
+
+    Copyright (C) 2024  Johnathan K Burchill
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "radix_sort.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+
+#include <cdf.h>
+
+#define RADIX_BITS 8
+#define RADIX_BUCKETS (1 << RADIX_BITS)
+
+// Native representation of the CDF data types
+enum VALUE_KIND {
+    VALUE_UNSUPPORTED = 0,
+    VALUE_DOUBLE,
+    VALUE_FLOAT,
+    VALUE_UINT8,
+    VALUE_UINT16,
+    VALUE_UINT32,
+    VALUE_INT8,
+    VALUE_INT16,
+    VALUE_INT32,
+    VALUE_INT64
+};
+
+static int valueKind(long dataType)
+{
+    switch (dataType)
+    {
+        case CDF_REAL8:
+        case CDF_DOUBLE:
+        case CDF_EPOCH:
+            return VALUE_DOUBLE;
+        case CDF_REAL4:
+        case CDF_FLOAT:
+            return VALUE_FLOAT;
+        case CDF_UINT1:
+        case CDF_UCHAR:
+        case CDF_BYTE:
+            return VALUE_UINT8;
+        case CDF_UINT2:
+            return VALUE_UINT16;
+        case CDF_UINT4:
+            return VALUE_UINT32;
+        case CDF_INT1:
+        case CDF_CHAR:
+            return VALUE_INT8;
+        case CDF_INT2:
+            return VALUE_INT16;
+        case CDF_INT4:
+            return VALUE_INT32;
+        case CDF_INT8:
+        case CDF_TIME_TT2000:
+            return VALUE_INT64;
+        default:
+            return VALUE_UNSUPPORTED;
+    }
+}
+
+int sortKeyBytes(long dataType)
+{
+    switch (valueKind(dataType))
+    {
+        case VALUE_DOUBLE:
+        case VALUE_INT64:
+            return 8;
+        case VALUE_FLOAT:
+        case VALUE_UINT32:
+        case VALUE_INT32:
+            return 4;
+        case VALUE_UINT16:
+        case VALUE_INT16:
+            return 2;
+        case VALUE_UINT8:
+        case VALUE_INT8:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+// One loop per native type rather than a type switch per value
+#define IGNORE_LOOP(type) \
+    { \
+        const type *v = values; \
+        for (size_t i = 0; i < count; i++) \
+        { \
+            if ((double)v[i] == ignoredValue) \
+                ignore[i] = 1; \
+        } \
+        break; \
+    }
+
+void ignoreMatchingValues(const void *values, long dataType, size_t count, double ignoredValue, uint8_t *ignore)
+{
+    switch (valueKind(dataType))
+    {
+        case VALUE_DOUBLE: IGNORE_LOOP(double)
+        case VALUE_FLOAT: IGNORE_LOOP(float)
+        case VALUE_UINT8: IGNORE_LOOP(uint8_t)
+        case VALUE_UINT16: IGNORE_LOOP(uint16_t)
+        case VALUE_UINT32: IGNORE_LOOP(uint32_t)
+        case VALUE_INT8: IGNORE_LOOP(int8_t)
+        case VALUE_INT16: IGNORE_LOOP(int16_t)
+        case VALUE_INT32: IGNORE_LOOP(int32_t)
+        case VALUE_INT64: IGNORE_LOOP(int64_t)
+        default:
+            break;
+    }
+
+    return;
+}
+
+static inline uint64_t doubleKey(double x)
+{
+    if (isnan(x))
+        return UINT64_MAX;
+    uint64_t bits = 0;
+    memcpy(&bits, &x, sizeof bits);
+
+    return (bits >> 63) ? ~bits : bits | (UINT64_C(1) << 63);
+}
+
+static inline uint64_t floatKey(float x)
+{
+    if (isnan(x))
+        return UINT32_MAX;
+    uint32_t bits = 0;
+    memcpy(&bits, &x, sizeof bits);
+
+    return (bits >> 31) ? (uint32_t)~bits : bits | (UINT32_C(1) << 31);
+}
+
+#define KEY_LOOP(type, keyExpression) \
+    { \
+        const type *v = values; \
+        for (size_t i = 0; i < count; i++) \
+        { \
+            if (ignore == NULL || !ignore[i]) \
+                keys[n++] = (keyExpression); \
+        } \
+        break; \
+    }
+
+size_t sortKeys(const void *values, long dataType, size_t count, const uint8_t *ignore, uint64_t *keys)
+{
+    size_t n = 0;
+    switch (valueKind(dataType))
+    {
+        case VALUE_DOUBLE: KEY_LOOP(double, doubleKey(v[i]))
+        case VALUE_FLOAT: KEY_LOOP(float, floatKey(v[i]))
+        case VALUE_UINT8: KEY_LOOP(uint8_t, v[i])
+        case VALUE_UINT16: KEY_LOOP(uint16_t, v[i])
+        case VALUE_UINT32: KEY_LOOP(uint32_t, v[i])
+        case VALUE_INT8: KEY_LOOP(int8_t, (uint8_t)v[i] ^ 0x80u)
+        case VALUE_INT16: KEY_LOOP(int16_t, (uint16_t)v[i] ^ 0x8000u)
+        case VALUE_INT32: KEY_LOOP(int32_t, (uint32_t)v[i] ^ 0x80000000u)
+        case VALUE_INT64: KEY_LOOP(int64_t, (uint64_t)v[i] ^ (UINT64_C(1) << 63))
+        default:
+            break;
+    }
+
+    return n;
+}
+
+#define DOUBLE_LOOP(type) \
+    { \
+        const type *v = values; \
+        for (size_t i = 0; i < count; i++) \
+        { \
+            if (ignore == NULL || !ignore[i]) \
+                doubles[n++] = (double)v[i]; \
+        } \
+        break; \
+    }
+
+size_t valuesAsDoubles(const void *values, long dataType, size_t count, const uint8_t *ignore, double *doubles)
+{
+    size_t n = 0;
+    switch (valueKind(dataType))
+    {
+        case VALUE_DOUBLE: DOUBLE_LOOP(double)
+        case VALUE_FLOAT: DOUBLE_LOOP(float)
+        case VALUE_UINT8: DOUBLE_LOOP(uint8_t)
+        case VALUE_UINT16: DOUBLE_LOOP(uint16_t)
+        case VALUE_UINT32: DOUBLE_LOOP(uint32_t)
+        case VALUE_INT8: DOUBLE_LOOP(int8_t)
+        case VALUE_INT16: DOUBLE_LOOP(int16_t)
+        case VALUE_INT32: DOUBLE_LOOP(int32_t)
+        case VALUE_INT64: DOUBLE_LOOP(int64_t)
+        default:
+            break;
+    }
+
+    return n;
+}
+
+bool sortKeyIsNaN(uint64_t key, long dataType)
+{
+    int kind = valueKind(dataType);
+
+    return (kind == VALUE_DOUBLE && key == UINT64_MAX) || (kind == VALUE_FLOAT && key == UINT32_MAX);
+}
+
+void printSortKey(FILE *dest, uint64_t key, long dataType)
+{
+    switch (valueKind(dataType))
+    {
+        case VALUE_DOUBLE:
+        {
+            uint64_t bits = (key >> 63) ? key ^ (UINT64_C(1) << 63) : ~key;
+            double x = 0.0;
+            memcpy(&x, &bits, sizeof x);
+            fprintf(dest, "%lf", sortKeyIsNaN(key, dataType) ? NAN : x);
+            break;
+        }
+        case VALUE_FLOAT:
+        {
+            uint32_t k = (uint32_t)key;
+            uint32_t bits = (k >> 31) ? k ^ (UINT32_C(1) << 31) : ~k;
+            float x = 0.0;
+            memcpy(&x, &bits, sizeof x);
+            fprintf(dest, "%f", sortKeyIsNaN(key, dataType) ? NAN : x);
+            break;
+        }
+        case VALUE_UINT8:
+        case VALUE_UINT16:
+        case VALUE_UINT32:
+            fprintf(dest, "%u", (uint32_t)key);
+            break;
+        case VALUE_INT8:
+            fprintf(dest, "%d", (int8_t)(uint8_t)(key ^ 0x80u));
+            break;
+        case VALUE_INT16:
+            fprintf(dest, "%d", (int16_t)(uint16_t)(key ^ 0x8000u));
+            break;
+        case VALUE_INT32:
+            fprintf(dest, "%d", (int32_t)(uint32_t)(key ^ 0x80000000u));
+            break;
+        case VALUE_INT64:
+            fprintf(dest, "%ld", (int64_t)(key ^ (UINT64_C(1) << 63)));
+            break;
+        default:
+            fprintf(dest, "x");
+    }
+
+    return;
+}
+
+// Each worker counts and scatters a contiguous block of keys, so the sort is stable
+typedef struct radixWorker {
+    const uint64_t *source;
+    uint64_t *destination;
+    size_t first;
+    size_t n;
+    int shift;
+    size_t counts[RADIX_BUCKETS]; // digit counts, then the worker's destination offsets
+} RadixWorker;
+
+static void *radixCount(void *arg)
+{
+    RadixWorker *worker = (RadixWorker *)arg;
+    memset(worker->counts, 0, sizeof worker->counts);
+    const uint64_t *keys = worker->source + worker->first;
+    for (size_t i = 0; i < worker->n; i++)
+        worker->counts[(keys[i] >> worker->shift) & (RADIX_BUCKETS - 1)]++;
+
+    return NULL;
+}
+
+static void *radixScatter(void *arg)
+{
+    RadixWorker *worker = (RadixWorker *)arg;
+    const uint64_t *keys = worker->source + worker->first;
+    for (size_t i = 0; i < worker->n; i++)
+        worker->destination[worker->counts[(keys[i] >> worker->shift) & (RADIX_BUCKETS - 1)]++] = keys[i];
+
+    return NULL;
+}
+
+// Runs a phase on every worker. The calling thread runs worker 0,
+// and any worker whose thread could not be started.
+static void runRadixPhase(RadixWorker *workers, int nWorkers, void *(*phase)(void *))
+{
+    pthread_t threadIds[RADIX_SORT_MAX_THREADS];
+    bool threadStarted[RADIX_SORT_MAX_THREADS] = {0};
+    for (int w = 1; w < nWorkers; w++)
+        threadStarted[w] = pthread_create(&threadIds[w], NULL, phase, (void *)&workers[w]) == 0;
+    phase((void *)&workers[0]);
+    for (int w = 1; w < nWorkers; w++)
+    {
+        if (threadStarted[w])
+            pthread_join(threadIds[w], NULL);
+        else
+            phase((void *)&workers[w]);
+    }
+
+    return;
+}
+
+int radixSort(uint64_t *keys, size_t n, int keyBytes, int nThreads)
+{
+    if (n < 2 || keyBytes <= 0)
+        return RADIX_SORT_OK;
+    if (keyBytes > 8)
+        return RADIX_SORT_DATA_TYPE;
+
+    uint64_t *buffer = malloc(n * sizeof *buffer);
+    if (buffer == NULL)
+        return RADIX_SORT_MEMORY;
+
+    int nWorkers = nThreads;
+    if (nWorkers > RADIX_SORT_MAX_THREADS)
+        nWorkers = RADIX_SORT_MAX_THREADS;
+    // Threads only pay for themselves on large blocks
+    if ((size_t)nWorkers > n / 65536)
+        nWorkers = (int)(n / 65536);
+    if (nWorkers < 1)
+        nWorkers = 1;
+    RadixWorker *workers = calloc((size_t)nWorkers, sizeof *workers);
+    if (workers == NULL)
+    {
+        free(buffer);
+        return RADIX_SORT_MEMORY;
+    }
+
+    uint64_t *source = keys;
+    uint64_t *destination = buffer;
+    for (int pass = 0; pass < keyBytes; pass++)
+    {
+        for (int w = 0; w < nWorkers; w++)
+        {
+            workers[w].source = source;
+            workers[w].destination = destination;
+            workers[w].first = n * (size_t)w / (size_t)nWorkers;
+            workers[w].n = n * (size_t)(w + 1) / (size_t)nWorkers - workers[w].first;
+            workers[w].shift = pass * RADIX_BITS;
+        }
+        runRadixPhase(workers, nWorkers, radixCount);
+
+        // Digit-major, worker-minor offsets keep equal digits in input order
+        bool trivial = false;
+        size_t offset = 0;
+        for (int d = 0; d < RADIX_BUCKETS && !trivial; d++)
+        {
+            size_t digitCount = 0;
+            for (int w = 0; w < nWorkers; w++)
+            {
+                size_t count = workers[w].counts[d];
+                workers[w].counts[d] = offset;
+                offset += count;
+                digitCount += count;
+            }
+            trivial = digitCount == n;
+        }
+        if (trivial)
+            continue;
+
+        runRadixPhase(workers, nWorkers, radixScatter);
+        uint64_t *swap = source;
+        source = destination;
+        destination = swap;
+    }
+
+    if (source != keys)
+        memcpy(keys, source, n * sizeof *keys);
+
+    free(workers);
+    free(buffer);
+
+    return RADIX_SORT_OK;
+}
@@ -0,0 +1,62 @@
+/*
+
+    SLIDEM Processor: util/printSortedVar/radix_sort.h
+
+    Copyright (C) 2024  Johnathan K Burchill
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _RADIX_SORT_H
+#define _RADIX_SORT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+// Values of a CDF variable are sorted as unsigned integer keys whose order is the
+// numeric order of the values: integers with the sign bit flipped, and IEEE floats
+// with the sign bit flipped for positive values and all bits flipped for negative values.
+// NaNs all map to the largest key, so they sort after +Inf.
+
+#define RADIX_SORT_MAX_THREADS 64
+
+enum RADIX_SORT_STATUS {
+    RADIX_SORT_OK = 0,
+    RADIX_SORT_MEMORY = -1,
+    RADIX_SORT_DATA_TYPE = -2
+};
+
+// Bytes of the native value, 0 for unsupported CDF data types
+int sortKeyBytes(long dataType);
+
+// Sets ignore[i] to 1 where value i equals ignoredValue
+void ignoreMatchingValues(const void *values, long dataType, size_t count, double ignoredValue, uint8_t *ignore);
+
+// Copies the values that are not ignored (ignore may be NULL) as doubles. Returns the number copied.
+size_t valuesAsDoubles(const void *values, long dataType, size_t count, const uint8_t *ignore, double *doubles);
+
+// Keys of the values that are not ignored (ignore may be NULL). Returns the number of keys.
+size_t sortKeys(const void *values, long dataType, size_t count, const uint8_t *ignore, uint64_t *keys);
+
+// LSD radix sort of keys of keyBytes significant bytes, 8 bits per pass.
+// Passes in which every key has the same digit are skipped.
+int radixSort(uint64_t *keys, size_t n, int keyBytes, int nThreads);
+
+bool sortKeyIsNaN(uint64_t key, long dataType);
+// Prints the value a key was made from
+void printSortKey(FILE *dest, uint64_t key, long dataType);
+
+#endif // _RADIX_SORT_H
@@ -0,0 +1,206 @@
+/*
+
+    SLIDEM Processor: util/printSortedVar/value_summary.c
+
+    Copyright (C) 2024  Johnathan K Burchill
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "value_summary.h"
+#include "selection_statistics.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+int initHistogram(const char *specification, bool logarithmic, Histogram *histogram)
+{
+    memset(histogram, 0, sizeof *histogram);
+    histogram->logarithmic = logarithmic;
+
+    double step = 0.0;
+    if (sscanf(specification, "%lf:%lf:%lf", &histogram->min, &histogram->max, &step) != 3 || !(step > 0.0) || !(histogram->max > histogram->min))
+        return VALUE_SUMMARY_SPECIFICATION;
+    if (logarithmic)
+    {
+        if (!(histogram->min > 0.0))
+            return VALUE_SUMMARY_SPECIFICATION;
+        histogram->width = 1.0 / step;
+        histogram->nBins = (size_t) ceil(log10(histogram->max / histogram->min) * step);
+    }
+    else
+    {
+        histogram->width = step;
+        histogram->nBins = (size_t) ceil((histogram->max - histogram->min) / step);
+    }
+    if (histogram->nBins == 0)
+        return VALUE_SUMMARY_SPECIFICATION;
+
+    histogram->counts = calloc(histogram->nBins, sizeof *histogram->counts);
+    if (histogram->counts == NULL)
+        return VALUE_SUMMARY_MEMORY;
+
+    return VALUE_SUMMARY_OK;
+}
+
+void freeHistogram(Histogram *histogram)
+{
+    free(histogram->counts);
+    histogram->counts = NULL;
+
+    return;
+}
+
+// Lower edge of a bin
+static double binEdge(const Histogram *histogram, size_t bin)
+{
+    if (histogram->logarithmic)
+        return histogram->min * pow(10.0, histogram->width * (double)bin);
+
+    return histogram->min + histogram->width * (double)bin;
+}
+
+void histogramAdd(Histogram *histogram, const double *values, size_t n)
+{
+    double inverseWidth = 1.0 / histogram->width;
+    double logMin = histogram->logarithmic ? log10(histogram->min) : 0.0;
+    for (size_t i = 0; i < n; i++)
+    {
+        double x = values[i];
+        if (isnan(x))
+        {
+            histogram->nNaN++;
+            continue;
+        }
+        if (x < histogram->min)
+        {
+            histogram->nUnderflow++;
+            continue;
+        }
+        if (x >= histogram->max)
+        {
+            histogram->nOverflow++;
+            continue;
+        }
+        double position = histogram->logarithmic ? (log10(x) - logMin) * inverseWidth : (x - histogram->min) * inverseWidth;
+        size_t bin = (size_t) position;
+        // Near a bin edge rounding can put the value on the wrong side; the edges decide there
+        double fraction = position - floor(position);
+        if (fraction < 1e-9 && bin > 0 && x < binEdge(histogram, bin))
+            bin--;
+        else if (fraction > 1.0 - 1e-9 && x >= binEdge(histogram, bin + 1))
+            bin++;
+        if (bin >= histogram->nBins)
+            bin = histogram->nBins - 1;
+        histogram->counts[bin]++;
+    }
+
+    return;
+}
+
+void printHistogram(FILE *dest, const Histogram *histogram)
+{
+    fprintf(dest, "Bin boundaries x1 and x2: x1 <= x < x2\n");
+    fprintf(dest, "x1 x2 count\n");
+    for (size_t b = 0; b < histogram->nBins; b++)
+    {
+        double x2 = b + 1 == histogram->nBins ? histogram->max : binEdge(histogram, b + 1);
+        fprintf(dest, "%lf %lf %zu\n", binEdge(histogram, b), x2, histogram->counts[b]);
+    }
+    fprintf(dest, "Below %lf: %zu\n", histogram->min, histogram->nUnderflow);
+    fprintf(dest, "At or above %lf: %zu\n", histogram->max, histogram->nOverflow);
+    fprintf(dest, "NaN: %zu\n", histogram->nNaN);
+
+    return;
+}
+
+int parsePercentiles(char *list, double *percentiles, int maxPercentiles)
+{
+    int n = 0;
+    char *item = NULL;
+    while ((item = strsep(&list, ",")) != NULL)
+    {
+        if (*item == '\0')
+            continue;
+        char *end = NULL;
+        double p = strtod(item, &end);
+        if (n == maxPercentiles || *end != '\0' || !(p >= 0.0 && p <= 100.0))
+            return -1;
+        percentiles[n++] = p;
+    }
+
+    return n;
+}
+
+static int compareDoubles(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+
+    return (x > y) - (x < y);
+}
+
+int selectPercentiles(double *data, size_t n, const double *percentiles, int nPercentiles, double *results, size_t *nNumbers)
+{
+    if (nPercentiles < 0 || nPercentiles > VALUE_SUMMARY_MAX_PERCENTILES)
+        return VALUE_SUMMARY_SPECIFICATION;
+
+    size_t m = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        if (!isnan(data[i]))
+            data[m++] = data[i];
+    }
+    *nNumbers = m;
+    if (m == 0)
+    {
+        for (int p = 0; p < nPercentiles; p++)
+            results[p] = NAN;
+        return VALUE_SUMMARY_OK;
+    }
+
+    // In increasing order each selection only searches above the previous one,
+    // whose partitioning leaves no smaller values there
+    double ordered[VALUE_SUMMARY_MAX_PERCENTILES];
+    memcpy(ordered, percentiles, (size_t)nPercentiles * sizeof *ordered);
+    qsort(ordered, (size_t)nPercentiles, sizeof *ordered, compareDoubles);
+
+    size_t lowest = 0;
+    for (int p = 0; p < nPercentiles; p++)
+    {
+        double delta = (double)(m - 1) * ordered[p] / 100.0;
+        size_t i = (size_t) floor(delta);
+        double lower = selectKth(data + lowest, m - lowest, i - lowest);
+        lowest = i;
+        double result = lower;
+        if (i + 1 < m)
+        {
+            double upper = data[i + 1];
+            for (size_t j = i + 2; j < m; j++)
+            {
+                if (data[j] < upper)
+                    upper = data[j];
+            }
+            result = lower + (delta - (double)i) * (upper - lower);
+        }
+        for (int r = 0; r < nPercentiles; r++)
+        {
+            if (percentiles[r] == ordered[p])
+                results[r] = result;
+        }
+    }
+
+    return VALUE_SUMMARY_OK;
+}
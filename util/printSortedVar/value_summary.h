@@ -0,0 +1,65 @@
+/*
+
+    SLIDEM Processor: util/printSortedVar/value_summary.h
+
+    Copyright (C) 2024  Johnathan K Burchill
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _VALUE_SUMMARY_H
+#define _VALUE_SUMMARY_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+// Summaries of a variable that need no full sort: percentiles by selection
+// and histograms accumulated in one pass over the values
+
+#define VALUE_SUMMARY_MAX_PERCENTILES 64
+#define VALUE_SUMMARY_BLOCK_SIZE 4096
+
+enum VALUE_SUMMARY_STATUS {
+    VALUE_SUMMARY_OK = 0,
+    VALUE_SUMMARY_SPECIFICATION = -1,
+    VALUE_SUMMARY_MEMORY = -2
+};
+
+typedef struct histogram {
+    bool logarithmic;
+    double min;
+    double max;
+    double width; // decades per bin for logarithmic bins
+    size_t nBins;
+    size_t *counts;
+    size_t nUnderflow;
+    size_t nOverflow;
+    size_t nNaN;
+} Histogram;
+
+// <min>:<max>:<width> for linear bins, <min>:<max>:<binsPerDecade> with 0 < min for logarithmic bins
+int initHistogram(const char *specification, bool logarithmic, Histogram *histogram);
+void freeHistogram(Histogram *histogram);
+void histogramAdd(Histogram *histogram, const double *values, size_t n);
+void printHistogram(FILE *dest, const Histogram *histogram);
+
+// Comma-separated percentiles from 0 to 100. Returns the number parsed, or -1 if any is invalid.
+int parsePercentiles(char *list, double *percentiles, int maxPercentiles);
+
+// Percentiles of data, linearly interpolated between order statistics as for slidembin Percentile<p>.
+// NaNs are removed first; nNumbers returns the number of other values. data are reordered.
+int selectPercentiles(double *data, size_t n, const double *percentiles, int nPercentiles, double *results, size_t *nNumbers);
+
+#endif // _VALUE_SUMMARY_H
@@ -0,0 +1,134 @@
+/*
+
+    SLIDEM Processor: util/slidemWatch/input_sets.c
+
+    Copyright (C) 2024  Johnathan K Burchill
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "input_sets.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char *datasetNames[NUM_INPUT_DATASETS] = {"LP_FP", "LP_HM", "SC_1B", "LR_1B"};
+
+bool parseInputFilename(const char *name, char *satellite, long *date, int *dataset, long *version)
+{
+    size_t len = strlen(name);
+    // Most Swarm CDF file names have a length of 59 characters. The MDR_MAG_LR files have a length of 70 characters.
+    // The MDR_MAG_LR files have the same filename structure up to character 55.
+    if (len != 59 && len != 70)
+        return false;
+    if (strncmp(name, "SW_", 3) != 0 || (name[11] != 'A' && name[11] != 'B' && name[11] != 'C'))
+        return false;
+
+    int d = 0;
+    for (d = 0; d < NUM_INPUT_DATASETS; d++)
+    {
+        if (strncmp(name + 13, datasetNames[d], 5) == 0)
+            break;
+    }
+    if (d == NUM_INPUT_DATASETS)
+        return false;
+
+    char fdate[9] = {0};
+    char fversion[5] = {0};
+    strncpy(fdate, name + 19, 8);
+    strncpy(fversion, name + 51, 4);
+    long fileDate = atol(fdate);
+    long fileVersion = atol(fversion);
+    if (fileDate < 19000101 || fileVersion <= 0)
+        return false;
+
+    *satellite = name[11];
+    *date = fileDate;
+    *dataset = d;
+    *version = fileVersion;
+
+    return true;
+}
+
+long inputSetIndex(InputSets *inputSets, char satellite, long date, bool create)
+{
+    for (long i = 0; i < inputSets->nSets; i++)
+    {
+        if (inputSets->sets[i].satellite == satellite && inputSets->sets[i].date == date)
+            return i;
+    }
+    if (!create)
+        return -1;
+
+    if (inputSets->nSets == inputSets->maxSets)
+    {
+        InputSet *mem = realloc(inputSets->sets, (size_t)(inputSets->maxSets + INPUT_SETS_BLOCK_SIZE) * sizeof(InputSet));
+        if (mem == NULL)
+            return -1;
+        inputSets->sets = mem;
+        inputSets->maxSets += INPUT_SETS_BLOCK_SIZE;
+    }
+    InputSet *set = &inputSets->sets[inputSets->nSets];
+    memset(set, 0, sizeof(InputSet));
+    set->satellite = satellite;
+    set->date = date;
+
+    return inputSets->nSets++;
+}
+
+bool updateInputSet(InputSet *set, int dataset, long version)
+{
+    if (dataset < 0 || dataset >= NUM_INPUT_DATASETS || version <= set->versions[dataset])
+        return false;
+
+    set->versions[dataset] = version;
+
+    return true;
+}
+
+bool inputSetComplete(const InputSet *set)
+{
+    for (int d = 0; d < NUM_INPUT_DATASETS; d++)
+    {
+        if (set->versions[d] == 0)
+            return false;
+    }
+
+    return true;
+}
+
+bool inputSetNeedsProcessing(const InputSet *set)
+{
+    if (!inputSetComplete(set))
+        return false;
+
+    for (int d = 0; d < NUM_INPUT_DATASETS; d++)
+    {
+        if (set->versions[d] > set->processedVersions[d])
+            return true;
+    }
+
+    return false;
+}
+
+void freeInputSets(InputSets *inputSets)
+{
+    free(inputSets->sets);
+    inputSets->sets = NULL;
+    inputSets->nSets = 0;
+    inputSets->maxSets = 0;
+
+    return;
+}
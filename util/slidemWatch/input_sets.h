@@ -0,0 +1,79 @@
+/*
+
+    SLIDEM Processor: util/slidemWatch/input_sets.h
+
+    Copyright (C) 2024  Johnathan K Burchill
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _INPUT_SETS_H
+#define _INPUT_SETS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Datasets needed to process one satellite and date. MOD for the previous day is optional.
+enum INPUT_DATASET {
+    INPUT_LP_FP = 0,
+    INPUT_LP_HM,
+    INPUT_MOD,
+    INPUT_MAG,
+    NUM_INPUT_DATASETS
+};
+
+enum INPUT_SET_STATE {
+    INPUT_SET_IDLE = 0,
+    INPUT_SET_QUEUED,
+    INPUT_SET_RUNNING
+};
+
+typedef struct inputSet
+{
+    char satellite;
+    long date; // yyyymmdd
+    long versions[NUM_INPUT_DATASETS]; // Latest file version seen, 0 if none
+    long processedVersions[NUM_INPUT_DATASETS]; // File versions of the last processing run
+    int state;
+    unsigned long queueOrder;
+    bool rerun; // Newer files arrived while running
+} InputSet;
+
+typedef struct inputSets
+{
+    long nSets;
+    long maxSets;
+    InputSet *sets;
+} InputSets;
+
+#define INPUT_SETS_BLOCK_SIZE 64
+
+// Parses a Swarm input file name (59 or 70 characters, as in the processor's getInputFilename()).
+// Returns false if the name is not one of the SLIDEM input datasets.
+bool parseInputFilename(const char *name, char *satellite, long *date, int *dataset, long *version);
+
+// Returns the set index, adding a set if create is true and there is none. Returns -1 if not found or out of memory.
+long inputSetIndex(InputSets *inputSets, char satellite, long date, bool create);
+
+// Records a file version. Returns true if it is newer than the one already known.
+bool updateInputSet(InputSet *set, int dataset, long version);
+
+bool inputSetComplete(const InputSet *set);
+
+// Complete and has at least one file newer than those last processed
+bool inputSetNeedsProcessing(const InputSet *set);
+
+void freeInputSets(InputSets *inputSets);
+
+#endif // _INPUT_SETS_H
@@ -0,0 +1,584 @@
+/*
+
+    SLIDEM Processor: util/slidemWatch/main.c
+
+    Copyright (C) 2024  Johnathan K Burchill
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "input_sets.h"
+
+#include "slidem_settings.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <limits.h>
+#include <unistd.h>
+#include <signal.h>
+#include <poll.h>
+#include <errno.h>
+#include <time.h>
+#include <fts.h>
+#include <fcntl.h>
+#include <sys/inotify.h>
+#include <sys/wait.h>
+
+#include <pthread.h>
+
+#define WATCH_SOFTWARE_VERSION "1.0"
+
+#define MAX_THREADS 38
+#define WATCH_POLL_INTERVAL 500 // milliseconds
+#define WATCH_EVENT_BUFFER_SIZE (64 * (sizeof(struct inotify_event) + NAME_MAX + 1))
+#define DEFAULT_PROCESSOR "slidem0301"
+#define WATCH_MASK (IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE)
+#define WATCHES_BLOCK_SIZE 64
+
+enum STATUS
+{
+    STATUS_OK = 0,
+    STATUS_PERMISSION,
+    STATUS_MEM
+};
+
+typedef struct watcher
+{
+    pthread_mutex_t lock;
+    pthread_cond_t workAvailable;
+    InputSets inputSets;
+    unsigned long nextQueueOrder;
+    bool stop;
+
+    const char *satellites;
+    const char *processor;
+    const char *lpDir;
+    const char *modDir;
+    const char *magDir;
+    const char *exportDir;
+} Watcher;
+
+// inotify watches on the input directory trees, so that paths of new subdirectories can be built
+typedef struct watches
+{
+    int fd;
+    long nWatches;
+    long maxWatches;
+    int *descriptors;
+    char **paths;
+} Watches;
+
+static volatile sig_atomic_t stopRequested = 0;
+
+static void requestStop(int signal)
+{
+    (void)signal;
+    stopRequested = 1;
+}
+
+static void logMessage(const char *format, ...)
+{
+    time_t now = time(NULL);
+    struct tm t;
+    gmtime_r(&now, &t);
+    va_list args;
+    va_start(args, format);
+    flockfile(stdout);
+    fprintf(stdout, "slidemWatch %4d-%02d-%02dT%02d:%02d:%02d: ", t.tm_year + 1900, t.tm_mon + 1, t.tm_mday, t.tm_hour, t.tm_min, t.tm_sec);
+    vfprintf(stdout, format, args);
+    fflush(stdout);
+    funlockfile(stdout);
+    va_end(args);
+
+    return;
+}
+
+static void productFilename(const Watcher *watcher, const InputSet *set, char *filename)
+{
+    snprintf(filename, FILENAME_MAX, "%s/SW_%s_EFI%c%s_2__%08ldT000000_%08ldT235959_%s.ZIP", watcher->exportDir, SLIDEM_PRODUCT_TYPE, set->satellite, SLIDEM_PRODUCT_CODE, set->date, set->date, EXPORT_VERSION_STRING);
+
+    return;
+}
+
+// Call with the lock held
+static void scheduleInputSet(Watcher *watcher, InputSet *set)
+{
+    if (set->state == INPUT_SET_RUNNING)
+    {
+        set->rerun = true;
+    }
+    else if (set->state == INPUT_SET_IDLE)
+    {
+        set->state = INPUT_SET_QUEUED;
+        set->queueOrder = watcher->nextQueueOrder++;
+        pthread_cond_signal(&watcher->workAvailable);
+        logMessage("Queued %c %08ld.\n", set->satellite, set->date);
+    }
+
+    return;
+}
+
+// Call with the lock held. Returns true if the file is a newer input for a watched satellite.
+static bool noteInputFile(Watcher *watcher, const char *name)
+{
+    char satellite = 0;
+    long date = 0;
+    int dataset = 0;
+    long version = 0;
+    if (!parseInputFilename(name, &satellite, &date, &dataset, &version) || strchr(watcher->satellites, satellite) == NULL)
+        return false;
+
+    long index = inputSetIndex(&watcher->inputSets, satellite, date, true);
+    if (index < 0)
+    {
+        logMessage("Unable to allocate memory to track %s.\n", name);
+        return false;
+    }
+
+    return updateInputSet(&watcher->inputSets.sets[index], dataset, version);
+}
+
+static int scanDirectory(Watcher *watcher, const char *directory)
+{
+    char *searchPath[2] = {NULL, NULL};
+    searchPath[0] = (char *)directory;
+
+    FTS *fts = fts_open(searchPath, FTS_PHYSICAL | FTS_NOCHDIR, NULL);
+    if (fts == NULL)
+        return STATUS_PERMISSION;
+
+    FTSENT *f = fts_read(fts);
+    while (f != NULL)
+    {
+        if (f->fts_info == FTS_F)
+            noteInputFile(watcher, f->fts_name);
+        f = fts_read(fts);
+    }
+    fts_close(fts);
+
+    return STATUS_OK;
+}
+
+static int addWatch(Watches *watches, const char *directory)
+{
+    int wd = inotify_add_watch(watches->fd, directory, WATCH_MASK);
+    if (wd == -1)
+        return STATUS_PERMISSION;
+    // Watching a directory again returns its existing descriptor
+    for (long i = 0; i < watches->nWatches; i++)
+    {
+        if (watches->descriptors[i] == wd)
+            return STATUS_OK;
+    }
+    if (watches->nWatches == watches->maxWatches)
+    {
+        long maxWatches = watches->maxWatches + WATCHES_BLOCK_SIZE;
+        int *descriptors = realloc(watches->descriptors, (size_t)maxWatches * sizeof(int));
+        if (descriptors == NULL)
+            return STATUS_MEM;
+        watches->descriptors = descriptors;
+        char **paths = realloc(watches->paths, (size_t)maxWatches * sizeof(char *));
+        if (paths == NULL)
+            return STATUS_MEM;
+        watches->paths = paths;
+        watches->maxWatches = maxWatches;
+    }
+    char *path = strdup(directory);
+    if (path == NULL)
+        return STATUS_MEM;
+    watches->descriptors[watches->nWatches] = wd;
+    watches->paths[watches->nWatches] = path;
+    watches->nWatches++;
+
+    return STATUS_OK;
+}
+
+// Watches directory and all of its subdirectories
+static int watchTree(Watches *watches, const char *directory)
+{
+    char *searchPath[2] = {NULL, NULL};
+    searchPath[0] = (char *)directory;
+
+    FTS *fts = fts_open(searchPath, FTS_PHYSICAL | FTS_NOCHDIR, NULL);
+    if (fts == NULL)
+        return STATUS_PERMISSION;
+
+    int status = STATUS_OK;
+    FTSENT *f = fts_read(fts);
+    while (f != NULL && status == STATUS_OK)
+    {
+        if (f->fts_info == FTS_D)
+            status = addWatch(watches, f->fts_path);
+        f = fts_read(fts);
+    }
+    fts_close(fts);
+
+    return status;
+}
+
+static const char *watchedPath(const Watches *watches, int wd)
+{
+    for (long i = 0; i < watches->nWatches; i++)
+    {
+        if (watches->descriptors[i] == wd)
+            return watches->paths[i];
+    }
+
+    return NULL;
+}
+
+// The kernel removed the watch, e.g. because the directory was deleted
+static void forgetWatch(Watches *watches, int wd)
+{
+    for (long i = 0; i < watches->nWatches; i++)
+    {
+        if (watches->descriptors[i] == wd)
+        {
+            free(watches->paths[i]);
+            watches->nWatches--;
+            watches->descriptors[i] = watches->descriptors[watches->nWatches];
+            watches->paths[i] = watches->paths[watches->nWatches];
+            return;
+        }
+    }
+
+    return;
+}
+
+static void freeWatches(Watches *watches)
+{
+    for (long i = 0; i < watches->nWatches; i++)
+        free(watches->paths[i]);
+    free(watches->paths);
+    free(watches->descriptors);
+    watches->paths = NULL;
+    watches->descriptors = NULL;
+    watches->nWatches = 0;
+    watches->maxWatches = 0;
+
+    return;
+}
+
+// Watches and scans a directory tree that may hold files no event was received for. Call with the lock held.
+static void rescanTree(Watcher *watcher, Watches *watches, const char *directory)
+{
+    if (watchTree(watches, directory) != STATUS_OK)
+        logMessage("Unable to watch all of %s.\n", directory);
+    if (scanDirectory(watcher, directory) != STATUS_OK)
+        logMessage("Could not open directory %s for reading.\n", directory);
+    for (long i = 0; i < watcher->inputSets.nSets; i++)
+    {
+        InputSet *set = &watcher->inputSets.sets[i];
+        if (set->state == INPUT_SET_IDLE && inputSetNeedsProcessing(set))
+            scheduleInputSet(watcher, set);
+    }
+
+    return;
+}
+
+// Runs the processor with its output appended to <exportDir>/<satellite><date>.log. Returns the wait status, or -1.
+static int runProcessor(const Watcher *watcher, const InputSet *job)
+{
+    char satellite[2] = {job->satellite, '\0'};
+    char date[16];
+    snprintf(date, sizeof date, "%08ld", job->date);
+    char logFilename[FILENAME_MAX];
+    snprintf(logFilename, FILENAME_MAX, "%s/%c%08ld.log", watcher->exportDir, job->satellite, job->date);
+    char *args[8] = {(char *)watcher->processor, satellite, date, (char *)watcher->lpDir, (char *)watcher->modDir, (char *)watcher->magDir, (char *)watcher->exportDir, NULL};
+
+    int logFd = open(logFilename, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (logFd == -1)
+        return -1;
+
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        // Only async-signal-safe calls between fork and exec
+        if (dup2(logFd, STDOUT_FILENO) == -1 || dup2(logFd, STDERR_FILENO) == -1)
+            _exit(127);
+        execvp(args[0], args);
+        _exit(127);
+    }
+    close(logFd);
+    if (pid == -1)
+        return -1;
+
+    int status = 0;
+    while (waitpid(pid, &status, 0) == -1)
+    {
+        if (errno != EINTR)
+            return -1;
+    }
+
+    return status;
+}
+
+// Picks the earliest queued set. Call with the lock held.
+static long nextQueuedSet(const Watcher *watcher)
+{
+    long next = -1;
+    for (long i = 0; i < watcher->inputSets.nSets; i++)
+    {
+        const InputSet *set = &watcher->inputSets.sets[i];
+        if (set->state == INPUT_SET_QUEUED && (next == -1 || set->queueOrder < watcher->inputSets.sets[next].queueOrder))
+            next = i;
+    }
+
+    return next;
+}
+
+static void *workerThread(void *arg)
+{
+    Watcher *watcher = (Watcher *)arg;
+    char zipFilename[FILENAME_MAX];
+
+    pthread_mutex_lock(&watcher->lock);
+    while (!watcher->stop)
+    {
+        long index = nextQueuedSet(watcher);
+        if (index < 0)
+        {
+            pthread_cond_wait(&watcher->workAvailable, &watcher->lock);
+            continue;
+        }
+        // Sets may be reallocated while unlocked, so work from a copy
+        InputSet *set = &watcher->inputSets.sets[index];
+        set->state = INPUT_SET_RUNNING;
+        set->rerun = false;
+        InputSet job = *set;
+        pthread_mutex_unlock(&watcher->lock);
+
+        bool reprocessing = false;
+        for (int d = 0; d < NUM_INPUT_DATASETS; d++)
+        {
+            if (job.processedVersions[d] > 0)
+                reprocessing = true;
+        }
+        productFilename(watcher, &job, zipFilename);
+        // The processor skips dates that already have a product
+        if (reprocessing && unlink(zipFilename) == 0)
+            logMessage("Removed %s to reprocess with newer inputs.\n", zipFilename);
+
+        logMessage("Processing %c %08ld.\n", job.satellite, job.date);
+        int status = runProcessor(watcher, &job);
+        if (status != -1 && WIFEXITED(status) && WEXITSTATUS(status) == 0)
+            logMessage("Processed %c %08ld.\n", job.satellite, job.date);
+        else
+            logMessage("Processing %c %08ld failed (status %d).\n", job.satellite, job.date, status != -1 && WIFEXITED(status) ? WEXITSTATUS(status) : -1);
+
+        pthread_mutex_lock(&watcher->lock);
+        set = &watcher->inputSets.sets[index];
+        // Failed runs are not retried until a newer input file arrives
+        memcpy(set->processedVersions, job.versions, sizeof set->processedVersions);
+        set->state = INPUT_SET_IDLE;
+        if (set->rerun || inputSetNeedsProcessing(set))
+            scheduleInputSet(watcher, set);
+        set->rerun = false;
+    }
+    pthread_mutex_unlock(&watcher->lock);
+
+    return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *processor = DEFAULT_PROCESSOR;
+    int nArgs = 1;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--about") == 0)
+        {
+            fprintf(stdout, "slidemWatch0301 version %s.\n", WATCH_SOFTWARE_VERSION);
+            fprintf(stdout, "Copyright (C) 2024  Johnathan K Burchill\n");
+            fprintf(stdout, "This program comes with ABSOLUTELY NO WARRANTY.\n");
+            fprintf(stdout, "This is free software, and you are welcome to redistribute it\n");
+            fprintf(stdout, "under the terms of the GNU General Public License.\n");
+            exit(0);
+        }
+        else if (strncmp(argv[i], "--processor=", 12) == 0)
+            processor = argv[i] + 12;
+        else
+            argv[nArgs++] = argv[i];
+    }
+    argc = nArgs;
+
+    if (argc != 7)
+    {
+        printf("usage:\t%s satellites lpDirectory modDirectory magDirectory exportDirectory nthreads [--processor=command]\n", argv[0]);
+        printf("\t\twatches the input directories and their subdirectories and processes each satellite and date (e.g. satellites \"ABC\") as soon as its LP_FP, LP_HM, MOD and MAG files are present.\n");
+        printf("\t\tDates are reprocessed when a newer version of one of their input files arrives.\n");
+        printf("\t\t--processor=command runs command instead of %s, with the same arguments.\n", DEFAULT_PROCESSOR);
+        printf("\t%s --about\n\t\tprints copyright and license information.\n", argv[0]);
+        exit(0);
+    }
+
+    Watcher watcher = {0};
+    watcher.satellites = argv[1];
+    watcher.lpDir = argv[2];
+    watcher.modDir = argv[3];
+    watcher.magDir = argv[4];
+    watcher.exportDir = argv[5];
+    watcher.processor = processor;
+    int nThreads = atoi(argv[6]);
+    if (nThreads < 1)
+        nThreads = 1;
+    if (nThreads > MAX_THREADS)
+        nThreads = MAX_THREADS;
+
+    const char *directories[3] = {watcher.lpDir, watcher.modDir, watcher.magDir};
+    int nDirectories = 3;
+
+    // Watch before scanning so that no file is missed in between
+    Watches watches = {0};
+    watches.fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (watches.fd == -1)
+    {
+        fprintf(stdout, "Unable to initialize inotify: %s\n", strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < nDirectories; i++)
+    {
+        if (watchTree(&watches, directories[i]) != STATUS_OK)
+        {
+            fprintf(stdout, "Unable to watch %s and its subdirectories: %s\n", directories[i], strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    pthread_mutex_init(&watcher.lock, NULL);
+    pthread_cond_init(&watcher.workAvailable, NULL);
+
+    // Existing files. Dates that already have a product are treated as processed with these versions.
+    pthread_mutex_lock(&watcher.lock);
+    for (int i = 0; i < nDirectories; i++)
+    {
+        if (scanDirectory(&watcher, directories[i]) != STATUS_OK)
+            logMessage("Could not open directory %s for reading.\n", directories[i]);
+    }
+    char zipFilename[FILENAME_MAX];
+    long nQueued = 0;
+    for (long i = 0; i < watcher.inputSets.nSets; i++)
+    {
+        InputSet *set = &watcher.inputSets.sets[i];
+        if (!inputSetComplete(set))
+            continue;
+        productFilename(&watcher, set, zipFilename);
+        if (access(zipFilename, F_OK) == 0)
+            memcpy(set->processedVersions, set->versions, sizeof set->processedVersions);
+        else
+        {
+            scheduleInputSet(&watcher, set);
+            nQueued++;
+        }
+    }
+    logMessage("Tracking %ld input sets, %ld queued for processing on %d threads.\n", watcher.inputSets.nSets, nQueued, nThreads);
+    pthread_mutex_unlock(&watcher.lock);
+
+    struct sigaction action = {0};
+    action.sa_handler = requestStop;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    pthread_t threadIds[MAX_THREADS];
+    int nStarted = 0;
+    for (int i = 0; i < nThreads; i++)
+    {
+        if (pthread_create(&threadIds[i], NULL, workerThread, &watcher) != 0)
+            break;
+        nStarted++;
+    }
+    if (nStarted == 0)
+    {
+        logMessage("Could not start worker threads.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    char *events = malloc(WATCH_EVENT_BUFFER_SIZE);
+    if (events == NULL)
+    {
+        logMessage("Could not allocate memory for inotify events.\n");
+        stopRequested = 1;
+    }
+    struct pollfd pfd = {.fd = watches.fd, .events = POLLIN};
+    while (!stopRequested)
+    {
+        int ready = poll(&pfd, 1, WATCH_POLL_INTERVAL);
+        if (ready <= 0)
+            continue;
+        ssize_t len = 0;
+        while ((len = read(watches.fd, events, WATCH_EVENT_BUFFER_SIZE)) > 0)
+        {
+            pthread_mutex_lock(&watcher.lock);
+            for (char *p = events; p < events + len; )
+            {
+                struct inotify_event *event = (struct inotify_event *)p;
+                p += sizeof(struct inotify_event) + event->len;
+                if (event->mask & IN_Q_OVERFLOW)
+                {
+                    // Events were lost
+                    logMessage("inotify event queue overflowed. Rescanning input directories.\n");
+                    for (int i = 0; i < nDirectories; i++)
+                        rescanTree(&watcher, &watches, directories[i]);
+                }
+                else if (event->mask & IN_IGNORED)
+                    forgetWatch(&watches, event->wd);
+                else if ((event->mask & IN_ISDIR) && (event->mask & (IN_CREATE | IN_MOVED_TO)) && event->len > 0)
+                {
+                    // Files can arrive in a new subdirectory before it is watched
+                    const char *parent = watchedPath(&watches, event->wd);
+                    if (parent == NULL)
+                        continue;
+                    char subdirectory[FILENAME_MAX];
+                    snprintf(subdirectory, FILENAME_MAX, "%s/%s", parent, event->name);
+                    rescanTree(&watcher, &watches, subdirectory);
+                }
+                else if (!(event->mask & IN_ISDIR) && (event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) && event->len > 0 && noteInputFile(&watcher, event->name))
+                {
+                    char satellite = 0;
+                    long date = 0;
+                    int dataset = 0;
+                    long version = 0;
+                    parseInputFilename(event->name, &satellite, &date, &dataset, &version);
+                    InputSet *set = &watcher.inputSets.sets[inputSetIndex(&watcher.inputSets, satellite, date, false)];
+                    logMessage("New input %s.\n", event->name);
+                    if (inputSetNeedsProcessing(set))
+                        scheduleInputSet(&watcher, set);
+                }
+            }
+            pthread_mutex_unlock(&watcher.lock);
+        }
+    }
+
+    // Running jobs are allowed to finish
+    logMessage("Stopping after running jobs finish.\n");
+    pthread_mutex_lock(&watcher.lock);
+    watcher.stop = true;
+    pthread_cond_broadcast(&watcher.workAvailable);
+    pthread_mutex_unlock(&watcher.lock);
+    for (int i = 0; i < nStarted; i++)
+        pthread_join(threadIds[i], NULL);
+
+    free(events);
+    close(watches.fd);
+    freeWatches(&watches);
+    pthread_cond_destroy(&watcher.workAvailable);
+    pthread_mutex_destroy(&watcher.lock);
+    freeInputSets(&watcher.inputSets);
+
+    return 0;
+}
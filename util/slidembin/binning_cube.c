@@ -0,0 +1,316 @@
+/*
+
+    SLIDEM Processor: util/slidembin/binning_cube.c
+
+    Copyright (C) 2024  Johnathan K Burchill
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "binning_cube.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <stdint.h>
+
+#include <cdf.h>
+
+#define MILLISECONDS_PER_DAY 86400000.0
+#define MILLISECONDS_PER_HOUR 3600000.0
+
+int parseBinAxis(char *text, BinAxis *axis)
+{
+    char *name = strsep(&text, ":");
+    if (name == NULL || *name == '\0' || text == NULL)
+        return BIN_SPECIFICATION;
+    if (sscanf(text, "%lf:%lf:%lf", &axis->min, &axis->max, &axis->delta) != 3 || !(axis->delta > 0.0))
+        return BIN_SPECIFICATION;
+    axis->nCells = (int) floor((axis->max - axis->min) / axis->delta);
+    if (axis->nCells <= 0)
+        return BIN_SPECIFICATION;
+
+    axis->name = name;
+    if (strcmp(name, "Year") == 0)
+        axis->source = BIN_AXIS_YEAR;
+    else if (strcmp(name, "Month") == 0)
+        axis->source = BIN_AXIS_MONTH;
+    else if (strcmp(name, "DayOfYear") == 0)
+        axis->source = BIN_AXIS_DAY_OF_YEAR;
+    else if (strcmp(name, "UTHour") == 0)
+        axis->source = BIN_AXIS_UT_HOUR;
+    else
+        axis->source = BIN_AXIS_VARIABLE;
+
+    return BIN_OK;
+}
+
+int initBinningCube(BinningCube *cube, const BinningState *specification, const BinAxis *axes, int nAxes)
+{
+    if (nAxes < 0 || nAxes > BINNING_CUBE_MAX_AXES)
+        return BIN_SPECIFICATION;
+
+    uint64_t nCells = 1;
+    for (int a = 0; a < nAxes; a++)
+    {
+        if ((uint64_t)axes[a].nCells > UINT64_MAX / nCells)
+        {
+            fprintf(stderr, "Too many cells in the binning axes.\n");
+            return BIN_SPECIFICATION;
+        }
+        nCells *= (uint64_t)axes[a].nCells;
+    }
+
+    memset(cube, 0, sizeof *cube);
+    cube->nAxes = nAxes;
+    for (int a = 0; a < nAxes; a++)
+        cube->axes[a] = axes[a];
+    cube->specification = *specification;
+    cube->specification.pages = NULL;
+    cube->pages = calloc(1, sizeof *cube->pages);
+    cube->capacity = BINNING_CUBE_INITIAL_CAPACITY;
+    cube->cells = calloc(cube->capacity, sizeof *cube->cells);
+    if (cube->pages == NULL || cube->cells == NULL)
+    {
+        free(cube->pages);
+        free(cube->cells);
+        cube->pages = NULL;
+        cube->cells = NULL;
+        cube->capacity = 0;
+        return BIN_MEMORY;
+    }
+
+    return BIN_OK;
+}
+
+void freeBinningCube(BinningCube *cube)
+{
+    for (size_t s = 0; s < cube->capacity; s++)
+    {
+        if (cube->cells[s].used)
+            freeBinStorage(&cube->cells[s].state);
+    }
+    free(cube->cells);
+    freeBinPageAllocator(cube->pages);
+    cube->pages = NULL;
+    cube->cells = NULL;
+    cube->capacity = 0;
+    cube->nUsed = 0;
+
+    return;
+}
+
+bool cubeCellIndices(const BinningCube *cube, const double *axisValues, int *cellIndices)
+{
+    for (int a = 0; a < cube->nAxes; a++)
+    {
+        const BinAxis *axis = &cube->axes[a];
+        double index = floor((axisValues[a] - axis->min) / axis->delta);
+        // Also rejects NaN
+        if (!(index >= 0.0 && index < (double)axis->nCells))
+            return false;
+        cellIndices[a] = (int) index;
+    }
+
+    return true;
+}
+
+static uint64_t cellKey(const BinningCube *cube, const int *cellIndices)
+{
+    uint64_t key = 0;
+    for (int a = 0; a < cube->nAxes; a++)
+        key = key * (uint64_t)cube->axes[a].nCells + (uint64_t)cellIndices[a];
+
+    return key;
+}
+
+static inline bool sameCell(const CubeCell *cell, uint64_t key, const int *cellIndices, int nAxes)
+{
+    return cell->used && cell->key == key && memcmp(cell->cellIndices, cellIndices, (size_t)nAxes * sizeof *cellIndices) == 0;
+}
+
+static size_t cellSlot(uint64_t key, size_t capacity)
+{
+    uint64_t h = key * 0x9E3779B97F4A7C15ULL;
+    h ^= h >> 32;
+
+    return (size_t)(h & (capacity - 1));
+}
+
+static int growCube(BinningCube *cube)
+{
+    size_t capacity = 2 * cube->capacity;
+    CubeCell *cells = calloc(capacity, sizeof *cells);
+    if (cells == NULL)
+        return BIN_MEMORY;
+    for (size_t s = 0; s < cube->capacity; s++)
+    {
+        if (!cube->cells[s].used)
+            continue;
+        size_t slot = cellSlot(cube->cells[s].key, capacity);
+        while (cells[slot].used)
+            slot = (slot + 1) & (capacity - 1);
+        cells[slot] = cube->cells[s];
+    }
+    free(cube->cells);
+    cube->cells = cells;
+    cube->capacity = capacity;
+    cube->lastSlot = 0;
+
+    return BIN_OK;
+}
+
+BinningState *cubeCellState(BinningCube *cube, const int *cellIndices)
+{
+    uint64_t key = cellKey(cube, cellIndices);
+    CubeCell *last = &cube->cells[cube->lastSlot];
+    if (sameCell(last, key, cellIndices, cube->nAxes))
+        return &last->state;
+
+    size_t slot = cellSlot(key, cube->capacity);
+    while (cube->cells[slot].used)
+    {
+        if (sameCell(&cube->cells[slot], key, cellIndices, cube->nAxes))
+        {
+            cube->lastSlot = slot;
+            return &cube->cells[slot].state;
+        }
+        slot = (slot + 1) & (cube->capacity - 1);
+    }
+
+    // New cell. Keep the table at most half full.
+    if (2 * (cube->nUsed + 1) > cube->capacity)
+    {
+        if (growCube(cube) != BIN_OK)
+            return NULL;
+        slot = cellSlot(key, cube->capacity);
+        while (cube->cells[slot].used)
+            slot = (slot + 1) & (cube->capacity - 1);
+    }
+    CubeCell *cell = &cube->cells[slot];
+    cell->state = cube->specification;
+    cell->state.pages = cube->pages;
+    if (initBinningState(&cell->state) != BIN_OK)
+        return NULL;
+    cell->used = true;
+    cell->key = key;
+    for (int a = 0; a < cube->nAxes; a++)
+        cell->cellIndices[a] = cellIndices[a];
+    cube->nUsed++;
+    cube->lastSlot = slot;
+
+    return &cell->state;
+}
+
+int mergeBinningCube(BinningCube *dest, const BinningCube *src)
+{
+    if (dest->nAxes != src->nAxes)
+        return BIN_SPECIFICATION;
+
+    for (size_t s = 0; s < src->capacity; s++)
+    {
+        const CubeCell *cell = &src->cells[s];
+        if (!cell->used)
+            continue;
+        BinningState *state = cubeCellState(dest, cell->cellIndices);
+        if (state == NULL)
+            return BIN_MEMORY;
+        int status = mergeBinningState(state, &cell->state);
+        if (status != BIN_OK)
+            return status;
+    }
+
+    return BIN_OK;
+}
+
+static int compareCells(const void *a, const void *b)
+{
+    uint64_t x = (*(const CubeCell * const *)a)->key;
+    uint64_t y = (*(const CubeCell * const *)b)->key;
+
+    return (x > y) - (x < y);
+}
+
+void printBinningCube(BinningCube *cube, char *parameter, char **statistics, int nStatistics)
+{
+    if (cube->nAxes == 0)
+    {
+        // Without extra axes there is one cell, which may not have been created if nothing was read
+        int none[1] = {0};
+        BinningState *state = cubeCellState(cube, none);
+        if (state != NULL)
+            printBinningResults(state, parameter, statistics, nStatistics);
+        return;
+    }
+
+    CubeCell **cells = malloc((cube->nUsed > 0 ? cube->nUsed : 1) * sizeof *cells);
+    if (cells == NULL)
+    {
+        fprintf(stderr, "Unable to allocate memory for statistics.\n");
+        return;
+    }
+    size_t n = 0;
+    for (size_t s = 0; s < cube->capacity; s++)
+    {
+        if (cube->cells[s].used)
+            cells[n++] = &cube->cells[s];
+    }
+    qsort(cells, n, sizeof *cells, compareCells);
+
+    fprintf(stdout, "%zu occupied cells\n", n);
+    for (size_t c = 0; c < n; c++)
+    {
+        fprintf(stdout, "Cell:");
+        for (int a = 0; a < cube->nAxes; a++)
+        {
+            const BinAxis *axis = &cube->axes[a];
+            double x1 = axis->min + axis->delta * (double)cells[c]->cellIndices[a];
+            fprintf(stdout, " %lf <= %s < %lf", x1, axis->name, x1 + axis->delta);
+        }
+        fprintf(stdout, "\n");
+        printBinningResults(&cells[c]->state, parameter, statistics, nStatistics);
+    }
+    free(cells);
+
+    return;
+}
+
+double binAxisTimeValue(int source, double epoch, TimeAxisCache *cache)
+{
+    double day = floor(epoch / MILLISECONDS_PER_DAY);
+    if (source != BIN_AXIS_UT_HOUR && day != cache->day)
+    {
+        long year, month, dayOfMonth, hour, minute, second, msec;
+        EPOCHbreakdown(epoch, &year, &month, &dayOfMonth, &hour, &minute, &second, &msec);
+        cache->day = day;
+        cache->year = (double) year;
+        cache->month = (double) month;
+        cache->dayOfYear = day - floor(computeEPOCH(year, 1, 1, 0, 0, 0, 0) / MILLISECONDS_PER_DAY) + 1.0;
+    }
+
+    switch (source)
+    {
+        case BIN_AXIS_YEAR:
+            return cache->year;
+        case BIN_AXIS_MONTH:
+            return cache->month;
+        case BIN_AXIS_DAY_OF_YEAR:
+            return cache->dayOfYear;
+        case BIN_AXIS_UT_HOUR:
+            return (epoch - day * MILLISECONDS_PER_DAY) / MILLISECONDS_PER_HOUR;
+        default:
+            return NAN;
+    }
+}
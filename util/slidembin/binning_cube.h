@@ -0,0 +1,100 @@
+/*
+
+    SLIDEM Processor: util/slidembin/binning_cube.h
+
+    Copyright (C) 2024  Johnathan K Burchill
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _BINNING_CUBE_H
+#define _BINNING_CUBE_H
+
+#include "statistics.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+// Bins over extra axes (file time or other product variables) in addition to QDLat and MLT.
+// Each occupied cell of the extra axes holds its own QDLat x MLT BinningState; cells are
+// kept in a hash table, so empty cells of the cube are never allocated. The cells share
+// one page allocator for their stored values.
+
+#define BINNING_CUBE_MAX_AXES 4
+#define BINNING_CUBE_INITIAL_CAPACITY 16
+
+enum BIN_AXIS_SOURCE {
+    BIN_AXIS_VARIABLE = 0,
+    BIN_AXIS_YEAR,
+    BIN_AXIS_MONTH,
+    BIN_AXIS_DAY_OF_YEAR,
+    BIN_AXIS_UT_HOUR
+};
+
+typedef struct binAxis {
+    char *name; // Year, Month, DayOfYear, UTHour, or a product variable
+    int source;
+    double min;
+    double max;
+    double delta;
+    int nCells;
+} BinAxis;
+
+typedef struct cubeCell {
+    bool used;
+    uint64_t key;
+    int cellIndices[BINNING_CUBE_MAX_AXES];
+    BinningState state;
+} CubeCell;
+
+typedef struct binningCube {
+    int nAxes;
+    BinAxis axes[BINNING_CUBE_MAX_AXES];
+    BinningState specification;
+    BinPageAllocator *pages;
+    CubeCell *cells;
+    size_t capacity;
+    size_t nUsed;
+    size_t lastSlot; // records arrive in time order, so consecutive lookups usually hit the same cell
+} BinningCube;
+
+// Time-derived axis values change at most once per day of records
+typedef struct timeAxisCache {
+    double day;
+    double year;
+    double month;
+    double dayOfYear;
+} TimeAxisCache;
+
+// Parses <name>:<min>:<max>:<width>; cells are min + n width <= x < min + (n+1) width
+int parseBinAxis(char *text, BinAxis *axis);
+
+// The number of cells of the extra axes must fit the 64-bit cell key
+int initBinningCube(BinningCube *cube, const BinningState *specification, const BinAxis *axes, int nAxes);
+void freeBinningCube(BinningCube *cube);
+
+// Cell of a record from its axis values. Returns false if a value is outside its axis.
+bool cubeCellIndices(const BinningCube *cube, const double *axisValues, int *cellIndices);
+// Finds or creates the cell. Returns NULL if memory is exhausted.
+BinningState *cubeCellState(BinningCube *cube, const int *cellIndices);
+
+int mergeBinningCube(BinningCube *dest, const BinningCube *src);
+
+// One table per occupied cell in cell order, or the plain table without extra axes
+void printBinningCube(BinningCube *cube, char *parameter, char **statistics, int nStatistics);
+
+double binAxisTimeValue(int source, double epoch, TimeAxisCache *cache);
+
+#endif // _BINNING_CUBE_H
@@ -0,0 +1,351 @@
+/*
+
+    SLIDEM Processor: util/slidembin/kll_sketch.c
+
+    Copyright (C) 2024  Johnathan K Burchill
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "kll_sketch.h"
+#include "selection_statistics.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+// Fixed seed so that a run is reproducible
+#define KLL_RANDOM_SEED 0x9E3779B97F4A7C15ULL
+
+typedef struct weightedItem {
+    double value;
+    uint64_t weight;
+} WeightedItem;
+
+uint32_t kllParameterForRankError(double rankError)
+{
+    if (!(rankError > 0.0))
+        return KLL_MIN_K;
+    double k = ceil(KLL_RANK_ERROR_CONSTANT / rankError);
+    if (k < KLL_MIN_K)
+        k = KLL_MIN_K;
+    if (k > UINT32_MAX / 2)
+        k = UINT32_MAX / 2;
+
+    return (uint32_t) k;
+}
+
+void kllInit(KllSketch *sketch, uint32_t k)
+{
+    memset(sketch, 0, sizeof *sketch);
+    sketch->k = k < KLL_MIN_K ? KLL_MIN_K : k;
+    sketch->nLevels = 1;
+    sketch->min = INFINITY;
+    sketch->max = -INFINITY;
+    sketch->randomState = KLL_RANDOM_SEED;
+
+    return;
+}
+
+void kllFree(KllSketch *sketch)
+{
+    for (int h = 0; h < KLL_MAX_LEVELS; h++)
+    {
+        free(sketch->levels[h]);
+        sketch->levels[h] = NULL;
+        sketch->levelSizes[h] = 0;
+        sketch->levelMaxSizes[h] = 0;
+    }
+    sketch->nLevels = 0;
+    sketch->n = 0;
+
+    return;
+}
+
+static uint64_t randomBits(KllSketch *sketch)
+{
+    // xorshift64
+    uint64_t x = sketch->randomState;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    sketch->randomState = x;
+
+    return x;
+}
+
+// Capacities shrink by 2/3 per level below the top level
+static uint32_t levelCapacity(const KllSketch *sketch, int h)
+{
+    double capacity = ceil((double)sketch->k * pow(2.0 / 3.0, (double)(sketch->nLevels - 1 - h)));
+    return capacity < 2.0 ? 2 : (uint32_t) capacity;
+}
+
+static int reserveLevel(KllSketch *sketch, int h, uint32_t size)
+{
+    if (size <= sketch->levelMaxSizes[h])
+        return KLL_OK;
+    uint32_t newSize = sketch->levelMaxSizes[h] == 0 ? levelCapacity(sketch, h) : sketch->levelMaxSizes[h];
+    while (newSize < size)
+        newSize *= 2;
+    double *mem = realloc(sketch->levels[h], (size_t)newSize * sizeof(double));
+    if (mem == NULL)
+        return KLL_MEMORY;
+    sketch->levels[h] = mem;
+    sketch->levelMaxSizes[h] = newSize;
+
+    return KLL_OK;
+}
+
+static int compareDoubles(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+
+    return (x > y) - (x < y);
+}
+
+// Halves the lowest level that is at capacity until the sketch fits
+static int compress(KllSketch *sketch)
+{
+    for (;;)
+    {
+        uint64_t size = 0;
+        uint64_t capacity = 0;
+        for (int h = 0; h < sketch->nLevels; h++)
+        {
+            size += sketch->levelSizes[h];
+            capacity += levelCapacity(sketch, h);
+        }
+        if (size < capacity)
+            return KLL_OK;
+
+        int h = 0;
+        while (h < sketch->nLevels && sketch->levelSizes[h] < levelCapacity(sketch, h))
+            h++;
+        if (h == sketch->nLevels)
+            return KLL_OK;
+        if (h + 1 == sketch->nLevels)
+        {
+            if (sketch->nLevels == KLL_MAX_LEVELS)
+                return KLL_MEMORY;
+            sketch->nLevels++;
+        }
+
+        double *items = sketch->levels[h];
+        uint32_t nItems = sketch->levelSizes[h];
+        // An odd item out stays at this level
+        uint32_t first = nItems % 2;
+        qsort(items + first, nItems - first, sizeof(double), compareDoubles);
+        uint32_t nPromoted = (nItems - first) / 2;
+        if (reserveLevel(sketch, h + 1, sketch->levelSizes[h + 1] + nPromoted) != KLL_OK)
+            return KLL_MEMORY;
+        uint32_t offset = (uint32_t)(randomBits(sketch) >> 63);
+        double *above = sketch->levels[h + 1] + sketch->levelSizes[h + 1];
+        for (uint32_t i = 0; i < nPromoted; i++)
+            above[i] = items[first + 2 * i + offset];
+        sketch->levelSizes[h + 1] += nPromoted;
+        sketch->levelSizes[h] = first;
+    }
+}
+
+int kllUpdate(KllSketch *sketch, double value)
+{
+    if (reserveLevel(sketch, 0, sketch->levelSizes[0] + 1) != KLL_OK)
+        return KLL_MEMORY;
+    sketch->levels[0][sketch->levelSizes[0]++] = value;
+    sketch->n++;
+    if (value < sketch->min)
+        sketch->min = value;
+    if (value > sketch->max)
+        sketch->max = value;
+
+    return compress(sketch);
+}
+
+int kllMerge(KllSketch *dest, const KllSketch *src)
+{
+    if (dest->k != src->k)
+        return KLL_MISMATCH;
+    if (src->n == 0)
+        return KLL_OK;
+
+    if (src->nLevels > dest->nLevels)
+        dest->nLevels = src->nLevels;
+    for (int h = 0; h < src->nLevels; h++)
+    {
+        uint32_t n = src->levelSizes[h];
+        if (n == 0)
+            continue;
+        if (reserveLevel(dest, h, dest->levelSizes[h] + n) != KLL_OK)
+            return KLL_MEMORY;
+        memcpy(dest->levels[h] + dest->levelSizes[h], src->levels[h], (size_t)n * sizeof(double));
+        dest->levelSizes[h] += n;
+    }
+    dest->n += src->n;
+    if (src->min < dest->min)
+        dest->min = src->min;
+    if (src->max > dest->max)
+        dest->max = src->max;
+
+    return compress(dest);
+}
+
+int kllWrite(const KllSketch *sketch, FILE *fp)
+{
+    int32_t nLevels = sketch->nLevels;
+    if (fwrite(&sketch->k, sizeof sketch->k, 1, fp) != 1 || fwrite(&nLevels, sizeof nLevels, 1, fp) != 1 || fwrite(&sketch->n, sizeof sketch->n, 1, fp) != 1 || fwrite(&sketch->min, sizeof sketch->min, 1, fp) != 1 || fwrite(&sketch->max, sizeof sketch->max, 1, fp) != 1 || fwrite(&sketch->randomState, sizeof sketch->randomState, 1, fp) != 1)
+        return KLL_IO;
+    if (fwrite(sketch->levelSizes, sizeof sketch->levelSizes[0], (size_t)nLevels, fp) != (size_t)nLevels)
+        return KLL_IO;
+    for (int h = 0; h < nLevels; h++)
+    {
+        if (sketch->levelSizes[h] > 0 && fwrite(sketch->levels[h], sizeof(double), sketch->levelSizes[h], fp) != sketch->levelSizes[h])
+            return KLL_IO;
+    }
+
+    return KLL_OK;
+}
+
+int kllRead(KllSketch *sketch, FILE *fp)
+{
+    uint32_t k = 0;
+    int32_t nLevels = 0;
+    if (fread(&k, sizeof k, 1, fp) != 1 || fread(&nLevels, sizeof nLevels, 1, fp) != 1)
+        return KLL_IO;
+    if (k != sketch->k)
+        return KLL_MISMATCH;
+    if (nLevels < 1 || nLevels > KLL_MAX_LEVELS)
+        return KLL_IO;
+    kllFree(sketch);
+    kllInit(sketch, k);
+    sketch->nLevels = nLevels;
+    if (fread(&sketch->n, sizeof sketch->n, 1, fp) != 1 || fread(&sketch->min, sizeof sketch->min, 1, fp) != 1 || fread(&sketch->max, sizeof sketch->max, 1, fp) != 1 || fread(&sketch->randomState, sizeof sketch->randomState, 1, fp) != 1)
+        return KLL_IO;
+    uint32_t levelSizes[KLL_MAX_LEVELS] = {0};
+    if (fread(levelSizes, sizeof levelSizes[0], (size_t)nLevels, fp) != (size_t)nLevels)
+        return KLL_IO;
+    for (int h = 0; h < nLevels; h++)
+    {
+        if (levelSizes[h] == 0)
+            continue;
+        if (reserveLevel(sketch, h, levelSizes[h]) != KLL_OK)
+            return KLL_MEMORY;
+        if (fread(sketch->levels[h], sizeof(double), levelSizes[h], fp) != levelSizes[h])
+            return KLL_IO;
+        sketch->levelSizes[h] = levelSizes[h];
+    }
+
+    return KLL_OK;
+}
+
+static int compareWeightedItems(const void *a, const void *b)
+{
+    double x = ((const WeightedItem *)a)->value;
+    double y = ((const WeightedItem *)b)->value;
+
+    return (x > y) - (x < y);
+}
+
+// Retained items sorted by value, each weighted by 2^level
+static WeightedItem *sortedItems(const KllSketch *sketch, size_t *nItems)
+{
+    size_t n = 0;
+    for (int h = 0; h < sketch->nLevels; h++)
+        n += sketch->levelSizes[h];
+    *nItems = n;
+    if (n == 0)
+        return NULL;
+
+    WeightedItem *items = malloc(n * sizeof *items);
+    if (items == NULL)
+        return NULL;
+    size_t i = 0;
+    for (int h = 0; h < sketch->nLevels; h++)
+    {
+        for (uint32_t j = 0; j < sketch->levelSizes[h]; j++)
+        {
+            items[i].value = sketch->levels[h][j];
+            items[i].weight = (uint64_t)1 << h;
+            i++;
+        }
+    }
+    qsort(items, n, sizeof *items, compareWeightedItems);
+
+    return items;
+}
+
+// Smallest retained value whose cumulative weight reaches fraction of the total
+static double weightedQuantile(const WeightedItem *items, size_t nItems, double fraction)
+{
+    uint64_t totalWeight = 0;
+    for (size_t i = 0; i < nItems; i++)
+        totalWeight += items[i].weight;
+
+    double target = fraction * (double)totalWeight;
+    uint64_t cumulativeWeight = 0;
+    for (size_t i = 0; i < nItems; i++)
+    {
+        cumulativeWeight += items[i].weight;
+        if ((double)cumulativeWeight >= target)
+            return items[i].value;
+    }
+
+    return items[nItems - 1].value;
+}
+
+int kllQuantile(const KllSketch *sketch, double fraction, double *result)
+{
+    if (sketch->n == 0)
+        return KLL_NO_DATA;
+    if (fraction <= 0.0)
+    {
+        *result = sketch->min;
+        return KLL_OK;
+    }
+    if (fraction >= 1.0)
+    {
+        *result = sketch->max;
+        return KLL_OK;
+    }
+
+    size_t nItems = 0;
+    WeightedItem *items = sortedItems(sketch, &nItems);
+    if (items == NULL)
+        return KLL_MEMORY;
+    *result = weightedQuantile(items, nItems, fraction);
+    free(items);
+
+    return KLL_OK;
+}
+
+int kllMedianAbsoluteDeviation(const KllSketch *sketch, double *result)
+{
+    if (sketch->n == 0)
+        return KLL_NO_DATA;
+
+    size_t nItems = 0;
+    WeightedItem *items = sortedItems(sketch, &nItems);
+    if (items == NULL)
+        return KLL_MEMORY;
+    double median = weightedQuantile(items, nItems, 0.5);
+    // Retained items stand in for the data with their weights
+    for (size_t i = 0; i < nItems; i++)
+        items[i].value = fabs(items[i].value - median);
+    qsort(items, nItems, sizeof *items, compareWeightedItems);
+    *result = SELECTION_MAD_SCALE * weightedQuantile(items, nItems, 0.5);
+    free(items);
+
+    return KLL_OK;
+}
@@ -0,0 +1,78 @@
+/*
+
+    SLIDEM Processor: util/slidembin/kll_sketch.h
+
+    Copyright (C) 2024  Johnathan K Burchill
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+// KLL quantile sketch (Karnin, Lang and Liberty 2016) for bounded-memory
+// approximate order statistics. Sketches of the same k can be merged.
+
+#ifndef _KLL_SKETCH_H
+#define _KLL_SKETCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define KLL_MAX_LEVELS 60
+#define KLL_MIN_K 8
+// Approximate normalized rank error is KLL_RANK_ERROR_CONSTANT / k
+#define KLL_RANK_ERROR_CONSTANT 2.3
+
+typedef struct kllSketch {
+    uint32_t k;
+    int nLevels;
+    double *levels[KLL_MAX_LEVELS];
+    uint32_t levelSizes[KLL_MAX_LEVELS];
+    uint32_t levelMaxSizes[KLL_MAX_LEVELS];
+    uint64_t n;
+    double min;
+    double max;
+    uint64_t randomState;
+} KllSketch;
+
+enum KLL_STATUS {
+    KLL_OK = 0,
+    KLL_MEMORY = -1,
+    KLL_NO_DATA = -2,
+    KLL_MISMATCH = -3,
+    KLL_IO = -4
+};
+
+// k for an approximate normalized rank error
+uint32_t kllParameterForRankError(double rankError);
+
+void kllInit(KllSketch *sketch, uint32_t k);
+void kllFree(KllSketch *sketch);
+
+int kllUpdate(KllSketch *sketch, double value);
+
+// Adds the items of src to dest. Both must have the same k.
+int kllMerge(KllSketch *dest, const KllSketch *src);
+
+// Binary form of a sketch in host byte order, for cached partial aggregates
+int kllWrite(const KllSketch *sketch, FILE *fp);
+// sketch must be freed or newly initialized; its k must match the stored k
+int kllRead(KllSketch *sketch, FILE *fp);
+
+// Approximate quantile for fraction in [0, 1]. The extremes are exact.
+int kllQuantile(const KllSketch *sketch, double fraction, double *result);
+
+// Approximate median absolute deviation, scaled like gsl_stats_mad
+int kllMedianAbsoluteDeviation(const KllSketch *sketch, double *result);
+
+#endif // _KLL_SKETCH_H
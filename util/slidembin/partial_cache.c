@@ -0,0 +1,200 @@
+/*
+
+    SLIDEM Processor: util/slidembin/partial_cache.c
+
+    Copyright (C) 2024  Johnathan K Burchill
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "partial_cache.h"
+#include "kll_sketch.h"
+#include "fnv_hash.h"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include <libgen.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+typedef struct partialCacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t keyLength;
+    uint64_t nBins;
+    int64_t nValsRead;
+    int64_t nValsWithinBinLimits;
+    int64_t nValsBinned;
+    uint32_t hasSketches;
+    uint32_t reserved;
+} PartialCacheHeader;
+
+// Start and stop times in the product file name, which have a resolution of 1 s
+static bool fileNameTimeRange(const char *name, double *fileFirstTime, double *fileLastTime)
+{
+    long y1, m1, d1, h1, min1, s1;
+    long y2, m2, d2, h2, min2, s2;
+    int nAssigned = sscanf(name, "SW_%*[^_]_%*[^_]_%*[^_]_%4ld%2ld%2ldT%2ld%2ld%2ld_%4ld%2ld%2ldT%2ld%2ld%2ld", &y1, &m1, &d1, &h1, &min1, &s1, &y2, &m2, &d2, &h2, &min2, &s2);
+    if (nAssigned != 12)
+        return false;
+    *fileFirstTime = computeEPOCH(y1, m1, d1, h1, min1, s1, 0);
+    *fileLastTime = computeEPOCH(y2, m2, d2, h2, min2, s2, 0);
+
+    return *fileFirstTime != ILLEGAL_EPOCH_VALUE && *fileLastTime != ILLEGAL_EPOCH_VALUE;
+}
+
+int partialCacheKey(const ProcessingParameters *params, const char *inputFile, const char *parameter, char *key, size_t length)
+{
+    if (params == NULL || inputFile == NULL || parameter == NULL || key == NULL)
+        return PARTIAL_CACHE_ARGUMENTS;
+
+    struct stat info;
+    if (stat(inputFile, &info) != 0)
+        return PARTIAL_CACHE_UNAVAILABLE;
+
+    char path[FILENAME_MAX];
+    snprintf(path, FILENAME_MAX, "%s", inputFile);
+    // Only records within the requested time range are binned. The window is part of the key
+    // unless it covers the whole file, so that extending the range keeps the partials of earlier files.
+    char window[80] = "all";
+    double fileFirstTime = 0.0;
+    double fileLastTime = 0.0;
+    if (!fileNameTimeRange(basename(path), &fileFirstTime, &fileLastTime) || params->firstTime > fileFirstTime || params->lastTime < fileLastTime + 1000.0)
+        snprintf(window, sizeof window, "%.17g %.17g", params->firstTime, params->lastTime);
+
+    snprintf(path, FILENAME_MAX, "%s", inputFile);
+    const BinningState *spec = &params->binningState;
+    int n = snprintf(key, length, "%s\nfile=%s size=%lld mtime=%lld window=%s\nparameter=%s\nbins=%d %.17g %.17g %.17g %.17g %.17g %.17g flip=%d\nflagIgnoreMask=%u\nsketchK=%u",
+        SOFTWARE_VERSION_STRING, basename(path), (long long)info.st_size, (long long)info.st_mtime, window, parameter,
+        (int)spec->equalArea, spec->qdlatmin, spec->qdlatmax, spec->deltaqdlat, spec->mltmin, spec->mltmax, spec->deltamlt, (int)spec->flipParamWhenDescending,
+        params->flagIgnoreMask, spec->useSketches ? kllParameterForRankError(spec->sketchRankError) : 0);
+    if (n < 0 || (size_t)n >= length)
+        return PARTIAL_CACHE_ARGUMENTS;
+
+    return PARTIAL_CACHE_OK;
+}
+
+void partialCacheFilename(const char *cacheDirectory, const char *inputFile, const char *parameter, const char *key, char *filename, size_t length)
+{
+    char path[FILENAME_MAX];
+    char directoryPath[FILENAME_MAX];
+    snprintf(path, FILENAME_MAX, "%s", inputFile);
+    snprintf(directoryPath, FILENAME_MAX, "%s", inputFile);
+    const char *directory = cacheDirectory != NULL ? cacheDirectory : dirname(directoryPath);
+    snprintf(filename, length, "%s/%s_%s_%016llx%s", directory, basename(path), parameter, (unsigned long long)fnv1aHash(key), PARTIAL_CACHE_EXTENSION);
+
+    return;
+}
+
+int readPartialAggregate(const char *filename, const char *key, BinningState *binningState)
+{
+    if (filename == NULL || key == NULL || binningState == NULL)
+        return PARTIAL_CACHE_ARGUMENTS;
+
+    FILE *fp = fopen(filename, "r");
+    if (fp == NULL)
+        return PARTIAL_CACHE_UNAVAILABLE;
+
+    int status = PARTIAL_CACHE_OK;
+    char storedKey[PARTIAL_CACHE_KEY_LENGTH] = {0};
+    PartialCacheHeader header;
+    size_t nBins = binningState->nBins;
+    if (fread(&header, sizeof header, 1, fp) != 1 || memcmp(header.magic, PARTIAL_CACHE_MAGIC, 8) != 0 || header.version != PARTIAL_CACHE_VERSION || header.keyLength >= PARTIAL_CACHE_KEY_LENGTH)
+    {
+        status = PARTIAL_CACHE_READ;
+        goto cleanup;
+    }
+    if (fread(storedKey, 1, header.keyLength, fp) != header.keyLength || strcmp(storedKey, key) != 0 || header.nBins != nBins || (header.hasSketches != 0) != (binningState->binSketches != NULL))
+    {
+        status = PARTIAL_CACHE_MISMATCH;
+        goto cleanup;
+    }
+    if (fread(binningState->binSizes, sizeof *binningState->binSizes, nBins, fp) != nBins
+        || fread(binningState->binValidSizes, sizeof *binningState->binValidSizes, nBins, fp) != nBins
+        || fread(binningState->binMeans, sizeof *binningState->binMeans, nBins, fp) != nBins
+        || fread(binningState->binM2s, sizeof *binningState->binM2s, nBins, fp) != nBins
+        || fread(binningState->binMins, sizeof *binningState->binMins, nBins, fp) != nBins
+        || fread(binningState->binMaxs, sizeof *binningState->binMaxs, nBins, fp) != nBins)
+    {
+        status = PARTIAL_CACHE_READ;
+        goto cleanup;
+    }
+    for (size_t i = 0; i < nBins && header.hasSketches; i++)
+    {
+        if (kllRead(&binningState->binSketches[i], fp) != KLL_OK)
+        {
+            status = PARTIAL_CACHE_READ;
+            goto cleanup;
+        }
+    }
+    binningState->nValsRead = header.nValsRead;
+    binningState->nValsWithinBinLimits = header.nValsWithinBinLimits;
+    binningState->nValsBinned = header.nValsBinned;
+
+cleanup:
+    fclose(fp);
+    if (status != PARTIAL_CACHE_OK)
+        resetBinningState(binningState);
+
+    return status;
+}
+
+int writePartialAggregate(const char *filename, const char *key, const BinningState *binningState)
+{
+    if (filename == NULL || key == NULL || binningState == NULL || strlen(key) >= PARTIAL_CACHE_KEY_LENGTH)
+        return PARTIAL_CACHE_ARGUMENTS;
+
+    char tmpFilename[FILENAME_MAX];
+    snprintf(tmpFilename, FILENAME_MAX, "%s.tmp%d", filename, (int)getpid());
+    FILE *fp = fopen(tmpFilename, "w");
+    if (fp == NULL)
+        return PARTIAL_CACHE_WRITE;
+
+    int status = PARTIAL_CACHE_OK;
+    size_t nBins = binningState->nBins;
+    PartialCacheHeader header = {0};
+    memcpy(header.magic, PARTIAL_CACHE_MAGIC, 8);
+    header.version = PARTIAL_CACHE_VERSION;
+    header.keyLength = (uint32_t) strlen(key);
+    header.nBins = nBins;
+    header.nValsRead = binningState->nValsRead;
+    header.nValsWithinBinLimits = binningState->nValsWithinBinLimits;
+    header.nValsBinned = binningState->nValsBinned;
+    header.hasSketches = binningState->binSketches != NULL;
+    if (fwrite(&header, sizeof header, 1, fp) != 1 || fwrite(key, 1, header.keyLength, fp) != header.keyLength
+        || fwrite(binningState->binSizes, sizeof *binningState->binSizes, nBins, fp) != nBins
+        || fwrite(binningState->binValidSizes, sizeof *binningState->binValidSizes, nBins, fp) != nBins
+        || fwrite(binningState->binMeans, sizeof *binningState->binMeans, nBins, fp) != nBins
+        || fwrite(binningState->binM2s, sizeof *binningState->binM2s, nBins, fp) != nBins
+        || fwrite(binningState->binMins, sizeof *binningState->binMins, nBins, fp) != nBins
+        || fwrite(binningState->binMaxs, sizeof *binningState->binMaxs, nBins, fp) != nBins)
+        status = PARTIAL_CACHE_WRITE;
+    for (size_t i = 0; i < nBins && header.hasSketches && status == PARTIAL_CACHE_OK; i++)
+    {
+        if (kllWrite(&binningState->binSketches[i], fp) != KLL_OK)
+            status = PARTIAL_CACHE_WRITE;
+    }
+    if (fclose(fp) != 0)
+        status = PARTIAL_CACHE_WRITE;
+
+    // Readers never see a partial file
+    if (status == PARTIAL_CACHE_OK && rename(tmpFilename, filename) != 0)
+        status = PARTIAL_CACHE_WRITE;
+    if (status != PARTIAL_CACHE_OK)
+        unlink(tmpFilename);
+
+    return status;
+}
@@ -0,0 +1,58 @@
+/*
+
+    SLIDEM Processor: util/slidembin/partial_cache.h
+
+    Copyright (C) 2024  Johnathan K Burchill
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _PARTIAL_CACHE_H
+#define _PARTIAL_CACHE_H
+
+#include "slidembin.h"
+#include "statistics.h"
+
+#include <stddef.h>
+
+// Each input file's bin accumulators for one parameter can be cached so that reruns
+// over a growing set of files only decode the new or changed files. Partials hold the
+// counts, moments and extremes and any quantile sketches, not the binned values,
+// so they are used only when no exact order statistic is requested.
+
+#define PARTIAL_CACHE_MAGIC "SLDMPAR\0"
+#define PARTIAL_CACHE_VERSION 1
+#define PARTIAL_CACHE_EXTENSION ".sbp"
+#define PARTIAL_CACHE_KEY_LENGTH 1024
+
+// Identifies the file version (name, size and modification time), parameter, bin specification and flag mask
+int partialCacheKey(const ProcessingParameters *params, const char *inputFile, const char *parameter, char *key, size_t length);
+
+// <cacheDirectory or input file directory>/<input file name>_<parameter>_<key hash>.sbp
+void partialCacheFilename(const char *cacheDirectory, const char *inputFile, const char *parameter, const char *key, char *filename, size_t length);
+
+// binningState must have been initialized with the specification the partial was made with
+int readPartialAggregate(const char *filename, const char *key, BinningState *binningState);
+int writePartialAggregate(const char *filename, const char *key, const BinningState *binningState);
+
+enum PARTIAL_CACHE_STATUS {
+    PARTIAL_CACHE_OK = 0,
+    PARTIAL_CACHE_ARGUMENTS = -1,
+    PARTIAL_CACHE_UNAVAILABLE = -2,
+    PARTIAL_CACHE_MISMATCH = -3,
+    PARTIAL_CACHE_READ = -4,
+    PARTIAL_CACHE_WRITE = -5
+};
+
+#endif // _PARTIAL_CACHE_H
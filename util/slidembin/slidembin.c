@@ -23,6 +23,8 @@
 
 #include "slidembin.h"
 #include "statistics.h"
+#include "pass_index.h"
+#include "partial_cache.h"
 
 #include <stdio.h>
 #include <stdbool.h>
@@ -35,6 +37,7 @@
 #include <math.h>
 #include <libgen.h>
 #include <errno.h>
+#include <pthread.h>
 
 #include <cdf.h>
 
@@ -43,6 +46,9 @@
 
 #define N_QUALITY_FLAG_BITS 18
 
+// The CDF library is not documented as reentrant, so CDF library calls are serialized. Sidecars are mapped without the lock.
+static pthread_mutex_t cdfLock = PTHREAD_MUTEX_INITIALIZER;
+
 static char* qualityFlagInfo[N_QUALITY_FLAG_BITS] = {
     "Faceplate current unavailable",
     "IDM product calculation did not converge",
@@ -76,6 +82,8 @@ int main(int argc, char *argv[])
     params.showFileProgress = true;
     params.cdfDirectory = ".";
     params.inputFile = NULL;
+    params.useColumnSidecars = true;
+    params.columnFile.fd = -1;
 
     // Defaults to equal-area binning
     params.binningState.equalArea = true;
@@ -86,88 +94,171 @@ int main(int argc, char *argv[])
     params.binningState.mltmax = 24.0;
     params.binningState.deltamlt = 8.0;
     params.binningState.flipParamWhenDescending = false;
+    params.binningState.useSketches = false;
+    params.binningState.sketchRankError = 0.01;
 
     // check options and arguments
     parseCommandLine(&params, argc, argv);
 
-    status = initBinningState(&params.binningState);
-    if (status != BIN_OK)
-        exit(EXIT_FAILURE);
+    // Only order statistics need every value
+    params.binningState.storeValues = false;
+    for (int s = 0; s < params.nStatistics; s++)
+    {
+        if (statisticNeedsValues(params.statistics[s]) && !params.binningState.useSketches)
+            params.binningState.storeValues = true;
+    }
 
-    // Turn off GSL failsafe error handler. Check the GSL return codes.
-    gsl_set_error_handler_off();
+    if (params.usePartialCache && params.binningState.storeValues)
+    {
+        fprintf(stderr, "Partial aggregates are not cached for exact order statistics. Use --approximate-quantiles to cache them.\n");
+        params.usePartialCache = false;
+    }
+    if (params.usePartialCache && params.nAxes > 0)
+    {
+        fprintf(stderr, "Partial aggregates are not cached when binning with extra axes.\n");
+        params.usePartialCache = false;
+    }
 
-    long processedFiles = 0;
-    float percentDone = 0.0;
+    // Each parameter of each worker starts from the same bin specification
+    BinningState binningSpecification = params.binningState;
 
-    void *mem = NULL;
+    for (int p = 0; p < params.nParameters; p++)
+    {
+        status = initBinningCube(&params.cubes[p], &binningSpecification, params.axes, params.nAxes);
+        if (status != BIN_OK)
+            exit(EXIT_FAILURE);
+    }
+
+    // Turn off GSL failsafe error handler. Check the GSL return codes.
+    gsl_set_error_handler_off();
 
     // Analyze files in requested directory
     char *dir[2] = {params.cdfDirectory, NULL};
     long nFiles = 0;
-    char *filename = NULL;
-    char fullpath[FILENAME_MAX + 1] = {0};
-    char *cwdresult = getcwd(fullpath, FILENAME_MAX);
-    size_t pathlen = strlen(fullpath);
-    if (cwdresult == NULL)
-    {
-        fprintf(stderr, "Unable to get current directory.\n");
-        exit(EXIT_FAILURE);
-    }
+    long maxFiles = 0;
+    char **files = NULL;
 
-    // Count files
+    // Collect matching files. fts_path is only valid until the next fts_read.
     FTS *f = fts_open(dir, FTS_PHYSICAL | FTS_NOSTAT, NULL);
     FTSENT *e = fts_read(f);
     while (e != NULL)
     {
         if (fileMatch(e, &params) == true)
-            nFiles++;            
+        {
+            if (nFiles == maxFiles)
+            {
+                maxFiles = maxFiles == 0 ? 1024 : 2 * maxFiles;
+                char **mem = realloc(files, (size_t)maxFiles * sizeof *files);
+                if (mem == NULL)
+                {
+                    fprintf(stderr, "Unable to allocate memory for file list.\n");
+                    exit(EXIT_FAILURE);
+                }
+                files = mem;
+            }
+            files[nFiles] = strdup(e->fts_path);
+            if (files[nFiles] == NULL)
+            {
+                fprintf(stderr, "Unable to allocate memory for file list.\n");
+                exit(EXIT_FAILURE);
+            }
+            nFiles++;
+        }
         e = fts_read(f);
     }
     fts_close(f);
 
-    int percentCheck = (int) ceil(0.01 * (float)nFiles);
-
-    // Reopen directory listing to do the analysis
-    f = fts_open(dir, FTS_PHYSICAL | FTS_NOSTAT, NULL);
-    e = fts_read(f);
-    while (e != NULL)
+    FileProgress progress = {0};
+    pthread_mutex_init(&progress.lock, NULL);
+    progress.programName = argv[0];
+    progress.show = params.showFileProgress;
+    progress.nFiles = nFiles;
+    progress.percentCheck = (long) ceil(0.01 * (float)nFiles);
+
+    int nWorkers = params.nThreads > 0 ? params.nThreads : (int) sysconf(_SC_NPROCESSORS_ONLN);
+    if (nWorkers > SLIDEMBIN_MAX_THREADS)
+        nWorkers = SLIDEMBIN_MAX_THREADS;
+    if (nWorkers > nFiles)
+        nWorkers = (int) nFiles;
+    if (nWorkers < 1)
+        nWorkers = 1;
+
+    static BinningWorker workers[SLIDEMBIN_MAX_THREADS];
+    pthread_t threadIds[SLIDEMBIN_MAX_THREADS];
+    bool threadStarted[SLIDEMBIN_MAX_THREADS] = {0};
+    for (int w = 0; w < nWorkers; w++)
     {
-        if (fileMatch(e, &params) == true)
+        workers[w].workerNumber = w;
+        workers[w].params = params;
+        workers[w].files = files;
+        workers[w].firstFile = nFiles * w / nWorkers;
+        workers[w].nFiles = nFiles * (w + 1) / nWorkers - workers[w].firstFile;
+        workers[w].progress = &progress;
+        workers[w].nCachedFiles = 0;
+        for (int p = 0; p < params.nParameters && w > 0; p++)
         {
-            if (params.verbose)
-                fprintf(stderr, "\nAnalyzing %s\n", e->fts_name);
+            if (initBinningCube(&workers[w].params.cubes[p], &binningSpecification, params.axes, params.nAxes) != BIN_OK)
+                exit(EXIT_FAILURE);
+        }
+    }
+    for (int w = 1; w < nWorkers; w++)
+    {
+        threadStarted[w] = pthread_create(&threadIds[w], NULL, &binningThread, (void*) &workers[w]) == 0;
+    }
+    binningThread((void*) &workers[0]);
+    for (int w = 1; w < nWorkers; w++)
+    {
+        // Files of a worker that could not be started are binned by the calling thread
+        if (threadStarted[w])
+            pthread_join(threadIds[w], NULL);
+        else
+            binningThread((void*) &workers[w]);
+    }
 
-            // snprintf(fullpath + pathlen, FILENAME_MAX - pathlen, "/%s", e->fts_path);
-            params.inputFile = e->fts_path;
-            processFile(&params);
-            processedFiles++;
+    if (params.usePartialCache && params.showFileProgress)
+    {
+        long nCachedFiles = 0;
+        for (int w = 0; w < nWorkers; w++)
+            nCachedFiles += workers[w].nCachedFiles;
+        fprintf(stderr, "\r\n%ld of %ld files merged from cached partial aggregates", nCachedFiles, nFiles);
+    }
 
-            if (params.showFileProgress)
+    // Merge in file order
+    for (int p = 0; p < params.nParameters; p++)
+    {
+        params.cubes[p] = workers[0].params.cubes[p];
+        for (int w = 1; w < nWorkers; w++)
+        {
+            if (mergeBinningCube(&params.cubes[p], &workers[w].params.cubes[p]) != BIN_OK)
             {
-                percentDone = (float)processedFiles / (float)nFiles * 100.0;
-                if (processedFiles % percentCheck == 0)
-                    fprintf(stderr, "\r%s: %ld of %ld files processed (%3.0f%%)", argv[0], processedFiles, nFiles, percentDone);
+                fprintf(stderr, "Unable to merge bin storage.\n");
+                exit(EXIT_FAILURE);
             }
+            freeBinningCube(&workers[w].params.cubes[p]);
         }
-
-        e = fts_read(f);
     }
-    fts_close(f);
+    pthread_mutex_destroy(&progress.lock);
+
+    for (long i = 0; i < nFiles; i++)
+        free(files[i]);
+    free(files);
 
     if (params.showFileProgress)
         fprintf(stderr, "\r\n");
 
-    printBinningResults(&params.binningState, params.parameter, params.statistic);
-
-    freeBinStorage(&params.binningState);
+    for (int p = 0; p < params.nParameters; p++)
+    {
+        printBinningCube(&params.cubes[p], params.parameters[p], params.statistics, params.nStatistics);
+        freeBinningCube(&params.cubes[p]);
+    }
 
     return EXIT_SUCCESS;
 }
 
 void usage(char *name)
 {
-    fprintf(stdout, "usage: %s <satLetter> <parameter> <statistic> <startDate> <stopDate>\n", name);
+    fprintf(stdout, "usage: %s <satLetter> <parameter>[,<parameter>...] <statistic>[,<statistic>...] <startDate> <stopDate>\n", name);
+    fprintf(stdout, "%35s   %s\n", "", "each parameter is binned once for all statistics and printed as its own table");
     fprintf(stdout, "%35s - %s\n", "--help", "print this message");
     fprintf(stdout, "%35s - %s\n", "--about", "print program and license info");
     fprintf(stdout, "%35s - %s\n", "--verbose", "extra processing information");
@@ -182,6 +273,11 @@ void usage(char *name)
     fprintf(stdout, "%35s - %s\n", "--deltamlt=<value>", "magnetic local time bin width (at the polar cap if for equal-area binning)");
     fprintf(stdout, "%35s - %s\n", "--flip-when-descending", "change sign of value when on descending part of orbit");
     fprintf(stdout, "%35s - %s\n", "--cdf-input-directory=<dir>", "path to directory containing binary input files");
+    fprintf(stdout, "%35s - %s\n", "--approximate-quantiles[=<e>]", "Median, MedianAbsoluteDeviation and percentiles from bounded-memory KLL sketches with approximate rank error e (default 0.01)");
+    fprintf(stdout, "%35s - %s\n", "--partial-cache[=<dir>]", "cache each file's bin accumulators (next to the file or in dir) and reuse them for unchanged files. Not used for exact order statistics");
+    fprintf(stdout, "%35s - %s\n", "--axis=<name>:<min>:<max>:<width>", "also bin by Year, Month, DayOfYear, UTHour or a product variable. Repeat for up to 4 axes; only occupied cells are stored and printed");
+    fprintf(stdout, "%35s - %s\n", "--threads=<n>", "number of threads loading and binning files. Default: one per processor");
+    fprintf(stdout, "%35s - %s\n", "--ignore-column-sidecars", "read the CDF files even where .col sidecars are present");
     fprintf(stdout, "%35s - %s\n", "--flag-ignore-mask=<mask>", "ignores the given flag bits for determining data quality, e.g. --flag-ignore-mask=0b00000110 or --flag-ignore-mask=16");
     fprintf(stdout, "%35s - %s\n", "--flag-mask-type={AND|OR}", "interpret --flag-mask values as bitwise AND or as bitwise OR");
     fprintf(stdout, "%35s - %s\n", "--flag-raised-is-good", "flag bit 0 signifies an issue. Default: bit equals 1 signifies an issue");
@@ -325,6 +421,71 @@ void parseCommandLine(ProcessingParameters *params, int argc, char *argv[])
                 exit(EXIT_FAILURE);
             }
         }
+        else if (strcmp(argv[i], "--approximate-quantiles") == 0)
+        {
+            params->nOptions++;
+            params->binningState.useSketches = true;
+        }
+        else if (strncmp(argv[i], "--approximate-quantiles=", 24) == 0)
+        {
+            params->nOptions++;
+            params->binningState.useSketches = true;
+            if (strlen(argv[i]) > 24 && atof(argv[i] + 24) > 0.0 && atof(argv[i] + 24) < 1.0)
+                params->binningState.sketchRankError = atof(argv[i] + 24);
+            else
+            {
+                fprintf(stderr, "Could not parse %s\n", argv[i]);
+                exit(EXIT_FAILURE);
+            }
+        }
+        else if (strcmp(argv[i], "--partial-cache") == 0)
+        {
+            params->nOptions++;
+            params->usePartialCache = true;
+        }
+        else if (strncmp(argv[i], "--partial-cache=", 16) == 0)
+        {
+            params->nOptions++;
+            params->usePartialCache = true;
+            if (strlen(argv[i]) > 16)
+                params->partialCacheDirectory = argv[i] + 16;
+            else
+            {
+                fprintf(stderr, "Could not parse %s\n", argv[i]);
+                exit(EXIT_FAILURE);
+            }
+        }
+        else if (strncmp(argv[i], "--axis=", 7) == 0)
+        {
+            params->nOptions++;
+            if (params->nAxes == BINNING_CUBE_MAX_AXES)
+            {
+                fprintf(stderr, "At most %d extra bin axes are supported.\n", BINNING_CUBE_MAX_AXES);
+                exit(EXIT_FAILURE);
+            }
+            if (parseBinAxis(argv[i] + 7, &params->axes[params->nAxes]) != BIN_OK)
+            {
+                fprintf(stderr, "Could not parse %s\n", argv[i]);
+                exit(EXIT_FAILURE);
+            }
+            params->nAxes++;
+        }
+        else if (strncmp(argv[i], "--threads=", 10) == 0)
+        {
+            params->nOptions++;
+            if (strlen(argv[i]) > 10 && atoi(argv[i] + 10) > 0)
+                params->nThreads = atoi(argv[i] + 10);
+            else
+            {
+                fprintf(stderr, "Could not parse %s\n", argv[i]);
+                exit(EXIT_FAILURE);
+            }
+        }
+        else if (strcmp(argv[i], "--ignore-column-sidecars") == 0)
+        {
+            params->nOptions++;
+            params->useColumnSidecars = false;
+        }
         // From cdfbin.c in TII-Ion-Drift-Processor on github
         else if (strncmp(argv[i], "--flag-ignore-mask=", 19) == 0)
         {
@@ -393,18 +554,46 @@ void parseCommandLine(ProcessingParameters *params, int argc, char *argv[])
 
     // Process files in directory based on time range
     params->satelliteLetter = argv[1][0];
-    params->parameter = argv[2];
-    params->statistic = argv[3];
     params->firstTimeString = argv[4];
     params->lastTimeString = argv[5];
     params->firstTime = parseEPOCH4(params->firstTimeString);
     params->lastTime = parseEPOCH4(params->lastTimeString);
 
-    if (!validStatistic(params->statistic))
+    char *list = argv[2];
+    char *item = NULL;
+    while ((item = strsep(&list, ",")) != NULL)
+    {
+        if (*item == '\0')
+            continue;
+        if (params->nParameters == SLIDEMBIN_MAX_PARAMETERS)
+        {
+            fprintf(stderr, "At most %d parameters can be binned at once.\n", SLIDEMBIN_MAX_PARAMETERS);
+            exit(EXIT_FAILURE);
+        }
+        params->parameters[params->nParameters++] = item;
+    }
+    list = argv[3];
+    while ((item = strsep(&list, ",")) != NULL)
     {
-        fprintf(stderr, "Invalid statistic '%s'\n", params->statistic);
-        fprintf(stderr, "Must be one of:\n");
-        printAvailableStatistics(stderr);
+        if (*item == '\0')
+            continue;
+        if (params->nStatistics == SLIDEMBIN_MAX_STATISTICS)
+        {
+            fprintf(stderr, "At most %d statistics can be calculated at once.\n", SLIDEMBIN_MAX_STATISTICS);
+            exit(EXIT_FAILURE);
+        }
+        if (!validStatistic(item))
+        {
+            fprintf(stderr, "Invalid statistic '%s'\n", item);
+            fprintf(stderr, "Must be one of:\n");
+            printAvailableStatistics(stderr);
+            exit(EXIT_FAILURE);
+        }
+        params->statistics[params->nStatistics++] = item;
+    }
+    if (params->nParameters == 0 || params->nStatistics == 0)
+    {
+        usage(argv[0]);
         exit(EXIT_FAILURE);
     }
 
@@ -496,13 +685,50 @@ bool fileMatch(FTSENT *e, ProcessingParameters *params)
     double firstTime = params->firstTime;
     double lastTime = params->lastTime;
 
-    bool match = ((strcmp(".cdf", e->fts_name + e->fts_namelen - 4) == 0) && ((firstTime >= fileFirstTime && firstTime <= fileLastTime) || (lastTime >= fileFirstTime && lastTime <= fileLastTime) || (firstTime < fileFirstTime && lastTime > fileLastTime)));
+    // A CDF with a current column sidecar is analyzed from the sidecar. A sidecar older
+    // than its CDF is from an earlier version of the product, and the CDF is analyzed instead.
+    size_t extensionLength = strlen(COLUMN_SIDECAR_EXTENSION);
+    bool isCdf = strcmp(".cdf", e->fts_name + e->fts_namelen - 4) == 0;
+    bool isSidecar = strcmp(COLUMN_SIDECAR_EXTENSION, e->fts_name + e->fts_namelen - extensionLength) == 0;
+    if (params->useColumnSidecars && isCdf)
+    {
+        char sidecarFilename[FILENAME_MAX];
+        columnSidecarFilename(e->fts_accpath, sidecarFilename, FILENAME_MAX);
+        if (columnSidecarCurrent(e->fts_accpath, sidecarFilename))
+            isCdf = false;
+    }
+    else if (params->useColumnSidecars && isSidecar)
+    {
+        char cdfFilename[FILENAME_MAX];
+        snprintf(cdfFilename, FILENAME_MAX, "%.*s.cdf", (int)(strlen(e->fts_accpath) - extensionLength), e->fts_accpath);
+        if (!columnSidecarCurrent(cdfFilename, e->fts_accpath))
+            isSidecar = false;
+    }
+    else if (!params->useColumnSidecars)
+        isSidecar = false;
+
+    bool match = ((isCdf || isSidecar) && ((firstTime >= fileFirstTime && firstTime <= fileLastTime) || (lastTime >= fileFirstTime && lastTime <= fileLastTime) || (firstTime < fileFirstTime && lastTime > fileLastTime)));
 
     free(inputstring);
 
     return match;
 }
 
+// Cell of the extra bin axes for record i. Returns false if the record is outside an axis.
+static bool recordCell(ProcessingParameters *params, long i, TimeAxisCache *timeCache, int *cellIndices)
+{
+    double axisValues[BINNING_CUBE_MAX_AXES] = {0};
+    for (int a = 0; a < params->nAxes; a++)
+    {
+        if (params->axes[a].source == BIN_AXIS_VARIABLE)
+            axisValues[a] = params->axisValues[a][i];
+        else
+            axisValues[a] = binAxisTimeValue(params->axes[a].source, params->time[i], timeCache);
+    }
+
+    return cubeCellIndices(&params->cubes[0], axisValues, cellIndices);
+}
+
 int processFile(ProcessingParameters *params)
 {
     if (params == NULL || params->inputFile == NULL)
@@ -511,128 +737,488 @@ int processFile(ProcessingParameters *params)
     int status = loadSlidemData(params);
 
     if (status != CDF_OK)
+    {
+        freeSlidemData(params);
         return status;
+    }
+
+    long n = params->nRecords;
+    if (n <= 0)
+    {
+        freeSlidemData(params);
+        return STATISTICS_OK;
+    }
 
-    double mlt = 0.0;
-    double qdlat = 0.0;
-    double lastQdLat = 0.0;
-    double value = 0.0;
-    uint32_t flag = 0;
     uint32_t flagMask = ~params->flagIgnoreMask;
+    BinningState *binningState = NULL;
+    int cellIndices[BINNING_CUBE_MAX_AXES] = {0};
+    int nextCellIndices[BINNING_CUBE_MAX_AXES] = {0};
+    size_t cellBytes = (size_t)params->nAxes * sizeof *cellIndices;
+    TimeAxisCache timeCache = {.day = NAN};
+
+    // Bin indices are calculated once per file for all parameters, then each
+    // parameter's values are accumulated over runs of records sharing a cell of the extra axes
+    long *indices = malloc((size_t)n * sizeof *indices);
+    bool *descending = malloc((size_t)n * sizeof *descending);
+    double *values = malloc((size_t)n * sizeof *values);
+    bool *includeValues = malloc((size_t)n * sizeof *includeValues);
+    if (indices == NULL || descending == NULL || values == NULL || includeValues == NULL)
+    {
+        status = STATISTICS_MEM;
+        goto cleanup;
+    }
+
+    for (long i = 0; i < n; i++)
+    {
+        // Use the exported pass index for direction when available
+        if (params->passInfo != NULL)
+            descending[i] = (params->passInfo[i] & PASS_INDEX_NORTHWARD) == 0;
+        else
+            descending[i] = i > 0 && params->qdlat[i] - params->qdlat[i-1] < 0.0;
+    }
+
+    long runEnd = 0;
+    bool inside = recordCell(params, 0, &timeCache, cellIndices);
+    for (long runStart = 0; runStart < n; runStart = runEnd)
+    {
+        bool nextInside = false;
+        for (runEnd = runStart + 1; runEnd < n; runEnd++)
+        {
+            nextInside = recordCell(params, runEnd, &timeCache, nextCellIndices);
+            if (nextInside != inside || (inside && memcmp(nextCellIndices, cellIndices, cellBytes) != 0))
+                break;
+        }
+        size_t nRun = (size_t)(runEnd - runStart);
+
+        for (int p = 0; p < params->nParameters && inside; p++)
+        {
+            binningState = cubeCellState(&params->cubes[p], cellIndices);
+            if (binningState == NULL)
+            {
+                status = STATISTICS_MEM;
+                goto cleanup;
+            }
+            // Every cell has the same bin specification
+            if (p == 0)
+                binIndices(binningState, params->qdlat + runStart, params->mlt + runStart, nRun, indices + runStart);
 
-    bool includeValue = false;
-    float qdDirection = 0.0;
+            for (long i = runStart; i < runEnd; i++)
+            {
+                values[i] = params->values[p][i];
+                if (binningState->flipParamWhenDescending && descending[i])
+                    values[i] = -values[i];
+                // Filter based on flag ignore mask
+                // Ignore the masked flag bits. All other bits must be 0.
+                includeValues[i] = params->flags[p] == NULL || (params->flags[p][i] & flagMask) == 0;
+            }
+            binningState->nValsRead += (long)nRun;
+            binValues(binningState, indices + runStart, values + runStart, includeValues + runStart, nRun);
+        }
 
-    for (int i = 0; i < params->nRecords; i++)
+        inside = nextInside;
+        memcpy(cellIndices, nextCellIndices, cellBytes);
+    }
+    status = STATISTICS_OK;
+
+cleanup:
+    free(indices);
+    free(descending);
+    free(values);
+    free(includeValues);
+    freeSlidemData(params);
+
+    return status;
+}
+
+void *binningThread(void *arg)
+{
+    BinningWorker *worker = (BinningWorker *) arg;
+    ProcessingParameters *params = &worker->params;
+
+    bool usePartials = params->usePartialCache;
+    for (int p = 0; p < params->nParameters && usePartials; p++)
     {
-        qdlat = params->qdlat[i];
-        if (i > 0)
-            qdDirection = qdlat - lastQdLat;
+        worker->partialStates[p] = params->binningState;
+        if (initBinningState(&worker->partialStates[p]) != BIN_OK)
+            exit(EXIT_FAILURE);
+    }
+
+    for (long i = worker->firstFile; i < worker->firstFile + worker->nFiles; i++)
+    {
+        if (params->verbose)
+            fprintf(stderr, "\nAnalyzing %s\n", worker->files[i]);
+
+        params->inputFile = worker->files[i];
+        if (usePartials)
+            binFileWithPartials(worker);
+        else
+            processFile(params);
+        reportFileProgress(worker->progress);
+    }
+
+    for (int p = 0; p < params->nParameters && usePartials; p++)
+        freeBinStorage(&worker->partialStates[p]);
+
+    return NULL;
+}
+
+// Merges the cached partial aggregates of the input file, binning and caching
+// the file first if any partial is missing or stale
+int binFileWithPartials(BinningWorker *worker)
+{
+    ProcessingParameters *params = &worker->params;
+    char keys[SLIDEMBIN_MAX_PARAMETERS][PARTIAL_CACHE_KEY_LENGTH];
+    char filenames[SLIDEMBIN_MAX_PARAMETERS][FILENAME_MAX];
+    // Partials are cached only without extra axes, where each cube has a single cell
+    BinningState *cells[SLIDEMBIN_MAX_PARAMETERS];
+    int cellIndices[1] = {0};
+
+    bool cached = true;
+    for (int p = 0; p < params->nParameters; p++)
+    {
+        cells[p] = cubeCellState(&params->cubes[p], cellIndices);
+        if (cells[p] == NULL)
+            return STATISTICS_MEM;
+        if (partialCacheKey(params, params->inputFile, params->parameters[p], keys[p], PARTIAL_CACHE_KEY_LENGTH) != PARTIAL_CACHE_OK)
+            return processFile(params);
+        partialCacheFilename(params->partialCacheDirectory, params->inputFile, params->parameters[p], keys[p], filenames[p], FILENAME_MAX);
+        if (cached && readPartialAggregate(filenames[p], keys[p], &worker->partialStates[p]) != PARTIAL_CACHE_OK)
+            cached = false;
+    }
+
+    int status = STATISTICS_OK;
+    if (cached)
+        worker->nCachedFiles++;
+    else
+    {
+        // Bin the file on its own into the partial states
+        BinningState accumulators[SLIDEMBIN_MAX_PARAMETERS];
+        for (int p = 0; p < params->nParameters; p++)
+        {
+            resetBinningState(&worker->partialStates[p]);
+            accumulators[p] = *cells[p];
+            *cells[p] = worker->partialStates[p];
+        }
+        status = processFile(params);
+        for (int p = 0; p < params->nParameters; p++)
+        {
+            worker->partialStates[p] = *cells[p];
+            *cells[p] = accumulators[p];
+        }
+        for (int p = 0; p < params->nParameters && status == STATISTICS_OK; p++)
+        {
+            if (writePartialAggregate(filenames[p], keys[p], &worker->partialStates[p]) != PARTIAL_CACHE_OK && params->verbose)
+                fprintf(stderr, "\nUnable to write %s\n", filenames[p]);
+        }
+    }
+
+    for (int p = 0; p < params->nParameters; p++)
+    {
+        if (status == STATISTICS_OK && mergeBinningState(cells[p], &worker->partialStates[p]) != BIN_OK)
+        {
+            fprintf(stderr, "Unable to merge bin storage.\n");
+            exit(EXIT_FAILURE);
+        }
+        resetBinningState(&worker->partialStates[p]);
+    }
+
+    return status;
+}
+
+void reportFileProgress(FileProgress *progress)
+{
+    pthread_mutex_lock(&progress->lock);
+    progress->processedFiles++;
+    if (progress->show && progress->processedFiles % progress->percentCheck == 0)
+    {
+        float percentDone = (float)progress->processedFiles / (float)progress->nFiles * 100.0;
+        fprintf(stderr, "\r%s: %ld of %ld files processed (%3.0f%%)", progress->programName, progress->processedFiles, progress->nFiles, percentDone);
+    }
+    pthread_mutex_unlock(&progress->lock);
+
+    return;
+}
+
+void freeSlidemData(ProcessingParameters *params)
+{
+    // Sidecar arrays are part of the map
+    if (params->columnFile.map != NULL)
+        closeColumnFile(&params->columnFile);
+    else
+    {
+        free(params->time);
+        free(params->mlt);
+        free(params->qdlat);
+        for (int p = 0; p < params->nParameters; p++)
+        {
+            free(params->values[p]);
+            free(params->flags[p]);
+        }
+        free(params->passInfo);
+        for (int a = 0; a < params->nAxes; a++)
+            free(params->axisValues[a]);
+    }
+    params->time = NULL;
+    params->mlt = NULL;
+    params->qdlat = NULL;
+    for (int p = 0; p < params->nParameters; p++)
+    {
+        params->values[p] = NULL;
+        params->flags[p] = NULL;
+    }
+    params->passInfo = NULL;
+    for (int a = 0; a < params->nAxes; a++)
+        params->axisValues[a] = NULL;
+
+    return;
+}
+
+// Records of a sorted time array within the inclusive time range
+static void recordRange(const double *time, long nRecords, double firstTime, double lastTime, long *firstRecord, long *nRangeRecords)
+{
+    long lo = 0;
+    long hi = nRecords;
+    while (lo < hi)
+    {
+        long mid = lo + (hi - lo) / 2;
+        if (time[mid] < firstTime)
+            lo = mid + 1;
         else
-            qdDirection = 0.0;
-        lastQdLat = qdlat;
-        mlt = params->mlt[i];
-        value = params->values[i];
-
-        if (params->flags != NULL)
-            flag = params->flags[i];
-        else flag = 0;
-
-        if (params->binningState.flipParamWhenDescending && qdDirection < 0.0)
-            value = -value;
-        params->binningState.nValsRead++;
-
-        // Filter based on flag ignore mask
-        // Ignore the masked flag bits. All other bits must be 0.
-        includeValue = (flag & flagMask) == 0;
-
-        binData(&params->binningState, qdlat, mlt, value, includeValue);
-    }
-
-    free(params->time);
-        params->time = NULL;
-    free(params->mlt);
-        params->mlt = NULL;
-    free(params->qdlat);
-        params->qdlat = NULL;
-    free(params->values);
-        params->values = NULL;
-    free(params->flags);
-        params->flags = NULL;
-
-    return STATISTICS_OK;
+            hi = mid;
+    }
+    *firstRecord = lo;
+    hi = nRecords;
+    while (lo < hi)
+    {
+        long mid = lo + (hi - lo) / 2;
+        if (time[mid] <= lastTime)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    *nRangeRecords = lo - *firstRecord;
+
+    return;
+}
+
+// Quality flag variable for a parameter, NULL if it has none
+static const char *flagVariableName(const char *parameter)
+{
+    // TBT model uses M_i_eff_Flags too
+    if (strcmp("M_i_eff", parameter) == 0 || strcmp("M_i_eff_tbt_model", parameter) == 0)
+        return "M_i_eff_Flags";
+    else if (strcmp("V_i", parameter) == 0)
+        return "V_i_Flags";
+    else if (strcmp("N_i", parameter) == 0)
+        return "N_i_Flags";
+
+    return NULL;
+}
+
+// CDF_DOUBLE and CDF_REAL8 are the same native type
+static bool sameDataType(long dataType, long expectedDataType)
+{
+    if ((dataType == CDF_DOUBLE || dataType == CDF_REAL8) && (expectedDataType == CDF_DOUBLE || expectedDataType == CDF_REAL8))
+        return true;
+
+    return dataType == expectedDataType;
+}
+
+// Returns NULL unless the column exists as a scalar of the given CDF data type and record size
+static void *mappedColumn(const ColumnFile *file, const char *name, long expectedDataType, size_t recordSize)
+{
+    size_t size = 0;
+    long dataType = 0;
+    const void *data = columnFileData(file, name, &size, &dataType);
+    if (data == NULL || size != recordSize || !sameDataType(dataType, expectedDataType))
+        return NULL;
+
+    // Read-only map: the arrays are not modified during binning
+    return (void *)data;
+}
+
+int loadSlidemColumns(ProcessingParameters *params)
+{
+    int status = openColumnFile(params->inputFile, &params->columnFile);
+    if (status != COLUMN_FILE_OK)
+        return status;
+
+    ColumnFile *file = &params->columnFile;
+    params->nRecords = (long) file->header->nRecords;
+    params->time = mappedColumn(file, "Timestamp", CDF_EPOCH, sizeof(double));
+    params->mlt = mappedColumn(file, "MLT", CDF_DOUBLE, sizeof(double));
+    params->qdlat = mappedColumn(file, "QDLatitude", CDF_DOUBLE, sizeof(double));
+    if (params->time == NULL || params->mlt == NULL || params->qdlat == NULL)
+    {
+        freeSlidemData(params);
+        return COLUMN_FILE_FORMAT;
+    }
+    for (int p = 0; p < params->nParameters; p++)
+    {
+        params->values[p] = mappedColumn(file, params->parameters[p], CDF_DOUBLE, sizeof(double));
+        if (params->values[p] == NULL)
+        {
+            freeSlidemData(params);
+            return COLUMN_FILE_FORMAT;
+        }
+        const char *flagVariable = flagVariableName(params->parameters[p]);
+        if (flagVariable != NULL)
+            params->flags[p] = mappedColumn(file, flagVariable, CDF_UINT4, sizeof(uint32_t));
+    }
+
+    for (int a = 0; a < params->nAxes; a++)
+    {
+        if (params->axes[a].source != BIN_AXIS_VARIABLE)
+            continue;
+        params->axisValues[a] = mappedColumn(file, params->axes[a].name, CDF_DOUBLE, sizeof(double));
+        if (params->axisValues[a] == NULL)
+        {
+            freeSlidemData(params);
+            return COLUMN_FILE_FORMAT;
+        }
+    }
+
+    if (params->binningState.flipParamWhenDescending)
+        params->passInfo = mappedColumn(file, "Pass_Index", CDF_UINT2, sizeof(uint16_t));
+
+    // Only records within the requested time range are binned
+    long first = 0;
+    recordRange(params->time, params->nRecords, params->firstTime, params->lastTime, &first, &params->nRecords);
+    params->time += first;
+    params->mlt += first;
+    params->qdlat += first;
+    for (int p = 0; p < params->nParameters; p++)
+    {
+        params->values[p] += first;
+        if (params->flags[p] != NULL)
+            params->flags[p] += first;
+    }
+    if (params->passInfo != NULL)
+        params->passInfo += first;
+    for (int a = 0; a < params->nAxes; a++)
+    {
+        if (params->axisValues[a] != NULL)
+            params->axisValues[a] += first;
+    }
+
+    return CDF_OK;
+}
+
+static int loadSlidemCdf(ProcessingParameters *params, char *inputFile);
+
+static CDFstatus lockedVariableRange(CDFid cdfId, char *variable, long expectedDataType, long firstRecord, long nRecords, void **mem)
+{
+    pthread_mutex_lock(&cdfLock);
+    CDFstatus status = loadCdfVariableRange(cdfId, variable, expectedDataType, firstRecord, nRecords, mem);
+    pthread_mutex_unlock(&cdfLock);
+
+    return status;
 }
 
 int loadSlidemData(ProcessingParameters *params)
 {
+    char *inputFile = params->inputFile;
+    char cdfFilename[FILENAME_MAX];
+    size_t n = strlen(inputFile);
+    size_t extensionLength = strlen(COLUMN_SIDECAR_EXTENSION);
+    if (n > extensionLength && strcmp(COLUMN_SIDECAR_EXTENSION, inputFile + n - extensionLength) == 0)
+    {
+        int columnStatus = loadSlidemColumns(params);
+        if (columnStatus == CDF_OK)
+            return CDF_OK;
+        // Fall back to the CDF the sidecar was made from
+        snprintf(cdfFilename, FILENAME_MAX, "%.*s.cdf", (int)(n - extensionLength), inputFile);
+        if (access(cdfFilename, R_OK) != 0)
+            return columnStatus;
+        if (params->verbose)
+            fprintf(stderr, "Unable to map %s, reading %s\n", inputFile, cdfFilename);
+        inputFile = cdfFilename;
+    }
 
-    // Open the CDF file with validation
-    CDFsetValidate(VALIDATEFILEoff);
+    return loadSlidemCdf(params, inputFile);
+}
+
+static int loadSlidemCdf(ProcessingParameters *params, char *inputFile)
+{
     CDFid cdfId;
     CDFstatus status;
-    // Attributes
-    long attrN;
-    long entryN;
-    char attrName[CDF_ATTR_NAME_LEN256+1];
-    long attrScope, maxEntry;
 
     // Check CDF info
-    long decoding, encoding, majority, maxrRec, numrVars, maxzRec, numzVars, numAttrs, format, numDims, dimSizes[CDF_MAX_DIMS];
-
-    status = CDFopenCDF(params->inputFile, &cdfId);
-    if (status != CDF_OK) 
-        return status;
+    long encoding, majority, maxrRec, numrVars, maxzRec, numzVars, numAttrs, numDims, dimSizes[CDF_MAX_DIMS];
 
-    status = CDFgetFormat(cdfId, &format);
-    status = CDFgetDecoding(cdfId, &decoding);
-    status = CDFinquireCDF(cdfId, &numDims, dimSizes, &encoding, &majority, &maxrRec, &numrVars, &maxzRec, &numzVars, &numAttrs);
+    // Only the CDF library calls are serialized, so that other threads can bin while this file is read
+    pthread_mutex_lock(&cdfLock);
+    // Open the CDF file without validation
+    CDFsetValidate(VALIDATEFILEoff);
+    status = CDFopenCDF(inputFile, &cdfId);
     if (status != CDF_OK)
     {
-    	CDFcloseCDF(cdfId);
+        pthread_mutex_unlock(&cdfLock);
         return status;
     }
-    uint8_t nVars = numzVars;
+    status = CDFinquireCDF(cdfId, &numDims, dimSizes, &encoding, &majority, &maxrRec, &numrVars, &maxzRec, &numzVars, &numAttrs);
+    if (status == CDF_OK)
+        status = loadCdfVariable(cdfId, "Timestamp", (void**)&params->time, &params->nRecords);
+    pthread_mutex_unlock(&cdfLock);
+    if (status != CDF_OK)
+        goto close;
+
+    // Only records within the requested time range are read from the other variables
+    long first = 0;
+    recordRange(params->time, params->nRecords, params->firstTime, params->lastTime, &first, &params->nRecords);
+    if (params->nRecords == 0)
+        goto close;
+    memmove(params->time, params->time + first, (size_t)params->nRecords * sizeof *params->time);
+    long n = params->nRecords;
 
-    status = loadCdfVariable(cdfId, "Timestamp", (void**)&params->time, &params->nRecords);
+    status = lockedVariableRange(cdfId, "MLT", CDF_DOUBLE, first, n, (void**)&params->mlt);
     if (status != CDF_OK)
-    {
-        CDFcloseCDF(cdfId);
-        return status;
-    }
+        goto close;
 
-    status = loadCdfVariable(cdfId, "MLT", (void**)&params->mlt, NULL);
+    status = lockedVariableRange(cdfId, "QDLatitude", CDF_DOUBLE, first, n, (void**)&params->qdlat);
     if (status != CDF_OK)
+        goto close;
+
+    for (int p = 0; p < params->nParameters; p++)
     {
-        CDFcloseCDF(cdfId);
-        return status;
+        status = lockedVariableRange(cdfId, params->parameters[p], CDF_DOUBLE, first, n, (void**)&params->values[p]);
+        if (status != CDF_OK)
+            goto close;
     }
 
-    status = loadCdfVariable(cdfId, "QDLatitude", (void**)&params->qdlat, NULL);
-    if (status != CDF_OK)
+    for (int a = 0; a < params->nAxes; a++)
     {
-        CDFcloseCDF(cdfId);
-        return status;
+        if (params->axes[a].source != BIN_AXIS_VARIABLE)
+            continue;
+        status = lockedVariableRange(cdfId, params->axes[a].name, CDF_DOUBLE, first, n, (void**)&params->axisValues[a]);
+        if (status != CDF_OK)
+            goto close;
     }
 
-    status = loadCdfVariable(cdfId, params->parameter, (void**)&params->values, NULL);
-    if (status != CDF_OK)
+    // Pass_Index is not in older SLIDEM files
+    pthread_mutex_lock(&cdfLock);
+    bool hasPassIndex = CDFgetVarNum(cdfId, "Pass_Index") >= 0;
+    pthread_mutex_unlock(&cdfLock);
+    if (params->binningState.flipParamWhenDescending && hasPassIndex)
     {
-        CDFcloseCDF(cdfId);
-        return status;
+        status = lockedVariableRange(cdfId, "Pass_Index", CDF_UINT2, first, n, (void**)&params->passInfo);
+        if (status != CDF_OK)
+            goto close;
     }
 
-    // TBT model uses M_i_eff_Flags too
-    if (strcmp("M_i_eff", params->parameter) == 0 || strcmp("M_i_eff_tbt_model", params->parameter) == 0)
-        status = loadCdfVariable(cdfId, "M_i_eff_Flags", (void**)&params->flags, NULL);
-    else if (strcmp("V_i", params->parameter) == 0)
-        status = loadCdfVariable(cdfId, "V_i_Flags", (void**)&params->flags, NULL);
-    else if (strcmp("N_i", params->parameter) == 0)
-        status = loadCdfVariable(cdfId, "N_i_Flags", (void**)&params->flags, NULL);
+    for (int p = 0; p < params->nParameters && status == CDF_OK; p++)
+    {
+        const char *flagVariable = flagVariableName(params->parameters[p]);
+        if (flagVariable != NULL)
+            status = lockedVariableRange(cdfId, (char *)flagVariable, CDF_UINT4, first, n, (void**)&params->flags[p]);
+    }
 
-	CDFcloseCDF(cdfId);
+close:
+    pthread_mutex_lock(&cdfLock);
+    CDFcloseCDF(cdfId);
+    pthread_mutex_unlock(&cdfLock);
 
-	return status;
-    
+    return status;
 }
 
 CDFstatus loadCdfVariable(CDFid cdfId, char *variable, void **mem, long *nRecords)
@@ -650,7 +1236,7 @@ CDFstatus loadCdfVariable(CDFid cdfId, char *variable, void **mem, long *nRecord
 	CDFstatus status = CDFreadzVarAllByVarID(cdfId, varNum, &numRecs, &dataType, &numElems, &numDims, dimSizes, &recVary, dimVarys, &data);
 	if (status != CDF_OK)
 	{
-    	CDFcloseCDF(cdfId);
+		// The caller closes the file
 		CDFdataFree(data);
 		return status;
 	}
@@ -680,6 +1266,58 @@ CDFstatus loadCdfVariable(CDFid cdfId, char *variable, void **mem, long *nRecord
     return CDF_OK;
 }
 
+CDFstatus loadCdfVariableRange(CDFid cdfId, char *variable, long expectedDataType, long firstRecord, long nRecords, void **mem)
+{
+    if (mem == NULL || nRecords <= 0)
+        return -1;
+
+    long varNum = CDFgetVarNum(cdfId, variable);
+    if (varNum < 0)
+        return (CDFstatus) varNum;
+
+    long dataType = 0;
+    long numVarBytes = 0;
+    long numDims = 0;
+    long dimSizes[CDF_MAX_DIMS] = {0};
+    CDFstatus status = CDFgetzVarDataType(cdfId, varNum, &dataType);
+    if (status != CDF_OK)
+        return status;
+    status = CDFgetzVarNumDims(cdfId, varNum, &numDims);
+    if (status != CDF_OK)
+        return status;
+    status = CDFgetzVarDimSizes(cdfId, varNum, dimSizes);
+    if (status != CDF_OK)
+        return status;
+
+    // The arrays are read as one value of the expected type per record, as from the column sidecars
+    long numValuesPerRec = 1;
+    for (long j = 0; j < numDims; j++)
+        numValuesPerRec *= dimSizes[j];
+    if (numValuesPerRec != 1)
+    {
+        fprintf(stderr, "%s is not a scalar variable.\n", variable);
+        return BAD_DIM_SIZE;
+    }
+    if (!sameDataType(dataType, expectedDataType))
+    {
+        fprintf(stderr, "%s does not have the expected CDF data type.\n", variable);
+        return BAD_DATA_TYPE;
+    }
+    status = CDFgetDataTypeSize(dataType, &numVarBytes);
+    if (status != CDF_OK)
+        return status;
+
+    *mem = malloc((size_t)nRecords * (size_t)numValuesPerRec * (size_t)numVarBytes);
+    if (*mem == NULL)
+    {
+        printf("Could not allocate heap.\n");
+        CDFcloseCDF(cdfId);
+        exit(42);
+    }
+
+    return CDFgetVarRangeRecordsByVarName(cdfId, variable, firstRecord, firstRecord + nRecords - 1, *mem);
+}
+
 void printQualityFlagTable(void)
 {
     fprintf(stdout, "Quality flag = 0 indicates nominal measurement.\n");
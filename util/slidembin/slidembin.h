@@ -22,11 +22,14 @@
 #define _SLIDEMBIN_H
 
 #include "statistics.h"
+#include "binning_cube.h"
+#include "column_file.h"
 
 #include <stdio.h>
 #include <stdint.h>
 #include <stdbool.h>
 #include <time.h>
+#include <pthread.h>
 
 #include <fts.h>
 #include <cdf.h>
@@ -36,6 +39,11 @@
 
 #define NUM_DATA_VARIABLES 7
 
+#define SLIDEMBIN_MAX_PARAMETERS 16
+#define SLIDEMBIN_MAX_STATISTICS 16
+
+#define SLIDEMBIN_MAX_THREADS 64 // Files are loaded and binned concurrently on up to this many threads
+
 typedef struct processingParameters
 {
     int nOptions;
@@ -46,18 +54,30 @@ typedef struct processingParameters
 
     char *cdfDirectory;
     char *inputFile;
-
-    char *parameter;
-    char *statistic;
-
-    long nRecords;
+    bool useColumnSidecars;
+    bool usePartialCache;
+    char *partialCacheDirectory; // NULL to cache partials next to the input files
+    ColumnFile columnFile; // when mapped, the data arrays below point into it
+
+    // Comma-separated lists from the command line, all binned in one pass
+    int nParameters;
+    char *parameters[SLIDEMBIN_MAX_PARAMETERS];
+    int nStatistics;
+    char *statistics[SLIDEMBIN_MAX_STATISTICS];
+
+    long nRecords; // records within the requested time range
     double *time;
     double *qdlat;
     double *mlt;
-    double *values;
-    uint32_t *flags;
+    double *values[SLIDEMBIN_MAX_PARAMETERS];
+    uint32_t *flags[SLIDEMBIN_MAX_PARAMETERS];
+    uint16_t *passInfo; // Pass_Index from the SLIDEM CDF, NULL for files that predate it
+    double *axisValues[BINNING_CUBE_MAX_AXES]; // product variables of extra bin axes, NULL for time axes
 
-    BinningState binningState;
+    BinningState binningState; // bin specification set from the command line
+    int nAxes;
+    BinAxis axes[BINNING_CUBE_MAX_AXES]; // extra bin axes from --axis
+    BinningCube cubes[SLIDEMBIN_MAX_PARAMETERS];
 
     char *firstTimeString;
     char *lastTimeString;
@@ -66,6 +86,7 @@ typedef struct processingParameters
     bool processAllSpaceSeries;
 
     long nFiles;
+    int nThreads; // 0 for one per online processor
 
     uint32_t flagIgnoreMask;
     uint32_t positiveFlagMask;
@@ -74,13 +95,46 @@ typedef struct processingParameters
 
 } ProcessingParameters;
 
+// Shared file progress report
+typedef struct fileProgress
+{
+    pthread_mutex_t lock;
+    char *programName;
+    bool show;
+    long nFiles;
+    long processedFiles;
+    long percentCheck;
+} FileProgress;
+
+// Each worker bins a contiguous block of the file list into its own BinningState.
+// Blocks are merged in file order, so bin contents match those of a serial run.
+typedef struct binningWorker
+{
+    int workerNumber;
+    ProcessingParameters params;
+    char **files;
+    long firstFile;
+    long nFiles;
+    FileProgress *progress;
+    BinningState partialStates[SLIDEMBIN_MAX_PARAMETERS]; // one file's accumulators when partials are cached
+    long nCachedFiles;
+} BinningWorker;
+
 void usage(char *name);
 void about(void);
 void parseCommandLine(ProcessingParameters *params, int argc, char *argv[]);
 bool fileMatch(FTSENT *e, ProcessingParameters *params);
 int processFile(ProcessingParameters *params);
+void *binningThread(void *arg);
+int binFileWithPartials(BinningWorker *worker);
+void reportFileProgress(FileProgress *progress);
 int loadSlidemData(ProcessingParameters *params);
+int loadSlidemColumns(ProcessingParameters *params);
+void freeSlidemData(ProcessingParameters *params);
 CDFstatus loadCdfVariable(CDFid cdfId, char *variable, void **mem, long *nRecords);
+// Reads records firstRecord to firstRecord + nRecords - 1 of a scalar variable.
+// Variables with dimensions or with a data type other than expectedDataType are rejected.
+CDFstatus loadCdfVariableRange(CDFid cdfId, char *variable, long expectedDataType, long firstRecord, long nRecords, void **mem);
 
 void printQualityFlagTable(void);
 
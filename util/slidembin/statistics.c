@@ -22,6 +22,7 @@
 // https://github.com/JohnathanBurchill/TII-Ion-Drift-Processor/tree/tracis_flagging
 
 #include "statistics.h"
+#include "selection_statistics.h"
 
 #include <string.h>
 #include <strings.h>
@@ -29,7 +30,6 @@
 
 #include <gsl/gsl_math.h>
 #include <gsl/gsl_errno.h>
-#include <gsl/gsl_statistics.h>
 
 static char *availableStatistics[NSTATISTICS] = {
     "Mean",
@@ -71,7 +71,9 @@ int initBinningState(BinningState *binningState)
     // Allocate memory for binning
     binningState->nMltsVsLatitude = calloc(binningState->nQDLats, sizeof *binningState->nMltsVsLatitude);
     binningState->cumulativeMltsVsLatitude = calloc(binningState->nQDLats, sizeof *binningState->cumulativeMltsVsLatitude); 
-    if (binningState->nMltsVsLatitude == NULL || binningState->cumulativeMltsVsLatitude == NULL)
+    binningState->deltaMltsVsLatitude = calloc(binningState->nQDLats, sizeof *binningState->deltaMltsVsLatitude);
+    binningState->inverseDeltaMltsVsLatitude = calloc(binningState->nQDLats, sizeof *binningState->inverseDeltaMltsVsLatitude);
+    if (binningState->nMltsVsLatitude == NULL || binningState->cumulativeMltsVsLatitude == NULL || binningState->deltaMltsVsLatitude == NULL || binningState->inverseDeltaMltsVsLatitude == NULL)
     {
         fprintf(stderr, "Unable to allocate memory.\n");
         return BIN_MEMORY;
@@ -94,128 +96,411 @@ int initBinningState(BinningState *binningState)
             binningState->ringSolidAngle = solidAngle(binningState->qdlatmin + q * binningState->deltaqdlat, binningState->qdlatmin + (q+1) * binningState->deltaqdlat, binningState->mltmin, binningState->mltmax);
             binningState->nMltsVsLatitude[q] = nRingBins(binningState->ringSolidAngle, binningState->solidAngleUnit);
         }        
+        binningState->deltaMltsVsLatitude[q] = (binningState->mltmax - binningState->mltmin) / (double)binningState->nMltsVsLatitude[q];
+        binningState->inverseDeltaMltsVsLatitude[q] = (double)binningState->nMltsVsLatitude[q] / (binningState->mltmax - binningState->mltmin);
         binningState->nBins += binningState->nMltsVsLatitude[q];
         if (q > 0)
             binningState->cumulativeMltsVsLatitude[q] = binningState->cumulativeMltsVsLatitude[q-1] + binningState->nMltsVsLatitude[q - 1];
     }
+    binningState->inverseDeltaQdlat = 1.0 / binningState->deltaqdlat;
 
-    if (allocateBinStorage(&binningState->binStorage, &binningState->binSizes, &binningState->binValidSizes, &binningState->binMaxSizes, binningState->nBins, BIN_STORAGE_BLOCK_SIZE, binningState->equalArea))
+    if (allocateBinStorage(binningState))
     {
         fprintf(stderr, "Could not allocate bin storage memory.\n");
         return BIN_MEMORY;
     }
+    binningState->binMeans = calloc(binningState->nBins, sizeof *binningState->binMeans);
+    binningState->binM2s = calloc(binningState->nBins, sizeof *binningState->binM2s);
+    binningState->binMins = malloc(binningState->nBins * sizeof *binningState->binMins);
+    binningState->binMaxs = malloc(binningState->nBins * sizeof *binningState->binMaxs);
+    if (binningState->binMeans == NULL || binningState->binM2s == NULL || binningState->binMins == NULL || binningState->binMaxs == NULL)
+    {
+        fprintf(stderr, "Could not allocate bin accumulator memory.\n");
+        return BIN_MEMORY;
+    }
+    for (size_t i = 0; i < binningState->nBins; i++)
+    {
+        binningState->binMins[i] = INFINITY;
+        binningState->binMaxs[i] = -INFINITY;
+    }
+    if (binningState->useSketches)
+    {
+        binningState->binSketches = malloc(binningState->nBins * sizeof *binningState->binSketches);
+        if (binningState->binSketches == NULL)
+        {
+            fprintf(stderr, "Could not allocate bin sketch memory.\n");
+            return BIN_MEMORY;
+        }
+        uint32_t k = kllParameterForRankError(binningState->sketchRankError);
+        for (size_t i = 0; i < binningState->nBins; i++)
+            kllInit(&binningState->binSketches[i], k);
+    }
     // Access bins with bins[mltIndex * nQDLats + qdlatIndex];
 
     return BIN_OK;
 }
 
-// Main bin storage
-int allocateBinStorage(double ***bins, size_t **binSizes, size_t **binValidSizes, size_t **binMaxSizes, size_t nBins, size_t sizePerBin, bool useEqualArea)
+// Main bin storage. Value pages are only allocated as values arrive.
+int allocateBinStorage(BinningState *binningState)
 {
-    *bins = malloc(nBins * sizeof *bins);
-    *binSizes = malloc(nBins * sizeof *binSizes);
-    *binValidSizes = malloc(nBins * sizeof *binValidSizes);
-    *binMaxSizes = malloc(nBins * sizeof *binMaxSizes);
-    if (*bins == NULL || *binSizes == NULL || *binValidSizes == NULL || *binMaxSizes == NULL)
+    size_t nBins = binningState->nBins;
+    binningState->binStorage = calloc(nBins, sizeof *binningState->binStorage);
+    binningState->binFirstPages = calloc(nBins, sizeof *binningState->binFirstPages);
+    binningState->binLastPages = calloc(nBins, sizeof *binningState->binLastPages);
+    binningState->binSizes = calloc(nBins, sizeof *binningState->binSizes);
+    binningState->binValidSizes = calloc(nBins, sizeof *binningState->binValidSizes);
+    if (binningState->binStorage == NULL || binningState->binFirstPages == NULL || binningState->binLastPages == NULL || binningState->binSizes == NULL || binningState->binValidSizes == NULL)
         return STATISTICS_MEM;
-    for (size_t i = 0; i < nBins; i++)
+    binningState->binArena = NULL;
+    binningState->ownsPages = binningState->pages == NULL;
+    if (binningState->ownsPages)
     {
-        (*bins)[i] = NULL;
-        (*binSizes)[i] = 0;
-        (*binValidSizes)[i] = 0;
-        (*binMaxSizes)[i] = 0;
+        binningState->pages = calloc(1, sizeof *binningState->pages);
+        if (binningState->pages == NULL)
+            return STATISTICS_MEM;
     }
-    for (size_t i = 0; i < nBins; i++)
+
+    return STATISTICS_OK;
+}
+
+// Pages in slab number s
+static inline size_t slabPages(size_t s)
+{
+    size_t pages = BIN_FIRST_SLAB_PAGES;
+    while (s-- > 0 && pages < BIN_MAX_SLAB_PAGES)
+        pages *= 2;
+
+    return pages < BIN_MAX_SLAB_PAGES ? pages : BIN_MAX_SLAB_PAGES;
+}
+
+static BinPage *newBinPage(BinPageAllocator *pages)
+{
+    if (pages->nSlabs == 0 || pages->nSlabPagesUsed == slabPages(pages->currentSlab))
     {
-        (*bins)[i] = malloc((sizePerBin * sizeof **bins));
-        if ((*bins)[i] == NULL)
-            return STATISTICS_MEM;
-        bzero((*bins)[i], sizePerBin * sizeof **bins);
-        (*binMaxSizes)[i] = sizePerBin;
+        // Slabs kept by resetBinningState are reused before new ones are allocated
+        if (pages->nSlabs > 0 && pages->currentSlab + 1 < pages->nSlabs)
+            pages->currentSlab++;
+        else
+        {
+            BinPage **slabs = realloc(pages->slabs, (pages->nSlabs + 1) * sizeof *slabs);
+            if (slabs == NULL)
+                return NULL;
+            pages->slabs = slabs;
+            slabs[pages->nSlabs] = malloc(slabPages(pages->nSlabs) * sizeof(BinPage));
+            if (slabs[pages->nSlabs] == NULL)
+                return NULL;
+            pages->currentSlab = pages->nSlabs;
+            pages->nSlabs++;
+        }
+        pages->nSlabPagesUsed = 0;
+    }
+    BinPage *page = pages->slabs[pages->currentSlab] + pages->nSlabPagesUsed++;
+    page->next = NULL;
+    page->nValues = 0;
+
+    return page;
+}
+
+static int appendBinValues(BinningState *binningState, size_t index, const double *values, size_t nValues)
+{
+    while (nValues > 0)
+    {
+        BinPage *page = binningState->binLastPages[index];
+        if (page == NULL || page->nValues == BIN_PAGE_VALUES)
+        {
+            BinPage *next = newBinPage(binningState->pages);
+            if (next == NULL)
+                return STATISTICS_MEM;
+            if (page == NULL)
+                binningState->binFirstPages[index] = next;
+            else
+                page->next = next;
+            binningState->binLastPages[index] = next;
+            page = next;
+        }
+        size_t n = BIN_PAGE_VALUES - page->nValues;
+        if (n > nValues)
+            n = nValues;
+        memcpy(page->values + page->nValues, values, n * sizeof *values);
+        page->nValues += n;
+        values += n;
+        nValues -= n;
     }
 
     return STATISTICS_OK;
 }
 
-// Grow the allocated bin storage
-int adjustBinStorage(double **bins, size_t *binMaxSizes, int mltQdLatIndex, long numberOfElementsToAdd)
+static void freeSlabs(BinPageAllocator *pages)
 {
-    void *mem = realloc(bins[mltQdLatIndex], (binMaxSizes[mltQdLatIndex] + numberOfElementsToAdd) * sizeof *bins[mltQdLatIndex]);
-    if (mem == NULL)
+    for (size_t s = 0; s < pages->nSlabs; s++)
+        free(pages->slabs[s]);
+    free(pages->slabs);
+    pages->slabs = NULL;
+    pages->nSlabs = 0;
+    pages->currentSlab = 0;
+    pages->nSlabPagesUsed = 0;
+
+    return;
+}
+
+void freeBinPageAllocator(BinPageAllocator *pages)
+{
+    if (pages == NULL)
+        return;
+    freeSlabs(pages);
+    free(pages);
+
+    return;
+}
+
+static void freeBinPages(BinningState *binningState)
+{
+    if (binningState->ownsPages && binningState->pages != NULL)
+        freeSlabs(binningState->pages);
+    for (size_t i = 0; i < binningState->nBins; i++)
+    {
+        binningState->binFirstPages[i] = NULL;
+        binningState->binLastPages[i] = NULL;
+    }
+
+    return;
+}
+
+int compactBinStorage(BinningState *binningState)
+{
+    if (binningState->binArena != NULL)
+        return STATISTICS_OK;
+
+    size_t nValues = 0;
+    for (size_t i = 0; i < binningState->nBins; i++)
+        nValues += binningState->binSizes[i];
+    binningState->binArena = malloc((nValues > 0 ? nValues : 1) * sizeof *binningState->binArena);
+    if (binningState->binArena == NULL)
         return STATISTICS_MEM;
-    bins[mltQdLatIndex] = mem;
 
-    binMaxSizes[mltQdLatIndex] += numberOfElementsToAdd;
+    size_t offset = 0;
+    for (size_t i = 0; i < binningState->nBins; i++)
+    {
+        binningState->binStorage[i] = binningState->binArena + offset;
+        for (BinPage *page = binningState->binFirstPages[i]; page != NULL; page = page->next)
+        {
+            memcpy(binningState->binArena + offset, page->values, page->nValues * sizeof *page->values);
+            offset += page->nValues;
+        }
+    }
+    freeBinPages(binningState);
 
     return STATISTICS_OK;
 }
 
 void freeBinStorage(BinningState *binningState)
 {
-    for (int i = 0; i < binningState->nBins; i++)
-    {
-        free(binningState->binStorage[i]);
-    }
+    freeBinPages(binningState);
+    if (binningState->ownsPages)
+        freeBinPageAllocator(binningState->pages);
+    binningState->pages = NULL;
+    free(binningState->binArena);
+    free(binningState->binFirstPages);
+    free(binningState->binLastPages);
 
     free(binningState->binStorage);
     free(binningState->binSizes);
     free(binningState->binValidSizes);
-    free(binningState->binMaxSizes);
+
+    free(binningState->binMeans);
+    free(binningState->binM2s);
+    free(binningState->binMins);
+    free(binningState->binMaxs);
+
+    if (binningState->binSketches != NULL)
+    {
+        for (size_t i = 0; i < binningState->nBins; i++)
+            kllFree(&binningState->binSketches[i]);
+        free(binningState->binSketches);
+    }
 
     free(binningState->nMltsVsLatitude);
     free(binningState->cumulativeMltsVsLatitude);
+    free(binningState->deltaMltsVsLatitude);
+    free(binningState->inverseDeltaMltsVsLatitude);
 
     return;
 }
 
-// Perform binning
-int binData(BinningState *binningState, double qdlat, double mlt, double value, bool includeValue)
+void resetBinningState(BinningState *binningState)
 {
-    int qdlatIndex = 0;
-    int mltIndex = 0;
+    for (size_t i = 0; i < binningState->nBins; i++)
+    {
+        binningState->binSizes[i] = 0;
+        binningState->binValidSizes[i] = 0;
+        binningState->binMeans[i] = 0.0;
+        binningState->binM2s[i] = 0.0;
+        binningState->binMins[i] = INFINITY;
+        binningState->binMaxs[i] = -INFINITY;
+        if (binningState->binSketches != NULL)
+        {
+            uint32_t k = binningState->binSketches[i].k;
+            kllFree(&binningState->binSketches[i]);
+            kllInit(&binningState->binSketches[i], k);
+        }
+    }
+    for (size_t i = 0; i < binningState->nBins; i++)
+    {
+        binningState->binFirstPages[i] = NULL;
+        binningState->binLastPages[i] = NULL;
+    }
+    if (binningState->ownsPages)
+    {
+        binningState->pages->currentSlab = 0;
+        binningState->pages->nSlabPagesUsed = 0;
+    }
+    binningState->nValsRead = 0;
+    binningState->nValsWithinBinLimits = 0;
+    binningState->nValsBinned = 0;
 
-    if (!isfinite(value))
-        return BIN_VALUE_NOT_FINITE;
+    return;
+}
 
-    size_t index = 0;
+int mergeBinningState(BinningState *dest, const BinningState *src)
+{
+    if (dest == NULL || src == NULL)
+        return BIN_SPECIFICATION;
+    if (dest->nBins != src->nBins)
+        return BIN_SPECIFICATION;
+
+    for (size_t i = 0; i < src->nBins; i++)
+    {
+        size_t n = src->binSizes[i];
+        if (n > 0)
+        {
+            // Chan et al. pairwise combination of the accumulators
+            double nA = (double) dest->binSizes[i];
+            double nB = (double) n;
+            double delta = src->binMeans[i] - dest->binMeans[i];
+            dest->binMeans[i] += delta * nB / (nA + nB);
+            dest->binM2s[i] += src->binM2s[i] + delta * delta * nA * nB / (nA + nB);
+            if (src->binMins[i] < dest->binMins[i])
+                dest->binMins[i] = src->binMins[i];
+            if (src->binMaxs[i] > dest->binMaxs[i])
+                dest->binMaxs[i] = src->binMaxs[i];
+        }
+        if (n > 0 && dest->useSketches)
+        {
+            if (kllMerge(&dest->binSketches[i], &src->binSketches[i]) != KLL_OK)
+                return BIN_MEMORY;
+        }
+        for (const BinPage *page = dest->storeValues ? src->binFirstPages[i] : NULL; page != NULL; page = page->next)
+        {
+            if (appendBinValues(dest, i, page->values, page->nValues) != STATISTICS_OK)
+                return BIN_MEMORY;
+        }
+        dest->binSizes[i] += n;
+        dest->binValidSizes[i] += src->binValidSizes[i];
+    }
+    dest->nValsRead += src->nValsRead;
+    dest->nValsWithinBinLimits += src->nValsWithinBinLimits;
+    dest->nValsBinned += src->nValsBinned;
+
+    return BIN_OK;
+}
+
+// Perform binning
+// Index of x in bins of the given width from 0, using the reciprocal width.
+// Near a bin edge the product can round differently than the division used previously,
+// so the division decides there. Returns -1 for x outside [0, nCells * width) and for NaN.
+static inline int cellIndex(double x, double width, double inverseWidth, int nCells)
+{
+    double scaled = x * inverseWidth;
+    if (!(scaled >= -1.0 && scaled < (double)nCells + 1.0))
+        return -1;
+    double cell = floor(scaled);
+    if (scaled - cell < 1e-9 || cell + 1.0 - scaled < 1e-9)
+        cell = floor(x / width);
+    if (cell < 0.0 || cell >= (double)nCells)
+        return -1;
+
+    return (int) cell;
+}
 
-    qdlatIndex = (int) floor((qdlat - binningState->qdlatmin) / binningState->deltaqdlat);
-    if (qdlatIndex < 0 || qdlatIndex >= binningState->nQDLats)
+static inline int binIndex(const BinningState *binningState, double qdlat, double mlt, size_t *index)
+{
+    int qdlatIndex = cellIndex(qdlat - binningState->qdlatmin, binningState->deltaqdlat, binningState->inverseDeltaQdlat, binningState->nQDLats);
+    if (qdlatIndex < 0)
         return BIN_QDLAT_OUTOFRANGE;
 
-    double deltamlt = (binningState->mltmax - binningState->mltmin) / (double)binningState->nMltsVsLatitude[qdlatIndex];
-    mltIndex = (int) floor((mlt - binningState->mltmin) / deltamlt);
-    if (mltIndex >= 0 && mltIndex < binningState->nMltsVsLatitude[qdlatIndex])
-    {
-        index = binningState->cumulativeMltsVsLatitude[qdlatIndex] + mltIndex;
-        // Measurement lies within a QDLat and MLT bin
-        binningState->binValidSizes[index]++;
-        binningState->nValsWithinBinLimits++;
+    int mltIndex = cellIndex(mlt - binningState->mltmin, binningState->deltaMltsVsLatitude[qdlatIndex], binningState->inverseDeltaMltsVsLatitude[qdlatIndex], binningState->nMltsVsLatitude[qdlatIndex]);
+    if (mltIndex < 0)
+        return BIN_MLT_OUTOFRANGE;
 
-        if (includeValue)
-        {
-            // Flip sign of parameter when moving southward, i.e. to make Viy eastward and Vixh or Vixv northward
+    *index = binningState->cumulativeMltsVsLatitude[qdlatIndex] + (size_t)mltIndex;
 
-            if (binningState->binSizes[index] >= binningState->binMaxSizes[index])
-            {
-                if(adjustBinStorage(binningState->binStorage, binningState->binMaxSizes, index, BIN_STORAGE_BLOCK_SIZE))
-                {
-                    fprintf(stderr, "Unable to allocate additional bin storage.\n");
-                    exit(EXIT_FAILURE);
-                }
+    return BIN_OK;
+}
 
-            }
-            binningState->binStorage[index][binningState->binSizes[index]] = value;
-            binningState->binSizes[index]++;
-            binningState->nValsBinned++;
+// Measurement lies within a QDLat and MLT bin
+static inline void accumulateValue(BinningState *binningState, size_t index, double value, bool includeValue)
+{
+    binningState->binValidSizes[index]++;
+    binningState->nValsWithinBinLimits++;
+
+    if (!includeValue)
+        return;
+
+    if (binningState->storeValues)
+    {
+        if (appendBinValues(binningState, index, &value, 1) != STATISTICS_OK)
+        {
+            fprintf(stderr, "Unable to allocate additional bin storage.\n");
+            exit(EXIT_FAILURE);
         }
     }
+    else if (binningState->useSketches && kllUpdate(&binningState->binSketches[index], value) != KLL_OK)
+    {
+        fprintf(stderr, "Unable to allocate additional bin sketch storage.\n");
+        exit(EXIT_FAILURE);
+    }
+    binningState->binSizes[index]++;
+    // Welford update, same running mean as gsl_stats_mean
+    double delta = value - binningState->binMeans[index];
+    binningState->binMeans[index] += delta / (double)binningState->binSizes[index];
+    binningState->binM2s[index] += delta * (value - binningState->binMeans[index]);
+    if (value < binningState->binMins[index])
+        binningState->binMins[index] = value;
+    if (value > binningState->binMaxs[index])
+        binningState->binMaxs[index] = value;
+    binningState->nValsBinned++;
 
-    return BIN_OK;
+    return;
 }
 
+void binIndices(const BinningState *binningState, const double *qdlat, const double *mlt, size_t n, long *indices)
+{
+    size_t index = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        if (binIndex(binningState, qdlat[i], mlt[i], &index) == BIN_OK)
+            indices[i] = (long) index;
+        else
+            indices[i] = BIN_INDEX_OUTSIDE;
+    }
 
-void printBinningResults(BinningState *binningState, char *parameter, char *statistic)
+    return;
+}
+
+void binValues(BinningState *binningState, const long *indices, const double *values, const bool *includeValues, size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        if (indices[i] == BIN_INDEX_OUTSIDE || !isfinite(values[i]))
+            continue;
+        accumulateValue(binningState, (size_t)indices[i], values[i], includeValues[i]);
+    }
+
+    return;
+}
+
+
+void printBinningResults(BinningState *binningState, char *parameter, char **statistics, int nStatistics)
 {
     double qdlat1 = 0.0;
     double qdlat2 = 0.0;
@@ -223,9 +508,35 @@ void printBinningResults(BinningState *binningState, char *parameter, char *stat
     double mlt2 = 0.0;
     double result = 0.0;
 
+    // Scratch space for statistics that need it, sized for the largest bin
+    size_t maxBinSize = 0;
+    for (size_t i = 0; i < binningState->nBins; i++)
+    {
+        if (binningState->binSizes[i] > maxBinSize)
+            maxBinSize = binningState->binSizes[i];
+    }
+    if (binningState->storeValues && compactBinStorage(binningState) != STATISTICS_OK)
+    {
+        fprintf(stderr, "Unable to allocate memory for statistics.\n");
+        return;
+    }
+    double *scratch = NULL;
+    if (maxBinSize > 0 && binningState->storeValues)
+    {
+        scratch = malloc(maxBinSize * sizeof *scratch);
+        if (scratch == NULL)
+        {
+            fprintf(stderr, "Unable to allocate memory for statistics.\n");
+            return;
+        }
+    }
+
     fprintf(stdout, "Time range is inclusive. Bin specification for remaining quantities x and bin boundaries x1 and x2: x1 <= x < x2\n");
     fprintf(stdout, "Row legend:\n");
-    fprintf(stdout, "MLT1 MLT2 QDLat1 QDLat2 %s(%s) binCount validRegionFraction totalReadFraction\n", statistic, parameter);
+    fprintf(stdout, "MLT1 MLT2 QDLat1 QDLat2");
+    for (int s = 0; s < nStatistics; s++)
+        fprintf(stdout, " %s(%s)", statistics[s], parameter);
+    fprintf(stdout, " binCount validRegionFraction totalReadFraction\n");
 
     double denomBinValidSizes = 0.0;
     double denomNValsRead = binningState->nValsRead > 0 ? (double) binningState->nValsRead : 1.0;
@@ -234,7 +545,7 @@ void printBinningResults(BinningState *binningState, char *parameter, char *stat
 
     for (size_t q = 0; q < binningState->nQDLats; q++)
     {
-        for (size_t m = 0; m < binningState->nMltsVsLatitude[q]; m++)
+        for (size_t m = 0; m < (size_t)binningState->nMltsVsLatitude[q]; m++)
         {
             index = binningState->cumulativeMltsVsLatitude[q] + m;
             qdlat1 = binningState->qdlatmin + binningState->deltaqdlat * ((double)q);
@@ -242,31 +553,39 @@ void printBinningResults(BinningState *binningState, char *parameter, char *stat
             binningState->deltamlt = (binningState->mltmax - binningState->mltmin) / (double)binningState->nMltsVsLatitude[q];
             mlt1 = binningState->mltmin + binningState->deltamlt * (double)m;
             mlt2 = mlt1 + binningState->deltamlt;
-            if (calculateStatistic(statistic, binningState->binStorage, binningState->binSizes, index, (void*) &result))
-                result = GSL_NAN;
+            fprintf(stdout, "%5.2lf %5.2lf %6.2lf %6.2lf", mlt1, mlt2, qdlat1, qdlat2);
+            for (int s = 0; s < nStatistics; s++)
+            {
+                if (calculateStatistic(statistics[s], binningState, index, scratch, (void*) &result))
+                    result = GSL_NAN;
+                fprintf(stdout, " %lf", result);
+            }
 
             denomBinValidSizes = binningState->binValidSizes[index] > 0 ? (double) binningState->binValidSizes[index] : 1.0;
 
-            fprintf(stdout, "%5.2lf %5.2lf %6.2lf %6.2lf %lf %ld %lf %lf\n", mlt1, mlt2, qdlat1, qdlat2, result, binningState->binSizes[index], (double)binningState->binSizes[index] / denomBinValidSizes, (double)binningState->binSizes[index] / denomNValsRead);
+            fprintf(stdout, " %ld %lf %lf\n", binningState->binSizes[index], (double)binningState->binSizes[index] / denomBinValidSizes, (double)binningState->binSizes[index] / denomNValsRead);
         }
     }
 
     fprintf(stdout, "Summary of counts\n");
     fprintf(stdout, "\tValues read: %ld; Values within bin limits: %ld; Values binned: %ld (%6.2lf%% of those within bin limits)\n", binningState->nValsRead, binningState->nValsWithinBinLimits, binningState->nValsBinned, 100.0 * (double)binningState->nValsBinned / (double)binningState->nValsWithinBinLimits);
 
+    free(scratch);
+
 }
 
 void printAvailableStatistics(FILE *dest)
 {
     for (int i = 0; i < NSTATISTICS; i++)
         fprintf(dest, "\t%s\n", availableStatistics[i]);
+    fprintf(dest, "\tPercentile<p>, 0 <= p <= 100, e.g. Percentile95\n");
 
     return;
 }
 
 bool validStatistic(const char *statistic)
 {
-    bool valid = false;
+    bool valid = percentileStatistic(statistic, NULL);
     for (int i = 0; i < NSTATISTICS; i++)
     {
         if (strcmp(statistic, availableStatistics[i])==0)
@@ -280,48 +599,101 @@ bool validStatistic(const char *statistic)
     return valid;
 }
 
+bool statisticNeedsValues(const char *statistic)
+{
+    return strcmp(statistic, "Median") == 0 || strcmp(statistic, "MedianAbsoluteDeviation") == 0 || percentileStatistic(statistic, NULL);
+}
+
+bool percentileStatistic(const char *statistic, double *fraction)
+{
+    if (strncmp(statistic, "Percentile", 10) != 0 || statistic[10] == '\0')
+        return false;
+    char *end = NULL;
+    double p = strtod(statistic + 10, &end);
+    if (*end != '\0' || !(p >= 0.0 && p <= 100.0))
+        return false;
+    if (fraction != NULL)
+        *fraction = p / 100.0;
+
+    return true;
+}
+
+// Linear interpolation between order statistics, as gsl_stats_quantile_from_sorted_data. data are reordered.
+static double exactQuantile(double *data, size_t n, double fraction)
+{
+    double delta = (double)(n - 1) * fraction;
+    size_t i = (size_t) floor(delta);
+    double lower = selectKth(data, n, i);
+    if (i + 1 >= n)
+        return lower;
+    // Values after i are no smaller than lower
+    double upper = data[i + 1];
+    for (size_t j = i + 2; j < n; j++)
+    {
+        if (data[j] < upper)
+            upper = data[j];
+    }
+
+    return lower + (delta - (double)i) * (upper - lower);
+}
+
 // Calculate requested statistic for each bin
-int calculateStatistic(const char *statistic, double **bins, size_t *binSizes, size_t mltQdIndex, void *returnValue)
+int calculateStatistic(const char *statistic, BinningState *binningState, size_t mltQdIndex, double *scratch, void *returnValue)
 {
     int status = STATISTICS_OK;
-    double result = 0.0;
+    double **bins = binningState->binStorage;
+    size_t *binSizes = binningState->binSizes;
     if (binSizes[mltQdIndex] == 0)
         return STATISTICS_NO_DATA;
     if (returnValue == NULL)
         return STATISTICS_POINTER;
+    if (statisticNeedsValues(statistic) && !binningState->storeValues && !binningState->useSketches)
+        return STATISTICS_UNSUPPORTED_STATISTIC;
+    KllSketch *sketch = binningState->useSketches ? &binningState->binSketches[mltQdIndex] : NULL;
+    double fraction = 0.0;
 
     if (strcmp(statistic, "Mean")==0)
     {
-        *(double*)returnValue = gsl_stats_mean(bins[mltQdIndex], 1, binSizes[mltQdIndex]);
+        *(double*)returnValue = binningState->binMeans[mltQdIndex];
     }
     else if (strcmp(statistic, "Median")==0)
     {
-        *(double*)returnValue = gsl_stats_median(bins[mltQdIndex], 1, binSizes[mltQdIndex]);
+        if (sketch != NULL)
+            status = kllQuantile(sketch, 0.5, (double*)returnValue) == KLL_OK ? STATISTICS_OK : STATISTICS_NO_DATA;
+        else
+            *(double*)returnValue = selectionMedian(bins[mltQdIndex], binSizes[mltQdIndex]);
+    }
+    else if (percentileStatistic(statistic, &fraction))
+    {
+        if (sketch != NULL)
+            status = kllQuantile(sketch, fraction, (double*)returnValue) == KLL_OK ? STATISTICS_OK : STATISTICS_NO_DATA;
+        else
+            *(double*)returnValue = exactQuantile(bins[mltQdIndex], binSizes[mltQdIndex], fraction);
     }
     else if (strcmp(statistic, "StandardDeviation")==0)
     {
-        *(double*)returnValue = gsl_stats_sd(bins[mltQdIndex], 1, binSizes[mltQdIndex]);
+        // Sample standard deviation as from gsl_stats_sd
+        *(double*)returnValue = sqrt(binningState->binM2s[mltQdIndex] / (double)(binSizes[mltQdIndex] - 1));
     }
     else if (strcmp(statistic, "MedianAbsoluteDeviation")==0)
     {
-        double *data = (double*)malloc(binSizes[mltQdIndex] * sizeof *data);
-        if (data == NULL)
-        {
-            status = STATISTICS_MEM;
-        }
+        SelectionStatistics stats;
+        if (sketch != NULL)
+            status = kllMedianAbsoluteDeviation(sketch, (double*)returnValue) == KLL_OK ? STATISTICS_OK : STATISTICS_NO_DATA;
+        else if (scratch == NULL)
+            status = STATISTICS_POINTER;
+        else if (selectionStatistics(bins[mltQdIndex], binSizes[mltQdIndex], scratch, &stats) == SELECTION_OK)
+            *(double*)returnValue = stats.mad;
         else
-        {
-            *(double*)returnValue = gsl_stats_mad(bins[mltQdIndex], 1, binSizes[mltQdIndex], data);
-            free(data);
-        }
+            status = STATISTICS_NO_DATA;
     }
     else if (strcmp(statistic, "Min")==0)
     {
-        *(double*)returnValue = gsl_stats_min(bins[mltQdIndex], 1, binSizes[mltQdIndex]);
+        *(double*)returnValue = binningState->binMins[mltQdIndex];
     }
     else if (strcmp(statistic, "Max")==0)
     {
-        *(double*)returnValue = gsl_stats_max(bins[mltQdIndex], 1, binSizes[mltQdIndex]);
+        *(double*)returnValue = binningState->binMaxs[mltQdIndex];
     }
     else if (strcmp(statistic, "Count")==0)
     {
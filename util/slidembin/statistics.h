@@ -28,7 +28,14 @@
 #include <stdio.h>
 #include <stdbool.h>
 
-#define BIN_STORAGE_BLOCK_SIZE 10240 // Number of elements to increment bin storage by at a time
+#include "kll_sketch.h"
+
+// Stored values are appended to per-bin chains of fixed-size pages carved from slabs,
+// so bins never reallocate. compactBinStorage then copies every bin into one contiguous arena.
+// Slabs double in size from one page, so that sparsely filled states stay small.
+#define BIN_PAGE_VALUES 510 // a page is 4 kiB
+#define BIN_FIRST_SLAB_PAGES 1
+#define BIN_MAX_SLAB_PAGES 256
 
 #define NSTATISTICS 7
 
@@ -51,6 +58,23 @@ enum BIN_STATUS
     BIN_MEMORY
 };
 
+typedef struct binPage
+{
+    struct binPage *next;
+    size_t nValues;
+    double values[BIN_PAGE_VALUES];
+} BinPage;
+
+// Slabs that value pages are carved from. A zeroed allocator is empty.
+// Several states can share one, such as the cells of a BinningCube.
+typedef struct binPageAllocator
+{
+    BinPage **slabs;
+    size_t nSlabs;
+    size_t currentSlab;
+    size_t nSlabPagesUsed;
+} BinPageAllocator;
+
 typedef struct binningState
 {
     bool equalArea;
@@ -65,13 +89,34 @@ typedef struct binningState
 
     int nQDLats;
     int nMLTs;
-    double *nMltsVsLatitude;
-    double *cumulativeMltsVsLatitude;
-
-    double **binStorage;
+    int *nMltsVsLatitude;
+    size_t *cumulativeMltsVsLatitude;
+    // Bin widths and their reciprocals, so that bin indices need no division
+    double inverseDeltaQdlat;
+    double *deltaMltsVsLatitude;
+    double *inverseDeltaMltsVsLatitude;
+
+    // Values are stored only for order statistics
+    bool storeValues;
+    double **binStorage; // each bin's values in binArena, set by compactBinStorage
+    double *binArena;
+    BinPage **binFirstPages;
+    BinPage **binLastPages;
+    BinPageAllocator *pages; // Shared if set before initBinningState, otherwise allocated and owned
+    bool ownsPages;
     size_t *binSizes;
     size_t *binValidSizes;
-    size_t *binMaxSizes;
+
+    // Approximate order statistics from bounded-memory quantile sketches instead of stored values
+    bool useSketches;
+    double sketchRankError;
+    KllSketch *binSketches;
+
+    // Single-pass accumulators for the moment and extreme statistics (Welford)
+    double *binMeans;
+    double *binM2s;
+    double *binMins;
+    double *binMaxs;
 
     size_t nBins;
     long nValsRead;
@@ -87,19 +132,43 @@ typedef struct binningState
 
 int initBinningState(BinningState *binningState);
 
-int allocateBinStorage(double ***bins, size_t **binSizes, size_t **binValidSizes, size_t **binMaxSizes, size_t nBins, size_t sizePerBin, bool useEqualArea);
+// Frees the slabs and the allocator itself
+void freeBinPageAllocator(BinPageAllocator *pages);
+
+int allocateBinStorage(BinningState *binningState);
 
-int adjustBinStorage(double **bins, size_t *binMaxSizes, int mltQdLatIndex, long numberOfElementsToAdd);
+// Copies the paged values of all bins into one arena in bin order (prefix-sum offsets)
+// and points binStorage at each bin's values. Values cannot be binned afterwards.
+// Owned pages are freed; shared pages are freed with their allocator.
+int compactBinStorage(BinningState *binningState);
 
 void freeBinStorage(BinningState *binningState);
 
-int binData(BinningState *binningState, double qdlat, double mlt, double value, bool includeValue);
-void printBinningResults(BinningState *binningState, char *parameter, char *statistic);
+// Empties the bins, keeping their storage. Shared pages stay in use by the other states.
+void resetBinningState(BinningState *binningState);
+
+// Combines the accumulators and appends any stored values and counts of src to dest, which must have the same bin specification
+int mergeBinningState(BinningState *dest, const BinningState *src);
+
+// Batched binning: bin indices are calculated for whole columns first (BIN_INDEX_OUTSIDE
+// outside the bins), then values are accumulated at those indices. The indices depend only
+// on the bin specification and can be reused for every state with the same specification.
+#define BIN_INDEX_OUTSIDE -1L
+void binIndices(const BinningState *binningState, const double *qdlat, const double *mlt, size_t n, long *indices);
+// Accumulates each value at its index, skipping values outside the bins and non-finite values
+void binValues(BinningState *binningState, const long *indices, const double *values, const bool *includeValues, size_t n);
+
+void printBinningResults(BinningState *binningState, char *parameter, char **statistics, int nStatistics);
 
 void printAvailableStatistics(FILE *dest);
 bool validStatistic(const char *statistic);
+// True for order statistics, which need every binned value or a quantile sketch
+bool statisticNeedsValues(const char *statistic);
+// Percentile<p> statistics, 0 <= p <= 100. fraction returns p / 100.
+bool percentileStatistic(const char *statistic, double *fraction);
 
-int calculateStatistic(const char *statistic, double **bins, size_t *binSizes, size_t mltQdIndex, void *returnValue);
+// scratch must hold as many values as the bin; needed for MedianAbsoluteDeviation
+int calculateStatistic(const char *statistic, BinningState *binningState, size_t mltQdIndex, double *scratch, void *returnValue);
 
 
 #endif // _STATISTICS_H
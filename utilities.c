@@ -31,6 +31,8 @@
 
 #include <fts.h>
 #include <math.h>
+#include <errno.h>
+#include <sys/stat.h>
 
 
 // Prefix for all fprintf messages
@@ -253,4 +255,25 @@ void utcDateStringWithMicroseconds(double exactSeconds, char *dateString)
 
     return;
 
-}
\ No newline at end of file
+}
+
+int slidemCacheDirectory(const char *requestedDir, char *cacheDir, size_t length)
+{
+    if (requestedDir != NULL)
+        snprintf(cacheDir, length, "%s", requestedDir);
+    else
+    {
+        const char *home = getenv("HOME");
+        if (home == NULL || *home == '\0')
+            return UTIL_ERR_CACHE_DIRECTORY;
+        char parent[FILENAME_MAX];
+        snprintf(parent, FILENAME_MAX, "%s/.cache", home);
+        if (mkdir(parent, 0755) != 0 && errno != EEXIST)
+            return UTIL_ERR_CACHE_DIRECTORY;
+        snprintf(cacheDir, length, "%s/%s", parent, SLIDEM_CACHE_DIRECTORY_NAME);
+    }
+    if (mkdir(cacheDir, 0755) != 0 && errno != EEXIST)
+        return UTIL_ERR_CACHE_DIRECTORY;
+
+    return UTIL_NO_ERROR;
+}
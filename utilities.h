@@ -22,11 +22,13 @@
 #define UTILITIES_H
 
 #include <stdint.h>
+#include <stddef.h>
 
 #include <time.h>
 #include <cdf.h>
 
 #define UTC_DATE_LENGTH 24
+#define SLIDEM_CACHE_DIRECTORY_NAME "slidem"
 
 // Constructs a full path to the export CDF file in the argument constructExportFileName.
 int constructExportFileName(const char satellite, long year, long month, long day, const char *exportDir, double *beginTime, double *endTime, char *cdfFileName);
@@ -51,13 +53,18 @@ void utcDateStringWithMicroseconds(double seconds, char *dateString);
 
 void utcNowDateString(char *dateString);
 
+// Directory for the processor's own caches, which are kept out of the export directory:
+// requestedDir if not NULL, otherwise $HOME/.cache/slidem. Created if missing.
+int slidemCacheDirectory(const char *requestedDir, char *cacheDir, size_t length);
+
 enum UTIL_ERRORS {
     UTIL_NO_ERROR = 0,
     UTIL_ERR_FP_FILENAME = -1,
     UTIL_ERR_HM_FILENAME = -2,
     UTIL_ERR_INPUT_FILE_MISMATCH = -3,
     UTIL_ERR_SATELLITE_LETTER = -4,
-    UTIL_ERR_DAY_OF_YEAR_CONVERSION = -5
+    UTIL_ERR_DAY_OF_YEAR_CONVERSION = -5,
+    UTIL_ERR_CACHE_DIRECTORY = -6
 };
 
 #endif // UTILITIES_H
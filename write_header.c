@@ -25,11 +25,14 @@
 #include <libxml/xmlwriter.h>
 #include <sys/stat.h>
 #include <math.h>
+#include <stdlib.h>
 #include <string.h>
 #include <cdf.h>
 
-int writeSlidemHeader(const char *slidemFilename, const char *fpFilename, const char *hmFilename, const char *modFilename, const char *modFilenamePrevious, const char *magFilename, time_t processingStartTime, double firstMeasurementTime, double lastMeasurementTime, long nVnecRecsPrev)
+int writeSlidemHeader(const char *slidemFilename, const char *fpFilename, const char *hmFilename, const char *modFilename, const char *modFilenamePrevious, const char *magFilename, time_t processingStartTime, double firstMeasurementTime, double lastMeasurementTime, long nVnecRecsPrev, char **headerText, size_t *headerLength)
 {
+    *headerText = NULL;
+    *headerLength = 0;
 
     // Level 2 product ZIP file neads a HDR file.
     size_t sLen = strlen(slidemFilename);
@@ -48,9 +51,6 @@ int writeSlidemHeader(const char *slidemFilename, const char *fpFilename, const
     }
     sprintf(sizeString, "%+021d", (int)fileInfo.st_size);
 
-    char headerFilename[FILENAME_MAX];
-    snprintf(headerFilename, sLen + 5, "%s.HDR", slidemFilename);
-
     char creationDate[UTC_DATE_LENGTH];
     utcDateString(processingStartTime, creationDate);
     char nowDate[UTC_DATE_LENGTH];
@@ -82,9 +82,16 @@ int writeSlidemHeader(const char *slidemFilename, const char *fpFilename, const
     int status = HEADER_OK;
     int bytes = 0;
 
-    xmlTextWriterPtr hdr = xmlNewTextWriterFilename(headerFilename, 0);
+    // Built in memory so that it can be stored directly in the product ZIP file
+    xmlBufferPtr buffer = xmlBufferCreate();
+    if (buffer == NULL)
+        return HEADER_CREATE;
+    xmlTextWriterPtr hdr = xmlNewTextWriterMemory(buffer, 0);
     if (hdr == NULL)
+    {
+        xmlBufferFree(buffer);
         return HEADER_CREATE;
+    }
 
     bytes = xmlTextWriterStartDocument(hdr, "1.0", "UTF-8", "no");
     if (bytes == -1)
@@ -214,9 +221,26 @@ int writeSlidemHeader(const char *slidemFilename, const char *fpFilename, const
 
     xmlTextWriterEndDocument(hdr);
     bytes = xmlTextWriterFlush(hdr);
+    if (bytes == -1)
+    {
+        status = HEADER_WRITE_ERROR;
+        goto cleanup;
+    }
+
+    size_t length = (size_t)xmlBufferLength(buffer);
+    *headerText = malloc(length + 1);
+    if (*headerText == NULL)
+    {
+        status = HEADER_MEMORY;
+        goto cleanup;
+    }
+    memcpy(*headerText, xmlBufferContent(buffer), length);
+    (*headerText)[length] = '\0';
+    *headerLength = length;
 
 cleanup:
     xmlFreeTextWriter(hdr);
+    xmlBufferFree(buffer);
 
     return status;    
 }
@@ -23,6 +23,7 @@
 #define WRITE_HEADER_H
 
 #include <time.h>
+#include <stddef.h>
 
 enum HEADER_STATUS
 {
@@ -31,11 +32,12 @@ enum HEADER_STATUS
     HEADER_START = -2,
     HEADER_WRITE_ERROR = -3,
     HEADER_FILENAME = -4,
-    HEADER_CDFFILEINFO = -5
+    HEADER_CDFFILEINFO = -5,
+    HEADER_MEMORY = -6
 };
 
-
-int writeSlidemHeader(const char *slidemFilename, const char *fpFilename, const char *hmFilename, const char *modFilename, const char *modFilenamePrevious, const char *magFilename, time_t processingStartTime, double firstMeasurementTime, double lastMeasurementTime, long nVnecRecsPrev);
+// Generates the L2 HDR for <slidemFilename>.cdf. headerText is allocated and must be freed by the caller.
+int writeSlidemHeader(const char *slidemFilename, const char *fpFilename, const char *hmFilename, const char *modFilename, const char *modFilenamePrevious, const char *magFilename, time_t processingStartTime, double firstMeasurementTime, double lastMeasurementTime, long nVnecRecsPrev, char **headerText, size_t *headerLength);
 
 
 #endif // WRITE_HEADER_H
@@ -0,0 +1,317 @@
+/*
+
+    SLIDEM Processor: zip_archive.c
+
+    Copyright (C) 2024  Johnathan K Burchill
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "zip_archive.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define ZIP_LOCAL_HEADER_SIGNATURE 0x04034b50
+#define ZIP_CENTRAL_HEADER_SIGNATURE 0x02014b50
+#define ZIP_END_OF_CENTRAL_DIRECTORY_SIGNATURE 0x06054b50
+#define ZIP_LOCAL_HEADER_SIZE 30
+#define ZIP_CENTRAL_HEADER_SIZE 46
+#define ZIP_END_OF_CENTRAL_DIRECTORY_SIZE 22
+#define ZIP_VERSION_NEEDED 10 // 1.0: stored entries
+#define ZIP_VERSION_MADE_BY ((3 << 8) | 20) // Unix, 2.0
+#define ZIP_LOCAL_HEADER_CRC_OFFSET 14
+
+static uint32_t crcTable[256];
+static int crcTableReady = 0;
+
+static void initCrcTable(void)
+{
+    for (uint32_t i = 0; i < 256; i++)
+    {
+        uint32_t c = i;
+        for (int k = 0; k < 8; k++)
+            c = (c & 1) ? 0xEDB88320U ^ (c >> 1) : c >> 1;
+        crcTable[i] = c;
+    }
+    crcTableReady = 1;
+
+    return;
+}
+
+uint32_t crc32Update(uint32_t crc, const uint8_t *data, size_t n)
+{
+    if (!crcTableReady)
+        initCrcTable();
+
+    crc = ~crc;
+    for (size_t i = 0; i < n; i++)
+        crc = crcTable[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+
+    return ~crc;
+}
+
+static uint8_t *put16(uint8_t *p, uint16_t value)
+{
+    p[0] = (uint8_t)(value & 0xFF);
+    p[1] = (uint8_t)(value >> 8);
+
+    return p + 2;
+}
+
+static uint8_t *put32(uint8_t *p, uint32_t value)
+{
+    p[0] = (uint8_t)(value & 0xFF);
+    p[1] = (uint8_t)((value >> 8) & 0xFF);
+    p[2] = (uint8_t)((value >> 16) & 0xFF);
+    p[3] = (uint8_t)(value >> 24);
+
+    return p + 4;
+}
+
+int openZipArchive(ZipArchive *zip, const char *filename, time_t modificationTime)
+{
+    if (zip == NULL || filename == NULL)
+        return ZIP_ARCHIVE_ARGUMENTS;
+
+    memset(zip, 0, sizeof(ZipArchive));
+    snprintf(zip->filename, FILENAME_MAX, "%s", filename);
+    snprintf(zip->tmpFilename, FILENAME_MAX, "%s.tmp%d", filename, (int)getpid());
+
+    struct tm t;
+    gmtime_r(&modificationTime, &t);
+    zip->dosTime = (uint16_t)((t.tm_hour << 11) | (t.tm_min << 5) | (t.tm_sec / 2));
+    zip->dosDate = (uint16_t)(((t.tm_year - 80) << 9) | ((t.tm_mon + 1) << 5) | t.tm_mday);
+
+    zip->fp = fopen(zip->tmpFilename, "w+");
+    if (zip->fp == NULL)
+        return ZIP_ARCHIVE_OPEN;
+
+    return ZIP_ARCHIVE_OK;
+}
+
+// Starts an entry with a local header. The CRC is patched in by finishEntry.
+static int startEntry(ZipArchive *zip, const char *entryName, size_t n, ZipEntry **entry)
+{
+    if (zip->fp == NULL || entryName == NULL || zip->nEntries == ZIP_ARCHIVE_MAX_ENTRIES || strlen(entryName) >= ZIP_ARCHIVE_ENTRY_NAME_LENGTH)
+        return ZIP_ARCHIVE_ARGUMENTS;
+
+    long offset = ftell(zip->fp);
+    if (offset < 0)
+        return ZIP_ARCHIVE_WRITE;
+    if ((uint64_t)n >= UINT32_MAX || (uint64_t)offset + n >= UINT32_MAX)
+        return ZIP_ARCHIVE_TOO_LARGE;
+
+    ZipEntry *e = &zip->entries[zip->nEntries];
+    snprintf(e->name, ZIP_ARCHIVE_ENTRY_NAME_LENGTH, "%s", entryName);
+    e->crc = 0;
+    e->size = (uint32_t)n;
+    e->offset = (uint32_t)offset;
+
+    uint16_t nameLength = (uint16_t)strlen(e->name);
+    uint8_t header[ZIP_LOCAL_HEADER_SIZE];
+    uint8_t *p = header;
+    p = put32(p, ZIP_LOCAL_HEADER_SIGNATURE);
+    p = put16(p, ZIP_VERSION_NEEDED);
+    p = put16(p, 0); // flags
+    p = put16(p, 0); // stored
+    p = put16(p, zip->dosTime);
+    p = put16(p, zip->dosDate);
+    p = put32(p, 0); // CRC-32, patched later
+    p = put32(p, e->size);
+    p = put32(p, e->size);
+    p = put16(p, nameLength);
+    p = put16(p, 0); // extra field length
+    if (fwrite(header, 1, sizeof header, zip->fp) != sizeof header || fwrite(e->name, 1, nameLength, zip->fp) != nameLength)
+        return ZIP_ARCHIVE_WRITE;
+
+    *entry = e;
+
+    return ZIP_ARCHIVE_OK;
+}
+
+static int finishEntry(ZipArchive *zip, ZipEntry *entry)
+{
+    uint8_t crc[4];
+    put32(crc, entry->crc);
+    long end = ftell(zip->fp);
+    if (end < 0 || fseek(zip->fp, (long)entry->offset + ZIP_LOCAL_HEADER_CRC_OFFSET, SEEK_SET) != 0 || fwrite(crc, 1, sizeof crc, zip->fp) != sizeof crc || fseek(zip->fp, end, SEEK_SET) != 0)
+        return ZIP_ARCHIVE_WRITE;
+    zip->nEntries++;
+
+    return ZIP_ARCHIVE_OK;
+}
+
+int addZipBuffer(ZipArchive *zip, const char *entryName, const void *data, size_t n)
+{
+    if (zip == NULL || (data == NULL && n > 0))
+        return ZIP_ARCHIVE_ARGUMENTS;
+
+    ZipEntry *entry = NULL;
+    int status = startEntry(zip, entryName, n, &entry);
+    if (status != ZIP_ARCHIVE_OK)
+        return status;
+    if (n > 0 && fwrite(data, 1, n, zip->fp) != n)
+        return ZIP_ARCHIVE_WRITE;
+    entry->crc = crc32Update(0, (const uint8_t*)data, n);
+
+    return finishEntry(zip, entry);
+}
+
+int addZipFile(ZipArchive *zip, const char *entryName, const char *path)
+{
+    if (zip == NULL || path == NULL)
+        return ZIP_ARCHIVE_ARGUMENTS;
+
+    FILE *in = fopen(path, "r");
+    if (in == NULL)
+        return ZIP_ARCHIVE_READ;
+
+    uint8_t *buffer = NULL;
+    int status = ZIP_ARCHIVE_OK;
+    if (fseek(in, 0, SEEK_END) != 0)
+    {
+        status = ZIP_ARCHIVE_READ;
+        goto cleanup;
+    }
+    long n = ftell(in);
+    rewind(in);
+    if (n < 0)
+    {
+        status = ZIP_ARCHIVE_READ;
+        goto cleanup;
+    }
+    buffer = malloc(ZIP_ARCHIVE_COPY_BUFFER_SIZE);
+    if (buffer == NULL)
+    {
+        status = ZIP_ARCHIVE_MEMORY;
+        goto cleanup;
+    }
+
+    ZipEntry *entry = NULL;
+    status = startEntry(zip, entryName, (size_t)n, &entry);
+    if (status != ZIP_ARCHIVE_OK)
+        goto cleanup;
+
+    // Copy and checksum in one pass
+    uint32_t crc = 0;
+    size_t remaining = (size_t)n;
+    while (remaining > 0)
+    {
+        size_t chunk = remaining < ZIP_ARCHIVE_COPY_BUFFER_SIZE ? remaining : ZIP_ARCHIVE_COPY_BUFFER_SIZE;
+        if (fread(buffer, 1, chunk, in) != chunk)
+        {
+            status = ZIP_ARCHIVE_READ;
+            goto cleanup;
+        }
+        if (fwrite(buffer, 1, chunk, zip->fp) != chunk)
+        {
+            status = ZIP_ARCHIVE_WRITE;
+            goto cleanup;
+        }
+        crc = crc32Update(crc, buffer, chunk);
+        remaining -= chunk;
+    }
+    entry->crc = crc;
+    status = finishEntry(zip, entry);
+
+cleanup:
+    free(buffer);
+    fclose(in);
+
+    return status;
+}
+
+int closeZipArchive(ZipArchive *zip)
+{
+    if (zip == NULL || zip->fp == NULL)
+        return ZIP_ARCHIVE_ARGUMENTS;
+
+    int status = ZIP_ARCHIVE_OK;
+    long centralDirectoryOffset = ftell(zip->fp);
+    if (centralDirectoryOffset < 0)
+    {
+        status = ZIP_ARCHIVE_WRITE;
+        goto cleanup;
+    }
+
+    uint8_t header[ZIP_CENTRAL_HEADER_SIZE];
+    uint32_t centralDirectorySize = 0;
+    for (int i = 0; i < zip->nEntries; i++)
+    {
+        const ZipEntry *e = &zip->entries[i];
+        uint16_t nameLength = (uint16_t)strlen(e->name);
+        uint8_t *p = header;
+        p = put32(p, ZIP_CENTRAL_HEADER_SIGNATURE);
+        p = put16(p, ZIP_VERSION_MADE_BY);
+        p = put16(p, ZIP_VERSION_NEEDED);
+        p = put16(p, 0); // flags
+        p = put16(p, 0); // stored
+        p = put16(p, zip->dosTime);
+        p = put16(p, zip->dosDate);
+        p = put32(p, e->crc);
+        p = put32(p, e->size);
+        p = put32(p, e->size);
+        p = put16(p, nameLength);
+        p = put16(p, 0); // extra field length
+        p = put16(p, 0); // comment length
+        p = put16(p, 0); // disk number
+        p = put16(p, 0); // internal attributes
+        p = put32(p, (uint32_t)0100644 << 16); // external attributes: regular file, rw-r--r--
+        p = put32(p, e->offset);
+        if (fwrite(header, 1, sizeof header, zip->fp) != sizeof header || fwrite(e->name, 1, nameLength, zip->fp) != nameLength)
+        {
+            status = ZIP_ARCHIVE_WRITE;
+            goto cleanup;
+        }
+        centralDirectorySize += ZIP_CENTRAL_HEADER_SIZE + nameLength;
+    }
+
+    uint8_t end[ZIP_END_OF_CENTRAL_DIRECTORY_SIZE];
+    uint8_t *p = end;
+    p = put32(p, ZIP_END_OF_CENTRAL_DIRECTORY_SIGNATURE);
+    p = put16(p, 0); // this disk
+    p = put16(p, 0); // disk with the central directory
+    p = put16(p, (uint16_t)zip->nEntries);
+    p = put16(p, (uint16_t)zip->nEntries);
+    p = put32(p, centralDirectorySize);
+    p = put32(p, (uint32_t)centralDirectoryOffset);
+    p = put16(p, 0); // comment length
+    if (fwrite(end, 1, sizeof end, zip->fp) != sizeof end)
+        status = ZIP_ARCHIVE_WRITE;
+
+cleanup:
+    if (fclose(zip->fp) != 0 && status == ZIP_ARCHIVE_OK)
+        status = ZIP_ARCHIVE_WRITE;
+    zip->fp = NULL;
+    if (status == ZIP_ARCHIVE_OK && rename(zip->tmpFilename, zip->filename) != 0)
+        status = ZIP_ARCHIVE_RENAME;
+    if (status != ZIP_ARCHIVE_OK)
+        unlink(zip->tmpFilename);
+
+    return status;
+}
+
+void abortZipArchive(ZipArchive *zip)
+{
+    if (zip == NULL || zip->fp == NULL)
+        return;
+
+    fclose(zip->fp);
+    zip->fp = NULL;
+    unlink(zip->tmpFilename);
+
+    return;
+}
@@ -0,0 +1,80 @@
+/*
+
+    SLIDEM Processor: zip_archive.h
+
+    Copyright (C) 2024  Johnathan K Burchill
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _ZIP_ARCHIVE_H
+#define _ZIP_ARCHIVE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+
+// Minimal store-mode (uncompressed) ZIP writer for the L2 product archive.
+// The archive is written to a temporary file and renamed into place when closed.
+
+#define ZIP_ARCHIVE_MAX_ENTRIES 8
+#define ZIP_ARCHIVE_ENTRY_NAME_LENGTH 256
+#define ZIP_ARCHIVE_COPY_BUFFER_SIZE (1024 * 1024)
+
+typedef struct zipEntry {
+    char name[ZIP_ARCHIVE_ENTRY_NAME_LENGTH];
+    uint32_t crc;
+    uint32_t size;
+    uint32_t offset; // Of the local file header
+} ZipEntry;
+
+typedef struct zipArchive {
+    FILE *fp;
+    char filename[FILENAME_MAX];
+    char tmpFilename[FILENAME_MAX];
+    uint16_t dosTime;
+    uint16_t dosDate;
+    int nEntries;
+    ZipEntry entries[ZIP_ARCHIVE_MAX_ENTRIES];
+} ZipArchive;
+
+uint32_t crc32Update(uint32_t crc, const uint8_t *data, size_t n);
+
+// Entries are time stamped with modificationTime
+int openZipArchive(ZipArchive *zip, const char *filename, time_t modificationTime);
+
+int addZipBuffer(ZipArchive *zip, const char *entryName, const void *data, size_t n);
+
+// Streams a file into the archive, computing its CRC-32 as it is copied
+int addZipFile(ZipArchive *zip, const char *entryName, const char *path);
+
+// Writes the central directory and renames the archive into place
+int closeZipArchive(ZipArchive *zip);
+
+// Closes and removes the temporary file
+void abortZipArchive(ZipArchive *zip);
+
+enum ZIP_ARCHIVE_STATUS {
+    ZIP_ARCHIVE_OK = 0,
+    ZIP_ARCHIVE_ARGUMENTS = -1,
+    ZIP_ARCHIVE_OPEN = -2,
+    ZIP_ARCHIVE_WRITE = -3,
+    ZIP_ARCHIVE_READ = -4,
+    ZIP_ARCHIVE_TOO_LARGE = -5,
+    ZIP_ARCHIVE_MEMORY = -6,
+    ZIP_ARCHIVE_RENAME = -7
+};
+
+#endif // _ZIP_ARCHIVE_H